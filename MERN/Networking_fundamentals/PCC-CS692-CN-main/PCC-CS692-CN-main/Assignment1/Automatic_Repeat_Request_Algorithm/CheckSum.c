@@ -2,6 +2,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "../../Codecs/inet_checksum.h" // inet_add_limbs(): one's complement sum a word at a time
+
+#define MAX_LIMBS 2  // 64-bit limbs for the 99 bits main() reads
+
+/**
+ * Packs a binary string, most significant bit first, into 64-bit limbs
+ * @param binary - Binary string
+ * @param limbs - Output limbs, least significant first
+ * @param length - Length of the binary string
+ */
+static void pack_binary(const char *binary, uint64_t *limbs, int length) {
+    memset(limbs, 0, MAX_LIMBS * sizeof(uint64_t));
+    for (int i = 0; i < length; i++) {
+        int bit = length - 1 - i;
+        limbs[bit / 64] |= (uint64_t)(binary[i] - '0') << (bit % 64);
+    }
+}
+
+/**
+ * Writes limbs back as a binary string of length bits
+ */
+static void unpack_binary(const uint64_t *limbs, char *binary, int length) {
+    for (int i = 0; i < length; i++) {
+        int bit = length - 1 - i;
+        binary[i] = (char)('0' + (limbs[bit / 64] >> (bit % 64) & 1));
+    }
+}
 
 /**
  * Adds two binary strings and returns the result
@@ -11,35 +39,20 @@
  * @param length - Length of the binary strings
  */
 void add_binary_strings(const char *binary1, const char *binary2, char *result, int length) {
-    int carry = 0;
-    
-    // Process from right to left (least significant bit to most significant bit)
-    for (int i = length - 1; i >= 0; i--) {
-        // Convert character '0'/'1' to integer 0/1 and add
-        int bit1 = binary1[i] - '0';
-        int bit2 = binary2[i] - '0';
-        int sum = bit1 + bit2 + carry;
-        
-        // Calculate result bit and carry
-        result[i] = (sum % 2) + '0';  // Remainder is the result bit
-        carry = sum / 2;               // Quotient is the carry bit
-    }
+    uint64_t a[MAX_LIMBS], b[MAX_LIMBS], r[MAX_LIMBS];
+    
+    // Add 64 bits at a time instead of character by character
+    pack_binary(binary1, a, length);
+    pack_binary(binary2, b, length);
+    int carry = inet_add_limbs(r, a, b, 0, length);
+    unpack_binary(r, result, length);
     
     printf("Sum before handling overflow: %s (carry: %d)\n", result, carry);
     
-    // Handle overflow (end-around carry)
+    // Handle overflow (end-around carry): add it back in at the bottom
     while (carry > 0) {
-        carry = 0;
-        // Add 1 to the result (end-around carry)
-        for (int i = length - 1; i >= 0; i--) {
-            if (result[i] == '0') {
-                result[i] = '1';
-                break;  // No further carry needed
-            } else {
-                result[i] = '0';  // This position generates a carry
-                carry = 1;
-            }
-        }
+        carry = inet_add_limbs(r, r, NULL, 1, length);
+        unpack_binary(r, result, length);
         printf("Sum after handling overflow: %s (carry: %d)\n", result, carry);
     }
 }
@@ -1,17 +1,12 @@
 #include <stdio.h> // Include standard input/output library for functions like printf and scanf
 #include <stdlib.h> // Include standard library for general purpose functions
 #include <string.h> // Include string library for string manipulation functions like strlen
+#include "../../Codecs/parity.h" // parity_text_ones(): counts '1's eight characters per popcount
 
 // Function to calculate the even parity bit for a given binary string
 int calculate_parity(const char * binary){
-    int count=0; // Initialize a counter for the number of '1's to zero
-    // Loop through each character in the binary string until the null terminator is reached
-    for(int i = 0 ; binary[i] != '\0' ; i++ ) {
-        // Check if the current character is '1'
-        if ( binary[i] == '1' ) {
-            count ++; // Increment the counter if the character is '1'
-        }
-    }
+    // Count the '1's eight characters at a time instead of one by one
+    uint64_t count = parity_text_ones(binary, strlen(binary));
     // Return 0 if the count of '1's is even, and 1 if it's odd (this calculates the even parity bit)
     return ( count % 2 );
 
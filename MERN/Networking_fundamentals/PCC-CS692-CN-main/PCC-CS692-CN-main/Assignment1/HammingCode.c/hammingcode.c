@@ -3,16 +3,23 @@
 #include <string.h> // Include string library for string manipulation functions like strlen
 
 #include <math.h> // Include math library for mathematical functions
+#include "../../Codecs/hamming_syndrome.h" // One-pass syndrome of a bit-packed codeword
 
 
 int input[32];
 int code[32];
-int hamming_calc(int, int);
+unsigned char packed[8]; // code[] one bit per position, position p at bit p
+void pack_code(int);
 
 void main(){
     int n,i,p_n=0,c_1,j,k;
     printf("Enter the length of the Dataword:");
     scanf("%d",&n);
+    if (n<1 || n>26)
+    {
+        printf("The Dataword must be 1 to 26 bits long\n");
+        return;
+    }
     printf("Enter the Dataword:");
     for(int i=0;i<n;i++){
         scanf("%d",&input[i]);
@@ -34,15 +41,17 @@ void main(){
         }
         else
         {
-            code[i]=input[i];
+            code[i]=input[j];
             j++;
         }
     }
+    // Fill the check bits at the powers of two in one pass over the packed codeword
+    pack_code(c_1);
+    hamming_syn_encode(packed,c_1);
     for ( i = 0; i < p_n ; i++)
     {
         int position = (int)pow(2,i);
-        int value = hamming_calc(position,c_1);
-        code[position] = value;
+        code[position-1] = hamming_syn_get(packed,position);
     }
 
     printf("The calculated code word is: ");
@@ -50,9 +59,9 @@ void main(){
     for ( i = 0; i < c_1; i++)
     {
         printf("%d",code[i]);
-        printf("\n");
     }
-    
+    printf("\n");
+
     printf("Please enter the received code word: ");
 
     for ( i = 0; i < c_1 ; i++)
@@ -60,50 +69,41 @@ void main(){
         scanf("%d",&code[i]);
     }
     
-    int error_position = 0;
-    for ( i = 0; i < p_n ; i++)
+    // The XOR of the positions of all 1 bits is the syndrome, found in one pass
+    int odd;
+    pack_code(c_1);
+    int error_position = (int)hamming_syn_words(packed,c_1,&odd);
+    if (error_position == 0)
     {
-        int position = (int)pow(2,i);
-        int value = hamming_calc(position,c_1);
-        if (value!=0)
-        {
-            error_position = position ;
-        }
-        if (error_position == 1)
-        {
-            printf("The received code word is correct!\n");
-        }
-        else
+        printf("The received code word is correct!\n");
+    }
+    else if (error_position > c_1)
+    {
+        printf("More than one bit is in error\n");
+    }
+    else
+    {
+        printf("Error at bit position %d\n",error_position);
+        code[error_position-1] ^= 1;
+        printf("The corrected code word is: ");
+        for ( i = 0; i < c_1; i++)
         {
-            printf("Error at bit position %d\n",error_position);
+            printf("%d",code[i]);
         }
+        printf("\n");
     }
 }
 
-int hamming_calc(int position, int c_1)
+void pack_code(int c_1)
 {
-    int count = 0,i,j;
+    int i;
 
-    i = position - 1;
-
-    while (i<c_1)
+    memset(packed,0,sizeof(packed));
+    for ( i = 0; i < c_1; i++)
     {
-        for ( j = i; j < i + position ; j++ )
+        if (code[i] == 1)
         {
-            if (code[j] == 1)
-            {
-                count++;
-            }
+            hamming_syn_flip(packed,i+1);
         }
-        i = i + (2 * position);
     }
-
-    if (count % 2 == 0)
-    {
-        return 0;
-    }
-    else
-    {
-        return 1;
-    }
-}
\ No newline at end of file
+}
@@ -10,12 +10,190 @@
 #include<sys/un.h>
 #include<sys/stat.h>
 
-#define MAX 100
+#include"parity_proto.h"
 
 int
-main ()
+readAll (int fd, void *buf, size_t n)
+{
+  char *p = buf;
+  while (n > 0)
+    {
+      ssize_t got = read (fd, p, n);
+      if (got <= 0)
+	return -1;
+      p += got;
+      n -= got;
+    }
+  return 0;
+}
+
+int
+writeAll (int fd, const void *buf, size_t n)
+{
+  const char *p = buf;
+  while (n > 0)
+    {
+      ssize_t put = write (fd, p, n);
+      if (put <= 0)
+	return -1;
+      p += put;
+      n -= put;
+    }
+  return 0;
+}
+
+/* Reads one NUL-terminated reply of any length into *buf.  Nothing
+   follows it until the next request, so it can be read in chunks. */
+int
+readString (int fd, char **buf, size_t *cap)
+{
+  size_t len = 0;
+  while (1)
+    {
+      ssize_t got;
+      if (*cap - len < 4096)
+	{
+	  size_t newCap = *cap ? *cap * 2 : 4096;
+	  char *p = realloc (*buf, newCap);
+	  if (!p)
+	    return -1;
+	  *buf = p;
+	  *cap = newCap;
+	}
+      got = read (fd, *buf + len, *cap - len);
+      if (got <= 0)
+	return -1;
+      len += got;
+      if ((*buf)[len - 1] == '\0')
+	return 0;
+    }
+}
+
+void
+printBits (const char *label, const unsigned char *p, uint64_t nbits)
+{
+  uint64_t i;
+  printf ("%s", label);
+  for (i = 0; i < nbits; i++)
+    putchar ('0' + (p[i / 8] >> (7 - i % 8) & 1));
+  printf ("\n");
+}
+
+/* Sends one frame and reads its response; *resp gets the payload. */
+int
+request (int fd, uint8_t op, int odd, uint16_t cols, uint64_t nbits,
+	 const unsigned char *payload, uint32_t n, unsigned char *hdr,
+	 unsigned char **resp)
+{
+  static uint32_t id;
+  unsigned char req[PARITY_HDR];
+  uint32_t len;
+  parity_put32 (req, PARITY_HDR - 4 + n);
+  parity_put32 (req + 4, ++id);
+  req[8] = op;
+  req[9] = odd ? PARITY_FLAG_ODD : 0;
+  req[10] = (unsigned char) (cols >> 8);
+  req[11] = (unsigned char) cols;
+  parity_put64 (req + 12, nbits);
+  if (writeAll (fd, req, PARITY_HDR) < 0 || writeAll (fd, payload, n) < 0
+      || readAll (fd, hdr, PARITY_HDR) < 0)
+    return -1;
+  len = parity_get32 (hdr) - (PARITY_HDR - 4);
+  free (*resp);
+  *resp = malloc (len ? len : 1);
+  return *resp && readAll (fd, *resp, len) == 0 && hdr[8] == PARITY_STATUS_OK ? 0 : -1;
+}
+
+/* 2-D mode: each bit-stream is sent for its VRC and LRC bits, one bit of
+   the block is flipped, and the server asked to find and correct it. */
+void
+run2d (int sockfd, uint16_t cols, int odd)
+{
+  static const char *const results[] =
+    { "clean", "corrected", "check bit", "detected" };
+  char *bit = NULL;
+  size_t cap = 0;
+  unsigned char hdr[PARITY_HDR], *resp = NULL;
+  writeAll (sockfd, PARITY_PROTO_MAGIC, 4);
+  while (1)
+    {
+      struct parity2d g;
+      ssize_t len;
+      uint64_t dataBytes, checkBytes;
+      unsigned char *block;
+      long flip;
+      printf ("Enter a Bit-Stream : ");
+      if ((len = getline (&bit, &cap, stdin)) < 0)
+	break;
+      while (len > 0 && (bit[len - 1] == '\n' || bit[len - 1] == '\r'))
+	bit[--len] = '\0';
+      if (strcmp (bit, "end") == 0)
+	{
+	  printf ("Client is terminated...\n\n");
+	  break;
+	}
+      if (parity2d_init (&g, len, cols, odd) < 0)
+	break;
+      dataBytes = (len + 7) / 8;
+      checkBytes = parity_check_bytes (&g, 1);
+      block = malloc (dataBytes + checkBytes);
+      if (!block || parity_pack (bit, len, block) < 0)
+	{
+	  printf ("Not a bit-stream...\n\n");
+	  free (block);
+	  continue;
+	}
+      if (request (sockfd, PARITY_OP_2D_ENCODE, odd, cols, len, block,
+		   dataBytes, hdr, &resp) < 0)
+	{
+	  printf ("Server refused the block...\n");
+	  free (block);
+	  break;
+	}
+      memcpy (block + dataBytes, resp, checkBytes - 1);
+      block[dataBytes + checkBytes - 1] = hdr[9];
+      printf ("%llu rows of %u bits\n", (unsigned long long) g.rows, cols);
+      printBits ("VRC    : ", resp, g.rows);
+      printBits ("LRC    : ", resp + parity2d_vrc_bytes (&g), cols);
+      printf ("Corner : %d\n", hdr[9]);
+
+      printf ("Bit to flip before checking (-1 for none) : ");
+      if (getline (&bit, &cap, stdin) < 0)
+	{
+	  free (block);
+	  break;
+	}
+      flip = strtol (bit, NULL, 10);
+      if (flip >= 0 && (uint64_t) flip < g.nbits)
+	block[flip / 8] ^= (unsigned char) (0x80 >> flip % 8);
+      if (request (sockfd, PARITY_OP_2D_CHECK, odd, cols, len, block,
+		   dataBytes + checkBytes, hdr, &resp) < 0)
+	{
+	  printf ("Server refused the check...\n");
+	  free (block);
+	  break;
+	}
+      printf ("Server says %s", results[hdr[9] & 3]);
+      if (hdr[9] == PARITY_CORRECTED)
+	printf (" at bit %llu", (unsigned long long) parity_get64 (hdr + 12));
+      printf ("\n");
+      printBits ("Block  : ", resp, g.nbits);
+      printf ("\n");
+      free (block);
+    }
+  free (bit);
+  free (resp);
+}
+
+int
+main (int argc, char *argv[])
 {
   struct sockaddr_un address;
+  if (argc > 1 && (strcmp (argv[1], "2d") != 0 || argc < 3))
+    {
+      printf ("Usage : %s [2d <columns> [odd]]\n", argv[0]);
+      exit (1);
+    }
   int sockfd = socket (AF_UNIX, SOCK_STREAM, 0);
   address.sun_family = AF_UNIX;
   strcpy (address.sun_path, "socket_server");
@@ -26,14 +204,31 @@ main ()
       printf ("Cannot connect to the Server...\n");
       exit (1);
     }
+  if (argc > 1)
+    {
+      int cols = atoi (argv[2]);
+      if (cols < 1 || cols > PARITY_MAX_COLS)
+	{
+	  printf ("Columns must be between 1 and %d...\n", PARITY_MAX_COLS);
+	  exit (1);
+	}
+      run2d (sockfd, (uint16_t) cols, argc > 3 && strcmp (argv[3], "odd") == 0);
+      close (sockfd);
+      return 0;
+    }
+
+  char *bit = NULL, *reply = NULL;
+  size_t bitCap = 0, replyCap = 0;
   while (1)
     {
-      char bit[MAX];
+      ssize_t n;
       printf ("Enter a Bit-Stream : ");
-      scanf ("%s", bit);
-      getchar ();
+      if ((n = getline (&bit, &bitCap, stdin)) < 0)
+	break;
+      while (n > 0 && (bit[n - 1] == '\n' || bit[n - 1] == '\r'))
+	bit[--n] = '\0';
 
-      write (sockfd, bit, strlen (bit) + 1);
+      writeAll (sockfd, bit, n + 1);
 
       if (strcmp (bit, "end") == 0)
 	{
@@ -41,9 +236,15 @@ main ()
 	  break;
 	}
       printf ("%s is sent to the server\n", bit);
-      read (sockfd, bit, MAX);
-      printf ("%s is received from the Server\n\n", bit);
+      if (readString (sockfd, &reply, &replyCap) < 0)
+	{
+	  printf ("Server closed the connection...\n");
+	  break;
+	}
+      printf ("%s is received from the Server\n\n", reply);
     }
+  free (bit);
+  free (reply);
   close (sockfd);
   return 0;
 }
@@ -0,0 +1,148 @@
+#ifndef PARITY_PROTO_H
+#define PARITY_PROTO_H
+
+/*
+ * Binary, length-prefixed request protocol for the parity Unix-socket
+ * server.
+ *
+ * A client switches a connection to this protocol by sending the 4-byte
+ * magic "PARB" instead of a '0'/'1' string.  After that both sides
+ * exchange frames, all integers in network byte order:
+ *
+ *   request   u32 len        bytes after this field (16 + payload)
+ *             u32 id         echoed in the response
+ *             u8  op         PARITY_OP_BIT, PARITY_OP_2D_ENCODE or
+ *                            PARITY_OP_2D_CHECK
+ *             u8  flags      PARITY_FLAG_ODD for odd parity
+ *             u16 cols       2-D row width in bits, 1..65535; 1-D zero
+ *             u64 nbits      block length in bits
+ *             payload        the block, bit-packed MSB first, (nbits+7)/8
+ *                            bytes; for PARITY_OP_2D_CHECK followed by its
+ *                            VRC bytes, its LRC bytes and one byte holding
+ *                            the corner bit
+ *
+ *   response  u32 len        bytes after this field (16 + payload)
+ *             u32 id
+ *             u8  status     PARITY_STATUS_*
+ *             u8  result     PARITY_OP_BIT: the parity bit;
+ *                            PARITY_OP_2D_ENCODE: the corner bit;
+ *                            PARITY_OP_2D_CHECK: PARITY_CLEAN,
+ *                            PARITY_CORRECTED, PARITY_CHECK_BIT or
+ *                            PARITY_DETECTED
+ *             u16            reserved, zero
+ *             u64 value      PARITY_OP_BIT: 1 bits in the block;
+ *                            PARITY_CORRECTED: the data bit flipped back;
+ *                            else zero
+ *             payload        PARITY_OP_2D_ENCODE: the VRC bytes, then the
+ *                            LRC bytes; PARITY_OP_2D_CHECK: the block, VRC
+ *                            and LRC bytes as corrected
+ *
+ * The 2-D layout, VRC, LRC and corner bits are those of Codecs/parity.h:
+ * rows of cols bits, one VRC bit per row in (rows+7)/8 bytes, one LRC bit
+ * per column in (cols+7)/8 bytes, all MSB first.  A block may have any
+ * length as long as its frame fits PARITY_MAX_FRAME.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include"../Codecs/parity.h"
+
+#define PARITY_PROTO_MAGIC "PARB"
+#define PARITY_HDR 20
+#define PARITY_MAX_FRAME (1u<<30)
+
+#define PARITY_OP_BIT 1
+#define PARITY_OP_2D_ENCODE 2
+#define PARITY_OP_2D_CHECK 3
+
+#define PARITY_FLAG_ODD 1
+
+#define PARITY_STATUS_OK 0
+#define PARITY_STATUS_BAD_REQUEST 1
+#define PARITY_STATUS_BAD_OP 2
+
+struct parity_request
+{
+  uint32_t len;
+  uint32_t id;
+  uint8_t op;
+  uint8_t flags;
+  uint16_t cols;
+  uint64_t nbits;
+  const unsigned char *payload;
+};
+
+static inline uint32_t parity_get32(const unsigned char *p)
+{
+  return (uint32_t)p[0]<<24|(uint32_t)p[1]<<16|(uint32_t)p[2]<<8|p[3];
+}
+
+static inline void parity_put32(unsigned char *p,uint32_t v)
+{
+  p[0]=(unsigned char)(v>>24);
+  p[1]=(unsigned char)(v>>16);
+  p[2]=(unsigned char)(v>>8);
+  p[3]=(unsigned char)v;
+}
+
+static inline uint64_t parity_get64(const unsigned char *p)
+{
+  return (uint64_t)parity_get32(p)<<32|parity_get32(p+4);
+}
+
+static inline void parity_put64(unsigned char *p,uint64_t v)
+{
+  parity_put32(p,(uint32_t)(v>>32));
+  parity_put32(p+4,(uint32_t)v);
+}
+
+/* Check bytes after the block of a 2-D frame: VRC, LRC and, with corner
+   set, the corner byte. */
+static inline uint64_t parity_check_bytes(const struct parity2d *g,int corner)
+{
+  return parity2d_vrc_bytes(g)+parity2d_lrc_bytes(g)+(corner?1:0);
+}
+
+/* Decodes a complete request frame of PARITY_HDR+payload bytes.  Returns
+   -1 if its op is unknown, its layout is out of range or the payload does
+   not hold what the op needs; r->id is still filled in. */
+static inline int parity_decode_request(const unsigned char *p,size_t len,struct parity_request *r)
+{
+  struct parity2d g;
+  uint64_t need;
+  memset(r,0,sizeof(*r));
+  if (len<PARITY_HDR)
+    return -1;
+  r->len=parity_get32(p);
+  r->id=parity_get32(p+4);
+  r->op=p[8];
+  r->flags=p[9];
+  r->cols=(uint16_t)(p[10]<<8|p[11]);
+  r->nbits=parity_get64(p+12);
+  r->payload=p+PARITY_HDR;
+  if (r->nbits>(uint64_t)PARITY_MAX_FRAME*8)
+    return -1;
+  need=(r->nbits+7)/8;
+  if (r->op==PARITY_OP_2D_ENCODE || r->op==PARITY_OP_2D_CHECK)
+  {
+    if (parity2d_init(&g,r->nbits,r->cols,0)<0)
+      return -1;
+    if (r->op==PARITY_OP_2D_CHECK)
+      need+=parity_check_bytes(&g,1);
+  }
+  else if (r->op!=PARITY_OP_BIT)
+    return -1;
+  return need==len-PARITY_HDR?0:-1;
+}
+
+static inline void parity_encode_response(unsigned char *p,uint32_t id,uint8_t status,uint8_t result,uint64_t value,uint32_t payload)
+{
+  parity_put32(p,PARITY_HDR-4+payload);
+  parity_put32(p+4,id);
+  p[8]=status;
+  p[9]=result;
+  p[10]=p[11]=0;
+  parity_put64(p+12,value);
+}
+
+#endif
@@ -10,8 +10,129 @@
 #include<sys/un.h>
 #include<sys/stat.h>
 
+#include"parity_proto.h"
+
 #define MAX 100
 
+/* Bytes read from the client and not yet answered, in[0..inLen). */
+unsigned char *in;
+size_t inLen, inCap;
+
+/* Reads until at least need bytes are buffered, growing the buffer.
+   Returns -1 once the client has gone. */
+int
+fill (int fd, size_t need)
+{
+  while (inLen < need)
+    {
+      ssize_t got;
+      if (inCap < need || inCap - inLen < 4096)
+	{
+	  size_t cap = inCap ? inCap : 4096;
+	  unsigned char *p;
+	  while (cap < need || cap - inLen < 4096)
+	    cap *= 2;
+	  if (!(p = realloc (in, cap)))
+	    return -1;
+	  in = p;
+	  inCap = cap;
+	}
+      got = read (fd, in + inLen, inCap - inLen);
+      if (got <= 0)
+	return -1;
+      inLen += got;
+    }
+  return 0;
+}
+
+/* Drops the first n buffered bytes. */
+void
+consume (size_t n)
+{
+  memmove (in, in + n, inLen - n);
+  inLen -= n;
+}
+
+int
+writeAll (int fd, const void *buf, size_t n)
+{
+  const char *p = buf;
+  while (n > 0)
+    {
+      ssize_t put = write (fd, p, n);
+      if (put <= 0)
+	return -1;
+      p += put;
+      n -= put;
+    }
+  return 0;
+}
+
+/* Answers one request frame, in[0..PARITY_HDR+payload). */
+int
+serveFrame (int fd, size_t len)
+{
+  struct parity_request r;
+  struct parity2d g;
+  unsigned char hdr[PARITY_HDR], *out = NULL;
+  uint64_t value = 0, n = 0;
+  int result = 0, status = PARITY_STATUS_OK, rc;
+  if (parity_decode_request (in, len, &r) < 0)
+    status = r.op < PARITY_OP_BIT || r.op > PARITY_OP_2D_CHECK
+      ? PARITY_STATUS_BAD_OP : PARITY_STATUS_BAD_REQUEST;
+  else if (r.op == PARITY_OP_BIT)
+    {
+      result = parity_bit (r.payload, r.nbits, r.flags & PARITY_FLAG_ODD);
+      value = parity_ones (r.payload, r.nbits);
+    }
+  else
+    {
+      uint64_t dataBytes = (r.nbits + 7) / 8;
+      parity2d_init (&g, r.nbits, r.cols, r.flags & PARITY_FLAG_ODD);
+      n = r.op == PARITY_OP_2D_ENCODE ? parity_check_bytes (&g, 0)
+	: dataBytes + parity_check_bytes (&g, 0);
+      if (!(out = malloc (n)))
+	{
+	  status = PARITY_STATUS_BAD_REQUEST;
+	  n = 0;
+	}
+      else if (r.op == PARITY_OP_2D_ENCODE)
+	result = parity2d_encode (&g, r.payload, out,
+				  out + parity2d_vrc_bytes (&g));
+      else
+	{
+	  memcpy (out, r.payload, n);
+	  result = parity2d_check (&g, out, out + dataBytes,
+				   out + dataBytes + parity2d_vrc_bytes (&g),
+				   r.payload[n] & 1, &value);
+	}
+    }
+  printf ("Server answered request %u: op %d, %llu bits, result %d\n",
+	  r.id, r.op, (unsigned long long) r.nbits, result);
+  parity_encode_response (hdr, r.id, status, result, value, n);
+  rc = writeAll (fd, hdr, PARITY_HDR) < 0 || writeAll (fd, out, n) < 0 ? -1 : 0;
+  free (out);
+  return rc;
+}
+
+/* Serves frames until the client goes. */
+void
+serveFrames (int fd)
+{
+  while (fill (fd, 4) == 0)
+    {
+      uint32_t len = parity_get32 (in);
+      if (len < PARITY_HDR - 4 || len > PARITY_MAX_FRAME)
+	{
+	  printf ("Server dropped a frame of %u bytes\n", len);
+	  return;
+	}
+      if (fill (fd, 4 + (size_t) len) < 0 || serveFrame (fd, 4 + len) < 0)
+	return;
+      consume (4 + len);
+    }
+}
+
 int
 main ()
 {
@@ -25,33 +146,79 @@ main ()
   listen (server_sockfd, 5);
   printf ("Server is running...\n\n");
 
-  int client_len = sizeof (client_address);
-  int client_sockfd =
-    accept (server_sockfd, (struct sockaddr *) &client_address, &client_len);
-
   while (1)
     {
-      char bit[MAX];
-      read (client_sockfd, bit, MAX);
-      if (strcmp (bit, "end") == 0)
-	{
-	  printf ("Server is terminated...\n");
-	  break;
-	}
-      printf ("Server received %s from Client\n", bit);
-      int i, count = 0;
-      for (i = 0; i < strlen (bit); i++)
+      socklen_t client_len = sizeof (client_address);
+      int client_sockfd =
+	accept (server_sockfd, (struct sockaddr *) &client_address,
+		&client_len);
+      int done = 0;
+      if (client_sockfd < 0)
+	continue;
+      inLen = 0;
+
+      /* '0'/'1' strings of any length, each up to its NUL, until "end" or
+         the switch to frames. */
+      while (1)
 	{
-	  if (bit[i] == '1')
-	    count++;
+	  unsigned char *nul;
+	  size_t scanned = 0;
+	  if (fill (client_sockfd, 1) < 0)
+	    break;
+	  if (in[0] == 'P')
+	    {
+	      if (fill (client_sockfd, 4) < 0)
+		break;
+	      if (memcmp (in, PARITY_PROTO_MAGIC, 4) == 0)
+		{
+		  consume (4);
+		  printf ("Client switched to parity frames\n");
+		  serveFrames (client_sockfd);
+		  break;
+		}
+	    }
+	  while (!(nul = memchr (in + scanned, '\0', inLen - scanned)))
+	    {
+	      scanned = inLen;
+	      if (fill (client_sockfd, inLen + 1) < 0)
+		break;
+	    }
+	  if (!nul)
+	    break;
+
+	  char *bit = (char *) in;
+	  size_t len = nul - in;
+	  if (strcmp (bit, "end") == 0)
+	    {
+	      printf ("Server is terminated...\n");
+	      done = 1;
+	      break;
+	    }
+	  if (len < MAX)
+	    printf ("Server received %s from Client\n", bit);
+	  else
+	    printf ("Server received %zu bits from Client\n", len);
+
+	  char parity = (parity_text_ones (bit, len) % 2 == 1) ? '1' : '0';
+	  char *reply = malloc (len + 2);
+	  if (!reply)
+	    break;
+	  memcpy (reply, bit, len);
+	  reply[len] = parity;
+	  reply[len + 1] = '\0';
+	  writeAll (client_sockfd, reply, len + 2);
+	  if (len < MAX)
+	    printf ("Server sent back %s to the Client\n\n", reply);
+	  else
+	    printf ("Server sent back %zu bits and parity %c to the Client\n\n",
+		    len, parity);
+	  free (reply);
+	  consume (len + 1);
 	}
-      if (count % 2 == 1)
-	bit[i++] = '1';
-      else
-	bit[i++] = '0';
-      bit[i] = '\0';
-      write (client_sockfd, bit, strlen (bit) + 1);
-      printf ("Server sent back %s to the Client\n\n", bit);
+      close (client_sockfd);
+      if (done)
+	break;
+      printf ("Client disconnected...\n\n");
     }
   close (server_sockfd);
   return 0;
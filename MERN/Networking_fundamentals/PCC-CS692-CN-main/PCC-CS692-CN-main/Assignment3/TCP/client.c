@@ -17,6 +17,19 @@ struct message_struct
   char remainder[MAX];
 };
 
+int readFull(int fd,void *buf,int n)
+{
+  int got=0;
+  while(got<n)
+  {
+    int r=read(fd,(char *)buf+got,n-got);
+    if (r<=0)
+      return got;
+    got+=r;
+  }
+  return got;
+}
+
 int main(int argc,char **argv)
 {
   char sip_addr[MAX];
@@ -47,7 +60,7 @@ int main(int argc,char **argv)
   printf("| Client Online |\n");
   while(1)
   {
-    struct message_struct message;
+    static struct message_struct message;
     printf("\nEnter the Dataword : ");
     scanf("%[^\n]%*c",message.dataword);
     if (strcmp(message.dataword,"end")==0)
@@ -60,8 +73,12 @@ int main(int argc,char **argv)
     printf("Enter the Divisor : ");
     scanf("%[^\n]%*c",message.divisor);
     write(sid,(void *)&message,sizeof(message));
-    int len=sizeof(saddr);
-    read(sid,(void *)&message,sizeof(message));
+    if (readFull(sid,(void *)&message,sizeof(message))<(int)sizeof(message))
+    {
+      printf("Server closed the connection...\n");
+      close(sid);
+      exit(1);
+    }
     printf("Codeword : %s\n",message.codeword);
     printf("Remainder : %s\n",message.remainder);
   }
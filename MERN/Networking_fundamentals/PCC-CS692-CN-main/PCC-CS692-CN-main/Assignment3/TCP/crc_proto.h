@@ -0,0 +1,216 @@
+#ifndef CRC_PROTO_H
+#define CRC_PROTO_H
+
+/*
+ * Binary, length-prefixed request protocol for the CRC TCP server.
+ *
+ * A client switches a connection to this protocol by sending the 4-byte
+ * magic "CRCB" instead of a struct message_struct.  After that both sides
+ * exchange frames, all integers in network byte order:
+ *
+ *   request   u32 len        bytes after this field (28 + payload)
+ *             u32 id         echoed in the response
+ *             u8  op         CRC_OP_GENERATE or CRC_OP_VERIFY
+ *             u8  width      generator degree, 1..64
+ *             u8  model      CRC_MODEL_RAW, or a crc_model.h catalogue id
+ *             u8             reserved, zero
+ *             u32 count      CRC_OP_VERIFY: codewords in the batch, else zero
+ *             u64 poly       generator without the x^width term
+ *             u64 nbits      dataword length in bits, or for CRC_OP_VERIFY
+ *                            the length of each codeword
+ *             payload        dataword, bit-packed MSB first, (nbits+7)/8 bytes;
+ *                            for CRC_OP_VERIFY count codewords of that size
+ *
+ *   response  u32 len        bytes after this field (20)
+ *             u32 id
+ *             u8  status     CRC_STATUS_*
+ *             u8  width
+ *             u16, u32       reserved, zero
+ *             u64 remainder  right-aligned
+ *
+ * With model CRC_MODEL_RAW the remainder is the plain division by
+ * x^width + poly.  Any other model selects a Rocksoft model (init,
+ * reflection, xorout) from the catalogue; width and poly are ignored, the
+ * dataword must be whole bytes and the response carries the model's width.
+ *
+ * CRC_OP_VERIFY checks a batch of codewords, each the dataword followed by
+ * its check bits and padded to whole bytes.  The response's remainder
+ * field holds the number of codewords that did not pass and is followed
+ * by one 8-byte verdict per codeword:
+ *
+ *   verdict   u8  result     CRC_VERIFY_PASS, CRC_VERIFY_BIT, CRC_VERIFY_FAIL
+ *             u8, u16        reserved, zero
+ *             u32 position   CRC_VERIFY_BIT: index of the flipped bit
+ *
+ * For a raw generator a codeword that fails because of one flipped bit is
+ * answered with CRC_VERIFY_BIT and the bit's position, found through a
+ * syndrome table (Codecs/crc_verify.h), so the receiver can correct it
+ * without asking again.  For a model the check bits are the CRC value in
+ * (width+7)/8 big-endian bytes after a whole-byte dataword, and verdicts
+ * are pass or fail only.
+ *
+ * Requests carry ids so a client may pipeline as many as it likes; the
+ * server answers in order, encoding the responses of everything it has
+ * read into one contiguous output buffer that goes out with write().
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+#define CRC_PROTO_MAGIC "CRCB"
+#define CRC_REQ_HDR 32
+#define CRC_RESP_HDR 24
+#define CRC_MAX_FRAME (64u<<20)
+
+#define CRC_OP_GENERATE 1
+#define CRC_OP_VERIFY 2
+#define CRC_VERDICT_SIZE 8
+
+#define CRC_STATUS_OK 0
+#define CRC_STATUS_BAD_REQUEST 1
+#define CRC_STATUS_BAD_OP 2
+#define CRC_STATUS_BAD_MODEL 3
+
+#define CRC_MODEL_RAW 0
+
+struct crc_request
+{
+  uint32_t len;
+  uint32_t id;
+  uint8_t op;
+  uint8_t width;
+  uint8_t model;
+  uint32_t count;             /* codewords in the payload */
+  uint64_t poly;
+  uint64_t nbits;
+  const unsigned char *payload;
+};
+
+struct crc_response
+{
+  uint32_t id;
+  uint8_t status;
+  uint8_t width;
+  uint64_t remainder;
+};
+
+static inline uint32_t proto_get32(const unsigned char *p)
+{
+  return (uint32_t)p[0]<<24|(uint32_t)p[1]<<16|(uint32_t)p[2]<<8|p[3];
+}
+
+static inline uint64_t proto_get64(const unsigned char *p)
+{
+  return (uint64_t)proto_get32(p)<<32|proto_get32(p+4);
+}
+
+static inline void proto_put32(unsigned char *p,uint32_t v)
+{
+  p[0]=(unsigned char)(v>>24);
+  p[1]=(unsigned char)(v>>16);
+  p[2]=(unsigned char)(v>>8);
+  p[3]=(unsigned char)v;
+}
+
+static inline void proto_put64(unsigned char *p,uint64_t v)
+{
+  proto_put32(p,(uint32_t)(v>>32));
+  proto_put32(p+4,(uint32_t)v);
+}
+
+/* Size of the frame starting at p, or 0 if fewer than 4 bytes are there. */
+static inline size_t proto_frame_size(const unsigned char *p,size_t have)
+{
+  return have<4?0:4+(size_t)proto_get32(p);
+}
+
+/* Decodes one complete request frame.  Returns -1 if the header is
+   truncated or the payload length does not match nbits and count; req->id
+   is still filled in when the frame is long enough to carry one. */
+static inline int proto_decode_request(const unsigned char *p,struct crc_request *req)
+{
+  memset(req,0,sizeof(*req));
+  req->len=proto_get32(p);
+  if (req->len>=4)
+    req->id=proto_get32(p+4);
+  if (req->len<CRC_REQ_HDR-4)
+    return -1;
+  req->op=p[8];
+  req->width=p[9];
+  req->model=p[10];
+  req->count=req->op==CRC_OP_VERIFY?proto_get32(p+12):1;
+  req->poly=proto_get64(p+16);
+  req->nbits=proto_get64(p+24);
+  req->payload=p+CRC_REQ_HDR;
+  if (req->count==0 || (req->op==CRC_OP_VERIFY && req->nbits==0) || req->nbits>(uint64_t)(req->len-(CRC_REQ_HDR-4))*8
+      || (req->nbits+7)/8*req->count!=req->len-(CRC_REQ_HDR-4))
+    return -1;
+  return 0;
+}
+
+/* Writes the header of a request whose payload is (nbits+7)/8 bytes. */
+static inline void proto_encode_request(unsigned char *p,uint32_t id,uint8_t op,uint8_t width,uint8_t model,uint64_t poly,uint64_t nbits)
+{
+  memset(p,0,CRC_REQ_HDR);
+  proto_put32(p,(uint32_t)(CRC_REQ_HDR-4+(nbits+7)/8));
+  proto_put32(p+4,id);
+  p[8]=op;
+  p[9]=width;
+  p[10]=model;
+  proto_put64(p+16,poly);
+  proto_put64(p+24,nbits);
+}
+
+/* Header of a CRC_OP_VERIFY request carrying count codewords of nbits
+   bits, each (nbits+7)/8 bytes. */
+static inline void proto_encode_verify(unsigned char *p,uint32_t id,uint8_t width,uint8_t model,uint64_t poly,uint64_t nbits,uint32_t count)
+{
+  proto_encode_request(p,id,CRC_OP_VERIFY,width,model,poly,nbits);
+  proto_put32(p,(uint32_t)(CRC_REQ_HDR-4+(nbits+7)/8*count));
+  proto_put32(p+12,count);
+}
+
+/* Response header followed by count verdicts, CRC_RESP_HDR+count*
+   CRC_VERDICT_SIZE bytes in all; the verdicts are written separately. */
+static inline void proto_encode_response_n(unsigned char *p,const struct crc_response *resp,uint32_t count)
+{
+  memset(p,0,CRC_RESP_HDR);
+  proto_put32(p,CRC_RESP_HDR-4+count*CRC_VERDICT_SIZE);
+  proto_put32(p+4,resp->id);
+  p[8]=resp->status;
+  p[9]=resp->width;
+  proto_put64(p+16,resp->remainder);
+}
+
+static inline void proto_put_verdict(unsigned char *p,uint8_t result,uint32_t position)
+{
+  memset(p,0,CRC_VERDICT_SIZE);
+  p[0]=result;
+  proto_put32(p+4,position);
+}
+
+static inline void proto_get_verdict(const unsigned char *p,uint8_t *result,uint32_t *position)
+{
+  *result=p[0];
+  *position=proto_get32(p+4);
+}
+
+static inline void proto_encode_response(unsigned char *p,const struct crc_response *resp)
+{
+  memset(p,0,CRC_RESP_HDR);
+  proto_put32(p,CRC_RESP_HDR-4);
+  proto_put32(p+4,resp->id);
+  p[8]=resp->status;
+  p[9]=resp->width;
+  proto_put64(p+16,resp->remainder);
+}
+
+static inline void proto_decode_response(const unsigned char *p,struct crc_response *resp)
+{
+  resp->id=proto_get32(p+4);
+  resp->status=p[8];
+  resp->width=p[9];
+  resp->remainder=proto_get64(p+16);
+}
+
+#endif
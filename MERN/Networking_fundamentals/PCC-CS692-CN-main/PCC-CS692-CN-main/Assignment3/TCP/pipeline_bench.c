@@ -0,0 +1,423 @@
+/*
+ * pipeline_bench.c - requests per second of the CRC TCP server with the
+ * lock-step struct protocol and with the pipelined binary protocol.
+ *
+ *   gcc -O2 server.c -o server && ./server 127.0.0.1 8080
+ *   gcc -O2 pipeline_bench.c -o pipeline_bench
+ *   ./pipeline_bench 127.0.0.1 8080 [requests] [connections]
+ *
+ * Every request asks for the CRC-32 remainder of the same 64-bit dataword,
+ * short enough for the lock-step run to use the original 400-byte struct
+ * message_struct; every speedup is against that run.  The lock-step run
+ * checks its last remainder, the binary runs check each response id and
+ * remainder.  With a connection count, a last run keeps that many clients
+ * open at once, each with one request in flight.  A final run sends
+ * CRC_OP_VERIFY batches of the dataword's codeword with none, one or two
+ * bits flipped and checks every verdict and located position.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<arpa/inet.h>
+#include<netinet/in.h>
+#include<netinet/tcp.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<sys/resource.h>
+#include<time.h>
+#include"../../Codecs/crc_verify.h"
+#include"crc_proto.h"
+
+#define MAX 100
+#define PAYLOAD 8
+#define CRC32_POLY 0x04C11DB7ull
+#define VERIFY_BATCH 1024
+
+struct message_struct
+{
+  char dataword[MAX];
+  char divisor[MAX];
+  char codeword[MAX];
+  char remainder[MAX];
+};
+
+static unsigned char payload[PAYLOAD];
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static int connectTo(const char *ip,int port)
+{
+  struct sockaddr_in saddr;
+  int one=1;
+  int sid=socket(AF_INET,SOCK_STREAM,0);
+  if (sid<0)
+    return -1;
+  saddr.sin_family=AF_INET;
+  saddr.sin_addr.s_addr=inet_addr(ip);
+  saddr.sin_port=htons(port);
+  if (connect(sid,(struct sockaddr *)&saddr,sizeof(saddr))<0)
+  {
+    close(sid);
+    return -1;
+  }
+  setsockopt(sid,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+  return sid;
+}
+
+static int readFull(int fd,void *buf,size_t n)
+{
+  size_t got=0;
+  while(got<n)
+  {
+    ssize_t r=read(fd,(char *)buf+got,n-got);
+    if (r<=0)
+      return -1;
+    got+=r;
+  }
+  return 0;
+}
+
+static int writeFull(int fd,const void *buf,size_t n)
+{
+  size_t put=0;
+  while(put<n)
+  {
+    ssize_t w=write(fd,(const char *)buf+put,n-put);
+    if (w<=0)
+      return -1;
+    put+=w;
+  }
+  return 0;
+}
+
+/* Lock-step struct protocol: one request on the wire at a time. */
+static double runText(const char *ip,int port,long total,uint64_t expect)
+{
+  static struct message_struct message;
+  char want[33];
+  long i;
+  double t0;
+  int sid=connectTo(ip,port);
+  if (sid<0)
+    return -1;
+  for(i=0;i<PAYLOAD*8;i++)
+    message.dataword[i]=((payload[i/8]>>(7-i%8))&1)?'1':'0';
+  message.dataword[PAYLOAD*8]='\0';
+  strcpy(message.divisor,"100000100110000010001110110110111");
+  t0=now();
+  for(i=0;i<total;i++)
+    if (writeFull(sid,&message,sizeof(message))<0 || readFull(sid,&message,sizeof(message))<0)
+    {
+      close(sid);
+      return -1;
+    }
+  t0=now()-t0;
+  close(sid);
+  for(i=0;i<32;i++)
+    want[i]=((expect>>(31-i))&1)?'1':'0';
+  want[32]='\0';
+  message.remainder[MAX-1]='\0';
+  if (strcmp(message.remainder,want)!=0)
+  {
+    printf("Bad remainder %s, expected %s\n",message.remainder,want);
+    return -1;
+  }
+  return total/t0;
+}
+
+/* Binary protocol with up to depth requests in flight.  Returns requests
+   per second, or -1 on a connection or verification failure. */
+static double runBinary(const char *ip,int port,long total,int depth,uint64_t expect)
+{
+  const size_t fs=CRC_REQ_HDR+PAYLOAD;
+  unsigned char *sendbuf=malloc(fs*depth),rbuf[1<<16];
+  size_t soff=0,slen=0,rlen=0;
+  long sent=0,recvd=0;
+  double t0;
+  int sid=connectTo(ip,port);
+  if (sid<0 || !sendbuf || writeFull(sid,CRC_PROTO_MAGIC,4)<0)
+  {
+    free(sendbuf);
+    if (sid>=0)
+      close(sid);
+    return -1;
+  }
+  fcntl(sid,F_SETFL,fcntl(sid,F_GETFL)|O_NONBLOCK);
+  t0=now();
+  while(recvd<total)
+  {
+    struct pollfd pfd;
+    if (soff==slen && sent<total && sent-recvd<depth)
+    {
+      long n=depth-(sent-recvd),k;
+      if (n>total-sent)
+        n=total-sent;
+      for(k=0;k<n;k++)
+      {
+        unsigned char *f=sendbuf+k*fs;
+        proto_encode_request(f,(uint32_t)(sent+k),CRC_OP_GENERATE,32,CRC_MODEL_RAW,CRC32_POLY,PAYLOAD*8);
+        memcpy(f+CRC_REQ_HDR,payload,PAYLOAD);
+      }
+      soff=0;
+      slen=n*fs;
+      sent+=n;
+    }
+    pfd.fd=sid;
+    pfd.events=POLLIN|(soff<slen?POLLOUT:0);
+    if (poll(&pfd,1,-1)<0)
+      break;
+    if ((pfd.revents&POLLOUT) && soff<slen)
+    {
+      ssize_t w=write(sid,sendbuf+soff,slen-soff);
+      if (w>0)
+        soff+=w;
+    }
+    if (pfd.revents&(POLLIN|POLLHUP|POLLERR))
+    {
+      size_t off=0;
+      ssize_t r=read(sid,rbuf+rlen,sizeof(rbuf)-rlen);
+      if (r==0 || (r<0 && pfd.revents&(POLLHUP|POLLERR)))
+        break;
+      if (r>0)
+        rlen+=r;
+      while(rlen-off>=CRC_RESP_HDR)
+      {
+        struct crc_response resp;
+        proto_decode_response(rbuf+off,&resp);
+        if (resp.id!=(uint32_t)recvd || resp.status!=CRC_STATUS_OK || resp.remainder!=expect)
+        {
+          printf("Bad response %u (status %d)\n",resp.id,resp.status);
+          recvd=-1;
+          break;
+        }
+        recvd++;
+        off+=CRC_RESP_HDR;
+      }
+      if (recvd<0)
+        break;
+      memmove(rbuf,rbuf+off,rlen-off);
+      rlen-=off;
+    }
+  }
+  t0=now()-t0;
+  close(sid);
+  free(sendbuf);
+  return recvd==total?total/t0:-1;
+}
+
+/* conns binary clients at once, each lock-step, total requests between
+   them.  Returns requests per second, or -1 on failure. */
+static double runMany(const char *ip,int port,long total,int conns,uint64_t expect)
+{
+  const size_t fs=CRC_REQ_HDR+PAYLOAD;
+  struct pollfd *pfd=calloc(conns,sizeof(*pfd));
+  long *done=calloc(conns,sizeof(*done)),recvd=0,per=total/conns;
+  size_t *have=calloc(conns,sizeof(*have));
+  unsigned char frame[CRC_REQ_HDR+PAYLOAD],(*rbuf)[CRC_RESP_HDR]=calloc(conns,CRC_RESP_HDR);
+  double t0;
+  int i,ok=1;
+  struct rlimit rl;
+  getrlimit(RLIMIT_NOFILE,&rl);
+  if (rl.rlim_cur<(rlim_t)conns+16)
+  {
+    rl.rlim_cur=rl.rlim_max<(rlim_t)conns+16?rl.rlim_max:(rlim_t)conns+16;
+    setrlimit(RLIMIT_NOFILE,&rl);
+  }
+  if (!pfd || !done || !have || !rbuf || per<1)
+    ok=0;
+  for(i=0;pfd && i<conns;i++)
+    pfd[i].fd=-1;
+  for(i=0;ok && i<conns;i++)
+  {
+    pfd[i].fd=connectTo(ip,port);
+    pfd[i].events=POLLIN;
+    if (pfd[i].fd<0 || writeFull(pfd[i].fd,CRC_PROTO_MAGIC,4)<0)
+    {
+      printf("Connection %d failed...\n",i);
+      ok=0;
+    }
+  }
+  memcpy(frame+CRC_REQ_HDR,payload,PAYLOAD);
+  t0=now();
+  for(i=0;ok && i<conns;i++)
+  {
+    proto_encode_request(frame,0,CRC_OP_GENERATE,32,CRC_MODEL_RAW,CRC32_POLY,PAYLOAD*8);
+    writeFull(pfd[i].fd,frame,fs);
+  }
+  while(ok && recvd<per*conns)
+  {
+    if (poll(pfd,conns,-1)<0)
+      break;
+    for(i=0;i<conns;i++)
+    {
+      ssize_t r;
+      if (!(pfd[i].revents&(POLLIN|POLLHUP|POLLERR)))
+        continue;
+      r=read(pfd[i].fd,rbuf[i]+have[i],CRC_RESP_HDR-have[i]);
+      if (r<=0)
+      {
+        ok=0;
+        break;
+      }
+      have[i]+=r;
+      if (have[i]<CRC_RESP_HDR)
+        continue;
+      struct crc_response resp;
+      proto_decode_response(rbuf[i],&resp);
+      if (resp.id!=(uint32_t)done[i] || resp.remainder!=expect)
+      {
+        ok=0;
+        break;
+      }
+      have[i]=0;
+      recvd++;
+      if (++done[i]<per)
+      {
+        proto_encode_request(frame,(uint32_t)done[i],CRC_OP_GENERATE,32,CRC_MODEL_RAW,CRC32_POLY,PAYLOAD*8);
+        writeFull(pfd[i].fd,frame,fs);
+      }
+      else
+        pfd[i].events=0;
+    }
+  }
+  t0=now()-t0;
+  for(i=0;pfd && i<conns;i++)
+    if (pfd[i].fd>=0)
+      close(pfd[i].fd);
+  free(pfd);
+  free(done);
+  free(have);
+  free(rbuf);
+  return ok?recvd/t0:-1;
+}
+
+/* CRC_OP_VERIFY batches of VERIFY_BATCH codewords, one batch in flight.
+   Returns codewords per second, or -1 on a wrong verdict. */
+static double runVerify(const char *ip,int port,long total,uint64_t crc)
+{
+  const size_t cwBytes=PAYLOAD+4,fs=CRC_REQ_HDR+VERIFY_BATCH*cwBytes,rs=CRC_RESP_HDR+VERIFY_BATCH*CRC_VERDICT_SIZE;
+  unsigned char *frame=malloc(fs),*rbuf=malloc(rs),*cw;
+  uint8_t want[VERIFY_BATCH];
+  uint32_t where[VERIFY_BATCH],bad=0;
+  long batches=total/VERIFY_BATCH>0?total/VERIFY_BATCH:1,b;
+  double t0;
+  int i,ok=1;
+  int sid=connectTo(ip,port);
+  if (sid<0 || !frame || !rbuf || writeFull(sid,CRC_PROTO_MAGIC,4)<0)
+    ok=0;
+  /* Every third codeword is clean, every third has one flipped bit and the
+     rest two, which CRC-32 detects but must not try to locate. */
+  for(i=0;ok && i<VERIFY_BATCH;i++)
+  {
+    cw=frame+CRC_REQ_HDR+i*cwBytes;
+    memcpy(cw,payload,PAYLOAD);
+    cw[PAYLOAD]=crc>>24;
+    cw[PAYLOAD+1]=crc>>16;
+    cw[PAYLOAD+2]=crc>>8;
+    cw[PAYLOAD+3]=crc;
+    want[i]=i%3==0?CRC_VERIFY_PASS:i%3==1?CRC_VERIFY_BIT:CRC_VERIFY_FAIL;
+    where[i]=rand()%(cwBytes*8);
+    if (want[i]!=CRC_VERIFY_PASS)
+      crc_flip_bit(cw,where[i]);
+    if (want[i]==CRC_VERIFY_FAIL)
+      crc_flip_bit(cw,(where[i]+1+rand()%(cwBytes*8-1))%(cwBytes*8));
+    bad+=want[i]!=CRC_VERIFY_PASS;
+  }
+  t0=now();
+  for(b=0;ok && b<batches;b++)
+  {
+    struct crc_response resp;
+    proto_encode_verify(frame,(uint32_t)b,32,CRC_MODEL_RAW,CRC32_POLY,cwBytes*8,VERIFY_BATCH);
+    if (writeFull(sid,frame,fs)<0 || readFull(sid,rbuf,rs)<0)
+    {
+      ok=0;
+      break;
+    }
+    proto_decode_response(rbuf,&resp);
+    if (resp.id!=(uint32_t)b || resp.status!=CRC_STATUS_OK || resp.remainder!=bad)
+      ok=0;
+    for(i=0;ok && i<VERIFY_BATCH;i++)
+    {
+      uint8_t r;
+      uint32_t pos;
+      proto_get_verdict(rbuf+CRC_RESP_HDR+i*CRC_VERDICT_SIZE,&r,&pos);
+      if (r!=want[i] || (r==CRC_VERIFY_BIT && pos!=where[i]))
+      {
+        printf("Codeword %d : verdict %d at %u, expected %d at %u\n",i,r,pos,want[i],where[i]);
+        ok=0;
+      }
+    }
+  }
+  t0=now()-t0;
+  if (sid>=0)
+    close(sid);
+  free(frame);
+  free(rbuf);
+  return ok?batches*VERIFY_BATCH/t0:-1;
+}
+
+int main(int argc,char **argv)
+{
+  static const int depths[]={1,16,256,4096};
+  struct crc_engine e;
+  long total=100000,i;
+  int conns=0;
+  char label[64];
+  double base;
+  uint64_t expect;
+  if (argc<3)
+  {
+    printf("Please provide IP and Port No....\n");
+    exit(1);
+  }
+  if (argc>3)
+    total=atol(argv[3]);
+  if (argc>4)
+    conns=atoi(argv[4]);
+  srand(7);
+  for(i=0;i<PAYLOAD;i++)
+    payload[i]=(unsigned char)rand();
+  crc_engine_init(&e,CRC32_POLY,32);
+  expect=crc_engine_final(&e,crc_engine_update(&e,0,payload,PAYLOAD));
+
+  base=runText(argv[1],atoi(argv[2]),total/10>0?total/10:1,expect);
+  if (base<0)
+  {
+    printf("Lock-step run failed...\n");
+    exit(1);
+  }
+  snprintf(label,sizeof(label),"lock-step, %d-byte struct",(int)sizeof(struct message_struct));
+  printf("%-26s %12.0f req/s\n",label,base);
+  for(i=0;i<(long)(sizeof(depths)/sizeof(depths[0]));i++)
+  {
+    double rate=runBinary(argv[1],atoi(argv[2]),total,depths[i],expect);
+    snprintf(label,sizeof(label),"binary, %d in flight",depths[i]);
+    if (rate<0)
+      printf("%-26s failed\n",label);
+    else
+      printf("%-26s %12.0f req/s  %6.1fx\n",label,rate,rate/base);
+  }
+  if (conns>0)
+  {
+    double rate=runMany(argv[1],atoi(argv[2]),total,conns,expect);
+    snprintf(label,sizeof(label),"binary, %d clients",conns);
+    if (rate<0)
+      printf("%-26s failed\n",label);
+    else
+      printf("%-26s %12.0f req/s  %6.1fx\n",label,rate,rate/base);
+  }
+  base=runVerify(argv[1],atoi(argv[2]),total,expect);
+  if (base<0)
+    printf("%-26s failed\n","verify batches");
+  else
+    printf("%-26s %12.0f codewords/s\n","verify batches",base);
+  return 0;
+}
@@ -1,14 +1,30 @@
+#define _GNU_SOURCE
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
 #include<unistd.h>
+#include<errno.h>
+#include<pthread.h>
 #include<sys/socket.h>
+#include<sys/epoll.h>
 #include<arpa/inet.h>
 #include<netinet/in.h>
+#include<netinet/tcp.h>
 #include<fcntl.h>
-#include<math.h>
+#include"../../Codecs/crc_cache.h"
+#include"../../Codecs/crc_parallel.h"
+#include"../../Codecs/crc_verify.h"
+#include"crc_proto.h"
 
 #define MAX 100
+#define MAX_EVENTS 256
+#define MAX_THREADS 64
+#define BUF_INIT 4096
+#define READ_CHUNK 65536
+#define OUT_HIGH (4<<20)
+#define PARALLEL_MIN (8<<20)
+#define CACHE_SIZE 64
+#define SYNDROME_CACHE_SIZE 4
 #define int long long int
 
 struct message_struct
@@ -19,113 +35,480 @@ struct message_struct
   char remainder[MAX];
 };
 
-void reverse(char *str)
+#define MODE_NEW 0
+#define MODE_TEXT 1
+#define MODE_BINARY 2
+
+/* One client.  Input is kept until a whole message_struct or frame has
+   arrived; responses queue in out until the socket takes them. */
+struct conn
+{
+  int fd;
+  int mode;
+  unsigned char *in,*out;
+  size_t inCap,inLen;
+  size_t outCap,outLen,outOff;
+  size_t served;
+};
+
+/* Built engines, shared by every event thread. */
+struct crc_cache cache;
+
+/* Syndrome tables of CRC_OP_VERIFY, one per generator. */
+struct crc_syndrome_cache syndromes;
+
+/* The divisor is a generator in binary or a catalogue model name such as
+   CRC-32. */
+void CRC(char *datawordBin,char *divisorBin,char *codewordBin,char *remainderBin)
 {
-  int i=0,j=strlen(str)-1;
-  while(i<j)
+  int bad;
+  if (crc_model_find(divisorBin))
+    bad=crc_model_codeword(datawordBin,divisorBin,codewordBin,remainderBin,MAX);
+  else
+    bad=crc_cache_codeword(&cache,datawordBin,divisorBin,codewordBin,remainderBin,MAX);
+  if (bad<0)
   {
-    char temp=str[i];
-    str[i]=str[j];
-    str[j]=temp;
-    i++;
-    j--;
+    strcpy(codewordBin,"invalid");
+    strcpy(remainderBin,"invalid");
   }
 }
 
-int toDec(char *str)
+/* Shared by every event thread for payloads of PARALLEL_MIN bytes or more;
+   a request that finds it busy is computed on its own thread. */
+struct crc_pool pool;
+
+/* Answers one binary request with an engine from the cache. */
+void serveRequest(const unsigned char *frame,struct crc_response *resp)
 {
-  int i,power=strlen(str)-1,n=0;
-  for(i=0;i<strlen(str);i++)
+  const struct crc_engine *engine;
+  struct crc_request req;
+  struct crc_stream s;
+  const struct crc_model *m;
+  int ok=proto_decode_request(frame,&req);
+  resp->id=req.id;
+  resp->width=req.width;
+  resp->remainder=0;
+  if (ok==0 && req.op==CRC_OP_GENERATE && req.model!=CRC_MODEL_RAW)
+  {
+    /* Catalogue models run over whole bytes; width and poly are ignored. */
+    m=crc_model_get(req.model);
+    resp->status=!m?CRC_STATUS_BAD_MODEL:req.nbits%8?CRC_STATUS_BAD_REQUEST:CRC_STATUS_OK;
+    if (m)
+      resp->width=m->width;
+    if (resp->status==CRC_STATUS_OK)
+      resp->remainder=m->kernel(req.payload,req.nbits/8);
+    return;
+  }
+  if (ok<0 || req.width<1 || req.width>CRC_MAX_WIDTH)
+  {
+    resp->status=CRC_STATUS_BAD_REQUEST;
+    return;
+  }
+  if (req.op!=CRC_OP_GENERATE)
+  {
+    resp->status=CRC_STATUS_BAD_OP;
+    return;
+  }
+  engine=crc_cache_get(&cache,req.poly,req.width,0);
+  if (!engine)
+  {
+    resp->status=CRC_STATUS_BAD_REQUEST;
+    return;
+  }
+  crc_stream_init(&s,engine);
+  if (req.nbits/8>=PARALLEL_MIN)
   {
-    n+=pow(2,power)*(str[i]-'0');
-    power--;
+    s.reg=crc_pool_try_update(&pool,engine,0,req.payload,req.nbits/8);
+    s.nbits=req.nbits/8*8;
+    crc_stream_update_bits(&s,req.payload+req.nbits/8,req.nbits%8);
   }
-  return n;
+  else
+    crc_stream_update_bits(&s,req.payload,req.nbits);
+  resp->status=CRC_STATUS_OK;
+  resp->remainder=crc_stream_final(&s);
+  crc_cache_release(&cache,engine);
 }
 
-void toBin(int dec,char *bin)
+/* Answers a CRC_OP_VERIFY batch, writing the response header and one
+   verdict per codeword to out.  Returns the bytes written. */
+size_t serveVerify(const unsigned char *frame,unsigned char *out)
 {
-  if (dec==0)
+  const struct crc_engine *engine=NULL;
+  const struct crc_model *m=NULL;
+  const struct crc_syndrome_table *t=NULL;
+  struct crc_syndrome_table tab;
+  struct crc_request req;
+  struct crc_response resp;
+  uint32_t i,bad=0;
+  size_t cwBytes;
+  int ok=proto_decode_request(frame,&req);
+  resp.id=req.id;
+  resp.width=req.width;
+  resp.remainder=0;
+  resp.status=CRC_STATUS_OK;
+  if (ok<0 || (uint64_t)req.count*CRC_VERDICT_SIZE>CRC_MAX_FRAME-CRC_RESP_HDR)
+    resp.status=CRC_STATUS_BAD_REQUEST;
+  else if (req.model!=CRC_MODEL_RAW)
   {
-    strcpy(bin,"0");
-    return;
+    /* The check bits are the model's CRC value after a whole-byte dataword. */
+    m=crc_model_get(req.model);
+    if (!m)
+      resp.status=CRC_STATUS_BAD_MODEL;
+    else
+    {
+      resp.width=m->width;
+      if (req.nbits%8 || req.nbits/8<=(uint64_t)(m->width+7)/8)
+        resp.status=CRC_STATUS_BAD_REQUEST;
+    }
   }
-  int i=0;
-  while(dec>0)
+  else if (req.width<1 || req.width>CRC_MAX_WIDTH || req.nbits<req.width
+           || !(engine=crc_cache_get(&cache,req.poly,req.width,0)))
+    resp.status=CRC_STATUS_BAD_REQUEST;
+  if (resp.status!=CRC_STATUS_OK)
   {
-    bin[i++]=(char)(dec%2+'0');
-    dec/=2;
+    proto_encode_response_n(out,&resp,0);
+    return CRC_RESP_HDR;
   }
-  bin[i]='\0';
-  reverse(bin);
+  cwBytes=(req.nbits+7)/8;
+  /* Without memory for the table errors are still caught, just not located.
+     The header is copied so the verdict stores below cannot force reloads. */
+  memset(&tab,0,sizeof(tab));
+  if (engine && (t=crc_syndrome_cache_get(&syndromes,engine,req.nbits)))
+    tab=*t;
+  for(i=0;i<req.count;i++)
+  {
+    const unsigned char *cw=req.payload+i*cwBytes;
+    unsigned char *v=out+CRC_RESP_HDR+i*CRC_VERDICT_SIZE;
+    uint64_t pos=0;
+    int r;
+    if (m)
+    {
+      size_t nb=(m->width+7)/8,dataBytes=cwBytes-nb;
+      r=m->kernel(cw,dataBytes)==crc_read_bits(cw,dataBytes*8,nb*8)?CRC_VERIFY_PASS:CRC_VERIFY_FAIL;
+    }
+    else
+      r=crc_verify_codeword(engine,&tab,cw,req.nbits,&pos);
+    proto_put_verdict(v,r,(uint32_t)pos);
+    bad+=r!=CRC_VERIFY_PASS;
+  }
+  if (t)
+    crc_syndrome_cache_release(&syndromes,t);
+  if (engine)
+    crc_cache_release(&cache,engine);
+  resp.remainder=bad;
+  proto_encode_response_n(out,&resp,req.count);
+  return CRC_RESP_HDR+(size_t)req.count*CRC_VERDICT_SIZE;
 }
 
-void CRC(char *datawordBin,char *divisorBin,char *codewordBin,char *remainderBin)
+void printCacheStats(void)
+{
+  struct crc_cache_stats st;
+  crc_cache_get_stats(&cache,&st);
+  printf("Table cache : %llu hits, %llu misses, %llu evictions, %d/%d entries\n",
+         (unsigned long long)st.hits,(unsigned long long)st.misses,
+         (unsigned long long)st.evictions,st.entries,st.cap);
+  pthread_mutex_lock(&syndromes.lock);
+  printf("Syndrome tables : %llu hits, %llu misses, %d/%d entries\n",
+         (unsigned long long)syndromes.hits,(unsigned long long)syndromes.misses,
+         syndromes.count,syndromes.cap);
+  pthread_mutex_unlock(&syndromes.lock);
+}
+
+/* Makes room for need more bytes in a buffer, returning -1 if out of
+   memory.  Buffers start small so idle connections stay cheap. */
+int reserve(unsigned char **buf,size_t *cap,size_t len,size_t need)
+{
+  size_t want=*cap?*cap:BUF_INIT;
+  unsigned char *grown;
+  if (len+need<=*cap)
+    return 0;
+  while(want<len+need)
+    want*=2;
+  grown=realloc(*buf,want);
+  if (!grown)
+    return -1;
+  *buf=grown;
+  *cap=want;
+  return 0;
+}
+
+/* Gives back a large buffer once it is empty. */
+void shrink(unsigned char **buf,size_t *cap)
+{
+  if (*cap>READ_CHUNK*2)
+  {
+    free(*buf);
+    *buf=NULL;
+    *cap=0;
+  }
+}
+
+/* Lock-step protocol: answers every complete struct message_struct.
+   Returns 1 when a client asks the server to shut down. */
+int serveText(struct conn *c,size_t *off)
+{
+  while(c->inLen-*off>=sizeof(struct message_struct))
+  {
+    struct message_struct *message=(struct message_struct *)(c->in+*off);
+    if (strcmp(message->dataword,"end")==0)
+      return 1;
+    message->dataword[MAX-1]='\0';
+    message->divisor[MAX-1]='\0';
+    printf("\nDataword : %s\n",message->dataword);
+    printf("Divisor : %s\n",message->divisor);
+    CRC(message->dataword,message->divisor,message->codeword,message->remainder);
+    printf("Codeword : %s\n",message->codeword);
+    printf("Remainder : %s\n",message->remainder);
+    if (reserve(&c->out,&c->outCap,c->outLen,sizeof(*message))<0)
+      return -1;
+    memcpy(c->out+c->outLen,message,sizeof(*message));
+    c->outLen+=sizeof(*message);
+    *off+=sizeof(*message);
+    c->served++;
+    if (c->outLen>=OUT_HIGH)
+      break;
+  }
+  return 0;
+}
+
+/* Binary protocol: answers every complete frame.  Returns -1 on a frame
+   that is too large to accept. */
+int serveBinary(struct conn *c,size_t *off)
 {
-  int divisorLen=strlen(divisorBin);
-  int datawordDec=toDec(datawordBin);
-  int divisorDec=toDec(divisorBin);
-  int dividendDec=datawordDec << (divisorLen-1);
-  int shft=(int)(ceil(log2(dividendDec+1))-divisorLen);
-  while(dividendDec>=divisorDec || shft>=0)
+  while(1)
+  {
+    struct crc_response resp;
+    struct crc_request req;
+    size_t fs=proto_frame_size(c->in+*off,c->inLen-*off),need=CRC_RESP_HDR;
+    int verify;
+    if (fs==0 || fs>c->inLen-*off)
+      return fs>CRC_MAX_FRAME?-1:0;
+    verify=proto_decode_request(c->in+*off,&req)==0 && req.op==CRC_OP_VERIFY;
+    if (verify && (uint64_t)req.count*CRC_VERDICT_SIZE<=CRC_MAX_FRAME-CRC_RESP_HDR)
+      need+=(size_t)req.count*CRC_VERDICT_SIZE;
+    if (reserve(&c->out,&c->outCap,c->outLen,need)<0)
+      return -1;
+    if (verify)
+      c->outLen+=serveVerify(c->in+*off,c->out+c->outLen);
+    else
+    {
+      serveRequest(c->in+*off,&resp);
+      proto_encode_response(c->out+c->outLen,&resp);
+      c->outLen+=CRC_RESP_HDR;
+    }
+    *off+=fs;
+    c->served++;
+    if (c->outLen>=OUT_HIGH)
+      return 0;
+  }
+}
+
+/* Runs every complete request in the input buffer.  Returns 1 on "end",
+   -1 if the connection should be dropped. */
+int process(struct conn *c)
+{
+  size_t off=0;
+  int r=0;
+  if (c->mode==MODE_NEW && c->inLen>=4)
+  {
+    c->mode=memcmp(c->in,CRC_PROTO_MAGIC,4)==0?MODE_BINARY:MODE_TEXT;
+    if (c->mode==MODE_BINARY)
+      off=4;
+  }
+  if (c->mode==MODE_TEXT)
+    r=serveText(c,&off);
+  else if (c->mode==MODE_BINARY)
+    r=serveBinary(c,&off);
+  memmove(c->in,c->in+off,c->inLen-off);
+  c->inLen-=off;
+  if (c->inLen==0)
+    shrink(&c->in,&c->inCap);
+  return r;
+}
+
+/* Sends queued responses until the socket would block.  Returns -1 on a
+   dead connection. */
+int flush(struct conn *c)
+{
+  while(c->outOff<c->outLen)
+  {
+    ssize_t w=write(c->fd,c->out+c->outOff,c->outLen-c->outOff);
+    if (w<0 && errno==EINTR)
+      continue;
+    if (w<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+      return 0;
+    if (w<=0)
+      return -1;
+    c->outOff+=w;
+  }
+  c->outOff=c->outLen=0;
+  shrink(&c->out,&c->outCap);
+  return 0;
+}
+
+/* Edge-triggered: drain the socket, answering as we go, until it would
+   block or the output backlog is over OUT_HIGH.  In the latter case
+   reading resumes from the EPOLLOUT that empties the backlog. */
+int pump(struct conn *c)
+{
+  while(1)
   {
-    int remDec=(dividendDec>>shft)^divisorDec;
-    dividendDec=(dividendDec&((1ll<<shft)-1))|(remDec<<shft);
-    shft=(int)(ceil(log2(dividendDec+1))-divisorLen);
+    int r=process(c);
+    if (r!=0)
+      return r;
+    if (flush(c)<0)
+      return -1;
+    if (c->outLen-c->outOff>=OUT_HIGH)
+      return 0;
+    size_t want=c->mode==MODE_TEXT?sizeof(struct message_struct):READ_CHUNK;
+    if (reserve(&c->in,&c->inCap,c->inLen,want)<0)
+      return -1;
+    ssize_t got=read(c->fd,c->in+c->inLen,c->inCap-c->inLen);
+    if (got<0 && errno==EINTR)
+      continue;
+    if (got<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+      return 0;
+    if (got<=0)
+      return -1;
+    c->inLen+=got;
   }
-  int codewordDec=(datawordDec<<(divisorLen-1))|dividendDec;
-  toBin(codewordDec,codewordBin);
-  strcpy(remainderBin,codewordBin+strlen(datawordBin));
+}
+
+void dropConn(int ep,struct conn *c)
+{
+  epoll_ctl(ep,EPOLL_CTL_DEL,c->fd,NULL);
+  close(c->fd);
+  if (c->mode==MODE_BINARY)
+    printf("Binary client served %zu requests\n",c->served);
+  free(c->in);
+  free(c->out);
+  free(c);
+}
+
+/* One event loop: its own epoll instance and its own SO_REUSEPORT listener,
+   so threads never share connections. */
+void *eventLoop(void *arg)
+{
+  int sid=(int)(intptr_t)arg;
+  int ep=epoll_create1(0);
+  struct epoll_event ev,events[MAX_EVENTS];
+  ev.events=EPOLLIN|EPOLLET;
+  ev.data.ptr=NULL;
+  epoll_ctl(ep,EPOLL_CTL_ADD,sid,&ev);
+  while(1)
+  {
+    int n=epoll_wait(ep,events,MAX_EVENTS,-1),i;
+    for(i=0;i<n;i++)
+    {
+      struct conn *c=events[i].data.ptr;
+      if (c==NULL)
+      {
+        int cid;
+        while((cid=accept4(sid,NULL,NULL,SOCK_NONBLOCK))>=0)
+        {
+          c=calloc(1,sizeof(*c));
+          if (!c)
+          {
+            close(cid);
+            continue;
+          }
+          int32_t one=1;
+          setsockopt(cid,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+          c->fd=cid;
+          ev.events=EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
+          ev.data.ptr=c;
+          epoll_ctl(ep,EPOLL_CTL_ADD,cid,&ev);
+        }
+        continue;
+      }
+      int r=0;
+      if (events[i].events&(EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))
+        r=pump(c);
+      else if (events[i].events&EPOLLOUT)
+      {
+        int backlog=c->outLen-c->outOff>=OUT_HIGH;
+        r=flush(c);
+        if (r==0 && backlog && c->outLen-c->outOff<OUT_HIGH)
+          r=pump(c);
+      }
+      if (r==1)
+      {
+        printCacheStats();
+        printf("| Server Offline |\n");
+        exit(0);
+      }
+      if (r<0)
+        dropConn(ep,c);
+    }
+  }
+  return NULL;
 }
 
 int main(int argc,char **argv)
 {
   char sip_addr[MAX];
-  int port;
-  if(argc!=3)
+  int port,threads=1,workers=sysconf(_SC_NPROCESSORS_ONLN)-1,t;
+  pthread_t tid[MAX_THREADS];
+  if(argc<3 || argc>5)
   {
     printf("Please provide IP and Port No....\n");
+    printf("Usage : %s <IP> <Port> [event threads] [CRC pool threads]\n",argv[0]);
     exit(1);
   }
   strcpy(sip_addr,argv[1]);
   port=atoi(argv[2]);
-  int sid=socket(AF_INET,SOCK_STREAM,0);
-  if (sid<0)
+  if (argc>3)
+    threads=atoi(argv[3]);
+  if (argc>4)
+    workers=atoi(argv[4]);
+  if (threads<1 || threads>MAX_THREADS)
   {
-    printf("Cannot create socket...\n");
+    printf("Thread count must be between 1 and %d...\n",MAX_THREADS);
     exit(1);
   }
-  struct sockaddr_in saddr,caddr;
-  saddr.sin_family=AF_INET;
-  saddr.sin_addr.s_addr=inet_addr(sip_addr);
-  saddr.sin_port=htons(port);
-  if (bind(sid,(struct sockaddr *)&saddr,sizeof(saddr))<0)
+  if (workers<0)
+    workers=0;
+  if (crc_cache_init(&cache,CACHE_SIZE)<0)
   {
-    printf("Cannot bind to the server...\n");
-    close(sid);
+    printf("Cannot allocate the table cache...\n");
     exit(1);
   }
-  listen(sid,5);
-  int32_t len=sizeof(caddr);
-  int cid=accept(sid,(struct sockaddr *)&caddr,&len);
-  printf("| Server Online |\n");
-  while(1)
+  crc_cache_prewarm_common(&cache);
+  crc_cache_reset_stats(&cache);
+  crc_syndrome_cache_init(&syndromes,SYNDROME_CACHE_SIZE);
+  if (crc_pool_init(&pool,workers)<0)
   {
-    struct message_struct message;
-    read(cid,(void *)&message,sizeof(message));
-    if (strcmp(message.dataword,"end")==0)
+    printf("Cannot start the CRC pool...\n");
+    exit(1);
+  }
+  struct sockaddr_in saddr;
+  saddr.sin_family=AF_INET;
+  saddr.sin_addr.s_addr=inet_addr(sip_addr);
+  saddr.sin_port=htons(port);
+  int sids[MAX_THREADS];
+  for(t=0;t<threads;t++)
+  {
+    int32_t one=1;
+    int sid=socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0);
+    if (sid<0)
     {
-      printf("| Server Offline |\n");
-      close(cid);
-      break;
+      printf("Cannot create socket...\n");
+      exit(1);
+    }
+    setsockopt(sid,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+    setsockopt(sid,SOL_SOCKET,SO_REUSEPORT,&one,sizeof(one));
+    if (bind(sid,(struct sockaddr *)&saddr,sizeof(saddr))<0)
+    {
+      printf("Cannot bind to the server...\n");
+      close(sid);
+      exit(1);
     }
-    printf("\nDataword : %s\n",message.dataword);
-    printf("Divisor : %s\n",message.divisor);
-    CRC(message.dataword,message.divisor,message.codeword,message.remainder);
-    printf("Codeword : %s\n",message.codeword);
-    printf("Remainder : %s\n",message.remainder);
-    write(cid,(void *)&message,sizeof(message));
-  }
-  close(sid);
+    listen(sid,SOMAXCONN);
+    sids[t]=sid;
+  }
+  printf("| Server Online |\n");
+  for(t=1;t<threads;t++)
+    pthread_create(&tid[t],NULL,eventLoop,(void *)(intptr_t)sids[t]);
+  eventLoop((void *)(intptr_t)sids[0]);
   return 0;
 }
@@ -41,22 +41,33 @@ int main(int argc,char **argv)
   printf("| Client Online |\n");
   while(1)
   {
-    struct message_struct message;
+    static struct message_struct message;
+    char packet[2*MAX+1],*remainder;
+    int n;
     printf("\nEnter the Dataword : ");
     scanf("%[^\n]%*c",message.dataword);
     if (strcmp(message.dataword,"end")==0)
     {
       printf("| Client Offline |\n");
-      sendto(sid,(void *)&message,sizeof(message),0,(struct sockaddr *)&saddr,sizeof(saddr));
+      sendto(sid,"end",4,0,(struct sockaddr *)&saddr,sizeof(saddr));
       close(sid);
       exit(1);
     }
     printf("Enter the Divisor : ");
     scanf("%[^\n]%*c",message.divisor);
-    sendto(sid,(void *)&message,sizeof(message),0,(struct sockaddr *)&saddr,sizeof(saddr));
-    int len=sizeof(saddr);
-    recvfrom(sid,(void *)&message,sizeof(message),0,(struct sockaddr *)&saddr,&len);
-    printf("Codeword : %s\n",message.codeword);
-    printf("Remainder : %s\n",message.remainder);
+    /* Compact request: only the two strings and their NULs. */
+    n=strlen(message.dataword)+1;
+    memcpy(packet,message.dataword,n);
+    strcpy(packet+n,message.divisor);
+    n+=strlen(message.divisor)+1;
+    sendto(sid,packet,n,0,(struct sockaddr *)&saddr,sizeof(saddr));
+    socklen_t len=sizeof(saddr);
+    n=recvfrom(sid,packet,sizeof(packet)-1,0,(struct sockaddr *)&saddr,&len);
+    packet[n>0?n:0]='\0';
+    remainder=packet+strlen(packet);
+    if (remainder<packet+n)
+      remainder++;
+    printf("Codeword : %s\n",packet);
+    printf("Remainder : %s\n",remainder);
   }
 }
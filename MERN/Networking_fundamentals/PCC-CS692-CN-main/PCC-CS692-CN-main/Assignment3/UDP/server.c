@@ -1,16 +1,26 @@
+#define _GNU_SOURCE
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
 #include<unistd.h>
+#include<errno.h>
+#include<poll.h>
 #include<sys/socket.h>
 #include<arpa/inet.h>
 #include<netinet/in.h>
 #include<fcntl.h>
-#include<math.h>
+#include"../../Codecs/crc_cache.h"
 
 #define MAX 100
+#define MAX_BATCH 256
+#define SOCK_BUF (4<<20)
+#define CACHE_SIZE 64
 #define int long long int
 
+/* Besides the whole struct, a request may be sent compact, as just the
+   used bytes "dataword\0divisor\0"; it is answered the same way with
+   "codeword\0remainder\0".  Either fits in dataword and divisor, so the
+   answer is computed into codeword and remainder of the same slot. */
 struct message_struct
 {
   char dataword[MAX];
@@ -19,78 +29,133 @@ struct message_struct
   char remainder[MAX];
 };
 
-void reverse(char *str)
+/* Built engines, so a burst of requests for the same generator costs one
+   table build. */
+struct crc_cache cache;
+
+/* The divisor is a generator in binary or a catalogue model name such as
+   CRC-32. */
+void CRC(char *datawordBin,char *divisorBin,char *codewordBin,char *remainderBin)
 {
-  int i=0,j=strlen(str)-1;
-  while(i<j)
+  int bad;
+  if (crc_model_find(divisorBin))
+    bad=crc_model_codeword(datawordBin,divisorBin,codewordBin,remainderBin,MAX);
+  else
+    bad=crc_cache_codeword(&cache,datawordBin,divisorBin,codewordBin,remainderBin,MAX);
+  if (bad<0)
   {
-    char temp=str[i];
-    str[i]=str[j];
-    str[j]=temp;
-    i++;
-    j--;
+    strcpy(codewordBin,"invalid");
+    strcpy(remainderBin,"invalid");
   }
 }
 
-int toDec(char *str)
+static struct message_struct messages[MAX_BATCH];
+static struct sockaddr_in peers[MAX_BATCH];
+static struct iovec iov[MAX_BATCH];
+static struct mmsghdr msgs[MAX_BATCH];
+static struct iovec replyIov[MAX_BATCH][2];
+static struct mmsghdr replies[MAX_BATCH];
+
+/* Splits a compact request of len bytes into its two strings.  Returns
+   the divisor, or NULL if the strings are missing or too long. */
+char *splitCompact(char *buf,int len)
 {
-  int i,power=strlen(str)-1,n=0;
-  for(i=0;i<strlen(str);i++)
-  {
-    n+=pow(2,power)*(str[i]-48);
-    power--;
-  }
-  return n;
+  char *end=memchr(buf,'\0',len<MAX?len:MAX);
+  char *divisor;
+  if (!end)
+    return NULL;
+  divisor=end+1;
+  len-=divisor-buf;
+  if (len<=0 || !memchr(divisor,'\0',len<MAX?len:MAX))
+    return NULL;
+  return divisor;
 }
 
-void toBin(int dec,char *bin)
+/* Queues the answer in messages[i] as reply out, pointing at the slot's
+   buffers rather than copying them. */
+void queueReply(int i,int out,int compact)
 {
-  int i=0;
-  while(dec>0)
+  struct message_struct *message=&messages[i];
+  struct msghdr *h=&replies[out].msg_hdr;
+  h->msg_name=&peers[i];
+  h->msg_namelen=msgs[i].msg_hdr.msg_namelen;
+  h->msg_iov=replyIov[out];
+  if (compact)
   {
-    bin[i++]=(char)(dec%2+48);
-    dec/=2;
+    replyIov[out][0].iov_base=message->codeword;
+    replyIov[out][0].iov_len=strlen(message->codeword)+1;
+    replyIov[out][1].iov_base=message->remainder;
+    replyIov[out][1].iov_len=strlen(message->remainder)+1;
+    h->msg_iovlen=2;
+  }
+  else
+  {
+    replyIov[out][0].iov_base=message;
+    replyIov[out][0].iov_len=sizeof(*message);
+    h->msg_iovlen=1;
   }
-  bin[i]='\0';
-  reverse(bin);
 }
 
-void CRC(char *datawordBin,char *divisorBin,char *codewordBin,char *remainderBin)
+/* Sends replies 0..n-1, waiting for room in the socket buffer if needed.
+   sendmmsg() stops at the first reply it cannot send; that one is dropped
+   (its client resends) and the rest still go out. */
+void sendAll(int sid,int n)
 {
-  int divisorLen=strlen(divisorBin);
-  int datawordDec=toDec(datawordBin);
-  int divisorDec=toDec(divisorBin);
-  int dividendDec=datawordDec << (divisorLen-1);
-  int shft=(int)(ceil(log2(dividendDec+1))-divisorLen);
-  while(dividendDec>=divisorDec || shft>=0)
+  int off=0;
+  while(off<n)
   {
-    int remDec=(dividendDec>>shft)^divisorDec;
-    dividendDec=(dividendDec&((1ll<<shft)-1))|(remDec<<shft);
-    shft=(int)(ceil(log2(dividendDec+1))-divisorLen);
+    int sent=sendmmsg(sid,replies+off,n-off,0);
+    if (sent<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+    {
+      struct pollfd pfd={sid,POLLOUT,0};
+      poll(&pfd,1,-1);
+      continue;
+    }
+    if (sent<0 && errno!=EINTR)
+      off++;
+    if (sent>0)
+      off+=sent;
   }
-  int codewordDec=(datawordDec<<(divisorLen-1))|dividendDec;
-  toBin(codewordDec,codewordBin);
-  strcpy(remainderBin,codewordBin+strlen(datawordBin));
 }
 
 int main(int argc,char **argv)
 {
   char sip_addr[MAX];
-  int port;
-  if(argc!=3)
+  int port,batch=32,verbose=1,i;
+  if(argc<3 || argc>5)
   {
     printf("Please provide IP and Port No....\n");
+    printf("Usage : %s <IP> <Port> [batch 1-%d] [log 0/1]\n",argv[0],MAX_BATCH);
     exit(1);
   }
   strcpy(sip_addr,argv[1]);
   port=atoi(argv[2]);
-  int sid=socket(AF_INET,SOCK_DGRAM,0);
+  if (argc>3)
+    batch=atoi(argv[3]);
+  if (argc>4)
+    verbose=atoi(argv[4]);
+  if (batch<1 || batch>MAX_BATCH)
+  {
+    printf("Batch depth must be between 1 and %d...\n",MAX_BATCH);
+    exit(1);
+  }
+  if (crc_cache_init(&cache,CACHE_SIZE)<0)
+  {
+    printf("Cannot allocate the table cache...\n");
+    exit(1);
+  }
+  crc_cache_prewarm_common(&cache);
+  crc_cache_reset_stats(&cache);
+  int sid=socket(AF_INET,SOCK_DGRAM|SOCK_NONBLOCK,0);
   if (sid<0)
   {
     printf("Cannot create socket...\n");
     exit(1);
   }
-  struct sockaddr_in saddr,caddr;
+  int32_t bufsize=SOCK_BUF;
+  setsockopt(sid,SOL_SOCKET,SO_RCVBUF,&bufsize,sizeof(bufsize));
+  setsockopt(sid,SOL_SOCKET,SO_SNDBUF,&bufsize,sizeof(bufsize));
+  struct sockaddr_in saddr;
   saddr.sin_family=AF_INET;
   saddr.sin_addr.s_addr=inet_addr(sip_addr);
   saddr.sin_port=htons(port);
@@ -100,21 +165,68 @@ int main(int argc,char **argv)
     close(sid);
     exit(1);
   }
+  for(i=0;i<batch;i++)
+  {
+    iov[i].iov_base=&messages[i];
+    iov[i].iov_len=sizeof(messages[i]);
+    msgs[i].msg_hdr.msg_iov=&iov[i];
+    msgs[i].msg_hdr.msg_iovlen=1;
+    msgs[i].msg_hdr.msg_name=&peers[i];
+  }
   printf("| Server Online |\n");
+  fflush(stdout);
   while(1)
   {
-    struct message_struct message;
-    int32_t len=sizeof(caddr);
-    recvfrom(sid,(void *)&message,sizeof(message),0,(struct sockaddr *)&caddr,&len);
-    if (strcmp(message.dataword,"end")==0)
+    struct pollfd pfd={sid,POLLIN,0};
+    if (poll(&pfd,1,-1)<0 && errno!=EINTR)
+      break;
+    /* Drain everything queued, batch datagrams per syscall each way. */
+    while(1)
     {
-      printf("| Server Offline |\n");
-      close(sid);
-      exit(1);
+      for(i=0;i<batch;i++)
+        msgs[i].msg_hdr.msg_namelen=sizeof(peers[i]);
+      int n=recvmmsg(sid,msgs,batch,MSG_DONTWAIT,NULL);
+      if (n<0 && errno==EINTR)
+        continue;
+      if (n<=0)
+        break;
+      int out=0;
+      for(i=0;i<n;i++)
+      {
+        struct message_struct *message=&messages[i];
+        char *divisor=message->divisor;
+        int compact=msgs[i].msg_len!=sizeof(*message);
+        if (compact)
+          divisor=splitCompact(message->dataword,msgs[i].msg_len);
+        else
+        {
+          message->dataword[MAX-1]='\0';
+          message->divisor[MAX-1]='\0';
+        }
+        if (compact?msgs[i].msg_len>=4 && memcmp(message->dataword,"end",4)==0:strcmp(message->dataword,"end")==0)
+        {
+          struct crc_cache_stats st;
+          sendAll(sid,out);
+          crc_cache_get_stats(&cache,&st);
+          printf("Table cache : %llu hits, %llu misses, %llu evictions\n",
+                 (unsigned long long)st.hits,(unsigned long long)st.misses,(unsigned long long)st.evictions);
+          printf("| Server Offline |\n");
+          close(sid);
+          exit(1);
+        }
+        if (!divisor)
+          continue;
+        if (verbose)
+        {
+          printf("\nDataword : %s\n",message->dataword);
+          printf("Divisor : %s\n",divisor);
+        }
+        CRC(message->dataword,divisor,message->codeword,message->remainder);
+        queueReply(i,out++,compact);
+      }
+      sendAll(sid,out);
     }
-    printf("\nDataword : %s\n",message.dataword);
-    printf("Divisor : %s\n",message.divisor);
-    CRC(message.dataword,message.divisor,message.codeword,message.remainder);
-    sendto(sid,(void *)&message,sizeof(message),0,(struct sockaddr *)&caddr,sizeof(caddr));
   }
+  close(sid);
+  return 0;
 }
@@ -0,0 +1,237 @@
+/*
+ * udp_bench.c - datagrams per second of the batched UDP CRC server on
+ * loopback, at several recvmmsg()/sendmmsg() batch depths.
+ *
+ *   gcc -O2 server.c -o server
+ *   gcc -O2 udp_bench.c -o udp_bench
+ *   ./udp_bench [requests] [window] [server binary]
+ *
+ * For each depth the benchmark starts its own server with logging off,
+ * keeps window requests in flight (lost datagrams are resent after a
+ * timeout), checks every remainder and stops the server with "end"; the
+ * best of RUNS such runs is reported, as loopback rates vary from run to
+ * run.
+ * Requests and replies are compact datagrams, "dataword\0divisor\0" and
+ * "codeword\0remainder\0".
+ */
+
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<errno.h>
+#include<poll.h>
+#include<signal.h>
+#include<sys/socket.h>
+#include<sys/wait.h>
+#include<arpa/inet.h>
+#include<netinet/in.h>
+#include<time.h>
+
+#define MAX 100
+#define MAX_WINDOW 256
+#define DATA_BITS 64
+#define PORT_BASE 9400
+#define RUNS 3
+#define CRC32_DIVISOR "100000100110000010001110110110111"
+
+static char dataword[MAX],request[2*MAX],replies[MAX_WINDOW][2*MAX+1];
+static char expect[MAX];
+static int requestLen;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* Bit-serial CRC of the request dataword, the reference for every reply. */
+static void reference(void)
+{
+  char temp[DATA_BITS+MAX];
+  int dlen=strlen(dataword),glen=strlen(CRC32_DIVISOR),i,j;
+  strcpy(temp,dataword);
+  memset(temp+dlen,'0',glen-1);
+  for(i=0;i<dlen;i++)
+    if (temp[i]=='1')
+      for(j=0;j<glen;j++)
+        temp[i+j]=(temp[i+j]==CRC32_DIVISOR[j])?'0':'1';
+  memcpy(expect,temp+dlen,glen-1);
+  expect[glen-1]='\0';
+}
+
+static pid_t startServer(const char *bin,int port,int batch)
+{
+  char portStr[16],batchStr[16];
+  pid_t pid;
+  snprintf(portStr,sizeof(portStr),"%d",port);
+  snprintf(batchStr,sizeof(batchStr),"%d",batch);
+  fflush(stdout);
+  pid=fork();
+  if (pid==0)
+  {
+    freopen("/dev/null","w",stdout);
+    execl(bin,bin,"127.0.0.1",portStr,batchStr,"0",(char *)NULL);
+    _exit(127);
+  }
+  usleep(200000);
+  return pid;
+}
+
+/* Up to window requests in flight.  Returns replies per second, or -1 if
+   the server stopped answering or sent a wrong remainder. */
+static double run(int port,long total,int window)
+{
+  struct sockaddr_in saddr;
+  struct mmsghdr out[MAX_WINDOW],in[MAX_WINDOW];
+  struct iovec oiov[MAX_WINDOW],iiov[MAX_WINDOW];
+  long sent=0,recvd=0;
+  int sid=socket(AF_INET,SOCK_DGRAM,0),bufsize=4<<20,i,stalls=0;
+  double t0;
+  if (sid<0)
+    return -1;
+  setsockopt(sid,SOL_SOCKET,SO_RCVBUF,&bufsize,sizeof(bufsize));
+  setsockopt(sid,SOL_SOCKET,SO_SNDBUF,&bufsize,sizeof(bufsize));
+  saddr.sin_family=AF_INET;
+  saddr.sin_addr.s_addr=inet_addr("127.0.0.1");
+  saddr.sin_port=htons(port);
+  if (connect(sid,(struct sockaddr *)&saddr,sizeof(saddr))<0)
+  {
+    close(sid);
+    return -1;
+  }
+  memset(out,0,sizeof(out));
+  memset(in,0,sizeof(in));
+  for(i=0;i<window;i++)
+  {
+    oiov[i].iov_base=request;
+    oiov[i].iov_len=requestLen;
+    out[i].msg_hdr.msg_iov=&oiov[i];
+    out[i].msg_hdr.msg_iovlen=1;
+    iiov[i].iov_base=replies[i];
+    iiov[i].iov_len=sizeof(replies[i])-1;
+    in[i].msg_hdr.msg_iov=&iiov[i];
+    in[i].msg_hdr.msg_iovlen=1;
+  }
+  t0=now();
+  while(recvd<total)
+  {
+    struct pollfd pfd={sid,POLLIN,0};
+    long want=window-(sent-recvd);
+    if (want>total-sent)
+      want=total-sent;
+    if (want>0)
+    {
+      int n=sendmmsg(sid,out,want,0);
+      if (n>0)
+        sent+=n;
+    }
+    if (poll(&pfd,1,100)==0)
+    {
+      /* Treat everything in flight as lost and send it again. */
+      if (++stalls>50)
+        break;
+      sent=recvd;
+      continue;
+    }
+    int n=recvmmsg(sid,in,window,MSG_DONTWAIT,NULL);
+    for(i=0;i<n;i++)
+    {
+      char *remainder=replies[i]+strnlen(replies[i],in[i].msg_len)+1;
+      replies[i][in[i].msg_len]='\0';
+      if (remainder>replies[i]+in[i].msg_len || strcmp(remainder,expect)!=0)
+      {
+        printf("Bad reply to request %ld, expected remainder %s\n",recvd+i,expect);
+        close(sid);
+        return -1;
+      }
+    }
+    if (n>0)
+    {
+      recvd+=n;
+      stalls=0;
+    }
+  }
+  t0=now()-t0;
+  close(sid);
+  return recvd>=total?recvd/t0:-1;
+}
+
+static void stopServer(int port,pid_t pid)
+{
+  struct sockaddr_in saddr;
+  int sid=socket(AF_INET,SOCK_DGRAM,0);
+  saddr.sin_family=AF_INET;
+  saddr.sin_addr.s_addr=inet_addr("127.0.0.1");
+  saddr.sin_port=htons(port);
+  sendto(sid,"end",4,0,(struct sockaddr *)&saddr,sizeof(saddr));
+  close(sid);
+  usleep(100000);
+  if (waitpid(pid,NULL,WNOHANG)==0)
+  {
+    kill(pid,SIGTERM);
+    waitpid(pid,NULL,0);
+  }
+}
+
+int main(int argc,char **argv)
+{
+  static const int depths[]={1,8,32,128};
+  const char *bin="./server";
+  long total=200000;
+  int window=256,i,r;
+  double base=0;
+  if (argc>1)
+    total=atol(argv[1]);
+  if (argc>2)
+    window=atoi(argv[2]);
+  if (argc>3)
+    bin=argv[3];
+  if (total<1 || window<1 || window>MAX_WINDOW)
+  {
+    printf("Usage : %s [requests] [window 1-%d] [server binary]\n",argv[0],MAX_WINDOW);
+    exit(1);
+  }
+  srand(7);
+  for(i=0;i<DATA_BITS;i++)
+    dataword[i]=(rand()&1)?'1':'0';
+  requestLen=sprintf(request,"%s%c%s",dataword,'\0',CRC32_DIVISOR)+1;
+  reference();
+
+  printf("%-10s %14s %10s\n","batch","replies/s","speedup");
+  for(i=0;i<(int)(sizeof(depths)/sizeof(depths[0]));i++)
+  {
+    int port=PORT_BASE+i;
+    double rate=-1;
+    for(r=0;r<RUNS;r++)
+    {
+      pid_t pid=startServer(bin,port,depths[i]);
+      double one;
+      if (pid<0)
+      {
+        printf("Cannot start %s...\n",bin);
+        exit(1);
+      }
+      one=run(port,total,window);
+      stopServer(port,pid);
+      if (one<0)
+      {
+        rate=-1;
+        break;
+      }
+      if (one>rate)
+        rate=one;
+    }
+    if (rate<0)
+    {
+      printf("%-10d %14s\n",depths[i],"failed");
+      continue;
+    }
+    if (i==0)
+      base=rate;
+    printf("%-10d %14.0f %9.2fx\n",depths[i],rate,base>0?rate/base:0);
+  }
+  return 0;
+}
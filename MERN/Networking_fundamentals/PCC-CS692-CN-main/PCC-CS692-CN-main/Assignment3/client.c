@@ -18,6 +18,20 @@ struct input_struct
   char remainder[MAX];
 };
 
+int
+readFull (int fd, void *buf, int n)
+{
+  int got = 0;
+  while (got < n)
+    {
+      int r = read (fd, (char *) buf + got, n - got);
+      if (r <= 0)
+	return got;
+      got += r;
+    }
+  return got;
+}
+
 int
 main ()
 {
@@ -35,7 +49,7 @@ main ()
 
   while (1)
     {
-      struct input_struct input;
+      static struct input_struct input;
       printf ("Enter the Data Word : ");
       scanf ("%[^\n]%*c", input.dataword);
 
@@ -56,8 +70,14 @@ main ()
 
       printf ("\nWaiting for Server response...\n");
 
-      struct input_struct output;
-      read (sockfd, (void *) &output, sizeof (output));
+      static struct input_struct output;
+      if (readFull (sockfd, (void *) &output, sizeof (output)) <
+	  (int) sizeof (output))
+	{
+	  printf ("Server closed the connection...\n");
+	  close (sockfd);
+	  exit (1);
+	}
 
       printf ("Code Word received from the Server : %s\n", output.codeword);
       printf ("\nRemainder : %s\n\n", output.remainder);
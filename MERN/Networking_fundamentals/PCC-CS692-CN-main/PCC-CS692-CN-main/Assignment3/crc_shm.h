@@ -0,0 +1,348 @@
+#ifndef CRC_SHM_H
+#define CRC_SHM_H
+
+/*
+ * Shared-memory request ring for the Unix-domain CRC server.
+ *
+ * A co-located client creates one memfd holding a ring header, nslots
+ * request descriptors and a data area, plus two eventfds, and hands all
+ * three over once with SCM_RIGHTS:
+ *
+ *   1. write a struct input_struct whose dataword is CRC_SHM_CONTROL,
+ *   2. sendmsg() one byte carrying { memfd, request bell, done bell },
+ *   3. read one status byte, 0 once the server has mapped the ring.
+ *
+ * From then on the socket only carries control traffic: closing it (or
+ * the client dying) ends the session.  The client writes its data straight
+ * into the data area, fills the descriptor at head, and publishes it by
+ * advancing head; the server answers descriptors in order, writing status
+ * and remainder back into the slot and advancing tail.  head and tail are
+ * free-running counters, slot = counter & (nslots-1).
+ *
+ * Doorbells cost a syscall only when the other side is asleep: a side
+ * about to block sets its idle flag, fences, and looks at the counters once
+ * more, and the other side rings only if it sees the flag after its own
+ * fence.  A busy server therefore drains a stream of requests without any
+ * system call on either side.
+ *
+ * Descriptors use the fields of the binary TCP protocol (TCP/crc_proto.h):
+ * op, width, poly and model, with the dataword bit-packed MSB first at
+ * data+offset.  The server copies each descriptor before checking it and
+ * never trusts offsets from the client; a region may be reused by the
+ * client once tail has passed the request that pointed at it.  The memfd
+ * is sealed against resizing so a client cannot fault the server by
+ * truncating it.
+ *
+ * Needs _GNU_SOURCE (memfd_create, F_ADD_SEALS) defined before any include.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include<stdatomic.h>
+#include<unistd.h>
+#include<poll.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/socket.h>
+#include<sys/eventfd.h>
+#include"TCP/crc_proto.h"
+
+#define CRC_SHM_CONTROL "shm"
+#define CRC_SHM_MAGIC 0x53435243u   /* "CRCS" */
+#define CRC_SHM_MAX_SLOTS 65536
+#define CRC_SHM_SPIN 2000           /* polls before a side goes to sleep */
+#define CRC_SHM_SEALS (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define crc_shm_pause() __builtin_ia32_pause()
+#else
+#define crc_shm_pause() ((void)0)
+#endif
+
+struct crc_shm_desc
+{
+  uint64_t offset;            /* into the data area */
+  uint64_t nbits;
+  uint64_t poly;
+  uint64_t remainder;         /* written by the server */
+  uint32_t id;
+  uint8_t op;
+  uint8_t width;
+  uint8_t model;
+  uint8_t status;             /* written by the server */
+};
+
+struct crc_shm_ring
+{
+  uint32_t magic;
+  uint32_t nslots;            /* power of two */
+  uint64_t size;              /* of the whole mapping */
+  uint64_t dataOffset,dataSize;
+  _Alignas(64) _Atomic uint32_t head;   /* published by the client */
+  _Atomic uint32_t serverIdle;
+  _Alignas(64) _Atomic uint32_t tail;   /* completed by the server */
+  _Atomic uint32_t clientIdle;
+  _Alignas(64) struct crc_shm_desc slot[];
+};
+
+/* One side's view of a session. */
+struct crc_shm
+{
+  int memfd,requestBell,doneBell;
+  struct crc_shm_ring *ring;
+  unsigned char *data;
+  size_t size;
+  uint32_t nslots;            /* private copies of the header, which the */
+  uint64_t dataSize;          /* peer could rewrite at any time */
+  int spin;                   /* 0 on one CPU, where spinning only delays the peer */
+  uint64_t bells,sleeps;      /* doorbells rung, times this side blocked */
+};
+
+static inline size_t crc_shm_data_offset(uint32_t nslots)
+{
+  size_t off=sizeof(struct crc_shm_ring)+(size_t)nslots*sizeof(struct crc_shm_desc);
+  return (off+4095)&~(size_t)4095;
+}
+
+static inline void crc_shm_reset(struct crc_shm *s)
+{
+  memset(s,0,sizeof(*s));
+  s->memfd=s->requestBell=s->doneBell=-1;
+  s->spin=sysconf(_SC_NPROCESSORS_ONLN)>1?CRC_SHM_SPIN:0;
+}
+
+static inline void crc_shm_close(struct crc_shm *s)
+{
+  if (s->ring)
+    munmap(s->ring,s->size);
+  if (s->memfd>=0)
+    close(s->memfd);
+  if (s->requestBell>=0)
+    close(s->requestBell);
+  if (s->doneBell>=0)
+    close(s->doneBell);
+  s->ring=NULL;
+  s->memfd=s->requestBell=s->doneBell=-1;
+}
+
+/* Client side: builds a ring of nslots descriptors and dataSize bytes of
+   data.  Returns -1 on a bad size or if any resource cannot be had. */
+static inline int crc_shm_create(struct crc_shm *s,uint32_t nslots,size_t dataSize)
+{
+  size_t off=crc_shm_data_offset(nslots);
+  crc_shm_reset(s);
+  if (nslots==0 || nslots>CRC_SHM_MAX_SLOTS || (nslots&(nslots-1)) || dataSize==0)
+    return -1;
+  s->size=off+((dataSize+4095)&~(size_t)4095);
+  s->memfd=memfd_create("crc_shm",MFD_CLOEXEC|MFD_ALLOW_SEALING);
+  s->requestBell=eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+  s->doneBell=eventfd(0,EFD_CLOEXEC|EFD_NONBLOCK);
+  if (s->memfd<0 || s->requestBell<0 || s->doneBell<0 || ftruncate(s->memfd,s->size)<0
+      || fcntl(s->memfd,F_ADD_SEALS,CRC_SHM_SEALS)<0)
+  {
+    crc_shm_close(s);
+    return -1;
+  }
+  s->ring=mmap(NULL,s->size,PROT_READ|PROT_WRITE,MAP_SHARED,s->memfd,0);
+  if (s->ring==MAP_FAILED)
+  {
+    s->ring=NULL;
+    crc_shm_close(s);
+    return -1;
+  }
+  s->ring->magic=CRC_SHM_MAGIC;
+  s->ring->nslots=nslots;
+  s->ring->size=s->size;
+  s->ring->dataOffset=off;
+  s->ring->dataSize=s->size-off;
+  s->data=(unsigned char *)s->ring+off;
+  s->nslots=nslots;
+  s->dataSize=s->ring->dataSize;
+  return 0;
+}
+
+/* Client side: passes the three descriptors over the socket. */
+static inline int crc_shm_send_fds(int sock,const struct crc_shm *s)
+{
+  int fds[3]={s->memfd,s->requestBell,s->doneBell};
+  char byte=0;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } ctl;
+  struct iovec iov={&byte,1};
+  struct msghdr msg;
+  struct cmsghdr *c;
+  memset(&msg,0,sizeof(msg));
+  memset(&ctl,0,sizeof(ctl));
+  msg.msg_iov=&iov;
+  msg.msg_iovlen=1;
+  msg.msg_control=ctl.buf;
+  msg.msg_controllen=sizeof(ctl.buf);
+  c=CMSG_FIRSTHDR(&msg);
+  c->cmsg_level=SOL_SOCKET;
+  c->cmsg_type=SCM_RIGHTS;
+  c->cmsg_len=CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(c),fds,sizeof(fds));
+  return sendmsg(sock,&msg,MSG_NOSIGNAL)==1?0:-1;
+}
+
+/* Server side: receives the descriptors and maps the ring, checking the
+   header against the real size of the memfd.  Returns -1 if anything is
+   missing or inconsistent. */
+static inline int crc_shm_accept(int sock,struct crc_shm *s)
+{
+  int fds[3],seals;
+  char byte;
+  union
+  {
+    struct cmsghdr h;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } ctl;
+  struct iovec iov={&byte,1};
+  struct msghdr msg;
+  struct cmsghdr *c;
+  struct stat st;
+  struct crc_shm_ring *r;
+  uint64_t off;
+  crc_shm_reset(s);
+  memset(&msg,0,sizeof(msg));
+  msg.msg_iov=&iov;
+  msg.msg_iovlen=1;
+  msg.msg_control=ctl.buf;
+  msg.msg_controllen=sizeof(ctl.buf);
+  if (recvmsg(sock,&msg,MSG_CMSG_CLOEXEC)!=1)
+    return -1;
+  c=CMSG_FIRSTHDR(&msg);
+  if (!c || c->cmsg_level!=SOL_SOCKET || c->cmsg_type!=SCM_RIGHTS)
+    return -1;
+  if (c->cmsg_len!=CMSG_LEN(sizeof(fds)))
+  {
+    /* Close whatever did arrive rather than leak it. */
+    int i,n=(int)((c->cmsg_len-CMSG_LEN(0))/sizeof(int));
+    for(i=0;i<n;i++)
+    {
+      int fd;
+      memcpy(&fd,CMSG_DATA(c)+i*sizeof(int),sizeof(int));
+      close(fd);
+    }
+    return -1;
+  }
+  memcpy(fds,CMSG_DATA(c),sizeof(fds));
+  s->memfd=fds[0];
+  s->requestBell=fds[1];
+  s->doneBell=fds[2];
+  seals=fcntl(s->memfd,F_GET_SEALS);
+  if (seals<0 || (seals&CRC_SHM_SEALS)!=CRC_SHM_SEALS || fstat(s->memfd,&st)<0 || (size_t)st.st_size<sizeof(*r))
+  {
+    crc_shm_close(s);
+    return -1;
+  }
+  s->size=(size_t)st.st_size;
+  r=mmap(NULL,s->size,PROT_READ|PROT_WRITE,MAP_SHARED,s->memfd,0);
+  if (r==MAP_FAILED)
+  {
+    crc_shm_close(s);
+    return -1;
+  }
+  s->ring=r;
+  s->nslots=r->nslots;
+  s->dataSize=r->dataSize;
+  off=r->dataOffset;
+  atomic_signal_fence(memory_order_seq_cst);
+  if (r->magic!=CRC_SHM_MAGIC || s->nslots==0 || s->nslots>CRC_SHM_MAX_SLOTS || (s->nslots&(s->nslots-1))
+      || off!=crc_shm_data_offset(s->nslots) || off>s->size || s->dataSize>s->size-off)
+  {
+    crc_shm_close(s);
+    return -1;
+  }
+  s->data=(unsigned char *)r+off;
+  return 0;
+}
+
+static inline void crc_shm_ring_bell(struct crc_shm *s,int fd)
+{
+  uint64_t one=1;
+  s->bells++;
+  if (write(fd,&one,sizeof(one))<0)
+  {
+    /* Only EAGAIN at a saturated counter, which still wakes the peer. */
+  }
+}
+
+static inline void crc_shm_clear_bell(int fd)
+{
+  uint64_t v;
+  while(read(fd,&v,sizeof(v))<0 && errno==EINTR);
+}
+
+/* Sleeps until counter differs from seen, the bell rings or the socket
+   has something (data, hang-up).  idle is this side's flag.  Returns 1 if
+   the socket needs attention, 0 otherwise. */
+static inline int crc_shm_sleep(struct crc_shm *s,_Atomic uint32_t *counter,uint32_t seen,_Atomic uint32_t *idle,int bell,int sock)
+{
+  struct pollfd p[2];
+  int i;
+  for(i=0;i<s->spin;i++)
+  {
+    if (atomic_load_explicit(counter,memory_order_acquire)!=seen)
+      return 0;
+    crc_shm_pause();
+  }
+  atomic_store_explicit(idle,1,memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(counter,memory_order_acquire)!=seen)
+  {
+    atomic_store_explicit(idle,0,memory_order_relaxed);
+    return 0;
+  }
+  p[0].fd=bell;
+  p[0].events=POLLIN;
+  p[1].fd=sock;
+  p[1].events=POLLIN;
+  s->sleeps++;
+  while(poll(p,2,-1)<0 && errno==EINTR);
+  atomic_store_explicit(idle,0,memory_order_relaxed);
+  if (p[0].revents&POLLIN)
+    crc_shm_clear_bell(bell);
+  return (p[1].revents&(POLLIN|POLLHUP|POLLERR))?1:0;
+}
+
+/* Wakes the peer if it announced it was going to sleep. */
+static inline void crc_shm_notify(struct crc_shm *s,_Atomic uint32_t *idle,int bell)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(idle,memory_order_relaxed))
+    crc_shm_ring_bell(s,bell);
+}
+
+/* Client side: publishes a filled-in descriptor.  Returns -1 when the
+   ring is full. */
+static inline int crc_shm_submit(struct crc_shm *s,const struct crc_shm_desc *d)
+{
+  struct crc_shm_ring *r=s->ring;
+  uint32_t head=atomic_load_explicit(&r->head,memory_order_relaxed);
+  if (head-atomic_load_explicit(&r->tail,memory_order_acquire)>=s->nslots)
+    return -1;
+  r->slot[head&(s->nslots-1)]=*d;
+  atomic_store_explicit(&r->head,head+1,memory_order_release);
+  crc_shm_notify(s,&r->serverIdle,s->requestBell);
+  return 0;
+}
+
+/* Client side: waits until the server has completed every request before
+   counter upto.  Returns -1 if the server went away. */
+static inline int crc_shm_wait(struct crc_shm *s,uint32_t upto,int sock)
+{
+  struct crc_shm_ring *r=s->ring;
+  uint32_t tail;
+  while((int32_t)(upto-(tail=atomic_load_explicit(&r->tail,memory_order_acquire)))>0)
+    if (crc_shm_sleep(s,&r->tail,tail,&r->clientIdle,s->doneBell,sock))
+      return -1;
+  return 0;
+}
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include<stdio.h>
 #include<stdlib.h>
 #include<unistd.h>
@@ -7,9 +8,11 @@
 #include<sys/stat.h>
 #include<sys/un.h>
 #include<fcntl.h>
-#include<math.h>
+#include"../Codecs/crc_cache.h"
+#include"crc_shm.h"
 
 #define MAX 100
+#define CACHE_SIZE 64
 
 struct input_struct
 {
@@ -19,78 +22,172 @@ struct input_struct
   char remainder[MAX];
 };
 
+int
+readFull (int fd, void *buf, int n)
+{
+  int got = 0;
+  while (got < n)
+    {
+      int r = read (fd, (char *) buf + got, n - got);
+      if (r <= 0)
+	return got;
+      got += r;
+    }
+  return got;
+}
+
 char code[MAX], rem[MAX];
+struct crc_cache cache;
 
+/* The divisor is either a generator in binary or the name of a catalogue
+   model such as CRC-32. */
 void
-toBin (long long int dec, char *bin)
+CRC (char *dataword, char *divisor)
 {
-  int i = 0;
-  while (dec > 0)
-    {
-      if (dec % 2 == 1)
-	{
-	  bin[i++] = '1';
-	}
-      else
-	{
-	  bin[i++] = '0';
-	}
-      dec /= 2;
-    }
-  i = 0;
-  int j = strlen (bin)-1;
-  while (i < j)
+  int bad;
+  if (crc_model_find (divisor))
+    bad = crc_model_codeword (dataword, divisor, code, rem, sizeof (code));
+  else
+    bad =
+      crc_cache_codeword (&cache, dataword, divisor, code, rem,
+			  sizeof (code));
+  if (bad < 0)
     {
-      char temp = bin[i];
-      bin[i] = bin[j];
-      bin[j] = temp;
-      i++;
-      j--;
+      strcpy (code, "invalid");
+      strcpy (rem, "invalid");
     }
-  bin[strlen (bin)] = '\0';
+  printf ("Codeword : %s\n", code);
+  printf ("Remainder : %s\n", rem);
 }
 
-long long int
-toDec (char *bin)
+/* Answers one descriptor from the shared ring in place of the socket
+   round trip.  d is the server's private copy. */
+void
+serveDescriptor (const struct crc_shm *shm, struct crc_shm_desc *d)
 {
-  long long int dec = 0;
-  int len = strlen (bin);
-  int i;
-  for (i = 0; i < len; i++)
+  const struct crc_engine *engine;
+  const struct crc_model *m;
+  struct crc_stream s;
+  d->remainder = 0;
+  if (d->op != CRC_OP_GENERATE)
+    {
+      d->status = CRC_STATUS_BAD_OP;
+      return;
+    }
+  /* Bounded in bits before any arithmetic on nbits, which could wrap. */
+  if (d->offset > shm->dataSize
+      || d->nbits > 8 * (shm->dataSize - d->offset))
+    {
+      d->status = CRC_STATUS_BAD_REQUEST;
+      return;
+    }
+  if (d->model != CRC_MODEL_RAW)
     {
-      dec += ((bin[i] - '0') * pow (2, len - (i + 1)));
+      m = crc_model_get (d->model);
+      d->status = !m ? CRC_STATUS_BAD_MODEL : d->nbits % 8 ?
+	CRC_STATUS_BAD_REQUEST : CRC_STATUS_OK;
+      if (m)
+	d->width = m->width;
+      if (d->status == CRC_STATUS_OK)
+	d->remainder = m->kernel (shm->data + d->offset, d->nbits / 8);
+      return;
     }
-  return dec;
+  if (d->width < 1 || d->width > CRC_MAX_WIDTH
+      || !(engine = crc_cache_get (&cache, d->poly, d->width, 0)))
+    {
+      d->status = CRC_STATUS_BAD_REQUEST;
+      return;
+    }
+  crc_stream_init (&s, engine);
+  crc_stream_update_bits (&s, shm->data + d->offset, d->nbits);
+  d->status = CRC_STATUS_OK;
+  d->remainder = crc_stream_final (&s);
+  crc_cache_release (&cache, engine);
 }
 
+/* Shared-memory session: takes the ring from the client and answers its
+   descriptors until the socket shows anything, which is the client
+   leaving.  No per-request output, that would cost more than the CRC. */
 void
-CRC (char *dataword, char *divisor)
+serveShm (int sockfd)
 {
-  int divLen = strlen (divisor);
-  long long int divisorDec = toDec (divisor);
-  long long int datawordDec = toDec (dataword);
-  long long int dividendDec = (datawordDec << (divLen - 1));
-  int shft = (int) (ceil (log2 (dividendDec + 1)) - divLen);
-  long long int remDec;
-  while ((dividendDec >= divisorDec) || (shft >= 0))
+  struct crc_shm shm;
+  struct crc_shm_ring *r;
+  uint32_t head, tail;
+  uint64_t served = 0, bytes = 0;
+  char status = 0;
+  if (crc_shm_accept (sockfd, &shm) < 0)
     {
-      remDec = (dividendDec >> shft) ^ divisorDec;
-      dividendDec = (dividendDec & ((1ll << shft) - 1)) | (remDec << shft);
-      shft = (int) (ceil (log2 (dividendDec + 1)) - divLen);
+      status = 1;
+      write (sockfd, &status, 1);
+      printf ("Shared memory setup failed...\n");
+      return;
     }
-  long long int codewordDec = (datawordDec << (divLen - 1)) | dividendDec;
-  char codewordBin[MAX];
-  toBin (codewordDec, codewordBin);
-  strcpy (code, codewordBin);
-  strcpy (rem, codewordBin + strlen (dataword));
-  printf ("Codeword : %s\n", code);
-  printf ("Remainder : %s\n", rem);
+  write (sockfd, &status, 1);
+  r = shm.ring;
+  printf ("Client switched to shared memory : %u slots, %llu KB of data\n",
+	  shm.nslots, (unsigned long long) shm.dataSize >> 10);
+  tail = atomic_load_explicit (&r->tail, memory_order_relaxed);
+  while (1)
+    {
+      head = atomic_load_explicit (&r->head, memory_order_acquire);
+      if (head - tail > shm.nslots)
+	{
+	  printf ("Client corrupted the ring...\n");
+	  break;
+	}
+      if (head == tail)
+	{
+	  if (crc_shm_sleep
+	      (&shm, &r->head, head, &r->serverIdle, shm.requestBell, sockfd))
+	    break;
+	  continue;
+	}
+      while (tail != head)
+	{
+	  struct crc_shm_desc d, *slot = &r->slot[tail & (shm.nslots - 1)];
+	  memcpy (&d, slot, sizeof (d));
+	  atomic_signal_fence (memory_order_seq_cst);
+	  serveDescriptor (&shm, &d);
+	  slot->width = d.width;
+	  slot->remainder = d.remainder;
+	  slot->status = d.status;
+	  served++;
+	  if (d.status == CRC_STATUS_OK)
+	    bytes += (d.nbits + 7) / 8;
+	  atomic_store_explicit (&r->tail, ++tail, memory_order_release);
+	  crc_shm_notify (&shm, &r->clientIdle, shm.doneBell);
+	}
+    }
+  printf ("Shared memory : %llu requests, %llu MB, %llu doorbells, %llu sleeps\n",
+	  (unsigned long long) served, (unsigned long long) bytes >> 20,
+	  (unsigned long long) shm.bells, (unsigned long long) shm.sleeps);
+  crc_shm_close (&shm);
+}
+
+void
+terminate (int server_sockfd)
+{
+  struct crc_cache_stats st;
+  crc_cache_get_stats (&cache, &st);
+  printf ("Table cache : %llu hits, %llu misses\n",
+	  (unsigned long long) st.hits, (unsigned long long) st.misses);
+  printf ("\nServer is terminated...\n");
+  close (server_sockfd);
+  exit (1);
 }
 
 int
 main ()
 {
   unlink ("socket_server");
+  if (crc_cache_init (&cache, CACHE_SIZE) < 0)
+    {
+      printf ("Cannot allocate the table cache...\n");
+      exit (1);
+    }
+  crc_cache_prewarm_common (&cache);
+  crc_cache_reset_stats (&cache);
 
   struct sockaddr_un client_address, server_address;
   int client_sockfd, server_sockfd;
@@ -110,19 +207,22 @@ main ()
   while (1)
     {
       printf ("\nServer is waiting\n");
-      struct input_struct input;
-      read (client_sockfd, (void *) &input, sizeof (input));
-      if (strcmp (input.dataword, "end") == 0)
+      static struct input_struct input;
+      if (readFull (client_sockfd, (void *) &input, sizeof (input)) <
+	  (int) sizeof (input) || strcmp (input.dataword, "end") == 0)
+	terminate (server_sockfd);
+      input.dataword[MAX - 1] = '\0';
+      input.divisor[MAX - 1] = '\0';
+      if (strcmp (input.dataword, CRC_SHM_CONTROL) == 0)
 	{
-	  printf ("\nServer is terminated...\n");
-	  close (server_sockfd);
-	  exit (1);
+	  serveShm (client_sockfd);
+	  terminate (server_sockfd);
 	}
       printf ("Server received Data Word : %s\n", input.dataword);
       printf ("Server received Divisor : %s\n", input.divisor);
 
       CRC (input.dataword, input.divisor);
-      struct input_struct output;
+      static struct input_struct output;
       strcpy (output.codeword, code);
       strcpy (output.remainder, rem);
       printf
@@ -0,0 +1,217 @@
+/*
+ * shm_client.c - checksums large buffers through the shared-memory ring of
+ * the Unix-domain CRC server (see crc_shm.h) and checks every remainder
+ * against a local engine, then checks that descriptors running past the
+ * data area are refused.
+ *
+ *   gcc -O2 server.c -o server && gcc -O2 shm_client.c -o shm_client
+ *   ./server &
+ *   ./shm_client [MB per request] [requests] [divisor or model name]
+ *
+ * The buffers are written once, straight into the shared data area; the
+ * socket is used only to hand over the ring and, by closing it, to end the
+ * session.
+ */
+
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<unistd.h>
+#include<string.h>
+#include<time.h>
+#include<sys/types.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+#include<sys/un.h>
+#include<fcntl.h>
+#include"../Codecs/crc_model.h"
+#include"crc_shm.h"
+
+#define MAX 100
+#define DEPTH 8			/* requests in flight, one data region each */
+
+struct input_struct
+{
+  char dataword[MAX];
+  char divisor[MAX];
+  char codeword[MAX];
+  char remainder[MAX];
+};
+
+int
+readFull (int fd, void *buf, int n)
+{
+  int got = 0;
+  while (got < n)
+    {
+      int r = read (fd, (char *) buf + got, n - got);
+      if (r <= 0)
+	return got;
+      got += r;
+    }
+  return got;
+}
+
+double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t mb = argc > 1 ? strtoul (argv[1], NULL, 10) : 16;
+  long requests = argc > 2 ? atol (argv[2]) : 64;
+  const char *divisor =
+    argc > 3 ? argv[3] : "100000100110000010001110110110111";
+  size_t region = mb << 20;
+  uint64_t expect[DEPTH];
+  struct crc_shm_desc d;
+  struct crc_engine e;
+  struct crc_shm shm;
+  int width, id, r, failed = 0;
+  uint64_t poly;
+  long i;
+  size_t j;
+  char status;
+  double t0, t1;
+
+  memset (&d, 0, sizeof (d));
+  d.op = CRC_OP_GENERATE;
+  d.nbits = (uint64_t) region * 8;
+  id = crc_model_find (divisor);
+  if (id)
+    d.model = id;
+  else if (crc_parse_bits (divisor, &poly, &width) < 0 || width < 1)
+    {
+      printf ("Usage : %s [MB per request] [requests] [divisor or model]\n",
+	      argv[0]);
+      exit (1);
+    }
+  else
+    {
+      d.model = CRC_MODEL_RAW;
+      d.width = width;
+      d.poly = poly;
+      crc_engine_init (&e, poly, width);
+    }
+  if (region == 0 || requests < 1
+      || crc_shm_create (&shm, 2 * DEPTH, DEPTH * region) < 0)
+    {
+      printf ("Cannot create the shared ring...\n");
+      exit (1);
+    }
+
+  /* Fill each region in place and work out what the server must say. */
+  srand (1);
+  for (r = 0; r < DEPTH; r++)
+    {
+      unsigned char *p = shm.data + r * region;
+      for (j = 0; j < region; j++)
+	p[j] = rand () >> 7;
+      if (id)
+	expect[r] = crc_model_get (id)->kernel (p, region);
+      else
+	expect[r] = crc_engine_final (&e, crc_engine_update_fast (&e, 0, p, region));
+    }
+
+  struct sockaddr_un address;
+  int sockfd = socket (AF_UNIX, SOCK_STREAM, 0);
+  address.sun_family = AF_UNIX;
+  strcpy (address.sun_path, "socket_server");
+  if (connect (sockfd, (struct sockaddr *) &address, sizeof (address)) == -1)
+    {
+      printf ("Cannot connect to the Server...\n");
+      exit (1);
+    }
+  static struct input_struct input;
+  strcpy (input.dataword, CRC_SHM_CONTROL);
+  write (sockfd, (void *) &input, sizeof (input));
+  if (crc_shm_send_fds (sockfd, &shm) < 0 || readFull (sockfd, &status, 1) < 1
+      || status != 0)
+    {
+      printf ("Server refused the shared ring...\n");
+      exit (1);
+    }
+  printf ("Sending %ld requests of %zu MB through shared memory...\n",
+	  requests, mb);
+
+  t0 = now ();
+  for (i = 0; i < requests + DEPTH; i++)
+    {
+      /* Region i%DEPTH is free again once request i-DEPTH is answered. */
+      if (i >= DEPTH)
+	{
+	  struct crc_shm_desc *done;
+	  if (crc_shm_wait (&shm, (uint32_t) (i - DEPTH + 1), sockfd) < 0)
+	    {
+	      printf ("Server closed the connection...\n");
+	      exit (1);
+	    }
+	  done = &shm.ring->slot[(i - DEPTH) & (shm.nslots - 1)];
+	  if (done->status != CRC_STATUS_OK
+	      || done->remainder != expect[(i - DEPTH) % DEPTH])
+	    {
+	      printf ("Request %ld : status %d, remainder %llx, expected %llx\n",
+		      i - DEPTH, done->status,
+		      (unsigned long long) done->remainder,
+		      (unsigned long long) expect[(i - DEPTH) % DEPTH]);
+	      failed = 1;
+	    }
+	}
+      if (i >= requests)
+	continue;
+      d.id = (uint32_t) i;
+      d.offset = (uint64_t) (i % DEPTH) * region;
+      while (crc_shm_submit (&shm, &d) < 0)
+	crc_shm_wait (&shm, shm.ring->tail + 1, sockfd);
+    }
+  t1 = now ();
+
+  /* Hostile descriptors: lengths that wrap when rounded up to bytes or run
+     past the data area, and an offset beyond it, must all be refused. */
+  struct crc_shm_desc bad[4];
+  for (r = 0; r < 4; r++)
+    {
+      bad[r] = d;
+      bad[r].id = (uint32_t) (requests + r);
+      bad[r].model = CRC_MODEL_RAW;
+      bad[r].width = 32;
+      bad[r].poly = 0x04C11DB7;
+      bad[r].offset = 0;
+    }
+  bad[0].nbits = ~0ull;
+  bad[1].nbits = ~0ull - 6;
+  bad[2].nbits = (uint64_t) DEPTH * region * 8 + 1;
+  bad[3].offset = (uint64_t) DEPTH * region + 1;
+  bad[3].nbits = 8;
+  for (r = 0; r < 4; r++)
+    {
+      struct crc_shm_desc *done;
+      crc_shm_submit (&shm, &bad[r]);
+      if (crc_shm_wait (&shm, (uint32_t) (requests + r + 1), sockfd) < 0)
+	{
+	  printf ("Server closed the connection...\n");
+	  exit (1);
+	}
+      done = &shm.ring->slot[(requests + r) & (shm.nslots - 1)];
+      if (done->status != CRC_STATUS_BAD_REQUEST)
+	{
+	  printf ("Hostile request %d : status %d, expected %d\n", r,
+		  done->status, CRC_STATUS_BAD_REQUEST);
+	  failed = 1;
+	}
+    }
+
+  printf ("%ld requests, %.2f GB/s, %llu doorbells, %llu sleeps, %s\n",
+	  requests, requests * (double) region / (t1 - t0) / 1e9,
+	  (unsigned long long) shm.bells, (unsigned long long) shm.sleeps,
+	  failed ? "MISMATCH" : "all remainders match, hostile requests refused");
+  printf ("\nClient is terminated...\n");
+  close (sockfd);
+  crc_shm_close (&shm);
+  return failed;
+}
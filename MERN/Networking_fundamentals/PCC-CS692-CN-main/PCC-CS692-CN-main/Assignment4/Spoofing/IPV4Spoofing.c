@@ -14,18 +14,11 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include "../../Codecs/inet_checksum.h" // RFC 1071 checksum
 
 // Calculate checksum
 unsigned short calculate_checksum(unsigned short *buf, int nwords) {
-    unsigned long sum = 0;
-    
-    for (sum = 0; nwords > 0; nwords--)
-        sum += *buf++;
-    
-    sum = (sum >> 16) + (sum & 0xffff);
-    sum += (sum >> 16);
-    
-    return (unsigned short)(~sum);
+    return inet_csum(buf, (size_t)nwords * 2);
 }
 
 int main(int argc, char *argv[]) {
@@ -12,11 +12,54 @@
 
 #define MAX 100
 
+int
+writeAll (int fd, const void *buf, size_t n)
+{
+  const char *p = buf;
+  while (n > 0)
+    {
+      ssize_t put = write (fd, p, n);
+      if (put <= 0)
+	return -1;
+      p += put;
+      n -= put;
+    }
+  return 0;
+}
+
+/* Reads one NUL-terminated reply of any length into *buf.  Nothing
+   follows it until the next request, so it can be read in chunks. */
+int
+readString (int fd, char **buf, size_t *cap)
+{
+  size_t len = 0;
+  while (1)
+    {
+      ssize_t got;
+      if (*cap - len < 4096)
+	{
+	  size_t newCap = *cap ? *cap * 2 : 4096;
+	  char *p = realloc (*buf, newCap);
+	  if (!p)
+	    return -1;
+	  *buf = p;
+	  *cap = newCap;
+	}
+      got = read (fd, *buf + len, *cap - len);
+      if (got <= 0)
+	return -1;
+      len += got;
+      if ((*buf)[len - 1] == '\0')
+	return 0;
+    }
+}
+
 int
 main (int ac, char **av)
 {
   struct sockaddr_in saddr;
-  char sip_addr[MAX], bit[MAX], ans[MAX];
+  char sip_addr[MAX], *bit = NULL, *ans = NULL;
+  size_t bitCap = 0, ansCap = 0;
   if (ac == 1)
     strcpy (sip_addr, "127.0.0.1");
   else
@@ -34,24 +77,40 @@ main (int ac, char **av)
     }
   while (1)
     {
+      ssize_t n;
       printf ("Enter a Bit-Stream : ");
-      scanf ("%s", bit);
-      getchar ();
-      if (strlen (bit) > 32)
+      if ((n = getline (&bit, &bitCap, stdin)) < 0)
+	break;
+      while (n > 0 && (bit[n - 1] == '\n' || bit[n - 1] == '\r'))
+	bit[--n] = '\0';
+      if (strcmp (bit, "end") != 0 && strspn (bit, "01") != (size_t) n)
 	{
-	  printf ("Input should be 32 bits...\n\n");
+	  printf ("Input should be a Bit-Stream...\n\n");
 	  continue;
 	}
-      write (sid, (void *) &bit, strlen (bit) + 1);
+      writeAll (sid, bit, n + 1);
       if (strcmp (bit, "end") == 0)
 	{
 	  printf ("Client terminated...\n");
 	  break;
 	}
-      printf ("\nClient sent %s to the Server\n", bit);
-      read (sid, ans, MAX);
-      printf ("Bit-Stuffed Result received from the server : %s\n\n", ans);
+      if (n < MAX)
+	printf ("\nClient sent %s to the Server\n", bit);
+      else
+	printf ("\nClient sent %zd bits to the Server\n", n);
+      if (readString (sid, &ans, &ansCap) < 0)
+	{
+	  printf ("Server closed the connection...\n");
+	  break;
+	}
+      if (strlen (ans) < MAX)
+	printf ("Bit-Stuffed Result received from the server : %s\n\n", ans);
+      else
+	printf ("Bit-Stuffed Result received from the server : %zu bits\n\n",
+		strlen (ans));
     }
+  free (bit);
+  free (ans);
   close (sid);
   return 0;
 }
@@ -10,13 +10,123 @@
 
 #include<unistd.h>
 
+#include"../Codecs/hdlc.h"
+
 #define MAX 100
+#define CHUNK 4096		/* characters read and stuffed at a time */
+
+/* One bit-stream from the client, stuffed as it arrives through buffers
+   of fixed size, whatever its length. */
+struct message
+{
+  struct hdlc_state st;
+  char head[MAX];		/* the first characters, to show and for "end" */
+  size_t len;
+  char sent[MAX];		/* the first characters sent back */
+  size_t sentLen;
+  char part[8];			/* characters short of a whole byte */
+  int partLen;
+  int stopped;			/* a character other than '0'/'1' was seen */
+};
+
+unsigned char packed[CHUNK / 8 + 1];
+unsigned char stuffed[(CHUNK + CHUNK / 5 + 64) / 8 + 8];
+char reply[CHUNK + CHUNK / 5 + 64];
+
+int
+writeAll (int fd, const void *buf, size_t n)
+{
+  const char *p = buf;
+  while (n > 0)
+    {
+      ssize_t put = write (fd, p, n);
+      if (put <= 0)
+	return -1;
+      p += put;
+      n -= put;
+    }
+  return 0;
+}
+
+/* Sends the first bits of stuffed to the client as characters. */
+void
+sendBits (int cid, struct message *m, size_t bits)
+{
+  hdlc_unpack (stuffed, bits, reply);
+  if (m->sentLen < MAX - 1)
+    {
+      size_t n = bits < MAX - 1 - m->sentLen ? bits : MAX - 1 - m->sentLen;
+      memcpy (m->sent + m->sentLen, reply, n);
+      m->sentLen += n;
+      m->sent[m->sentLen] = '\0';
+    }
+  writeAll (cid, reply, bits);
+}
+
+/* Stuffs the characters c[0..n) of the current message, none of them the
+   NUL, eight at a time. */
+void
+stuffChars (int cid, struct message *m, const char *c, size_t n)
+{
+  size_t i, whole;
+  if (m->len < MAX - 1)
+    {
+      size_t k = n < MAX - 1 - m->len ? n : MAX - 1 - m->len;
+      memcpy (m->head + m->len, c, k);
+      m->head[m->len + k] = '\0';
+    }
+  m->len += n;
+  if (m->stopped)
+    return;
+  for (i = 0; i < n; i++)
+    if (c[i] != '0' && c[i] != '1')
+      {
+	n = i;
+	m->stopped = 1;
+	break;
+      }
+  /* Top up the part byte, then whole bytes straight from c. */
+  while (m->partLen > 0 && m->partLen < 8 && n > 0)
+    {
+      m->part[m->partLen++] = *c++;
+      n--;
+    }
+  if (m->partLen == 8)
+    {
+      hdlc_pack (m->part, 8, packed);
+      sendBits (cid, m, 8 * hdlc_stuff (&m->st, packed, 8, stuffed));
+      m->partLen = 0;
+    }
+  whole = n / 8 * 8;
+  if (whole > 0)
+    {
+      hdlc_pack (c, whole, packed);
+      sendBits (cid, m, 8 * hdlc_stuff (&m->st, packed, whole, stuffed));
+    }
+  memcpy (m->part + m->partLen, c + whole, n - whole);
+  m->partLen += n - whole;
+}
+
+/* Stuffs the last characters and sends the rest of the reply and its
+   NUL. */
+void
+finish (int cid, struct message *m)
+{
+  uint64_t before = m->st.bitsOut - m->st.n;
+  size_t n;
+  hdlc_pack (m->part, m->partLen, packed);
+  n = hdlc_stuff (&m->st, packed, m->partLen, stuffed);
+  hdlc_flush (&m->st, stuffed + n);
+  sendBits (cid, m, m->st.bitsOut - before);
+  writeAll (cid, "", 1);
+}
 
 int
 main (int ac, char **av)
 {
   struct sockaddr_in saddr, caddr;
-  char sip_addr[MAX], bit[MAX];
+  char sip_addr[MAX], bit[CHUNK];
+  struct message m;
   if (ac == 1)
     strcpy (sip_addr, "127.0.0.1");
   else
@@ -34,41 +144,49 @@ main (int ac, char **av)
       exit (1);
     }
   listen (sid, 5);
-  int len = sizeof (caddr);
+  socklen_t len = sizeof (caddr);
   int cid = accept (sid, (struct sockaddr *) &caddr, &len);
-  while (1)
+  int done = 0;
+  memset (&m, 0, sizeof (m));
+  hdlc_init (&m.st);
+  while (!done)
     {
-      read (cid, (void *) &bit, MAX);
-      if (strcmp (bit, "end") == 0)
+      ssize_t got = read (cid, bit, CHUNK);
+      size_t pos = 0;
+      if (got <= 0)
 	{
-	  printf ("Server terminated\n");
+	  printf ("Client disconnected\n");
 	  break;
 	}
-      printf ("Server received %s from the client...\n", bit);
-      int count = 0;
-      int i;
-      for (i = 0; i < strlen (bit); i++)
+      /* A read may end inside a message or hold the ends of several. */
+      while (pos < (size_t) got)
 	{
-	  if (bit[i] == '1')
-	    count++;
-	  if (bit[i] == '0')
-	    count = 0;
-	  if (count == 5)
+	  char *nul = memchr (bit + pos, '\0', got - pos);
+	  size_t n = nul ? (size_t) (nul - bit) - pos : (size_t) got - pos;
+	  stuffChars (cid, &m, bit + pos, n);
+	  pos += n;
+	  if (!nul)
+	    break;
+	  pos++;
+	  if (strcmp (m.head, "end") == 0)
 	    {
-	      int j;
-	      char prev = '0', curr;
-	      for (j = i + 1; j < strlen (bit); j++)
-		{
-		  int curr = bit[j];
-		  bit[j] = prev;
-		  prev = curr;
-		}
-	      bit[j] = prev;
-	      bit[j + 1] = '\0';
+	      printf ("Server terminated\n");
+	      done = 1;
+	      break;
 	    }
+	  if (m.len < MAX)
+	    printf ("Server received %s from the client...\n", m.head);
+	  else
+	    printf ("Server received %zu bits from the client...\n", m.len);
+	  finish (cid, &m);
+	  if (m.st.bitsOut < MAX)
+	    printf ("Server sent %s to the client\n\n", m.sent);
+	  else
+	    printf ("Server sent %llu bits to the client\n\n",
+		    (unsigned long long) m.st.bitsOut);
+	  memset (&m, 0, sizeof (m));
+	  hdlc_init (&m.st);
 	}
-      write (cid, (void *) &bit, strlen (bit) + 1);
-      printf ("Server sent %s to the client\n\n", bit);
     }
   close (sid);
   close (cid);
@@ -0,0 +1,376 @@
+/*
+ * hamming_bench.c - cost of one Hamming encode with the original string
+ * routine and with the bit-parallel encoder, and of one decode, then
+ * codewords per second of the server's encode and decode batches.
+ *
+ *   gcc -O2 server.c -o server && ./server 127.0.0.1 8080
+ *   gcc -O2 hamming_bench.c -o hamming_bench -lm
+ *   ./hamming_bench 127.0.0.1 8080 [batches]
+ *
+ * Every batch reply is checked against the local encoder.  Decode batches
+ * carry clean codewords and codewords with one and two flipped bits, and
+ * every correction, position and detection is checked.  BCH batches go
+ * the same way with 0..t flipped bits per codeword and also report the
+ * corrected bits per second.  Add -mpopcnt to both builds to turn each
+ * parity into one popcnt instruction.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<sys/socket.h>
+#include<sys/time.h>
+#include<arpa/inet.h>
+#include<netinet/in.h>
+#include<time.h>
+#include"../Codecs/reference.h"
+#include"hamming_proto.h"
+
+#define LOCAL_ROUNDS 1000000
+
+static volatile uint32_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static uint64_t rand64(void)
+{
+  return (uint64_t)rand()<<42^(uint64_t)rand()<<21^(uint64_t)rand();
+}
+
+/* ns per 64-bit dataword: string hamming(), hamming_encode() and the
+   (72,64) encoder, then the two decoders. */
+static void runLocal(void)
+{
+  static struct hamming_code h;
+  static uint64_t words[1024];
+  static uint8_t checks[1024];
+  char dataword[65],codeword[80];
+  double t0,tString,tGeneral,tFixed;
+  long i;
+  int j;
+  for(j=0;j<1024;j++)
+    words[j]=rand64();
+  for(j=0;j<64;j++)
+    dataword[j]=(words[0]>>(63-j)&1)?'1':'0';
+  dataword[64]='\0';
+  hamming_init(&h,64);
+  t0=now();
+  for(i=0;i<LOCAL_ROUNDS/100;i++)
+  {
+    hamming(dataword,codeword);
+    sink+=codeword[0];
+  }
+  tString=(now()-t0)/(LOCAL_ROUNDS/100);
+  t0=now();
+  for(i=0;i<LOCAL_ROUNDS;i++)
+    sink+=hamming_encode(&h,&words[i&1023]);
+  tGeneral=(now()-t0)/LOCAL_ROUNDS;
+  t0=now();
+  for(i=0;i<LOCAL_ROUNDS;i++)
+    sink+=hamming72_encode(words[i&1023]);
+  tFixed=(now()-t0)/LOCAL_ROUNDS;
+  printf("%-28s %10.1f ns/codeword\n","string hamming()",tString*1e9);
+  printf("%-28s %10.1f ns/codeword\n","hamming_encode(), k=64",tGeneral*1e9);
+  printf("%-28s %10.1f ns/codeword\n","hamming72_encode()",tFixed*1e9);
+
+  /* Decode the words with a bit flipped in every other one. */
+  for(j=0;j<1024;j++)
+  {
+    checks[j]=hamming72_encode(words[j]);
+    if (j&1)
+      words[j]^=1ull<<(j%64);
+  }
+  t0=now();
+  for(i=0;i<LOCAL_ROUNDS;i++)
+  {
+    int pos;
+    uint64_t d=words[i&1023];
+    sink+=hamming_decode(&h,&d,checks[i&1023],&pos);
+  }
+  tGeneral=(now()-t0)/LOCAL_ROUNDS;
+  t0=now();
+  for(i=0;i<LOCAL_ROUNDS;i++)
+  {
+    int pos;
+    uint64_t d=words[i&1023];
+    sink+=hamming72_decode(&d,checks[i&1023],&pos);
+  }
+  tFixed=(now()-t0)/LOCAL_ROUNDS;
+  printf("%-28s %10.1f ns/codeword\n","hamming_decode(), k=64",tGeneral*1e9);
+  printf("%-28s %10.1f ns/codeword\n","hamming72_decode()",tFixed*1e9);
+}
+
+/* Lock-step encode batches of the largest count for k data bits.
+   Returns codewords per second, or -1 on a lost or wrong reply. */
+static double runEncode(int sid,int k,long batches)
+{
+  static unsigned char req[HAMMING_MAX_DGRAM],resp[HAMMING_MAX_DGRAM];
+  static struct hamming_code h;
+  struct hamming_batch b;
+  uint64_t data[HAMMING_MAX_WORDS];
+  int dataBytes=(k+7)/8,checkBytes=hamming_check_bytes(k),cwBytes=dataBytes+checkBytes;
+  int count=hamming_max_count(dataBytes,cwBytes),i,j;
+  long n;
+  double t0;
+  hamming_init(&h,k);
+  memset(&b,0,sizeof(b));
+  b.op=HAMMING_OP_ENCODE;
+  b.k=k;
+  b.count=count;
+  for(i=0;i<count*dataBytes;i++)
+    req[HAMMING_HDR+i]=(unsigned char)rand();
+  /* Keep the pad bits zero so the echoed datawords compare equal. */
+  for(i=0;k%8 && i<count;i++)
+    req[HAMMING_HDR+i*dataBytes+dataBytes-1]&=(unsigned char)(0xFF<<(8-k%8));
+  t0=now();
+  for(n=0;n<batches;n++)
+  {
+    b.id=(uint32_t)n;
+    hamming_encode_header(req,&b);
+    send(sid,req,HAMMING_HDR+count*dataBytes,0);
+    if (recv(sid,resp,sizeof(resp),0)!=HAMMING_HDR+count*cwBytes || hamming_get32(resp+4)!=(uint32_t)n
+        || resp[9]!=HAMMING_STATUS_OK)
+      return -1;
+    if (n>0)
+      continue;
+    for(i=0;i<count;i++)
+    {
+      const unsigned char *cw=resp+HAMMING_HDR+i*cwBytes;
+      uint32_t check=0;
+      if (memcmp(cw,req+HAMMING_HDR+i*dataBytes,dataBytes)!=0)
+        return -1;
+      for(j=0;j<checkBytes;j++)
+        check=check<<8|cw[dataBytes+j];
+      hamming_load(&h,cw,data);
+      if (check!=hamming_encode(&h,data))
+        return -1;
+    }
+  }
+  return batches*count/(now()-t0);
+}
+
+/* Flips Hamming position p of a codeword: 0 the overall parity bit, a
+   power of two a check bit, anything else a data bit. */
+static void flipPosition(const struct hamming_code *h,unsigned char *cw,int p)
+{
+  int dataBytes=(h->k+7)/8,checkBytes=hamming_check_bytes(h->k),c;
+  if (p && (p&(p-1)))
+  {
+    cw[h->bit[p]/8]^=(unsigned char)(0x80>>(h->bit[p]%8));
+    return;
+  }
+  c=p?__builtin_ctz(p):h->r;
+  cw[dataBytes+checkBytes-1-c/8]^=(unsigned char)(1<<(c%8));
+}
+
+/* Lock-step decode batches of codewords that are clean, have one flipped
+   bit or two.  Returns codewords per second, or -1 on a wrong result. */
+static double runDecode(int sid,int k,long batches)
+{
+  static unsigned char req[HAMMING_MAX_DGRAM],resp[HAMMING_MAX_DGRAM],orig[HAMMING_MAX_DGRAM];
+  static struct hamming_code h;
+  static uint8_t want[HAMMING_MAX_DGRAM];
+  static uint16_t where[HAMMING_MAX_DGRAM];
+  struct hamming_batch b;
+  uint64_t data[HAMMING_MAX_WORDS];
+  int dataBytes=(k+7)/8,checkBytes=hamming_check_bytes(k),cwBytes=dataBytes+checkBytes;
+  int itemBytes=dataBytes+HAMMING_RESULT_SIZE,count=hamming_max_count(cwBytes,itemBytes),i,j;
+  long n;
+  double t0;
+  hamming_init(&h,k);
+  memset(&b,0,sizeof(b));
+  b.op=HAMMING_OP_DECODE;
+  b.k=k;
+  b.count=count;
+  for(i=0;i<count;i++)
+  {
+    unsigned char *cw=req+HAMMING_HDR+i*cwBytes;
+    uint32_t check;
+    for(j=0;j<dataBytes;j++)
+      cw[j]=(unsigned char)rand();
+    if (k%8)
+      cw[dataBytes-1]&=(unsigned char)(0xFF<<(8-k%8));
+    memcpy(orig+i*dataBytes,cw,dataBytes);
+    hamming_load(&h,cw,data);
+    check=hamming_encode(&h,data);
+    for(j=0;j<checkBytes;j++)
+      cw[dataBytes+j]=(unsigned char)(check>>8*(checkBytes-1-j));
+    want[i]=i%3==0?HAMMING_CLEAN:i%3==1?HAMMING_CORRECTED:HAMMING_DOUBLE;
+    where[i]=rand()%(h.n+1);
+    if (want[i]!=HAMMING_CLEAN)
+      flipPosition(&h,cw,where[i]);
+    if (want[i]==HAMMING_DOUBLE)
+      flipPosition(&h,cw,(where[i]+1+rand()%h.n)%(h.n+1));
+  }
+  t0=now();
+  for(n=0;n<batches;n++)
+  {
+    b.id=(uint32_t)n;
+    hamming_encode_header(req,&b);
+    send(sid,req,HAMMING_HDR+count*cwBytes,0);
+    if (recv(sid,resp,sizeof(resp),0)!=HAMMING_HDR+count*itemBytes || hamming_get32(resp+4)!=(uint32_t)n
+        || resp[9]!=HAMMING_STATUS_OK)
+      return -1;
+    if (n>0)
+      continue;
+    for(i=0;i<count;i++)
+    {
+      const unsigned char *item=resp+HAMMING_HDR+i*itemBytes;
+      int pos=item[dataBytes+2]<<8|item[dataBytes+3];
+      if (item[dataBytes]!=want[i] || (want[i]==HAMMING_CORRECTED && pos!=where[i])
+          || (want[i]!=HAMMING_DOUBLE && memcmp(item,orig+i*dataBytes,dataBytes)!=0))
+      {
+        printf("k=%d codeword %d : result %d at %d, expected %d at %d\n",k,i,item[dataBytes],pos,want[i],where[i]);
+        return -1;
+      }
+    }
+  }
+  return batches*count/(now()-t0);
+}
+
+/* Lock-step BCH encode batches, then decode batches of the same codewords
+   with i%(t+1) bits flipped in codeword i.  Fills in codewords per second
+   of each and corrected bits per second; returns -1 on a wrong reply. */
+static int runBch(int sid,int m,int t,int k,long batches,double *encRate,double *decRate,double *bitRate)
+{
+  static unsigned char req[HAMMING_MAX_DGRAM],resp[HAMMING_MAX_DGRAM],cws[HAMMING_MAX_DGRAM];
+  static struct bch_code code;
+  struct hamming_batch b;
+  int dataBytes=k/8,cwBytes=dataBytes+bch_ecc_bytes(m,t),count,itemBytes,i,j;
+  long n,bits=0;
+  double t0;
+  if (bch_init(&code,m,t,k)<0)
+    return -1;
+  memset(&b,0,sizeof(b));
+  b.k=k;
+  b.m=m;
+  b.t=t;
+  b.op=HAMMING_OP_BCH_DECODE;
+  itemBytes=hamming_item_bytes(&b,1);
+  count=hamming_max_count(cwBytes,itemBytes);
+  b.op=HAMMING_OP_BCH_ENCODE;
+  b.count=count;
+  for(i=0;i<count*dataBytes;i++)
+    req[HAMMING_HDR+i]=(unsigned char)rand();
+  for(i=0;i<count;i++)
+  {
+    memcpy(cws+i*cwBytes,req+HAMMING_HDR+i*dataBytes,dataBytes);
+    bch_encode(&code,cws+i*cwBytes,cws+i*cwBytes+dataBytes);
+  }
+  t0=now();
+  for(n=0;n<batches;n++)
+  {
+    b.id=(uint32_t)n;
+    hamming_encode_header(req,&b);
+    send(sid,req,HAMMING_HDR+count*dataBytes,0);
+    if (recv(sid,resp,sizeof(resp),0)!=HAMMING_HDR+count*cwBytes || hamming_get32(resp+4)!=(uint32_t)n
+        || resp[9]!=HAMMING_STATUS_OK || (n==0 && memcmp(resp+HAMMING_HDR,cws,count*cwBytes)!=0))
+      return -1;
+  }
+  *encRate=batches*count/(now()-t0);
+
+  b.op=HAMMING_OP_BCH_DECODE;
+  memcpy(req+HAMMING_HDR,cws,count*cwBytes);
+  for(i=0;i<count;i++)
+    for(j=0;j<i%(t+1);j++)
+    {
+      int p=(int)((i*131+j*(k+code.deg)/t)%(k+code.deg));
+      req[HAMMING_HDR+i*cwBytes+(p<k?p/8:dataBytes+(p-k)/8)]^=(unsigned char)(0x80>>(p<k?p%8:(p-k)%8));
+      bits++;
+    }
+  t0=now();
+  for(n=0;n<batches;n++)
+  {
+    b.id=(uint32_t)n;
+    hamming_encode_header(req,&b);
+    send(sid,req,HAMMING_HDR+count*cwBytes,0);
+    if (recv(sid,resp,sizeof(resp),0)!=HAMMING_HDR+count*itemBytes || hamming_get32(resp+4)!=(uint32_t)n
+        || resp[9]!=HAMMING_STATUS_OK)
+      return -1;
+    if (n>0)
+      continue;
+    for(i=0;i<count;i++)
+    {
+      const unsigned char *item=resp+HAMMING_HDR+i*itemBytes;
+      int flips=i%(t+1);
+      if (item[dataBytes]!=(flips?HAMMING_CORRECTED:HAMMING_CLEAN) || item[dataBytes+1]!=flips
+          || memcmp(item,cws+i*cwBytes,dataBytes)!=0)
+      {
+        printf("bch m=%d t=%d codeword %d : result %d with %d bits, expected %d bits\n",m,t,i,
+               item[dataBytes],item[dataBytes+1],flips);
+        return -1;
+      }
+    }
+  }
+  *decRate=batches*count/(now()-t0);
+  *bitRate=*decRate/count*bits;
+  return 0;
+}
+
+int main(int argc,char **argv)
+{
+  static const int ks[]={64,57,247,1024};
+  static const int bchs[][3]={{10,8,512},{13,4,4096}};
+  struct sockaddr_in saddr;
+  struct timeval tv={1,0};
+  long batches=2000;
+  int sid,i;
+  if (argc<3)
+  {
+    printf("Please provide the IP and Port no.s...\n");
+    exit(1);
+  }
+  if (argc>3)
+    batches=atol(argv[3]);
+  srand(3);
+  runLocal();
+
+  sid=socket(AF_INET,SOCK_DGRAM,0);
+  saddr.sin_family=AF_INET;
+  saddr.sin_addr.s_addr=inet_addr(argv[1]);
+  saddr.sin_port=htons(atoi(argv[2]));
+  if (sid<0 || connect(sid,(struct sockaddr *)&saddr,sizeof(saddr))<0)
+  {
+    printf("Cannot create Socket...\n");
+    exit(1);
+  }
+  setsockopt(sid,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+  for(i=0;i<(int)(sizeof(ks)/sizeof(ks[0]));i++)
+  {
+    char label[64];
+    double rate=runEncode(sid,ks[i],batches);
+    snprintf(label,sizeof(label),"server encode, k=%d",ks[i]);
+    if (rate<0)
+      printf("%-28s failed\n",label);
+    else
+      printf("%-28s %10.0f codewords/s\n",label,rate);
+  }
+  for(i=0;i<(int)(sizeof(ks)/sizeof(ks[0]));i++)
+  {
+    char label[64];
+    double rate=runDecode(sid,ks[i],batches);
+    snprintf(label,sizeof(label),"server decode, k=%d",ks[i]);
+    if (rate<0)
+      printf("%-28s failed\n",label);
+    else
+      printf("%-28s %10.0f codewords/s\n",label,rate);
+  }
+  for(i=0;i<(int)(sizeof(bchs)/sizeof(bchs[0]));i++)
+  {
+    char label[64];
+    double enc,dec,bits;
+    snprintf(label,sizeof(label),"server bch m=%d t=%d k=%d",bchs[i][0],bchs[i][1],bchs[i][2]);
+    if (runBch(sid,bchs[i][0],bchs[i][1],bchs[i][2],batches,&enc,&dec,&bits)<0)
+      printf("%-28s failed\n",label);
+    else
+      printf("%-28s %10.0f encodes/s %10.0f decodes/s %12.0f bits fixed/s\n",label,enc,dec,bits);
+  }
+  close(sid);
+  return 0;
+}
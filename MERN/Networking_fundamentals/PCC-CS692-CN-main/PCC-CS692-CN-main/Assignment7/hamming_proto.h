@@ -0,0 +1,172 @@
+#ifndef HAMMING_PROTO_H
+#define HAMMING_PROTO_H
+
+/*
+ * Binary batch datagrams for the Hamming UDP server.
+ *
+ * A datagram that starts with the magic "HAMB" carries a batch instead of
+ * one '0'/'1' dataword string.  All integers are in network byte order:
+ *
+ *   request   char[4] magic  "HAMB"
+ *             u32 id         echoed in the response
+ *             u8  op         HAMMING_OP_ENCODE, HAMMING_OP_DECODE,
+ *                            HAMMING_OP_BCH_ENCODE or HAMMING_OP_BCH_DECODE
+ *             u8             reserved, zero
+ *             u16 k          data bits per codeword, 1..HAMMING_MAX_DATA;
+ *                            for BCH whole bytes up to n-deg(g)
+ *             u16 count      datawords or codewords in the batch
+ *             u8  m          BCH only: GF(2^m), codeword length 2^m-1
+ *             u8  t          BCH only: bits corrected per codeword
+ *             payload        the encode ops: count datawords, each
+ *                            bit-packed MSB first in (k+7)/8 bytes;
+ *                            the decode ops: count codewords as below
+ *
+ *   response  the request header with the reserved byte after op set to
+ *             a HAMMING_STATUS_* code, followed on success by count items:
+ *
+ *             HAMMING_OP_ENCODE: codewords of (k+7)/8 data bytes and
+ *             (r+8)/8 check bytes
+ *
+ *             HAMMING_OP_DECODE: the corrected dataword, (k+7)/8 bytes
+ *             u8  result     HAMMING_CLEAN, HAMMING_CORRECTED or
+ *                            HAMMING_DOUBLE
+ *             u8             reserved, zero
+ *             u16 position   HAMMING_CORRECTED: Hamming position of the
+ *                            flipped bit, 0 for the overall parity bit
+ *
+ *             HAMMING_OP_BCH_ENCODE: codewords of k/8 data bytes and
+ *             bch_ecc_bytes(m,t) check bytes
+ *
+ *             HAMMING_OP_BCH_DECODE: the corrected dataword, k/8 bytes
+ *             u8  result     HAMMING_CLEAN, HAMMING_CORRECTED or
+ *                            HAMMING_DOUBLE for more errors than t
+ *             u8  bits       bits corrected
+ *             u16            reserved, zero
+ *
+ * The Hamming code is the SEC-DED code of Codecs/hamming.h: the check
+ * bytes hold the r Hamming check bits and the overall parity bit as
+ * returned by hamming_encode(), big-endian.  For k=64 that is the (72,64)
+ * code, nine bytes per codeword.  The BCH code is that of Codecs/bch.h,
+ * the check bits MSB first after the data.  A batch must fit one datagram
+ * both ways.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include"../Codecs/hamming.h"
+#include"../Codecs/bch.h"
+
+#define HAMMING_PROTO_MAGIC "HAMB"
+#define HAMMING_HDR 16
+#define HAMMING_MAX_DGRAM 65507
+
+#define HAMMING_OP_ENCODE 1
+#define HAMMING_OP_DECODE 2
+#define HAMMING_OP_BCH_ENCODE 3
+#define HAMMING_OP_BCH_DECODE 4
+#define HAMMING_RESULT_SIZE 4
+
+#define HAMMING_STATUS_OK 0
+#define HAMMING_STATUS_BAD_REQUEST 1
+#define HAMMING_STATUS_BAD_OP 2
+
+struct hamming_batch
+{
+  uint32_t id;
+  uint8_t op;
+  uint8_t status;
+  uint16_t k;
+  uint16_t count;
+  uint8_t m,t;                      /* BCH only */
+  const unsigned char *payload;
+};
+
+static inline uint32_t hamming_get32(const unsigned char *p)
+{
+  return (uint32_t)p[0]<<24|(uint32_t)p[1]<<16|(uint32_t)p[2]<<8|p[3];
+}
+
+static inline void hamming_put32(unsigned char *p,uint32_t v)
+{
+  p[0]=(unsigned char)(v>>24);
+  p[1]=(unsigned char)(v>>16);
+  p[2]=(unsigned char)(v>>8);
+  p[3]=(unsigned char)v;
+}
+
+/* Check bytes per codeword for k data bits: r check bits plus parity. */
+static inline int hamming_check_bytes(int k)
+{
+  int r=0;
+  while((1<<r)<r+k+1)
+    r++;
+  return (r+8)/8;
+}
+
+static inline int hamming_is_batch(const unsigned char *p,size_t len)
+{
+  return len>=4 && memcmp(p,HAMMING_PROTO_MAGIC,4)==0;
+}
+
+static inline int hamming_is_bch(int op)
+{
+  return op==HAMMING_OP_BCH_ENCODE || op==HAMMING_OP_BCH_DECODE;
+}
+
+/* Bytes per payload item of a request, or with response set of its
+   response. */
+static inline int hamming_item_bytes(const struct hamming_batch *b,int response)
+{
+  int dataBytes=(b->k+7)/8;
+  int checkBytes=hamming_is_bch(b->op)?bch_ecc_bytes(b->m,b->t):hamming_check_bytes(b->k);
+  int decode=b->op==HAMMING_OP_DECODE || b->op==HAMMING_OP_BCH_DECODE;
+  if (response)
+    return dataBytes+(decode?HAMMING_RESULT_SIZE:checkBytes);
+  return dataBytes+(decode?checkBytes:0);
+}
+
+/* Decodes a request datagram.  Returns -1 if it is truncated, its code
+   parameters are out of range or its payload does not hold count items;
+   b->id is still filled in when the header is complete. */
+static inline int hamming_decode_batch(const unsigned char *p,size_t len,struct hamming_batch *b)
+{
+  memset(b,0,sizeof(*b));
+  if (len<HAMMING_HDR || !hamming_is_batch(p,len))
+    return -1;
+  b->id=hamming_get32(p+4);
+  b->op=p[8];
+  b->k=(uint16_t)(p[10]<<8|p[11]);
+  b->count=(uint16_t)(p[12]<<8|p[13]);
+  b->m=p[14];
+  b->t=p[15];
+  b->payload=p+HAMMING_HDR;
+  if (hamming_is_bch(b->op) ? !bch_params_ok(b->m,b->t,b->k) : b->k<1 || b->k>HAMMING_MAX_DATA)
+    return -1;
+  if ((size_t)b->count*hamming_item_bytes(b,0)!=len-HAMMING_HDR)
+    return -1;
+  return 0;
+}
+
+static inline void hamming_encode_header(unsigned char *p,const struct hamming_batch *b)
+{
+  memcpy(p,HAMMING_PROTO_MAGIC,4);
+  hamming_put32(p+4,b->id);
+  p[8]=b->op;
+  p[9]=b->status;
+  p[10]=(unsigned char)(b->k>>8);
+  p[11]=(unsigned char)b->k;
+  p[12]=(unsigned char)(b->count>>8);
+  p[13]=(unsigned char)b->count;
+  p[14]=b->m;
+  p[15]=b->t;
+}
+
+/* Largest count for which both a request and its response fit one
+   datagram, given the bytes per item of each. */
+static inline int hamming_max_count(int reqBytes,int respBytes)
+{
+  int per=respBytes>reqBytes?respBytes:reqBytes;
+  return (HAMMING_MAX_DGRAM-HAMMING_HDR)/per;
+}
+
+#endif
@@ -6,50 +6,157 @@
 #include<sys/socket.h>
 #include<arpa/inet.h>
 #include<netinet/in.h>
-#include<math.h>
+#include"hamming_proto.h"
 
 #define MAX 100
+#define CODEWORD_MAX (HAMMING_MAX_DATA+HAMMING_MAX_R+2)
 
+/* The code of the last text dataword, rebuilt when the length changes. */
+struct hamming_code textCode;
+struct hamming_code batchCode;
+struct bch_code bchCode;
+unsigned char reply[HAMMING_MAX_DGRAM];
+long batches,encoded,decoded,corrected,doubles,bchBits,bchFailed;
+
+/* Hamming codeword of a '0'/'1' dataword, positions as in the original
+   string encoder; "invalid" for anything else. */
 void hamming(char *dataword,char *codeword)
 {
-  int m=strlen(dataword),power=0;
-  while(pow(2,power)<power+m+1)
-    power++;
-  int sz=m+power;
-  int i,j=0;
-  for(i=0;i<sz;i++)
+  if (hamming_encode_text(&textCode,dataword,codeword,0)<0)
+    strcpy(codeword,"invalid");
+}
+
+/* Check bits of every dataword of an encode batch, each codeword going
+   out as the dataword and its check bytes. */
+void encodeBatch(const struct hamming_batch *b,unsigned char *out)
+{
+  uint64_t data[HAMMING_MAX_WORDS];
+  int dataBytes=(b->k+7)/8,checkBytes=hamming_check_bytes(b->k),i,j;
+  if (b->k==64)
   {
-    if (ceil(log2(sz-i))==floor(log2(sz-i)))
-      codeword[i]='p';
-    else
-      codeword[i]=dataword[j++];
+    for(i=0;i<b->count;i++,out+=9)
+    {
+      memcpy(out,b->payload+8*i,8);
+      out[8]=hamming72_encode(hamming_load64(out));
+    }
+    return;
   }
-  codeword[i]='\0';
-  int bitsCal=0;
-  while(bitsCal<power)
+  for(i=0;i<b->count;i++,out+=dataBytes+checkBytes)
   {
-    int pos=pow(2,bitsCal);
-    int bitsPos=pos;
-    int ones=0;
-    while(bitsPos<=sz)
+    uint32_t check;
+    memcpy(out,b->payload+i*dataBytes,dataBytes);
+    hamming_load(&batchCode,out,data);
+    check=hamming_encode(&batchCode,data);
+    for(j=0;j<checkBytes;j++)
+      out[dataBytes+j]=(unsigned char)(check>>8*(checkBytes-1-j));
+  }
+}
+
+/* Corrects every codeword of a decode batch, each answered with the
+   corrected dataword, the result and the flipped position. */
+void decodeBatch(const struct hamming_batch *b,unsigned char *out)
+{
+  uint64_t data[HAMMING_MAX_WORDS];
+  int dataBytes=(b->k+7)/8,checkBytes=hamming_check_bytes(b->k),i,j;
+  const unsigned char *in=b->payload;
+  for(i=0;i<b->count;i++,in+=dataBytes+checkBytes,out+=dataBytes+HAMMING_RESULT_SIZE)
+  {
+    uint32_t check=0;
+    int pos=0,r;
+    for(j=0;j<checkBytes;j++)
+      check=check<<8|in[dataBytes+j];
+    if (b->k==64)
+    {
+      data[0]=hamming_load64(in);
+      r=hamming72_decode(data,(uint8_t)check,&pos);
+    }
+    else
     {
-      j=0;
-      while(j<pos)
-      {
-        if(codeword[sz-(bitsPos+j)]=='1')
-          ones++;
-        j++;
-      }
-      bitsPos+=2*pos;
+      hamming_load(&batchCode,in,data);
+      r=hamming_decode(&batchCode,data,check,&pos);
     }
-    if (ones%2==0)
-      codeword[sz-pos]='0';
+    for(j=0;j<dataBytes;j++)
+      out[j]=(unsigned char)(data[j/8]>>(56-8*(j%8)));
+    out[dataBytes]=(unsigned char)r;
+    out[dataBytes+1]=0;
+    out[dataBytes+2]=(unsigned char)(pos>>8);
+    out[dataBytes+3]=(unsigned char)pos;
+    corrected+=r==HAMMING_CORRECTED;
+    doubles+=r==HAMMING_DOUBLE;
+  }
+}
+
+/* BCH check bytes of every dataword of an encode batch. */
+void encodeBch(const struct hamming_batch *b,unsigned char *out)
+{
+  int dataBytes=b->k/8,eccBytes=(bchCode.deg+7)/8,i;
+  for(i=0;i<b->count;i++,out+=dataBytes+eccBytes)
+  {
+    memcpy(out,b->payload+i*dataBytes,dataBytes);
+    bch_encode(&bchCode,out,out+dataBytes);
+  }
+}
+
+/* Corrects every codeword of a BCH decode batch, each answered with the
+   corrected dataword, the result and the number of bits flipped back. */
+void decodeBch(const struct hamming_batch *b,unsigned char *out)
+{
+  unsigned char ecc[BCH_WORDS*8];
+  int dataBytes=b->k/8,eccBytes=(bchCode.deg+7)/8,i;
+  const unsigned char *in=b->payload;
+  for(i=0;i<b->count;i++,in+=dataBytes+eccBytes,out+=dataBytes+HAMMING_RESULT_SIZE)
+  {
+    int r;
+    memcpy(out,in,dataBytes);
+    memcpy(ecc,in+dataBytes,eccBytes);
+    r=bch_decode(&bchCode,out,ecc);
+    out[dataBytes]=r==BCH_FAILED?HAMMING_DOUBLE:r?HAMMING_CORRECTED:HAMMING_CLEAN;
+    out[dataBytes+1]=(unsigned char)(r>0?r:0);
+    out[dataBytes+2]=out[dataBytes+3]=0;
+    if (r==BCH_FAILED)
+      bchFailed++;
     else
-      codeword[sz-pos]='1';
-    bitsCal++;
+      bchBits+=r;
   }
 }
 
+/* Answers one "HAMB" batch datagram into reply.  Returns the reply
+   length. */
+int serveBatch(const unsigned char *buf,int len)
+{
+  struct hamming_batch b;
+  int ok=hamming_decode_batch(buf,len,&b);
+  int respBytes=ok<0?0:hamming_item_bytes(&b,1);
+  if (ok<0 || b.count>hamming_max_count(hamming_item_bytes(&b,0),respBytes))
+    b.status=HAMMING_STATUS_BAD_REQUEST;
+  else if (b.op<HAMMING_OP_ENCODE || b.op>HAMMING_OP_BCH_DECODE)
+    b.status=HAMMING_STATUS_BAD_OP;
+  if (b.status!=HAMMING_STATUS_OK)
+  {
+    b.count=0;
+    hamming_encode_header(reply,&b);
+    return HAMMING_HDR;
+  }
+  if (hamming_is_bch(b.op) && (bchCode.m!=b.m || bchCode.t!=b.t || bchCode.k!=b.k))
+    bch_init(&bchCode,b.m,b.t,b.k);
+  else if (!hamming_is_bch(b.op) && b.k!=64 && batchCode.k!=b.k)
+    hamming_init(&batchCode,b.k);
+  switch(b.op)
+  {
+    case HAMMING_OP_ENCODE: encodeBatch(&b,reply+HAMMING_HDR); break;
+    case HAMMING_OP_DECODE: decodeBatch(&b,reply+HAMMING_HDR); break;
+    case HAMMING_OP_BCH_ENCODE: encodeBch(&b,reply+HAMMING_HDR); break;
+    case HAMMING_OP_BCH_DECODE: decodeBch(&b,reply+HAMMING_HDR); break;
+  }
+  if (b.op==HAMMING_OP_ENCODE || b.op==HAMMING_OP_BCH_ENCODE)
+    encoded+=b.count;
+  else
+    decoded+=b.count;
+  hamming_encode_header(reply,&b);
+  batches++;
+  return HAMMING_HDR+b.count*respBytes;
+}
+
 int main(int argc,char **argv)
 {
   char sip_addr[MAX];
@@ -80,11 +187,25 @@ int main(int argc,char **argv)
   printf("Server is Online...\n");
   while(1)
   {
-    char dataword[MAX],codeword[MAX];
-    int len=sizeof(caddr);
-    recvfrom(sid,(void *)&dataword,MAX,0,(struct sockaddr*)&caddr,&len);
+    static char dataword[HAMMING_MAX_DGRAM+1];
+    char codeword[CODEWORD_MAX];
+    socklen_t len=sizeof(caddr);
+    int got=recvfrom(sid,(void *)&dataword,HAMMING_MAX_DGRAM,0,(struct sockaddr*)&caddr,&len);
+    if (got<0)
+      continue;
+    if (hamming_is_batch((unsigned char *)dataword,got))
+    {
+      int n=serveBatch((unsigned char *)dataword,got);
+      sendto(sid,reply,n,0,(struct sockaddr*)&caddr,sizeof(caddr));
+      continue;
+    }
+    dataword[got]='\0';
     if(strcmp(dataword,"end")==0)
     {
+      if (batches)
+        printf("%ld batches, %ld codewords encoded, %ld decoded (Hamming: %ld corrected, %ld double errors;"
+               " BCH: %ld bits corrected, %ld uncorrectable)\n",
+               batches,encoded,decoded,corrected,doubles,bchBits,bchFailed);
       printf("Server terminated...\n");
       break;
     }
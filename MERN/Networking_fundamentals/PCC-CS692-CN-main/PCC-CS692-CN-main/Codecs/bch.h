@@ -0,0 +1,375 @@
+#ifndef CODECS_BCH_H
+#define CODECS_BCH_H
+
+/*
+ * Binary BCH encoder and decoder correcting up to t bits per codeword.
+ *
+ * The code is the narrow-sense primitive BCH code of length n = 2^m-1,
+ * shortened to k data bits: its generator g(x) is the product of the
+ * minimal polynomials of alpha^1..alpha^2t over GF(2^m), and a codeword is
+ * the dataword followed by the deg(g) <= m*t check bits of
+ * d(x)*x^deg mod g(x).  Data bytes are taken MSB first, the first data bit
+ * being the highest power of x.
+ *
+ *   encoding  an LFSR over g(x) stepped a byte at a time through a
+ *             256-entry table, like a table-driven CRC; the register is
+ *             left-aligned in up to BCH_WORDS 64-bit words
+ *   decoding  the same LFSR gives the remainder of the received word;
+ *             zero means clean.  Otherwise the syndromes S_j are the
+ *             remainder evaluated at alpha^j, Berlekamp-Massey turns them
+ *             into the error locator, whose roots are the flipped
+ *             positions: in closed form for one or two errors (a table
+ *             solves y^2+y=c), by a Chien search for more.
+ *
+ * GF(2^m) products go through log/antilog tables.  m runs from BCH_MIN_M
+ * to BCH_MAX_M and t up to BCH_MAX_T; k must be whole bytes.
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+#define BCH_MIN_M 5
+#define BCH_MAX_M 13
+#define BCH_MAX_T 16
+#define BCH_MAX_N ((1<<BCH_MAX_M)-1)
+#define BCH_MAX_ECC (BCH_MAX_M*BCH_MAX_T)
+#define BCH_WORDS ((BCH_MAX_ECC+63)/64)
+
+#define BCH_FAILED (-1)
+
+/* Primitive polynomials of GF(2^m), with the x^m term. */
+static const uint16_t bch_primitive[BCH_MAX_M+1]=
+{
+  0,0,0,0,0,0x25,0x43,0x89,0x11D,0x211,0x409,0x805,0x1053,0x201B,
+};
+
+struct bch_code
+{
+  int m,t,n;                        /* n = 2^m-1 */
+  int k;                            /* data bits, a multiple of 8 */
+  int deg;                          /* check bits, the degree of g(x) */
+  int words;                        /* 64-bit words of the register */
+  uint16_t alog[2*BCH_MAX_N];       /* alpha^i, twice over to skip mod n */
+  uint16_t log[BCH_MAX_N+1];
+  uint64_t gen[BCH_WORDS];          /* g(x) without x^deg, left-aligned */
+  uint64_t table[256][BCH_WORDS];   /* b(x)*x^deg mod g(x) */
+  uint16_t quad[BCH_MAX_N+1];       /* a y with y^2+y = c, 0 if none */
+};
+
+/* Degree of g(x) for m and t: the sizes of the distinct cyclotomic
+   cosets of 1..2t.  Returns -1 if m or t is out of range. */
+static inline int bch_degree(int m,int t)
+{
+  unsigned char seen[BCH_MAX_N+1];
+  int n=(1<<m)-1,deg=0,i;
+  if (m<BCH_MIN_M || m>BCH_MAX_M || t<1 || t>BCH_MAX_T || 2*t>=n)
+    return -1;
+  memset(seen,0,n+1);
+  for(i=1;i<2*t;i+=2)
+  {
+    int j=i;
+    if (seen[i])
+      continue;
+    do
+    {
+      seen[j]=1;
+      deg++;
+      j=2*j%n;
+    }
+    while(j!=i);
+  }
+  return deg;
+}
+
+/* Check bytes per codeword, or -1 if m and t are out of range. */
+static inline int bch_ecc_bytes(int m,int t)
+{
+  int deg=bch_degree(m,t);
+  return deg<0?-1:(deg+7)/8;
+}
+
+/* Whether k data bits fit a codeword of m and t. */
+static inline int bch_params_ok(int m,int t,int k)
+{
+  int deg=bch_degree(m,t);
+  return deg>=0 && k>=8 && k%8==0 && k+deg<=(1<<m)-1;
+}
+
+static inline uint16_t bch_mul(const struct bch_code *c,uint16_t a,uint16_t b)
+{
+  return (a && b)?c->alog[c->log[a]+c->log[b]]:0;
+}
+
+static inline uint16_t bch_div(const struct bch_code *c,uint16_t a,uint16_t b)
+{
+  return a?c->alog[c->log[a]+c->n-c->log[b]]:0;
+}
+
+static inline void bch_shift(uint64_t *r,int words,int bits)
+{
+  int w;
+  for(w=0;w<words-1;w++)
+    r[w]=r[w]<<bits|r[w+1]>>(64-bits);
+  r[w]<<=bits;
+}
+
+/* Builds the code.  Returns -1 on parameters bch_params_ok() rejects. */
+static inline int bch_init(struct bch_code *c,int m,int t,int k)
+{
+  unsigned char seen[BCH_MAX_N+1],g[BCH_MAX_ECC+1];
+  int i,j,b,x=1;
+  memset(c,0,sizeof(*c));
+  if (!bch_params_ok(m,t,k))
+    return -1;
+  c->m=m;
+  c->t=t;
+  c->n=(1<<m)-1;
+  c->k=k;
+  for(i=0;i<c->n;i++)
+  {
+    c->alog[i]=c->alog[i+c->n]=(uint16_t)x;
+    c->log[x]=(uint16_t)i;
+    x<<=1;
+    if (x>>m)
+      x^=bch_primitive[m];
+  }
+
+  for(i=1;i<=c->n;i++)
+    c->quad[bch_mul(c,(uint16_t)i,(uint16_t)i)^i]=(uint16_t)i;
+
+  /* g(x) as one coefficient per byte, times each minimal polynomial. */
+  memset(seen,0,sizeof(seen));
+  memset(g,0,sizeof(g));
+  g[0]=1;
+  for(i=1;i<2*t;i+=2)
+  {
+    uint16_t mp[BCH_MAX_M+1];
+    int d=0,r=i;
+    if (seen[i])
+      continue;
+    memset(mp,0,sizeof(mp));
+    mp[0]=1;
+    do
+    {
+      /* mp *= (x + alpha^r) */
+      seen[r]=1;
+      for(j=++d;j>=0;j--)
+        mp[j]=(uint16_t)((j?mp[j-1]:0)^bch_mul(c,mp[j],c->alog[r]));
+      r=2*r%c->n;
+    }
+    while(r!=i);
+    /* The minimal polynomial has binary coefficients. */
+    for(j=c->deg;j>=0;j--)
+      if (g[j])
+        for(b=d;b>=1;b--)
+          g[j+b]^=(unsigned char)mp[b];
+    c->deg+=d;
+  }
+  c->words=(c->deg+63)/64;
+  for(i=0;i<c->deg;i++)
+    if (g[i])
+    {
+      int p=c->deg-1-i;
+      c->gen[p/64]|=1ull<<(63-p%64);
+    }
+
+  /* The LFSR a bit at a time, run over each byte value. */
+  for(b=0;b<256;b++)
+  {
+    uint64_t *r=c->table[b];
+    for(i=7;i>=0;i--)
+    {
+      int fb=(int)(r[0]>>63)^(b>>i&1);
+      bch_shift(r,c->words,1);
+      if (fb)
+        for(j=0;j<c->words;j++)
+          r[j]^=c->gen[j];
+    }
+  }
+  return 0;
+}
+
+/* The register after len data bytes: d(x)*x^deg mod g(x), left-aligned. */
+static inline void bch_remainder(const struct bch_code *c,const unsigned char *data,size_t len,uint64_t *r)
+{
+  size_t i;
+  int w;
+  memset(r,0,BCH_WORDS*sizeof(uint64_t));
+  if (c->words==1)
+  {
+    for(i=0;i<len;i++)
+      r[0]=r[0]<<8^c->table[(r[0]>>56)^data[i]][0];
+    return;
+  }
+  for(i=0;i<len;i++)
+  {
+    const uint64_t *e=c->table[(r[0]>>56)^data[i]];
+    bch_shift(r,c->words,8);
+    for(w=0;w<c->words;w++)
+      r[w]^=e[w];
+  }
+}
+
+/* Writes the (deg+7)/8 check bytes of k/8 data bytes. */
+static inline void bch_encode(const struct bch_code *c,const unsigned char *data,unsigned char *ecc)
+{
+  uint64_t r[BCH_WORDS];
+  int i;
+  bch_remainder(c,data,c->k/8,r);
+  for(i=0;i<(c->deg+7)/8;i++)
+    ecc[i]=(unsigned char)(r[i/8]>>(56-8*(i%8)));
+}
+
+/* Corrects a codeword in place.  Returns the number of bits flipped back,
+   0 for a clean codeword, or BCH_FAILED when more than t bits are wrong
+   as far as the decoder can tell; the codeword is then left alone. */
+static inline int bch_decode(const struct bch_code *c,unsigned char *data,unsigned char *ecc)
+{
+  uint64_t r[BCH_WORDS],any=0;
+  uint16_t s[2*BCH_MAX_T+1],lam[2*BCH_MAX_T+2],prev[2*BCH_MAX_T+2],tmp[2*BCH_MAX_T+2];
+  int where[BCH_MAX_T];
+  int n=c->n,len=c->k+c->deg,L=0,shift=1,found=0,i,j,w;
+  uint16_t last=1;
+
+  bch_remainder(c,data,c->k/8,r);
+  for(i=0;i<(c->deg+7)/8;i++)
+    r[i/8]^=(uint64_t)ecc[i]<<(56-8*(i%8));
+  /* Pad bits after the last check bit are not part of the code. */
+  if (c->deg%64)
+    r[c->words-1]&=~0ull<<(64-c->deg%64);
+  for(w=0;w<c->words;w++)
+    any|=r[w];
+  if (!any)
+    return 0;
+
+  /* S_j = R(alpha^j) for odd j over the set bits of the remainder, whose
+     top bit is x^(deg-1); S_2j = S_j^2. */
+  memset(s,0,sizeof(s));
+  for(w=0;w<c->words;w++)
+  {
+    uint64_t bits=r[w];
+    while(bits)
+    {
+      int top=__builtin_clzll(bits),e,step;
+      int p=c->deg-1-(64*w+top);
+      bits&=~(1ull<<(63-top));
+      for(j=1,e=p,step=2*p%n;j<2*c->t;j+=2)
+      {
+        s[j]^=c->alog[e];
+        e+=step;
+        if (e>=n)
+          e-=n;
+      }
+    }
+  }
+  for(j=1;j<=c->t;j++)
+    s[2*j]=bch_mul(c,s[j],s[j]);
+
+  /* Berlekamp-Massey: lam is the error locator, prev the last copy of it
+     before its length grew, last the discrepancy it had then. */
+  memset(lam,0,sizeof(lam));
+  memset(prev,0,sizeof(prev));
+  lam[0]=prev[0]=1;
+  for(i=0;i<2*c->t;i++)
+  {
+    uint16_t d=s[i+1],f;
+    for(j=1;j<=L;j++)
+      d^=bch_mul(c,lam[j],s[i+1-j]);
+    if (!d)
+    {
+      shift++;
+      continue;
+    }
+    f=bch_div(c,d,last);
+    memcpy(tmp,lam,sizeof(lam));
+    for(j=0;j+shift<=2*c->t+1;j++)
+      lam[j+shift]^=bch_mul(c,f,prev[j]);
+    if (2*L<=i)
+    {
+      L=i+1-L;
+      memcpy(prev,tmp,sizeof(prev));
+      last=d;
+      shift=1;
+    }
+    else
+      shift++;
+  }
+  if (L==0 || L>c->t || lam[L]==0)
+    return BCH_FAILED;
+
+  /* The error positions p are the logs of the roots X = alpha^p of
+     X^L + lam_1 X^(L-1) + ... + lam_L.  One or two have closed forms. */
+  if (L==1)
+    where[found++]=c->log[lam[1]];
+  else if (L==2 && lam[1])
+  {
+    /* X = lam_1 y turns it into y^2 + y = lam_2/lam_1^2. */
+    uint16_t y=c->quad[bch_div(c,lam[2],bch_mul(c,lam[1],lam[1]))];
+    if (y)
+    {
+      uint16_t x=bch_mul(c,lam[1],y);
+      where[found++]=c->log[x];
+      where[found++]=c->log[x^lam[1]];
+    }
+  }
+  else if (L>2)
+  {
+    /* Chien search: lam(alpha^-p) is zero at each position p in error.
+       Term j adds alpha^(log(lam_j) - p*j) to position p.  One term is
+       added over all positions at a time, in four interleaved runs of
+       exponents so that no single chain of mod-n steps sets the pace. */
+    uint16_t sum[BCH_MAX_N+3];
+    for(i=0;i<len;i++)
+      sum[i]=1;
+    for(j=1;j<=L;j++)
+    {
+      int e0,e1,e2,e3,st=4*j%n;
+      if (!lam[j])
+        continue;
+      e0=c->log[lam[j]];
+      e1=(e0+n-j%n)%n;
+      e2=(e1+n-j%n)%n;
+      e3=(e2+n-j%n)%n;
+      for(i=0;i<len;i+=4)
+      {
+        sum[i]^=c->alog[e0];
+        sum[i+1]^=c->alog[e1];
+        sum[i+2]^=c->alog[e2];
+        sum[i+3]^=c->alog[e3];
+        e0-=st;
+        e0+=n&-(e0<0);
+        e1-=st;
+        e1+=n&-(e1<0);
+        e2-=st;
+        e2+=n&-(e2<0);
+        e3-=st;
+        e3+=n&-(e3<0);
+      }
+    }
+    for(i=0;i<len && found<L;i++)
+      if (!sum[i])
+        where[found++]=i;
+  }
+  for(i=0;i<found;i++)
+    if (where[i]>=len)
+      return BCH_FAILED;
+  if (found!=L)
+    return BCH_FAILED;
+  for(i=0;i<found;i++)
+  {
+    int p=where[i];
+    if (p<c->deg)
+    {
+      p=c->deg-1-p;
+      ecc[p/8]^=(unsigned char)(0x80>>(p%8));
+    }
+    else
+    {
+      p=len-1-p;
+      data[p/8]^=(unsigned char)(0x80>>(p%8));
+    }
+  }
+  return found;
+}
+
+#endif
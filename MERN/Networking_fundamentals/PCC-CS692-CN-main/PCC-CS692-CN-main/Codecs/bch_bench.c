@@ -0,0 +1,160 @@
+/*
+ * bch_bench.c - BCH codec of bch.h against the (72,64) Hamming code of
+ * hamming.h: encode and decode throughput, and what each corrected bit
+ * costs.
+ *
+ *   gcc -O2 bch_bench.c -o bch_bench
+ *   ./bch_bench [MB]
+ *
+ * Every code encodes a buffer of data (default 4 MB), decodes it clean,
+ * then decodes it again with as many bit errors per codeword as it can
+ * correct: one for Hamming, t for BCH.  Every corrected codeword is
+ * checked against the original.  MB/s are of data bytes; "ns/bit" is the
+ * decode time with errors divided by the bits corrected.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"hamming.h"
+#include"bch.h"
+
+#define MIN_SECS 0.2
+
+static struct bch_code code;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static void report(const char *name,size_t bytes,double tEnc,double tClean,double tErr,double bits)
+{
+  printf("%-22s %10.1f %10.1f %10.1f %12.1f %10.1f\n",name,bytes/tEnc/1e6,bytes/tClean/1e6,
+         bytes/tErr/1e6,bits/tErr/1e6,tErr/bits*1e9);
+}
+
+/* (72,64) over 64-bit datawords, one flipped bit per codeword. */
+static int runHamming(const unsigned char *data,size_t len)
+{
+  size_t count=len/8,i;
+  uint64_t *words=malloc(count*8),*work=malloc(count*8);
+  uint8_t *checks=malloc(count),*result=malloc(count);
+  double t0,tEnc,tClean,tErr;
+  long calls;
+  int failed=0;
+  for(i=0;i<count;i++)
+    words[i]=hamming_load64(data+8*i);
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    hamming72_encode_block(words,checks,count);
+  tEnc=(now()-t0)/calls;
+  for(calls=0,tClean=0;calls==0 || tClean<MIN_SECS;calls++)
+  {
+    memcpy(work,words,count*8);
+    t0=now();
+    hamming72_decode_block(work,checks,result,count);
+    tClean+=now()-t0;
+  }
+  tClean/=calls;
+  for(calls=0,tErr=0;calls==0 || tErr<MIN_SECS;calls++)
+  {
+    for(i=0;i<count;i++)
+      work[i]=words[i]^1ull<<(i*7%64);
+    t0=now();
+    hamming72_decode_block(work,checks,result,count);
+    tErr+=now()-t0;
+  }
+  tErr/=calls;
+  if (memcmp(work,words,count*8)!=0)
+  {
+    printf("hamming (72,64) : correction mismatch\n");
+    failed=1;
+  }
+  else
+    report("hamming (72,64)",count*8,tEnc,tClean,tErr,(double)count);
+  free(words);
+  free(work);
+  free(checks);
+  free(result);
+  return failed;
+}
+
+/* BCH with k data bits, t flipped bits per codeword. */
+static int runBch(const unsigned char *data,size_t len,int m,int t,int k)
+{
+  int dataBytes=k/8,eccBytes=bch_ecc_bytes(m,t),cw=dataBytes+eccBytes,failed=0,j;
+  size_t count=len/dataBytes,i;
+  unsigned char *enc=malloc(count*cw),*work=malloc(count*cw);
+  double t0,tEnc,tClean,tErr;
+  long calls;
+  char name[40];
+  if (bch_init(&code,m,t,k)<0 || !enc || !work)
+    return 1;
+  for(i=0;i<count;i++)
+    memcpy(enc+i*cw,data+i*dataBytes,dataBytes);
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    for(i=0;i<count;i++)
+      bch_encode(&code,enc+i*cw,enc+i*cw+dataBytes);
+  tEnc=(now()-t0)/calls;
+  for(calls=0,tClean=0;calls==0 || tClean<MIN_SECS;calls++)
+  {
+    memcpy(work,enc,count*cw);
+    t0=now();
+    for(i=0;i<count;i++)
+      failed|=bch_decode(&code,work+i*cw,work+i*cw+dataBytes)!=0;
+    tClean+=now()-t0;
+  }
+  tClean/=calls;
+  for(calls=0,tErr=0;calls==0 || tErr<MIN_SECS;calls++)
+  {
+    memcpy(work,enc,count*cw);
+    /* t distinct bits spread over data and check bits. */
+    for(i=0;i<count;i++)
+      for(j=0;j<t;j++)
+      {
+        int p=(int)((i*131+j*(k+code.deg)/t)%(k+code.deg));
+        work[i*cw+(p<k?p/8:dataBytes+(p-k)/8)]^=(unsigned char)(0x80>>(p<k?p%8:(p-k)%8));
+      }
+    t0=now();
+    for(i=0;i<count;i++)
+      failed|=bch_decode(&code,work+i*cw,work+i*cw+dataBytes)!=t;
+    tErr+=now()-t0;
+  }
+  tErr/=calls;
+  snprintf(name,sizeof(name),"bch m=%d t=%d k=%d",m,t,k);
+  if (failed || memcmp(work,enc,count*cw)!=0)
+  {
+    printf("%-22s correction mismatch\n",name);
+    failed=1;
+  }
+  else
+    report(name,count*dataBytes,tEnc,tClean,tErr,(double)count*t);
+  free(enc);
+  free(work);
+  return failed;
+}
+
+int main(int argc,char **argv)
+{
+  static const int codes[][3]={{10,2,512},{10,4,512},{10,8,512},{13,2,4096},{13,4,4096},{13,8,4096},{13,16,4096}};
+  size_t len=(argc>1?strtoul(argv[1],NULL,10):4)<<20,i;
+  unsigned char *data=malloc(len);
+  int c,failed=0;
+  if (len==0 || !data)
+  {
+    printf("Usage : %s [MB]\n",argv[0]);
+    return 1;
+  }
+  srand(11);
+  for(i=0;i<len;i++)
+    data[i]=(unsigned char)rand();
+  printf("%-22s %10s %10s %10s %12s %10s\n","code","enc MB/s","clean MB/s","err MB/s","fixed Mbit/s","ns/bit");
+  failed|=runHamming(data,len);
+  for(c=0;c<(int)(sizeof(codes)/sizeof(codes[0]));c++)
+    failed|=runBch(data,len,codes[c][0],codes[c][1],codes[c][2]);
+  free(data);
+  return failed;
+}
@@ -0,0 +1,419 @@
+#ifndef CODECS_CHANNEL_H
+#define CODECS_CHANNEL_H
+
+/*
+ * Noisy-channel models for evaluating the codecs: error masks over a
+ * stream of bits, 64 bits to a word, bit 63 first.
+ *
+ *   CHAN_BSC       binary symmetric: every bit flips with probability p
+ *   CHAN_GILBERT   Gilbert-Elliott bursts: a good and a bad state with
+ *                  their own flip rates, left with probability pgb and
+ *                  pbg after each bit
+ *   erasures       either model over units (packets, shards) instead of
+ *                  bits, through chan_erase()
+ *
+ * Random bits come from sixteen xoshiro256++ generators run side by side,
+ * stepped with AVX2 or in plain C (same output), each lane a jump of 2^128
+ * from the last so that streams for different threads never overlap.
+ * Rates below CHAN_SPARSE are made by skipping: the gap to the next error
+ * is geometric, so the cost is per error rather than per bit.  Higher
+ * rates build each word from a ladder of random words, one AND or OR per
+ * bit of p, taken to 32 bits.  The state of the channel carries over from
+ * one call to the next, so a long stream can be made piece by piece.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include<math.h>
+
+#define CHAN_LANES 16
+#define CHAN_BUF 256                /* random words made per refill */
+#define CHAN_SPARSE (1.0/16)
+
+#define CHAN_BSC 0
+#define CHAN_GILBERT 1
+
+#define CHAN_SCALAR 0
+#define CHAN_AVX2 1
+
+static const char *const chan_kernel_names[]={"scalar","avx2"};
+
+struct chan_model
+{
+  int type;
+  double p;                         /* CHAN_BSC: flip rate */
+  double pgb,pbg;                   /* CHAN_GILBERT: good->bad, bad->good per bit */
+  double eg,eb;                     /* CHAN_GILBERT: flip rate while good, bad */
+};
+
+struct chan_rng
+{
+  uint64_t s[4][CHAN_LANES];        /* word i of the state of each lane */
+  uint64_t buf[CHAN_BUF];
+  int pos;
+};
+
+struct chan
+{
+  struct chan_model model;
+  struct chan_rng rng;
+  int bad;                          /* CHAN_GILBERT state */
+  uint64_t run;                     /* bits left in this state */
+  uint64_t gap;                     /* sparse: bits before the next error */
+  int gapValid;
+  uint64_t bits,errors;             /* totals */
+};
+
+static inline uint64_t chan_rotl(uint64_t x,int k)
+{
+  return x<<k|x>>(64-k);
+}
+
+static inline uint64_t chan_splitmix(uint64_t *x)
+{
+  uint64_t z=(*x+=0x9E3779B97F4A7C15ull);
+  z=(z^z>>30)*0xBF58476D1CE4E5B9ull;
+  z=(z^z>>27)*0x94D049BB133111EBull;
+  return z^z>>31;
+}
+
+static inline uint64_t chan_step(uint64_t s[4])
+{
+  uint64_t r=chan_rotl(s[0]+s[3],23)+s[0],t=s[1]<<17;
+  s[2]^=s[0];
+  s[3]^=s[1];
+  s[1]^=s[2];
+  s[0]^=s[3];
+  s[2]^=t;
+  s[3]=chan_rotl(s[3],45);
+  return r;
+}
+
+/* Advances s by 2^128 steps. */
+static inline void chan_jump(uint64_t s[4])
+{
+  static const uint64_t jump[4]={0x180EC6D33CFD0ABAull,0xD5A61266F0C9392Cull,0xA9582618E03FC9AAull,0x39ABDC4529B1661Cull};
+  uint64_t t[4]={0,0,0,0};
+  int i,b,j;
+  for(i=0;i<4;i++)
+    for(b=0;b<64;b++)
+    {
+      if (jump[i]>>b&1)
+        for(j=0;j<4;j++)
+          t[j]^=s[j];
+      chan_step(s);
+    }
+  memcpy(s,t,sizeof(t));
+}
+
+static inline void chan_fill_scalar(struct chan_rng *r)
+{
+  int i,l;
+  for(i=0;i<CHAN_BUF;i+=CHAN_LANES)
+    for(l=0;l<CHAN_LANES;l++)
+    {
+      uint64_t s[4]={r->s[0][l],r->s[1][l],r->s[2][l],r->s[3][l]};
+      r->buf[i+l]=chan_step(s);
+      r->s[0][l]=s[0];
+      r->s[1][l]=s[1];
+      r->s[2][l]=s[2];
+      r->s[3][l]=s[3];
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+#include<immintrin.h>
+
+static inline int chan_detect(void)
+{
+  unsigned int a,b,c,d,xcr0=0;
+  if (!__get_cpuid(1,&a,&b,&c,&d) || !(c&bit_OSXSAVE) || !(c&bit_AVX))
+    return CHAN_SCALAR;
+  __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+  if ((xcr0&0x6)!=0x6 || !__get_cpuid_count(7,0,&a,&b,&c,&d) || !(b&bit_AVX2))
+    return CHAN_SCALAR;
+  return CHAN_AVX2;
+}
+
+#define CHAN_ROTL256(x,k) _mm256_or_si256(_mm256_slli_epi64(x,k),_mm256_srli_epi64(x,64-(k)))
+
+/* Each four lanes in their own set of registers, so that the sets' chains
+   of dependent steps overlap. */
+__attribute__((target("avx2")))
+static inline void chan_fill_avx2(struct chan_rng *r)
+{
+  __m256i s0[CHAN_LANES/4],s1[CHAN_LANES/4],s2[CHAN_LANES/4],s3[CHAN_LANES/4];
+  int i,h;
+  for(h=0;h<CHAN_LANES/4;h++)
+  {
+    s0[h]=_mm256_loadu_si256((const __m256i *)(r->s[0]+4*h));
+    s1[h]=_mm256_loadu_si256((const __m256i *)(r->s[1]+4*h));
+    s2[h]=_mm256_loadu_si256((const __m256i *)(r->s[2]+4*h));
+    s3[h]=_mm256_loadu_si256((const __m256i *)(r->s[3]+4*h));
+  }
+  for(i=0;i<CHAN_BUF;i+=CHAN_LANES)
+    for(h=0;h<CHAN_LANES/4;h++)
+    {
+      __m256i sum=_mm256_add_epi64(s0[h],s3[h]),t=_mm256_slli_epi64(s1[h],17);
+      _mm256_storeu_si256((__m256i *)(r->buf+i+4*h),_mm256_add_epi64(CHAN_ROTL256(sum,23),s0[h]));
+      s2[h]=_mm256_xor_si256(s2[h],s0[h]);
+      s3[h]=_mm256_xor_si256(s3[h],s1[h]);
+      s1[h]=_mm256_xor_si256(s1[h],s2[h]);
+      s0[h]=_mm256_xor_si256(s0[h],s3[h]);
+      s2[h]=_mm256_xor_si256(s2[h],t);
+      s3[h]=CHAN_ROTL256(s3[h],45);
+    }
+  for(h=0;h<CHAN_LANES/4;h++)
+  {
+    _mm256_storeu_si256((__m256i *)(r->s[0]+4*h),s0[h]);
+    _mm256_storeu_si256((__m256i *)(r->s[1]+4*h),s1[h]);
+    _mm256_storeu_si256((__m256i *)(r->s[2]+4*h),s2[h]);
+    _mm256_storeu_si256((__m256i *)(r->s[3]+4*h),s3[h]);
+  }
+}
+
+#undef CHAN_ROTL256
+
+#else
+
+static inline int chan_detect(void)
+{
+  return CHAN_SCALAR;
+}
+
+#endif
+
+static int chan_tier=-1;
+
+/* Kernel in use; detected on first call, without a data race. */
+static inline int chan_kernel_get(void)
+{
+  int tier=__atomic_load_n(&chan_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=chan_detect();
+    if (!__atomic_compare_exchange_n(&chan_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to compare them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int chan_kernel_set(int tier)
+{
+  if (tier<CHAN_SCALAR || tier>chan_detect())
+    return -1;
+  __atomic_store_n(&chan_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+static inline void chan_rng_refill(struct chan_rng *r)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (chan_kernel_get()==CHAN_AVX2)
+    chan_fill_avx2(r);
+  else
+#endif
+    chan_fill_scalar(r);
+  r->pos=0;
+}
+
+/* Seeds the generator for one stream of a seed: streams 0, 1, ... start
+   CHAN_LANES jumps apart. */
+static inline void chan_rng_seed(struct chan_rng *r,uint64_t seed,unsigned int stream)
+{
+  uint64_t s[4];
+  unsigned int i;
+  int l,w;
+  for(w=0;w<4;w++)
+    s[w]=chan_splitmix(&seed);
+  for(i=0;i<stream*CHAN_LANES;i++)
+    chan_jump(s);
+  for(l=0;l<CHAN_LANES;l++)
+  {
+    for(w=0;w<4;w++)
+      r->s[w][l]=s[w];
+    chan_jump(s);
+  }
+  r->pos=CHAN_BUF;
+}
+
+static inline uint64_t chan_rng_next(struct chan_rng *r)
+{
+  if (r->pos==CHAN_BUF)
+    chan_rng_refill(r);
+  return r->buf[r->pos++];
+}
+
+/* Uniform in (0,1]. */
+static inline double chan_rng_unit(struct chan_rng *r)
+{
+  return ((chan_rng_next(r)>>11)+1)*0x1p-53;
+}
+
+/* Bits before the next event of probability p per bit; UINT64_MAX when p
+   is zero. */
+static inline uint64_t chan_geometric(struct chan_rng *r,double p)
+{
+  double g;
+  if (p<=0)
+    return UINT64_MAX;
+  if (p>=1)
+    return 0;
+  g=log(chan_rng_unit(r))/log1p(-p);
+  return g>=0x1p63?UINT64_MAX:(uint64_t)g;
+}
+
+/* A word whose bits are set with probability q/2^32 each. */
+static inline uint64_t chan_dense_word(struct chan_rng *r,uint32_t q)
+{
+  uint64_t m=0;
+  int b;
+  if (!q)
+    return 0;
+  for(b=__builtin_ctz(q);b<32;b++)
+    m=(q>>b&1)?m|chan_rng_next(r):m&chan_rng_next(r);
+  return m;
+}
+
+/* Bits spent in a Gilbert-Elliott state left with probability p per bit,
+   at least one. */
+static inline uint64_t chan_sojourn(struct chan_rng *r,double p)
+{
+  uint64_t g=chan_geometric(r,p);
+  return g==UINT64_MAX?g:g+1;
+}
+
+static inline void chan_init(struct chan *ch,const struct chan_model *m,uint64_t seed,unsigned int stream)
+{
+  memset(ch,0,sizeof(*ch));
+  ch->model=*m;
+  chan_rng_seed(&ch->rng,seed,stream);
+  ch->run=m->type==CHAN_GILBERT?chan_sojourn(&ch->rng,m->pgb):UINT64_MAX;
+}
+
+/* ORs errors at rate p into bits [pos,pos+n) of mask.  Returns the
+   number set. */
+static inline uint64_t chan_fill_rate(struct chan *ch,uint64_t *mask,uint64_t pos,uint64_t n,double p)
+{
+  uint64_t count=0,end=pos+n;
+  if (p<CHAN_SPARSE)
+  {
+    if (!ch->gapValid)
+    {
+      ch->gap=chan_geometric(&ch->rng,p);
+      ch->gapValid=1;
+    }
+    while(ch->gap<end-pos)
+    {
+      pos+=ch->gap;
+      mask[pos/64]|=1ull<<(63-pos%64);
+      count++;
+      pos++;
+      ch->gap=chan_geometric(&ch->rng,p);
+    }
+    ch->gap-=end-pos;
+    return count;
+  }
+  {
+    uint32_t q=p>=1?0:(uint32_t)(p*0x1p32+0.5);
+    while(pos<end)
+    {
+      int off=(int)(pos%64),take=64-off;
+      uint64_t w=p>=1?~0ull:chan_dense_word(&ch->rng,q),keep;
+      if ((uint64_t)take>end-pos)
+        take=(int)(end-pos);
+      keep=(take==64?~0ull:((1ull<<take)-1)<<(64-off-take));
+      w&=keep;
+      mask[pos/64]|=w;
+      count+=__builtin_popcountll(w);
+      pos+=take;
+    }
+    /* A later sparse stretch must draw its own gap. */
+    ch->gapValid=0;
+    return count;
+  }
+}
+
+/* Error mask for the next 64*words bits of the stream.  Returns the
+   number of errors. */
+static inline uint64_t chan_mask(struct chan *ch,uint64_t *mask,size_t words)
+{
+  uint64_t n=64*(uint64_t)words,pos=0,count=0;
+  memset(mask,0,words*sizeof(uint64_t));
+  if (ch->model.type==CHAN_BSC)
+    count=chan_fill_rate(ch,mask,0,n,ch->model.p);
+  else
+    while(pos<n)
+    {
+      uint64_t take=ch->run<n-pos?ch->run:n-pos;
+      count+=chan_fill_rate(ch,mask,pos,take,ch->bad?ch->model.eb:ch->model.eg);
+      pos+=take;
+      ch->run-=take;
+      if (ch->run==0)
+      {
+        /* The gap is memoryless, so a new state just draws a new one. */
+        ch->bad^=1;
+        ch->run=chan_sojourn(&ch->rng,ch->bad?ch->model.pbg:ch->model.pgb);
+        ch->gapValid=0;
+      }
+    }
+  ch->bits+=n;
+  ch->errors+=count;
+  return count;
+}
+
+/* Bits [pos,pos+n) of a mask, n <= 64, right-aligned. */
+static inline uint64_t chan_bits(const uint64_t *mask,uint64_t pos,int n)
+{
+  uint64_t w=mask[pos/64]<<(pos%64);
+  if (pos%64+n>64)
+    w|=mask[pos/64+1]>>(64-pos%64);
+  return w>>(64-n);
+}
+
+/* Flips the next 8*len bits of the stream into buf, the stream taken in
+   whole words.  Returns the number flipped. */
+static inline uint64_t chan_apply(struct chan *ch,unsigned char *buf,size_t len)
+{
+  uint64_t mask[64],count=0;
+  size_t i,j;
+  for(i=0;i<len;i+=sizeof(mask))
+  {
+    size_t n=len-i<sizeof(mask)?len-i:sizeof(mask);
+    if (chan_mask(ch,mask,(n+7)/8)==0)
+      continue;
+    for(j=0;j<n;j++)
+    {
+      unsigned char e=(unsigned char)(mask[j/8]>>(56-8*(j%8)));
+      buf[i+j]^=e;
+      count+=__builtin_popcount(e);
+    }
+  }
+  return count;
+}
+
+/* Erasure channel: each of units flags is set when the next bit of the
+   stream is in error, so the model's rates are per unit.  Returns the
+   number erased. */
+static inline size_t chan_erase(struct chan *ch,unsigned char *erased,size_t units)
+{
+  uint64_t mask[64];
+  size_t i,j,count=0;
+  for(i=0;i<units;i+=64*64)
+  {
+    size_t n=units-i<64*64?units-i:64*64;
+    chan_mask(ch,mask,(n+63)/64);
+    for(j=0;j<n;j++)
+    {
+      erased[i+j]=(unsigned char)(mask[j/64]>>(63-j%64)&1);
+      count+=erased[i+j];
+    }
+  }
+  return count;
+}
+
+#endif
@@ -0,0 +1,344 @@
+/*
+ * channel_sim.c - residual error rates of the codecs over a noisy channel.
+ *
+ *   gcc -O2 -pthread channel_sim.c -o channel_sim -lm
+ *   ./channel_sim [-p ber | -g pgb,pbg,eg,eb] [-e rate] [-n Mbit] [-j threads] [-s seed]
+ *
+ *   -p ber            binary symmetric channel (default 1e-4)
+ *   -g pgb,pbg,eg,eb  Gilbert-Elliott channel: good->bad and bad->good
+ *                     per bit, then the bit error rate in each state
+ *   -e rate           shard erasure rate for Reed-Solomon (default 0.05)
+ *   -n Mbit           channel bits per codec, in millions (default 1000)
+ *   -j threads        default one per CPU
+ *   -s seed
+ *
+ * Every codec encodes random data, sends it through its own stream of the
+ * channel, decodes it and compares the result with what was sent.  The
+ * frames are
+ *
+ *   parity    a byte and its even parity bit, 9 bits
+ *   hamming   the (72,64) SEC-DED codeword of hamming.h
+ *   crc32c    64 bytes and their CRC-32C, 544 bits
+ *   rs 10+4   a stripe of 14 shards of 256 bytes of rs.h, each shard
+ *             erased or not at the -e rate (i.i.d., or bursty with -g)
+ *
+ * and each frame counts as clean (no errors), corrected, detected (the
+ * decoder rejected it) or undetected (the decoder passed data that
+ * differs).  Gbit/s are channel bits through encode, channel and decode
+ * on all threads.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<pthread.h>
+#include"channel.h"
+#include"hamming.h"
+#include"crc_model.h"
+#include"rs.h"
+
+#define BATCH 4096                  /* frames per channel call, a multiple of 64 */
+#define CRC_FRAME 64
+#define RS_K 10
+#define RS_M 4
+#define RS_SHARD 256
+#define MAX_THREADS 256
+
+enum { PARITY, HAMMING, CRC32C, RS, CODECS };
+
+static const char *const codecNames[CODECS]={"parity","hamming","crc32c","rs 10+4"};
+static const int frameBits[CODECS]={9,72,8*(CRC_FRAME+4),8*RS_SHARD*(RS_K+RS_M)};
+
+struct tally
+{
+  uint64_t frames,clean,corrected,detected,undetected,errors;
+};
+
+struct job
+{
+  int codec;
+  unsigned int stream;
+  uint64_t frames;
+  struct tally t;
+};
+
+static struct chan_model model,erasureModel;
+static uint64_t seed=1;
+static struct rs_code rsCode;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static void randomBytes(struct chan_rng *r,unsigned char *p,size_t len)
+{
+  size_t i;
+  for(i=0;i+8<=len;i+=8)
+  {
+    uint64_t w=chan_rng_next(r);
+    memcpy(p+i,&w,8);
+  }
+  for(;i<len;i++)
+    p[i]=(unsigned char)chan_rng_next(r);
+}
+
+static void runParity(struct chan *ch,uint64_t batches,struct tally *t)
+{
+  static __thread unsigned char data[BATCH],par[BATCH];
+  static __thread uint64_t mask[9*BATCH/64];
+  uint64_t b;
+  int i;
+  for(b=0;b<batches;b++)
+  {
+    randomBytes(&ch->rng,data,BATCH);
+    for(i=0;i<BATCH;i++)
+      par[i]=(unsigned char)(__builtin_popcount(data[i])&1);
+    if (chan_mask(ch,mask,9*BATCH/64)==0)
+    {
+      t->clean+=BATCH;
+      continue;
+    }
+    for(i=0;i<BATCH;i++)
+    {
+      uint64_t e=chan_bits(mask,9*(uint64_t)i,9);
+      unsigned int rx=data[i]^(unsigned int)(e>>1),rp=par[i]^(unsigned int)(e&1);
+      if (!e)
+        t->clean++;
+      else if ((__builtin_popcount(rx)&1)!=(int)rp)
+        t->detected++;
+      else
+        t->undetected++;
+    }
+  }
+}
+
+static void runHamming(struct chan *ch,uint64_t batches,struct tally *t)
+{
+  static __thread uint64_t data[BATCH],rx[BATCH],mask[72*BATCH/64];
+  static __thread uint8_t check[BATCH],result[BATCH];
+  uint64_t b;
+  int i;
+  for(b=0;b<batches;b++)
+  {
+    randomBytes(&ch->rng,(unsigned char *)data,sizeof(data));
+    hamming72_encode_block(data,check,BATCH);
+    if (chan_mask(ch,mask,72*BATCH/64)==0)
+    {
+      t->clean+=BATCH;
+      continue;
+    }
+    for(i=0;i<BATCH;i++)
+    {
+      rx[i]=data[i]^chan_bits(mask,72*(uint64_t)i,64);
+      check[i]^=(uint8_t)chan_bits(mask,72*(uint64_t)i+64,8);
+    }
+    hamming72_decode_block(rx,check,result,BATCH);
+    for(i=0;i<BATCH;i++)
+    {
+      if (!chan_bits(mask,72*(uint64_t)i,64) && !chan_bits(mask,72*(uint64_t)i+64,8))
+        t->clean++;
+      else if (result[i]==HAMMING_DOUBLE)
+        t->detected++;
+      else if (rx[i]==data[i])
+        t->corrected++;
+      else
+        t->undetected++;
+    }
+  }
+}
+
+static void runCrc(struct chan *ch,uint64_t batches,struct tally *t)
+{
+  static __thread unsigned char tx[BATCH*(CRC_FRAME+4)],rx[BATCH*(CRC_FRAME+4)];
+  const size_t frame=CRC_FRAME+4;
+  uint64_t b;
+  int i;
+  for(b=0;b<batches;b++)
+  {
+    randomBytes(&ch->rng,tx,sizeof(tx));
+    for(i=0;i<BATCH;i++)
+    {
+      unsigned char *f=tx+i*frame;
+      uint32_t crc=(uint32_t)crc32c(f,CRC_FRAME);
+      f[CRC_FRAME]=(unsigned char)(crc>>24);
+      f[CRC_FRAME+1]=(unsigned char)(crc>>16);
+      f[CRC_FRAME+2]=(unsigned char)(crc>>8);
+      f[CRC_FRAME+3]=(unsigned char)crc;
+    }
+    memcpy(rx,tx,sizeof(rx));
+    if (chan_apply(ch,rx,sizeof(rx))==0)
+    {
+      t->clean+=BATCH;
+      continue;
+    }
+    for(i=0;i<BATCH;i++)
+    {
+      const unsigned char *f=rx+i*frame;
+      uint32_t crc=(uint32_t)f[CRC_FRAME]<<24|f[CRC_FRAME+1]<<16|f[CRC_FRAME+2]<<8|f[CRC_FRAME+3];
+      if (memcmp(f,tx+i*frame,frame)==0)
+        t->clean++;
+      else if ((uint32_t)crc32c(f,CRC_FRAME)!=crc)
+        t->detected++;
+      else
+        t->undetected++;
+    }
+  }
+}
+
+/* Erasures come from the channel at one error per shard lost. */
+static void runRs(struct chan *ch,uint64_t stripes,struct tally *t)
+{
+  static __thread unsigned char buf[RS_K+RS_M][RS_SHARD],orig[RS_K+RS_M][RS_SHARD];
+  unsigned char erased[RS_K+RS_M],present[RS_K+RS_M];
+  uint8_t *shards[RS_K+RS_M];
+  uint64_t s;
+  int i;
+  for(i=0;i<RS_K+RS_M;i++)
+    shards[i]=buf[i];
+  for(s=0;s<stripes;s++)
+  {
+    size_t lost;
+    randomBytes(&ch->rng,buf[0],RS_K*RS_SHARD);
+    rs_encode(&rsCode,NULL,(const uint8_t *const *)shards,shards+RS_K,RS_SHARD);
+    lost=chan_erase(ch,erased,RS_K+RS_M);
+    t->errors+=lost;
+    if (lost==0)
+    {
+      t->clean++;
+      continue;
+    }
+    if (lost>RS_M)
+    {
+      t->detected++;
+      continue;
+    }
+    memcpy(orig,buf,sizeof(buf));
+    for(i=0;i<RS_K+RS_M;i++)
+    {
+      present[i]=!erased[i];
+      if (erased[i])
+        memset(buf[i],0,RS_SHARD);
+    }
+    if (rs_decode(&rsCode,NULL,shards,present,RS_SHARD)<0)
+      t->detected++;
+    else if (memcmp(orig,buf,sizeof(buf))==0)
+      t->corrected++;
+    else
+      t->undetected++;
+  }
+}
+
+static void *worker(void *arg)
+{
+  struct job *j=(struct job *)arg;
+  struct chan ch;
+  uint64_t units=j->codec==RS?j->frames:j->frames/BATCH;
+  chan_init(&ch,j->codec==RS?&erasureModel:&model,seed,j->stream);
+  switch(j->codec)
+  {
+    case PARITY: runParity(&ch,units,&j->t); break;
+    case HAMMING: runHamming(&ch,units,&j->t); break;
+    case CRC32C: runCrc(&ch,units,&j->t); break;
+    case RS: runRs(&ch,units,&j->t); break;
+  }
+  j->t.frames=j->codec==RS?units:units*BATCH;
+  if (j->codec!=RS)
+    j->t.errors=ch.errors;
+  return NULL;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,"Usage : %s [-p ber | -g pgb,pbg,eg,eb] [-e rate] [-n Mbit] [-j threads] [-s seed]\n",argv0);
+  exit(2);
+}
+
+int main(int argc,char **argv)
+{
+  static struct job jobs[MAX_THREADS];
+  pthread_t tid[MAX_THREADS];
+  double mbits=1000,erasure=0.05;
+  int nthreads=(int)sysconf(_SC_NPROCESSORS_ONLN),opt,codec,i;
+  model.type=CHAN_BSC;
+  model.p=1e-4;
+  while((opt=getopt(argc,argv,"p:g:e:n:j:s:"))!=-1)
+  {
+    switch(opt)
+    {
+      case 'p': model.type=CHAN_BSC; model.p=atof(optarg); break;
+      case 'g':
+        model.type=CHAN_GILBERT;
+        if (sscanf(optarg,"%lf,%lf,%lf,%lf",&model.pgb,&model.pbg,&model.eg,&model.eb)!=4)
+          usage(argv[0]);
+        break;
+      case 'e': erasure=atof(optarg); break;
+      case 'n': mbits=atof(optarg); break;
+      case 'j': nthreads=atoi(optarg); break;
+      case 's': seed=strtoull(optarg,NULL,0); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (nthreads<1 || nthreads>MAX_THREADS || mbits<=0 || model.p<0 || model.p>1 || erasure<0 || erasure>1)
+    usage(argv[0]);
+  /* Erasures follow the bit model scaled to shards: i.i.d. at the -e
+     rate, or with -g the same bursts with -e as the bad-state rate. */
+  erasureModel=model;
+  if (model.type==CHAN_BSC)
+    erasureModel.p=erasure;
+  else
+    erasureModel.eb=erasure;
+  rs_init(&rsCode,RS_K,RS_M);
+
+  if (model.type==CHAN_BSC)
+    printf("BSC, bit error rate %g; shard erasure rate %g\n",model.p,erasure);
+  else
+    printf("Gilbert-Elliott, pgb %g pbg %g, error rate %g good, %g bad; shard erasure rate %g bad\n",
+           model.pgb,model.pbg,model.eg,model.eb,erasure);
+  printf("%-8s %12s %12s %10s %10s %10s %10s %12s %8s\n","codec","frames","errors","clean","corrected","detected",
+         "undetected","residual","Gbit/s");
+  for(codec=0;codec<CODECS;codec++)
+  {
+    struct tally sum;
+    uint64_t frames=(uint64_t)(mbits*1e6/frameBits[codec]);
+    double t0;
+    if (codec!=RS)
+      frames=(frames+BATCH-1)/BATCH*BATCH;
+    t0=now();
+    for(i=0;i<nthreads;i++)
+    {
+      memset(&jobs[i],0,sizeof(jobs[i]));
+      jobs[i].codec=codec;
+      jobs[i].stream=(unsigned int)(codec*nthreads+i);
+      jobs[i].frames=frames/nthreads;
+      if (codec!=RS)
+        jobs[i].frames=jobs[i].frames/BATCH*BATCH;
+      if (i==0)
+        jobs[i].frames+=frames-jobs[i].frames*nthreads;
+    }
+    for(i=1;i<nthreads;i++)
+      pthread_create(&tid[i],NULL,worker,&jobs[i]);
+    worker(&jobs[0]);
+    for(i=1;i<nthreads;i++)
+      pthread_join(tid[i],NULL);
+    memset(&sum,0,sizeof(sum));
+    for(i=0;i<nthreads;i++)
+    {
+      sum.frames+=jobs[i].t.frames;
+      sum.clean+=jobs[i].t.clean;
+      sum.corrected+=jobs[i].t.corrected;
+      sum.detected+=jobs[i].t.detected;
+      sum.undetected+=jobs[i].t.undetected;
+      sum.errors+=jobs[i].t.errors;
+    }
+    printf("%-8s %12llu %12llu %10llu %10llu %10llu %10llu %12.3e %8.2f\n",codecNames[codec],
+           (unsigned long long)sum.frames,(unsigned long long)sum.errors,(unsigned long long)sum.clean,
+           (unsigned long long)sum.corrected,(unsigned long long)sum.detected,(unsigned long long)sum.undetected,
+           (double)sum.undetected/sum.frames,(double)sum.frames*frameBits[codec]/(now()-t0)/1e9);
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * checksum_bench.c - Internet checksum of inet_checksum.h against the
+ * word-at-a-time calculate_checksum() of Assignment4, across buffer sizes,
+ * and RFC 1624 updates against summing the packet again.
+ *
+ *   gcc -O2 checksum_bench.c -o checksum_bench
+ *   ./checksum_bench
+ *
+ * Sizes run from an IPv4 header to 16 MB, odd ones included, each also
+ * one byte off alignment.  Every kernel must give the checksum of a plain
+ * byte-pair sum.  GB/s are of buffer bytes.  The update rows rewrite the
+ * source address of a 20-byte IPv4 header and a 16-bit field of a
+ * 1500-byte packet, checking each updated checksum against a full one.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"reference.h"
+#include"inet_checksum.h"
+
+#define MIN_SECS 0.2
+
+static volatile uint32_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* RFC 1071 over byte pairs in memory order, the obvious way. */
+static uint16_t slowChecksum(const unsigned char *p,size_t len)
+{
+  uint64_t sum=0;
+  size_t i;
+  for(i=0;i+1<len;i+=2)
+  {
+    uint16_t w;
+    memcpy(&w,p+i,2);
+    sum+=w;
+  }
+  if (len&1)
+  {
+    uint16_t w=0;
+    memcpy(&w,p+len-1,1);
+    sum+=w;
+  }
+  return (uint16_t)~inet_csum_fold(sum);
+}
+
+/* Seconds per checksum of len bytes at p; kernel -1 is
+   calculate_checksum(), which needs even length and alignment. */
+static double timeChecksum(int kernel,const unsigned char *p,size_t len)
+{
+  double t0;
+  long calls,reps=len<4096?(long)(65536/len)+1:1,r;
+  if (kernel>=0)
+    inet_kernel_set(kernel);
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    for(r=0;r<reps;r++)
+      sink+=kernel<0?calculate_checksum((const unsigned short *)p,(int)(len/2)):inet_csum(p,len);
+  return (now()-t0)/calls/reps;
+}
+
+/* ns per update and per full checksum after rewriting field bytes at off
+   of a packet of len bytes; -1 if an update disagrees. */
+static int timeUpdate(unsigned char *pkt,size_t len,size_t off,size_t field,double *tUpdate,double *tFull)
+{
+  unsigned char old[16],new[16];
+  uint16_t check=inet_csum(pkt,len);
+  double t0;
+  long i,n=2000000;
+  for(i=0;i<1000;i++)
+  {
+    uint32_t o,v;
+    size_t j;
+    memcpy(old,pkt+off,field);
+    for(j=0;j<field;j++)
+      new[j]=(unsigned char)rand();
+    memcpy(&o,old,4);
+    memcpy(&v,new,4);
+    check=field==4?inet_csum_update32(check,o,v):inet_csum_replace(check,old,new,field);
+    memcpy(pkt+off,new,field);
+    if (check!=inet_csum(pkt,len))
+      return -1;
+  }
+  t0=now();
+  for(i=0;i<n;i++)
+  {
+    uint32_t o,v=(uint32_t)i*2654435761u;
+    memcpy(&o,pkt+off,4);
+    check=field==4?inet_csum_update32(check,o,v):inet_csum_update16(check,(uint16_t)o,(uint16_t)v);
+    memcpy(pkt+off,&v,field);
+  }
+  *tUpdate=(now()-t0)/n*1e9;
+  t0=now();
+  for(i=0;i<n/10;i++)
+  {
+    uint32_t v=(uint32_t)i*2654435761u;
+    memcpy(pkt+off,&v,field);
+    check^=inet_csum(pkt,len);
+  }
+  *tFull=(now()-t0)/(n/10)*1e9;
+  sink+=check;
+  return 0;
+}
+
+int main(void)
+{
+  static const size_t sizes[]={20,64,65,576,1500,1501,9000,65536,1<<20,16<<20};
+  int best=inet_kernel_get(),k,s,failed=0;
+  unsigned char *buf=malloc((16<<20)+64),*pkt;
+  double tu,tf;
+  size_t i;
+  if (!buf)
+    return 1;
+  srand(23);
+  for(i=0;i<(16<<20)+64;i++)
+    buf[i]=(unsigned char)rand();
+
+  printf("%-10s %6s %14s","bytes","offset","calc_checksum");
+  for(k=0;k<=best;k++)
+    printf(" %10s",inet_kernel_names[k]);
+  printf("   GB/s\n");
+  for(s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+  {
+    int off;
+    for(off=0;off<2;off++)
+    {
+      const unsigned char *p=buf+32+off;
+      size_t len=sizes[s];
+      uint16_t want=slowChecksum(p,len);
+      printf("%-10zu %6d",len,off);
+      if (off==0 && len%2==0)
+      {
+        if (calculate_checksum((const unsigned short *)p,(int)(len/2))!=want)
+        {
+          printf("\ncalculate_checksum() disagrees at %zu bytes\n",len);
+          failed=1;
+        }
+        printf(" %14.2f",len/timeChecksum(-1,p,len)/1e9);
+      }
+      else
+        printf(" %14s","-");
+      for(k=0;k<=best;k++)
+      {
+        inet_kernel_set(k);
+        if (inet_csum(p,len)!=want)
+        {
+          printf("\n%s disagrees at %zu bytes, offset %d\n",inet_kernel_names[k],len,off);
+          failed=1;
+        }
+        printf(" %10.2f",len/timeChecksum(k,p,len)/1e9);
+      }
+      printf("\n");
+    }
+  }
+  inet_kernel_set(best);
+
+  /* Pieces at odd offsets joined with inet_csum_combine(). */
+  for(i=1;i<200;i++)
+  {
+    const unsigned char *p=buf+7;
+    uint16_t a=inet_csum_fold(inet_csum_partial(p,i,0)),b=inet_csum_fold(inet_csum_partial(p+i,1500-i,0));
+    uint16_t check=(uint16_t)~inet_csum_combine(a,b,i);
+    if (check!=slowChecksum(p,1500))
+    {
+      printf("inet_csum_combine() disagrees at a split of %zu\n",i);
+      failed=1;
+      break;
+    }
+  }
+
+  pkt=buf+1;
+  if (timeUpdate(pkt,20,12,4,&tu,&tf)<0)
+  {
+    printf("IPv4 address update disagrees\n");
+    failed=1;
+  }
+  else
+    printf("\nIPv4 source rewrite      update %6.1f ns   full %7.1f ns\n",tu,tf);
+  if (timeUpdate(pkt,1500,40,2,&tu,&tf)<0)
+  {
+    printf("16-bit field update disagrees\n");
+    failed=1;
+  }
+  else
+    printf("1500-byte field rewrite  update %6.1f ns   full %7.1f ns\n",tu,tf);
+  free(buf);
+  return failed;
+}
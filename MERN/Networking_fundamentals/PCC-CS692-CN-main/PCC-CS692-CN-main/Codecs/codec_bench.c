@@ -0,0 +1,316 @@
+/*
+ * codec_bench.c - micro-benchmarks of the error-detection routines used
+ * across the Assignment programs, over inputs from 8 bits to 16 MB.
+ *
+ *   gcc -O2 -pthread codec_bench.c -o codec_bench -lm
+ *   ./codec_bench [max size, e.g. 16M] [results file]
+ *
+ * Every codec runs on the same random '0'/'1' input at sizes 8, 32, 128,
+ * ... bits up to the maximum (default 16M bytes, i.e. 128M bits).  Each
+ * point is repeated for at least 0.1 s and reported as ns per input bit,
+ * GB/s and TSC cycles per byte, where a byte is eight input bits.  Once one
+ * call of a codec takes longer than a second its larger sizes are skipped,
+ * which is what stops the quadratic routines.
+ *
+ * Results are also written as JSON (default codec_bench.json) to compare
+ * runs.  To add a codec, give it a run function and a row in codecs[].
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include<x86intrin.h>
+#endif
+#include"crc_cache.h"
+#include"reference.h"
+#include"hamming.h"
+#include"parity.h"
+#include"hdlc.h"
+
+#define CRC32_DIVISOR "100000100110000010001110110110111"
+#define CRC32_WIDTH 32
+#define MIN_SECS 0.1
+#define MAX_CALL_SECS 1.0
+
+/* Buffers shared by every codec at the current size. */
+struct workspace
+{
+  size_t nbits;
+  char *in;                   /* nbits random '0'/'1', NUL-terminated */
+  char *in2;                  /* a second operand of the same length */
+  char *work;                 /* scratch the codec may overwrite */
+  char *out;
+  char rem[128];
+  struct crc_cache cache;
+  uint64_t *packed;           /* in as 64-bit words, MSB first */
+  uint8_t *check;
+  struct hamming_code text;
+};
+
+struct codec
+{
+  const char *name;
+  const char *origin;
+  void (*prepare)(struct workspace *w);   /* once per size, untimed */
+  void (*run)(struct workspace *w);
+};
+
+static volatile char sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static unsigned long long ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static void prepareDividend(struct workspace *w)
+{
+  memcpy(w->work,w->in,w->nbits);
+  memset(w->work+w->nbits,'0',CRC32_WIDTH);
+  w->work[w->nbits+CRC32_WIDTH]='\0';
+}
+
+static void runXorDivision(struct workspace *w)
+{
+  xorDivision(w->work,CRC32_DIVISOR,w->rem);
+}
+
+static void runCRC(struct workspace *w)
+{
+  char rem[CRC32_WIDTH+2];
+  if (crc_cache_codeword(&w->cache,w->in,CRC32_DIVISOR,w->out,rem,w->nbits+CRC32_WIDTH+1)<0)
+    strcpy(w->rem,"invalid");
+  else
+    strcpy(w->rem,rem);
+}
+
+static void runHamming(struct workspace *w)
+{
+  hamming(w->in,w->out);
+  sink=w->out[0];
+}
+
+static void preparePacked(struct workspace *w)
+{
+  size_t i,words=(w->nbits+63)/64;
+  memset(w->packed,0,words*sizeof(uint64_t));
+  for(i=0;i<w->nbits;i++)
+    w->packed[i/64]|=(uint64_t)(w->in[i]-'0')<<(63-i%64);
+}
+
+/* The input as consecutive (72,64) datawords, the last zero-padded. */
+static void runHamming72(struct workspace *w)
+{
+  hamming72_encode_block(w->packed,w->check,(w->nbits+63)/64);
+  sink=w->check[0];
+}
+
+static void runAddBinary(struct workspace *w)
+{
+  add_binary_strings(w->in,w->in2,w->out,(int)w->nbits);
+  sink=w->out[0];
+}
+
+/* parity_append() writes the parity bit and a NUL past the input; both are
+   put back so the next call and the next size see the same data. */
+static void runParity(struct workspace *w)
+{
+  char next=w->in[w->nbits+1];
+  parity_append(w->in);
+  sink=w->in[w->nbits];
+  w->in[w->nbits]='\0';
+  w->in[w->nbits+1]=next;
+}
+
+/* The input bit-packed into work, for parity_bit(). */
+static void prepareParityBytes(struct workspace *w)
+{
+  parity_pack(w->in,w->nbits,(unsigned char *)w->work);
+}
+
+static void runParityBit(struct workspace *w)
+{
+  sink=(char)parity_bit(w->work,w->nbits,0);
+}
+
+static void runBitStuff(struct workspace *w)
+{
+  memcpy(w->work,w->in,w->nbits+1);
+  bit_stuff(w->work);
+  sink=w->work[0];
+}
+
+/* The input bit-packed into work, for hdlc_stuff(). */
+static void prepareHdlc(struct workspace *w)
+{
+  hdlc_pack(w->in,w->nbits,(unsigned char *)w->work);
+}
+
+static void runHdlc(struct workspace *w)
+{
+  struct hdlc_state st;
+  size_t n;
+  hdlc_init(&st);
+  n=hdlc_stuff(&st,w->work,w->nbits,w->out);
+  hdlc_flush(&st,w->out+n);
+  sink=w->out[0];
+}
+
+static const struct codec codecs[]=
+{
+  {"xorDivision","Assignment1/CRC",prepareDividend,runXorDivision},
+  {"CRC","Assignment3/*/server.c",NULL,runCRC},
+  {"hamming","Assignment7/server.c",NULL,runHamming},
+  {"hamming (72,64)","Codecs/hamming.h",preparePacked,runHamming72},
+  {"add_binary_strings","Assignment1/.../CheckSum.c",NULL,runAddBinary},
+  {"parity","Assignment2/server.c",NULL,runParity},
+  {"parity (popcount)","Codecs/parity.h",prepareParityBytes,runParityBit},
+  {"bit_stuff","Assignment5/server.c",NULL,runBitStuff},
+  {"bit stuff (table)","Codecs/hdlc.h",prepareHdlc,runHdlc},
+};
+
+#define NCODECS (sizeof(codecs)/sizeof(codecs[0]))
+
+/* Parses 4096, 64K, 16M, 1G. */
+static size_t parseSize(const char *s)
+{
+  char *end;
+  size_t n=strtoull(s,&end,10);
+  if (*end=='K' || *end=='k')
+    n<<=10;
+  else if (*end=='M' || *end=='m')
+    n<<=20;
+  else if (*end=='G' || *end=='g')
+    n<<=30;
+  return n;
+}
+
+int main(int argc,char **argv)
+{
+  size_t maxbytes=16<<20,maxbits,nbits,i;
+  const char *path="codec_bench.json";
+  int skipped[NCODECS]={0},first=1,failed=0;
+  struct workspace w;
+  struct utsname un;
+  FILE *json;
+  if (argc>1)
+    maxbytes=parseSize(argv[1]);
+  if (argc>2)
+    path=argv[2];
+  maxbits=maxbytes*8;
+  if (maxbits<8)
+  {
+    printf("Usage : %s [max size, e.g. 16M] [results file]\n",argv[0]);
+    return 1;
+  }
+  w.in=malloc(maxbits+2);
+  w.in2=malloc(maxbits+1);
+  w.work=malloc(maxbits+maxbits/5+CRC32_WIDTH+64);
+  w.out=malloc(maxbits+CRC32_WIDTH+128);
+  w.packed=malloc((maxbits+63)/64*sizeof(uint64_t));
+  w.check=malloc((maxbits+63)/64);
+  memset(&w.text,0,sizeof(w.text));
+  json=fopen(path,"w");
+  if (!w.in || !w.in2 || !w.work || !w.out || !w.packed || !w.check || crc_cache_init(&w.cache,4)<0)
+  {
+    printf("Out of memory...\n");
+    return 1;
+  }
+  if (!json)
+  {
+    printf("Cannot write %s...\n",path);
+    return 1;
+  }
+  srand(1);
+  for(i=0;i<maxbits;i++)
+  {
+    w.in[i]=(rand()&1)?'1':'0';
+    w.in2[i]=(rand()&1)?'1':'0';
+  }
+  uname(&un);
+  fprintf(json,"{\n  \"machine\": \"%s %s\",\n  \"crc_kernel\": \"%s\",\n  \"results\": [\n",
+          un.machine,un.release,crc_kernel_names[crc_kernel_get()]);
+
+  printf("%-20s %12s %12s %10s %12s %10s\n","codec","bits","ns/bit","GB/s","cycles/byte","calls");
+  for(nbits=8;nbits<=maxbits;nbits*=4)
+  {
+    char xorRem[128]="",crcRem[128]="";
+    size_t c;
+    w.nbits=nbits;
+    w.in[nbits]='\0';
+    w.in2[nbits]='\0';
+    for(c=0;c<NCODECS;c++)
+    {
+      long calls=0;
+      double t0,t1,secs,bytes=nbits/8.0;
+      unsigned long long k0,k1;
+      if (skipped[c])
+        continue;
+      if (codecs[c].prepare)
+        codecs[c].prepare(&w);
+      t0=now();
+      k0=ticks();
+      do
+      {
+        codecs[c].run(&w);
+        calls++;
+        t1=now();
+      } while(t1-t0<MIN_SECS);
+      k1=ticks();
+      secs=(t1-t0)/calls;
+      if (secs>MAX_CALL_SECS)
+        skipped[c]=1;
+      if (c==0)
+        strcpy(xorRem,w.rem);
+      if (c==1)
+        strcpy(crcRem,w.rem);
+      printf("%-20s %12zu %12.3f %10.4f %12.2f %10ld\n",codecs[c].name,nbits,
+             secs/nbits*1e9,bytes/secs/1e9,(double)(k1-k0)/calls/bytes,calls);
+      fprintf(json,"%s    {\"codec\": \"%s\", \"origin\": \"%s\", \"bits\": %zu, \"ns_per_bit\": %.6g, \"gb_per_s\": %.6g, \"cycles_per_byte\": %.6g, \"calls\": %ld}",
+              first?"":",\n",codecs[c].name,codecs[c].origin,nbits,secs/nbits*1e9,bytes/secs/1e9,(double)(k1-k0)/calls/bytes,calls);
+      first=0;
+    }
+    if (xorRem[0] && crcRem[0] && strcmp(xorRem,crcRem)!=0)
+    {
+      printf("CRC mismatch at %zu bits: %s != %s\n",nbits,crcRem,xorRem);
+      failed=1;
+    }
+    /* The bit-parallel encoder must give the string routine's codeword. */
+    if (nbits<=HAMMING_MAX_DATA)
+    {
+      hamming(w.in,w.out);
+      hamming_encode_text(&w.text,w.in,w.work,0);
+      if (strcmp(w.out,w.work)!=0)
+      {
+        printf("Hamming mismatch at %zu bits\n",nbits);
+        failed=1;
+      }
+    }
+    w.in[nbits]=(rand()&1)?'1':'0';
+    w.in2[nbits]=(rand()&1)?'1':'0';
+  }
+  fprintf(json,"\n  ]\n}\n");
+  fclose(json);
+  printf("\nResults written to %s\n",path);
+  crc_cache_destroy(&w.cache);
+  free(w.in);
+  free(w.in2);
+  free(w.work);
+  free(w.out);
+  free(w.packed);
+  free(w.check);
+  return failed;
+}
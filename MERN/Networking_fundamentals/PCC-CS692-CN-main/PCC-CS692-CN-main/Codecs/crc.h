@@ -0,0 +1,381 @@
+#ifndef CODECS_CRC_H
+#define CODECS_CRC_H
+
+/*
+ * Table-driven CRC engine for generator polynomials of degree 1 to 64.
+ *
+ * The CRC register is kept left-aligned in a uint64_t, so a degree-w
+ * generator P is run as the degree-64 generator P*x^(64-w) and every width
+ * shares one MSB-first slice-by-8 kernel.  The remainder is read back from
+ * the top w bits.  Arithmetic is the plain (non-reflected, zero init) modulo-2
+ * division that the Assignment servers perform on '0'/'1' strings.
+ *
+ * Header only: a server just includes it and is still built with
+ *   gcc -O2 server.c -o server
+ */
+
+#include<stdint.h>
+#include<stddef.h>
+#include<string.h>
+
+#define CRC_MAX_WIDTH 64
+#define CRC_FOLD_STRIDES 5
+
+struct crc_engine
+{
+  int width;                  /* degree of the generator */
+  uint64_t poly;              /* generator without the x^width term */
+  uint64_t apoly;             /* poly left-aligned to bit 63 */
+  uint64_t table[8][256];     /* table[k][b] = b*x^(64+8k) mod P, aligned */
+  uint64_t fold[CRC_FOLD_STRIDES][2]; /* x^(D+64), x^D mod Q for D=16..256 bytes */
+  uint64_t mu;                /* x^128 / Q without the x^64 term */
+};
+
+static inline uint64_t crc_load_be64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v,p,8);
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  v=__builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/* Fills the folding and Barrett constants of an initialised engine. */
+static inline void crc_engine_init_fold(struct crc_engine *e)
+{
+  static const int bytes[CRC_FOLD_STRIDES]={16,32,64,128,256};
+  uint64_t r=1,mu=0;
+  int n,s;
+  for(n=1;n<=256*8+64;n++)
+  {
+    r=(r<<1)^((r>>63)?e->apoly:0);
+    for(s=0;s<CRC_FOLD_STRIDES;s++)
+    {
+      if (n==bytes[s]*8+64)
+        e->fold[s][0]=r;
+      if (n==bytes[s]*8)
+        e->fold[s][1]=r;
+    }
+  }
+  /* Long division of x^128 by Q: quotient bits fall out of the carries. */
+  r=e->apoly;
+  for(n=63;n>=0;n--)
+  {
+    uint64_t carry=r>>63;
+    r<<=1;
+    if (carry)
+    {
+      r^=e->apoly;
+      mu|=1ull<<n;
+    }
+  }
+  e->mu=mu;
+}
+
+/* Builds the slice-by-8 tables for x^width + poly.  Returns -1 for a width
+   outside 0..64; width 0 (divisor "1") yields an empty remainder. */
+static inline int crc_engine_init(struct crc_engine *e,uint64_t poly,int width)
+{
+  int b,k,i;
+  if (width<0 || width>CRC_MAX_WIDTH)
+    return -1;
+  e->width=width;
+  if (width==0)
+  {
+    e->poly=e->apoly=0;
+    memset(e->table,0,sizeof(e->table));
+    memset(e->fold,0,sizeof(e->fold));
+    e->mu=0;
+    return 0;
+  }
+  e->poly=(width==64)?poly:(poly&((1ull<<width)-1));
+  e->apoly=e->poly<<(64-width);
+  for(b=0;b<256;b++)
+  {
+    uint64_t r=(uint64_t)b<<56;
+    for(i=0;i<8;i++)
+      r=(r<<1)^((r>>63)?e->apoly:0);
+    e->table[0][b]=r;
+  }
+  for(k=1;k<8;k++)
+    for(b=0;b<256;b++)
+    {
+      uint64_t r=e->table[k-1][b];
+      e->table[k][b]=(r<<8)^e->table[0][r>>56];
+    }
+  crc_engine_init_fold(e);
+  return 0;
+}
+
+/* Parses a generator written as a '0'/'1' string (MSB first, e.g. "1011")
+   into its degree and the coefficients below it.  Leading zeros are
+   ignored.  Returns -1 if the string is not binary, is all zeros or has
+   degree above 64. */
+static inline int crc_parse_bits(const char *divisor,uint64_t *poly,int *width)
+{
+  uint64_t p=0;
+  int w=-1;
+  for(;*divisor;divisor++)
+  {
+    if (*divisor!='0' && *divisor!='1')
+      return -1;
+    if (w<0)
+    {
+      if (*divisor=='1')
+        w=0;
+      continue;
+    }
+    if (++w>CRC_MAX_WIDTH)
+      return -1;
+    p=(p<<1)|(uint64_t)(*divisor-'0');
+  }
+  if (w<0)
+    return -1;
+  *poly=p;
+  *width=w;
+  return 0;
+}
+
+/* crc_engine_init() from a '0'/'1' generator string. */
+static inline int crc_engine_init_bits(struct crc_engine *e,const char *divisor)
+{
+  uint64_t poly;
+  int width;
+  if (crc_parse_bits(divisor,&poly,&width)<0)
+    return -1;
+  return crc_engine_init(e,poly,width);
+}
+
+/* Shifts one message bit into the aligned register. */
+static inline uint64_t crc_engine_update_bit(const struct crc_engine *e,uint64_t crc,int bit)
+{
+  crc^=(uint64_t)(bit&1)<<63;
+  return (crc<<1)^((crc>>63)?e->apoly:0);
+}
+
+/* Shifts len message bytes into the aligned register, eight at a time. */
+static inline uint64_t crc_engine_update(const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+  if (e->width==0)
+    return 0;
+  while(len>=8)
+  {
+    uint64_t x=crc^crc_load_be64(p);
+    crc=e->table[7][x>>56]^e->table[6][(x>>48)&0xff]
+       ^e->table[5][(x>>40)&0xff]^e->table[4][(x>>32)&0xff]
+       ^e->table[3][(x>>24)&0xff]^e->table[2][(x>>16)&0xff]
+       ^e->table[1][(x>>8)&0xff]^e->table[0][x&0xff];
+    p+=8;
+    len-=8;
+  }
+  while(len--)
+    crc=e->table[0][(crc>>56)^*p++]^(crc<<8);
+  return crc;
+}
+
+/* Right-aligned remainder held in the register. */
+static inline uint64_t crc_engine_final(const struct crc_engine *e,uint64_t crc)
+{
+  return e->width?crc>>(64-e->width):0;
+}
+
+/* a*b mod Q for aligned registers, Q = x^64 + apoly. */
+static inline uint64_t crc_mulmod(uint64_t apoly,uint64_t a,uint64_t b)
+{
+  uint64_t r=0;
+  int i;
+  for(i=63;i>=0;i--)
+  {
+    r=(r<<1)^((r>>63)?apoly:0);
+    if ((b>>i)&1)
+      r^=a;
+  }
+  return r;
+}
+
+/* x^n mod Q by square-and-multiply. */
+static inline uint64_t crc_xpow(uint64_t apoly,uint64_t n)
+{
+  uint64_t r=1,base=2;
+  while(n)
+  {
+    if (n&1)
+      r=crc_mulmod(apoly,r,base);
+    base=crc_mulmod(apoly,base,base);
+    n>>=1;
+  }
+  return r;
+}
+
+/* The register after nbits more zero bits, in O(log nbits) multiplies. */
+static inline uint64_t crc_engine_shift(const struct crc_engine *e,uint64_t crc,uint64_t nbits)
+{
+  return e->width?crc_mulmod(e->apoly,crc,crc_xpow(e->apoly,nbits)):0;
+}
+
+/* Remainder of A followed by B from the right-aligned remainders of A and
+   B on their own, lenB being B's length in bytes. */
+static inline uint64_t crc_combine(const struct crc_engine *e,uint64_t crcA,uint64_t crcB,uint64_t lenB)
+{
+  int shift=64-e->width;
+  if (e->width==0)
+    return 0;
+  return (crc_engine_shift(e,crcA<<shift,lenB*8)^(crcB<<shift))>>shift;
+}
+
+#include"crc_clmul.h"
+
+/*
+ * Streaming CRC over bit-packed data of any length.
+ *
+ * The register only ever holds (message so far)*x^64 mod Q, so it does not
+ * care where byte boundaries fell in the original frame: whole bytes go
+ * through the table/folding kernels and a ragged tail is shifted in bit by
+ * bit.  Bits are packed MSB first, the first bit of the frame being bit 7 of
+ * byte 0.
+ */
+struct crc_stream
+{
+  const struct crc_engine *e;
+  uint64_t reg;               /* aligned register */
+  uint64_t nbits;             /* message bits consumed so far */
+};
+
+static inline void crc_stream_init(struct crc_stream *s,const struct crc_engine *e)
+{
+  s->e=e;
+  s->reg=0;
+  s->nbits=0;
+}
+
+/* Feeds len whole bytes. */
+static inline void crc_stream_update(struct crc_stream *s,const void *buf,size_t len)
+{
+  s->reg=crc_engine_update_fast(s->e,s->reg,buf,len);
+  s->nbits+=(uint64_t)len*8;
+}
+
+/* Feeds the first nbits bits of buf; the unused low bits of the last byte
+   are ignored. */
+static inline void crc_stream_update_bits(struct crc_stream *s,const void *buf,uint64_t nbits)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+  size_t whole=(size_t)(nbits/8);
+  int i;
+  crc_stream_update(s,p,whole);
+  for(i=0;i<(int)(nbits%8);i++)
+    s->reg=crc_engine_update_bit(s->e,s->reg,(p[whole]>>(7-i))&1);
+  s->nbits+=nbits%8;
+}
+
+/* Packs n '0'/'1' characters into n/8 bytes, eight characters per step.
+   Returns -1 if any of them is not a binary digit. */
+static inline int crc_pack_bits(const char *bits,size_t n,unsigned char *out)
+{
+  size_t i;
+  for(i=0;i+8<=n;i+=8)
+  {
+    uint64_t v;
+    memcpy(&v,bits+i,8);
+#if __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+    v=__builtin_bswap64(v);
+#endif
+    if ((v^0x3030303030303030ull)&~0x0101010101010101ull)
+      return -1;
+    /* Gather the low bit of every character, first character to bit 7. */
+    out[i/8]=(unsigned char)(((v&0x0101010101010101ull)*0x8040201008040201ull)>>56);
+  }
+  return 0;
+}
+
+/* Feeds n '0'/'1' characters.  Returns -1 on a non-binary character; the
+   stream is left part-way through and should be discarded. */
+static inline int crc_stream_update_ascii(struct crc_stream *s,const char *bits,size_t n)
+{
+  unsigned char chunk[4096];
+  while(n>=8)
+  {
+    size_t take=n/8<sizeof(chunk)?n/8:sizeof(chunk);
+    if (crc_pack_bits(bits,take*8,chunk)<0)
+      return -1;
+    crc_stream_update(s,chunk,take);
+    bits+=take*8;
+    n-=take*8;
+  }
+  for(;n;n--,bits++)
+  {
+    if (*bits!='0' && *bits!='1')
+      return -1;
+    s->reg=crc_engine_update_bit(s->e,s->reg,*bits-'0');
+    s->nbits++;
+  }
+  return 0;
+}
+
+/* Remainder of (everything fed)*x^width. */
+static inline uint64_t crc_stream_final(const struct crc_stream *s)
+{
+  return crc_engine_final(s->e,s->reg);
+}
+
+/* Remainder of dataword*x^width for a dataword given as nbits '0'/'1'
+   characters.  Returns -1 on a non-binary character. */
+static inline int crc_engine_bitstring(const struct crc_engine *e,const char *bits,size_t nbits,uint64_t *rem)
+{
+  struct crc_stream s;
+  crc_stream_init(&s,e);
+  if (crc_stream_update_ascii(&s,bits,nbits)<0)
+    return -1;
+  *rem=crc_stream_final(&s);
+  return 0;
+}
+
+/* Writes the low nbits of value as a '0'/'1' string, MSB first. */
+static inline void crc_to_bitstring(uint64_t value,int nbits,char *out)
+{
+  int i;
+  for(i=0;i<nbits;i++)
+    out[i]=(i>=nbits-64 && (value>>(nbits-1-i))&1)?'1':'0';
+  out[nbits]='\0';
+}
+
+/*
+ * Fills codeword (dataword followed by the remainder) and remainder for an
+ * engine already built from the divisor.  rbits is strlen(divisor)-1, the
+ * remainder length the original long-division code printed, which is more
+ * than the degree when the divisor has leading zeros.  cap is the size of
+ * the codeword buffer.  Returns -1 on a bad dataword or if the codeword
+ * would not fit.
+ */
+static inline int crc_engine_codeword(const struct crc_engine *e,const char *dataword,size_t rbits,char *codeword,char *remainder,size_t cap)
+{
+  size_t dlen=strlen(dataword);
+  uint64_t rem;
+  if (dlen+rbits+1>cap)
+    return -1;
+  if (crc_engine_bitstring(e,dataword,dlen,&rem)<0)
+    return -1;
+  crc_to_bitstring(rem,(int)rbits,remainder);
+  memcpy(codeword,dataword,dlen);
+  strcpy(codeword+dlen,remainder);
+  return 0;
+}
+
+/*
+ * Drop-in body for the servers' CRC(): builds the engine for divisor and
+ * calls crc_engine_codeword().  remainder needs room for strlen(divisor)
+ * characters.  Returns -1 on a bad dataword/divisor or if the codeword
+ * would not fit.
+ */
+static inline int crc_codeword(const char *dataword,const char *divisor,char *codeword,char *remainder,size_t cap)
+{
+  struct crc_engine e;
+  size_t rlen=strlen(divisor);
+  if (rlen==0 || crc_engine_init_bits(&e,divisor)<0)
+    return -1;
+  return crc_engine_codeword(&e,dataword,rlen-1,codeword,remainder,cap);
+}
+
+#endif
@@ -0,0 +1,477 @@
+/*
+ * crc_bench.c - throughput of the CRC engine against the bit-serial string
+ * division used by Assignment1/CRC and Assignment3.
+ *
+ *   gcc -O2 -pthread crc_bench.c -o crc_bench
+ *   ./crc_bench [threads] [MB]
+ *
+ * Every run first cross-checks each folding kernel the CPU supports against
+ * xorDivision() on random generators, lengths and alignments, and the
+ * streaming API on ragged bit lengths fed in random pieces, then reports
+ * the table engine against the serial division and every kernel in GB/s.
+ * The catalogue models are checked against their published check values
+ * and a bit-at-a-time Rocksoft reference, then timed through their own
+ * kernels and through a runtime-built crc_model_engine.  crc_combine(),
+ * crc_model_combine() and the thread pool are checked against the serial
+ * CRC; with a thread count the pool is also timed on an MB-sized buffer
+ * (default 1024) at 1, 2, 4, ... threads.  The engine cache is hammered
+ * from several threads with more generators than it holds, and a cache hit
+ * is timed against building the engine.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"crc_model.h"
+#include"crc_parallel.h"
+#include"crc_cache.h"
+#include"reference.h"
+
+#define MAX 100
+
+struct generator
+{
+  const char *name;
+  const char *divisor;
+};
+
+static const struct generator generators[]=
+{
+  {"CRC-8","100000111"},
+  {"CRC-16","11000000000000101"},
+  {"CRC-32","100000100110000010001110110110111"},
+  {"CRC-64","10100001011110000111000011110101110101001111010100110100110010011"},
+};
+
+static const size_t sizes[]={1024,4096,65536,1048576};
+static const size_t fold_sizes[]={65536,1048576,16777216};
+
+#define COUNT(a) (sizeof(a)/sizeof((a)[0]))
+
+/* Keeps the timed results alive. */
+static volatile uint64_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* Repeats body for at least 0.2s and stores the seconds per call. */
+#define TIME_LOOP(secs,body) \
+  do \
+  { \
+    long iters=0; \
+    double t0=now(),t1; \
+    do \
+    { \
+      body; \
+      iters++; \
+      t1=now(); \
+    } while(t1-t0<0.2); \
+    secs=(t1-t0)/iters; \
+  } while(0)
+
+/* Spells data followed by width zero bits as a '0'/'1' dividend. */
+static void to_dividend(const unsigned char *data,size_t n,int width,char *dividend)
+{
+  size_t i,nbits=n*8;
+  for(i=0;i<nbits;i++)
+    dividend[i]=((data[i/8]>>(7-i%8))&1)?'1':'0';
+  memset(dividend+nbits,'0',width);
+  dividend[nbits+width]='\0';
+}
+
+/* Random generators, lengths, offsets and split points through every
+   kernel, compared with xorDivision().  Returns the number of mismatches. */
+static int check_kernels(const unsigned char *data,char *dividend)
+{
+  int tiers=crc_kernel_detect(),bad=0,round,tier;
+  for(round=0;round<200;round++)
+  {
+    struct crc_engine e;
+    char divisor[MAX],ref[MAX],got[MAX];
+    int width=1+rand()%CRC_MAX_WIDTH,i;
+    size_t off=rand()%64,n=rand()%4096,split=n?rand()%n:0;
+    divisor[0]='1';
+    for(i=1;i<=width;i++)
+      divisor[i]=(i==width || rand()%2)?'1':'0';
+    divisor[width+1]='\0';
+    crc_engine_init_bits(&e,divisor);
+    to_dividend(data+off,n,width,dividend);
+    xorDivision(dividend,divisor,ref);
+    for(tier=0;tier<=tiers;tier++)
+    {
+      uint64_t crc;
+      crc_kernel_set(tier);
+      crc=crc_engine_update_fast(&e,0,data+off,split);
+      crc=crc_engine_update_fast(&e,crc,data+off+split,n-split);
+      crc_to_bitstring(crc_engine_final(&e,crc),width,got);
+      if (strcmp(ref,got)!=0)
+      {
+        printf("%s mismatch: width %d, %zu bytes at offset %zu: %s != %s\n",
+               crc_kernel_names[tier],width,n,off,got,ref);
+        bad++;
+      }
+    }
+  }
+  crc_kernel_set(tiers);
+  return bad;
+}
+
+/* Ragged bit lengths through crc_stream_update_bits() and through
+   crc_stream_update_ascii() in random pieces, compared with xorDivision(). */
+static int check_stream(const unsigned char *data,char *dividend)
+{
+  int bad=0,round;
+  for(round=0;round<200;round++)
+  {
+    struct crc_engine e;
+    struct crc_stream bits,ascii;
+    char divisor[MAX],ref[MAX],got[MAX];
+    int width=1+rand()%CRC_MAX_WIDTH,i;
+    size_t nbits=rand()%20000,done=0;
+    divisor[0]='1';
+    for(i=1;i<=width;i++)
+      divisor[i]=(i==width || rand()%2)?'1':'0';
+    divisor[width+1]='\0';
+    crc_engine_init_bits(&e,divisor);
+    to_dividend(data,(nbits+7)/8,0,dividend);
+    crc_stream_init(&ascii,&e);
+    while(done<nbits)
+    {
+      size_t piece=1+rand()%(nbits-done);
+      crc_stream_update_ascii(&ascii,dividend+done,piece);
+      done+=piece;
+    }
+    crc_stream_init(&bits,&e);
+    crc_stream_update_bits(&bits,data,nbits);
+    memset(dividend+nbits,'0',width);
+    dividend[nbits+width]='\0';
+    xorDivision(dividend,divisor,ref);
+    crc_to_bitstring(crc_stream_final(&bits),width,got);
+    if (strcmp(ref,got)!=0 || crc_stream_final(&bits)!=crc_stream_final(&ascii) || bits.nbits!=nbits)
+    {
+      printf("stream mismatch: width %d, %zu bits: %s != %s\n",width,nbits,got,ref);
+      bad++;
+    }
+  }
+  return bad;
+}
+
+/* Direct bit-at-a-time Rocksoft algorithm, the reference for the models. */
+static uint64_t model_bitwise(const struct crc_model *m,const unsigned char *p,size_t n)
+{
+  uint64_t mask=m->width==64?~0ull:(1ull<<m->width)-1,reg=m->init&mask;
+  size_t i;
+  int b;
+  for(i=0;i<n;i++)
+    for(b=0;b<8;b++)
+    {
+      int bit=(p[i]>>(m->refin?b:7-b))&1;
+      int feedback=(int)((reg>>(m->width-1))&1)^bit;
+      reg=(reg<<1)&mask;
+      if (feedback)
+        reg^=m->poly;
+    }
+  if (m->refout)
+    reg=crc_reflect(reg,m->width);
+  return (reg^m->xorout)&mask;
+}
+
+/* Check values, the bitwise reference on random lengths and the runtime
+   engine fed in random pieces, for every catalogue model.  Lengths run
+   past CRC_REFLECT_CHUNK and the rounds cycle through every kernel, which
+   reflected models reach through the byte reversal. */
+static int check_models(const unsigned char *data)
+{
+  int bad=0,i,round;
+  for(i=0;i<CRC_MODEL_COUNT;i++)
+  {
+    const struct crc_model *m=&crc_models[i];
+    struct crc_model_engine me;
+    crc_model_engine_init(&me,m);
+    crc_model_engine_update(&me,"123456789",9);
+    if (m->kernel("123456789",9)!=m->check || crc_model_engine_final(&me)!=m->check)
+    {
+      printf("%s check value mismatch: %llx / %llx != %llx\n",m->name,
+             (unsigned long long)m->kernel("123456789",9),
+             (unsigned long long)crc_model_engine_final(&me),(unsigned long long)m->check);
+      bad++;
+    }
+    for(round=0;round<20;round++)
+    {
+      size_t n=round<16?rand()%3000:rand()%(5*CRC_REFLECT_CHUNK),done=0;
+      uint64_t ref=model_bitwise(m,data,n);
+      crc_kernel_set(round%(crc_kernel_detect()+1));
+      crc_model_engine_init(&me,m);
+      while(done<n)
+      {
+        size_t piece=1+rand()%(n-done);
+        crc_model_engine_update(&me,data+done,piece);
+        done+=piece;
+      }
+      if (m->kernel(data,n)!=ref || crc_model_engine_final(&me)!=ref)
+      {
+        printf("%s mismatch at %zu bytes, %s kernel\n",m->name,n,crc_kernel_names[crc_kernel_get()]);
+        bad++;
+      }
+    }
+  }
+  crc_kernel_set(crc_kernel_detect());
+  return bad;
+}
+
+/* Split points through crc_combine()/crc_model_combine() and ragged
+   lengths through small pools, compared with the serial CRC. */
+static int check_combine(const unsigned char *data)
+{
+  int bad=0,round,t;
+  for(round=0;round<200;round++)
+  {
+    struct crc_engine e;
+    const struct crc_model *m=&crc_models[rand()%CRC_MODEL_COUNT];
+    int width=1+rand()%CRC_MAX_WIDTH;
+    size_t n=rand()%8192,split=rand()%(n+1);
+    uint64_t whole,a,b;
+    crc_engine_init(&e,((uint64_t)rand()<<33)^((uint64_t)rand()<<2)^1,width);
+    whole=crc_engine_final(&e,crc_engine_update(&e,0,data,n));
+    a=crc_engine_final(&e,crc_engine_update(&e,0,data,split));
+    b=crc_engine_final(&e,crc_engine_update(&e,0,data+split,n-split));
+    if (crc_combine(&e,a,b,n-split)!=whole)
+    {
+      printf("combine mismatch: width %d, %zu+%zu bytes\n",width,split,n-split);
+      bad++;
+    }
+    if (crc_model_combine(m,m->kernel(data,split),m->kernel(data+split,n-split),n-split)!=m->kernel(data,n))
+    {
+      printf("%s combine mismatch: %zu+%zu bytes\n",m->name,split,n-split);
+      bad++;
+    }
+  }
+  for(t=1;t<=4;t++)
+  {
+    struct crc_pool pool;
+    struct crc_engine e;
+    size_t n=CRC_POOL_MIN_CHUNK*(t+2)+rand()%CRC_POOL_MIN_CHUNK;
+    uint64_t init=((uint64_t)rand()<<40)^rand();
+    crc_engine_init(&e,0x42F0E1EBA9EA3693ull,64);
+    crc_pool_init(&pool,t);
+    if (crc_pool_update(&pool,&e,init,data,n)!=crc_engine_update_fast(&e,init,data,n))
+    {
+      printf("pool mismatch: %d threads, %zu bytes\n",t,n);
+      bad++;
+    }
+    crc_pool_destroy(&pool);
+  }
+  return bad;
+}
+
+struct cache_job
+{
+  struct crc_cache *cache;
+  const unsigned char *data;
+  unsigned int seed;
+  int bad;
+};
+
+/* Random gets over 16 generators through a 4-entry cache; every engine
+   handed out must still compute its own generator's CRC. */
+static void *cache_worker(void *arg)
+{
+  struct cache_job *job=(struct cache_job *)arg;
+  int i;
+  for(i=0;i<20000;i++)
+  {
+    int k=rand_r(&job->seed)%16,width=8+k*3;
+    uint64_t poly=0x9E3779B97F4A7C15ull*(k+1)|1;
+    const struct crc_engine *e=crc_cache_get(job->cache,poly,width,k&1);
+    if (!e || e->width!=width || e->poly!=(poly&((1ull<<width)-1)))
+      job->bad++;
+    else if (i%1000==0)
+    {
+      struct crc_engine fresh;
+      crc_engine_init(&fresh,poly,width);
+      if (!(k&1) && crc_engine_update(e,0,job->data,512)!=crc_engine_update(&fresh,0,job->data,512))
+        job->bad++;
+    }
+    if (e)
+      crc_cache_release(job->cache,e);
+  }
+  return NULL;
+}
+
+static int check_cache(const unsigned char *data)
+{
+  struct crc_cache cache;
+  struct cache_job jobs[4];
+  struct crc_cache_stats st;
+  pthread_t tid[4];
+  int t,bad=0;
+  crc_cache_init(&cache,4);
+  for(t=0;t<4;t++)
+  {
+    jobs[t].cache=&cache;
+    jobs[t].data=data;
+    jobs[t].seed=t+1;
+    jobs[t].bad=0;
+    pthread_create(&tid[t],NULL,cache_worker,&jobs[t]);
+  }
+  for(t=0;t<4;t++)
+  {
+    pthread_join(tid[t],NULL);
+    bad+=jobs[t].bad;
+  }
+  crc_cache_get_stats(&cache,&st);
+  if (st.entries>st.cap || st.hits+st.misses!=80000)
+    bad++;
+  crc_cache_destroy(&cache);
+  return bad;
+}
+
+int main(int argc,char **argv)
+{
+  size_t maxbytes=fold_sizes[COUNT(fold_sizes)-1]+64;
+  unsigned char *data=malloc(maxbytes);
+  char *dividend=malloc(sizes[COUNT(sizes)-1]*8+CRC_MAX_WIDTH+1);
+  size_t i,g,s;
+  int failed=0,tier;
+  if (!data || !dividend)
+  {
+    printf("Out of memory...\n");
+    return 1;
+  }
+  srand(1);
+  for(i=0;i<maxbytes;i++)
+    data[i]=(unsigned char)rand();
+
+  printf("Kernels available : ");
+  for(tier=0;tier<=crc_kernel_detect();tier++)
+    printf("%s ",crc_kernel_names[tier]);
+  printf("\n");
+  failed=check_kernels(data,dividend);
+  printf("Cross-check against xorDivision() : %s\n",failed?"FAILED":"passed");
+  failed+=check_stream(data,dividend);
+  printf("Streaming bit/ASCII check : %s\n",failed?"FAILED":"passed");
+  failed+=check_models(data);
+  printf("CRC model catalogue check : %s\n",failed?"FAILED":"passed");
+  failed+=check_combine(data);
+  printf("Combine / thread pool check : %s\n",failed?"FAILED":"passed");
+  failed+=check_cache(data);
+  printf("Engine cache check : %s\n",failed?"FAILED":"passed");
+  {
+    struct crc_cache cache;
+    struct crc_engine e;
+    double build,hit;
+    crc_cache_init(&cache,64);
+    crc_cache_prewarm_common(&cache);
+    TIME_LOOP(build,crc_engine_init_bits(&e,generators[2].divisor);sink^=e.table[7][1]);
+    TIME_LOOP(hit,crc_cache_release(&cache,crc_cache_get_bits(&cache,generators[2].divisor)));
+    printf("Engine build %.2f us, cache hit %.3f us\n\n",build*1e6,hit*1e6);
+    crc_cache_destroy(&cache);
+  }
+
+  printf("%-8s %10s %14s %14s %10s\n","CRC","bytes","serial MB/s","table MB/s","speedup");
+  for(g=0;g<COUNT(generators);g++)
+  {
+    struct crc_engine e;
+    char divisor[MAX],ref[MAX],got[MAX];
+    int width;
+    strcpy(divisor,generators[g].divisor);
+    crc_engine_init_bits(&e,divisor);
+    width=e.width;
+    for(s=0;s<COUNT(sizes);s++)
+    {
+      size_t n=sizes[s];
+      double serial,table;
+      to_dividend(data,n,width,dividend);
+      xorDivision(dividend,divisor,ref);
+      crc_to_bitstring(crc_engine_final(&e,crc_engine_update(&e,0,data,n)),width,got);
+      if (strcmp(ref,got)!=0)
+      {
+        printf("%s mismatch at %zu bytes: %s != %s\n",generators[g].name,n,got,ref);
+        failed=1;
+        continue;
+      }
+
+      TIME_LOOP(serial,xorDivision(dividend,divisor,ref));
+      TIME_LOOP(table,sink^=crc_engine_update(&e,0,data,n));
+      printf("%-8s %10zu %14.2f %14.2f %9.0fx\n",generators[g].name,n,
+             n/serial/1e6,n/table/1e6,serial/table);
+    }
+  }
+
+  printf("\n%-8s %10s","CRC","bytes");
+  for(tier=0;tier<=crc_kernel_detect();tier++)
+    printf(" %10s",crc_kernel_names[tier]);
+  printf("   (GB/s)\n");
+  for(g=0;g<COUNT(generators);g++)
+  {
+    struct crc_engine e;
+    crc_engine_init_bits(&e,generators[g].divisor);
+    for(s=0;s<COUNT(fold_sizes);s++)
+    {
+      size_t n=fold_sizes[s];
+      printf("%-8s %10zu",generators[g].name,n);
+      for(tier=0;tier<=crc_kernel_detect();tier++)
+      {
+        double secs;
+        crc_kernel_set(tier);
+        TIME_LOOP(secs,sink^=crc_engine_update_fast(&e,0,data,n));
+        printf(" %10.2f",n/secs/1e9);
+      }
+      printf("\n");
+    }
+  }
+
+  printf("\n%-20s %6s %6s %12s %12s   (GB/s, %zu bytes)\n","model","refin","refout","kernel","engine",fold_sizes[0]);
+  for(g=0;g<(size_t)CRC_MODEL_COUNT;g++)
+  {
+    const struct crc_model *m=&crc_models[g];
+    struct crc_model_engine me;
+    size_t n=fold_sizes[0];
+    double kern,eng;
+    crc_model_engine_init(&me,m);
+    TIME_LOOP(kern,sink^=m->kernel(data,n));
+    TIME_LOOP(eng,crc_model_engine_update(&me,data,n);sink^=crc_model_engine_final(&me));
+    printf("%-20s %6d %6d %12.2f %12.2f\n",m->name,m->refin,m->refout,n/kern/1e9,n/eng/1e9);
+  }
+
+  if (argc>1)
+  {
+    int maxthreads=atoi(argv[1]),t;
+    size_t n=(size_t)(argc>2?atol(argv[2]):1024)<<20;
+    unsigned char *big=malloc(n);
+    struct crc_engine e;
+    double one=0;
+    if (!big)
+    {
+      printf("Out of memory...\n");
+      return 1;
+    }
+    for(i=0;i<n;i++)
+      big[i]=data[i%maxbytes];
+    crc_engine_init_bits(&e,generators[2].divisor);
+    printf("\n%-8s %12s %10s %10s   (CRC-32, %zu MB, %s)\n","threads","GB/s","speedup","match",n>>20,crc_kernel_names[crc_kernel_get()]);
+    uint64_t serial=crc_engine_update_fast(&e,0,big,n);
+    for(t=1;t<=maxthreads;t*=2)
+    {
+      struct crc_pool pool;
+      double secs;
+      uint64_t got=0;
+      crc_pool_init(&pool,t-1);
+      TIME_LOOP(secs,got=crc_pool_update(&pool,&e,0,big,n));
+      crc_pool_destroy(&pool);
+      if (t==1)
+        one=secs;
+      printf("%-8d %12.2f %9.2fx %10s\n",t,n/secs/1e9,one/secs,got==serial?"yes":"NO");
+      failed+=got!=serial;
+    }
+    free(big);
+  }
+  free(data);
+  free(dividend);
+  return failed;
+}
@@ -0,0 +1,270 @@
+#ifndef CODECS_CRC_CACHE_H
+#define CODECS_CRC_CACHE_H
+
+/*
+ * Bounded, thread-safe LRU cache of built CRC engines.
+ *
+ * Building an engine (8x256 tables plus folding constants) costs far more
+ * than the CRC of a typical request, and clients reuse a handful of
+ * generators, so the servers look engines up here instead.  Entries are
+ * keyed by the normalised generator (degree and coefficients, leading
+ * zeros of the divisor string dropped) and by the input reflection, the
+ * only model parameter the tables depend on.
+ *
+ * crc_cache_get() hands out a reference; the engine stays valid until the
+ * matching crc_cache_release(), even if it falls off the LRU end in the
+ * meantime.  When every entry is in use the cache briefly holds more than
+ * its capacity and trims back as references are dropped.
+ */
+
+#include<stdlib.h>
+#include<pthread.h>
+#include"crc_model.h"
+
+struct crc_cache_entry
+{
+  struct crc_engine e;
+  int refin;
+  int refs;
+  struct crc_cache_entry *prev,*next;   /* LRU list, most recent first */
+  struct crc_cache_entry *hnext;        /* hash chain */
+};
+
+struct crc_cache
+{
+  pthread_mutex_t lock;
+  int cap,count;
+  unsigned int nbuckets;                /* power of two */
+  struct crc_cache_entry **buckets;
+  struct crc_cache_entry lru;           /* list head */
+  uint64_t hits,misses,evictions;
+};
+
+struct crc_cache_stats
+{
+  uint64_t hits,misses,evictions;
+  int entries,cap;
+};
+
+static inline unsigned int crc_cache_hash(const struct crc_cache *c,uint64_t poly,int width,int refin)
+{
+  uint64_t h=(poly^((uint64_t)width<<1|(uint64_t)(refin&1)))*0x9E3779B97F4A7C15ull;
+  return (unsigned int)(h>>32)&(c->nbuckets-1);
+}
+
+/* Returns -1 if cap is not positive or memory runs out. */
+static inline int crc_cache_init(struct crc_cache *c,int cap)
+{
+  memset(c,0,sizeof(*c));
+  if (cap<1)
+    return -1;
+  c->cap=cap;
+  c->nbuckets=1;
+  while(c->nbuckets<2u*(unsigned int)cap)
+    c->nbuckets<<=1;
+  c->buckets=calloc(c->nbuckets,sizeof(*c->buckets));
+  if (!c->buckets)
+    return -1;
+  c->lru.next=c->lru.prev=&c->lru;
+  pthread_mutex_init(&c->lock,NULL);
+  return 0;
+}
+
+static inline void crc_cache_destroy(struct crc_cache *c)
+{
+  struct crc_cache_entry *x=c->lru.next;
+  while(x!=&c->lru)
+  {
+    struct crc_cache_entry *next=x->next;
+    free(x);
+    x=next;
+  }
+  free(c->buckets);
+  pthread_mutex_destroy(&c->lock);
+}
+
+static inline void crc_cache_unlink(struct crc_cache *c,struct crc_cache_entry *x)
+{
+  struct crc_cache_entry **pp=&c->buckets[crc_cache_hash(c,x->e.poly,x->e.width,x->refin)];
+  while(*pp!=x)
+    pp=&(*pp)->hnext;
+  *pp=x->hnext;
+  x->prev->next=x->next;
+  x->next->prev=x->prev;
+  c->count--;
+}
+
+static inline void crc_cache_push_front(struct crc_cache *c,struct crc_cache_entry *x)
+{
+  x->prev=&c->lru;
+  x->next=c->lru.next;
+  c->lru.next->prev=x;
+  c->lru.next=x;
+}
+
+/* Drops unreferenced entries from the cold end until back within cap.
+   Called with the lock held. */
+static inline void crc_cache_trim(struct crc_cache *c)
+{
+  struct crc_cache_entry *x=c->lru.prev;
+  while(c->count>c->cap && x!=&c->lru)
+  {
+    struct crc_cache_entry *prev=x->prev;
+    if (x->refs==0)
+    {
+      crc_cache_unlink(c,x);
+      free(x);
+      c->evictions++;
+    }
+    x=prev;
+  }
+}
+
+static inline struct crc_cache_entry *crc_cache_find(struct crc_cache *c,uint64_t poly,int width,int refin)
+{
+  struct crc_cache_entry *x=c->buckets[crc_cache_hash(c,poly,width,refin)];
+  while(x && (x->e.poly!=poly || x->e.width!=width || x->refin!=refin))
+    x=x->hnext;
+  return x;
+}
+
+/* Engine for x^width + poly, built on a miss.  refin selects the reflected
+   tables of crc_model.h.  Returns NULL on a bad width or out of memory. */
+static inline const struct crc_engine *crc_cache_get(struct crc_cache *c,uint64_t poly,int width,int refin)
+{
+  struct crc_cache_entry *x,*built;
+  if (width<0 || width>CRC_MAX_WIDTH)
+    return NULL;
+  if (width==0)
+    poly=0;
+  else if (width<64)
+    poly&=(1ull<<width)-1;
+  refin=refin?1:0;
+  pthread_mutex_lock(&c->lock);
+  x=crc_cache_find(c,poly,width,refin);
+  if (x)
+  {
+    c->hits++;
+    x->refs++;
+    x->prev->next=x->next;
+    x->next->prev=x->prev;
+    crc_cache_push_front(c,x);
+    pthread_mutex_unlock(&c->lock);
+    return &x->e;
+  }
+  c->misses++;
+  pthread_mutex_unlock(&c->lock);
+
+  /* Build outside the lock; another thread may insert the same key first. */
+  built=malloc(sizeof(*built));
+  if (!built)
+    return NULL;
+  if (refin)
+    crc_engine_init_reflected(&built->e,poly,width);
+  else
+    crc_engine_init(&built->e,poly,width);
+  built->refin=refin;
+  built->refs=1;
+  pthread_mutex_lock(&c->lock);
+  x=crc_cache_find(c,poly,width,refin);
+  if (x)
+  {
+    x->refs++;
+    free(built);
+  }
+  else
+  {
+    unsigned int h=crc_cache_hash(c,poly,width,refin);
+    x=built;
+    x->hnext=c->buckets[h];
+    c->buckets[h]=x;
+    crc_cache_push_front(c,x);
+    c->count++;
+    crc_cache_trim(c);
+  }
+  pthread_mutex_unlock(&c->lock);
+  return &x->e;
+}
+
+/* crc_cache_get() for a '0'/'1' divisor string. */
+static inline const struct crc_engine *crc_cache_get_bits(struct crc_cache *c,const char *divisor)
+{
+  uint64_t poly;
+  int width;
+  if (crc_parse_bits(divisor,&poly,&width)<0)
+    return NULL;
+  return crc_cache_get(c,poly,width,0);
+}
+
+/* Gives back an engine from crc_cache_get(). */
+static inline void crc_cache_release(struct crc_cache *c,const struct crc_engine *e)
+{
+  struct crc_cache_entry *x=(struct crc_cache_entry *)((char *)e-offsetof(struct crc_cache_entry,e));
+  pthread_mutex_lock(&c->lock);
+  if (--x->refs==0 && c->count>c->cap)
+    crc_cache_trim(c);
+  pthread_mutex_unlock(&c->lock);
+}
+
+/* crc_codeword() with the engine taken from the cache. */
+static inline int crc_cache_codeword(struct crc_cache *c,const char *dataword,const char *divisor,char *codeword,char *remainder,size_t cap)
+{
+  const struct crc_engine *e;
+  size_t rlen=strlen(divisor);
+  int ok;
+  if (rlen==0 || !(e=crc_cache_get_bits(c,divisor)))
+    return -1;
+  ok=crc_engine_codeword(e,dataword,rlen-1,codeword,remainder,cap);
+  crc_cache_release(c,e);
+  return ok;
+}
+
+/* Builds and keeps an engine ahead of the first request.  Returns -1 on a
+   bad generator. */
+static inline int crc_cache_prewarm(struct crc_cache *c,uint64_t poly,int width,int refin)
+{
+  const struct crc_engine *e=crc_cache_get(c,poly,width,refin);
+  if (!e)
+    return -1;
+  crc_cache_release(c,e);
+  return 0;
+}
+
+static inline int crc_cache_prewarm_bits(struct crc_cache *c,const char *divisor)
+{
+  const struct crc_engine *e=crc_cache_get_bits(c,divisor);
+  if (!e)
+    return -1;
+  crc_cache_release(c,e);
+  return 0;
+}
+
+/* Generators most clients ask for: the unreflected tables behind the
+   CRC-8 to CRC-64 entries of the model catalogue. */
+static inline void crc_cache_prewarm_common(struct crc_cache *c)
+{
+  int i;
+  for(i=0;i<CRC_MODEL_COUNT;i++)
+    crc_cache_prewarm(c,crc_models[i].poly,crc_models[i].width,0);
+}
+
+/* Zeroes the counters, e.g. once prewarming is done. */
+static inline void crc_cache_reset_stats(struct crc_cache *c)
+{
+  pthread_mutex_lock(&c->lock);
+  c->hits=c->misses=c->evictions=0;
+  pthread_mutex_unlock(&c->lock);
+}
+
+static inline void crc_cache_get_stats(struct crc_cache *c,struct crc_cache_stats *st)
+{
+  pthread_mutex_lock(&c->lock);
+  st->hits=c->hits;
+  st->misses=c->misses;
+  st->evictions=c->evictions;
+  st->entries=c->count;
+  st->cap=c->cap;
+  pthread_mutex_unlock(&c->lock);
+}
+
+#endif
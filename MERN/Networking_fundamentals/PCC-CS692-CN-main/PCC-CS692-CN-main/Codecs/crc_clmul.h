@@ -0,0 +1,251 @@
+#ifndef CODECS_CRC_CLMUL_H
+#define CODECS_CRC_CLMUL_H
+
+/*
+ * Carry-less multiply folding kernels for the CRC engine in crc.h.
+ *
+ * The aligned register makes every generator a degree-64 polynomial
+ * Q = x^64 + apoly, so one set of kernels covers all widths.  The message is
+ * consumed as 128-bit big-endian lanes; a lane A followed by D more bits is
+ * folded forward as A_hi*(x^(D+64) mod Q) ^ A_lo*(x^D mod Q), and the last
+ * lane is brought down to 64 bits with a Barrett reduction (mu = x^128 / Q).
+ *
+ * Kernels, picked once per process from CPUID:
+ *   avx512  VPCLMULQDQ on zmm, 4 x 64 bytes in flight
+ *   avx2    VPCLMULQDQ on ymm, 4 x 32 bytes in flight
+ *   sse4.2  PCLMULQDQ on xmm, 4 x 16 bytes in flight
+ *   scalar  slice-by-8 tables
+ * Each kernel consumes a whole number of its blocks and reports how many
+ * bytes it took; the tables finish the tail.
+ */
+
+#define CRC_KERNEL_SCALAR 0
+#define CRC_KERNEL_SSE42 1
+#define CRC_KERNEL_AVX2 2
+#define CRC_KERNEL_AVX512 3
+
+static const char *const crc_kernel_names[]={"scalar","sse4.2","avx2","avx512"};
+
+/* Folding only pays off once the start-up and reduction are amortised. */
+#define CRC_FOLD_MIN 256
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+#include<immintrin.h>
+
+/* Highest kernel this CPU and OS can run. */
+static inline int crc_kernel_detect(void)
+{
+  unsigned int a,b,c,d,xcr0=0;
+  int tier=CRC_KERNEL_SCALAR;
+  if (!__get_cpuid(1,&a,&b,&c,&d))
+    return tier;
+  if (!(c&bit_PCLMUL) || !(c&bit_SSE4_2))
+    return tier;
+  tier=CRC_KERNEL_SSE42;
+  if (!(c&bit_OSXSAVE) || !(c&bit_AVX))
+    return tier;
+  __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+  if ((xcr0&0x6)!=0x6 || !__get_cpuid_count(7,0,&a,&b,&c,&d))
+    return tier;
+  if (!(b&bit_AVX2) || !(c&bit_VPCLMULQDQ))
+    return tier;
+  tier=CRC_KERNEL_AVX2;
+  if ((xcr0&0xe6)==0xe6 && (b&bit_AVX512F) && (b&bit_AVX512BW))
+    tier=CRC_KERNEL_AVX512;
+  return tier;
+}
+
+__attribute__((target("pclmul,sse4.2")))
+static inline __m128i crc_fold128(__m128i x,__m128i k)
+{
+  return _mm_xor_si128(_mm_clmulepi64_si128(x,k,0x11),_mm_clmulepi64_si128(x,k,0x00));
+}
+
+/* A*x^64 mod Q for the 128-bit lane A: fold the high half over x^128, then
+   Barrett-reduce the 128-bit result. */
+__attribute__((target("pclmul,sse4.2")))
+static inline uint64_t crc_fold_reduce(const struct crc_engine *e,__m128i x)
+{
+  uint64_t hi=(uint64_t)_mm_extract_epi64(x,1),lo=(uint64_t)_mm_extract_epi64(x,0);
+  __m128i c=_mm_clmulepi64_si128(_mm_set_epi64x(0,(long long)hi),_mm_set_epi64x(0,(long long)e->fold[0][1]),0x00);
+  uint64_t chi=(uint64_t)_mm_extract_epi64(c,1)^lo,clo=(uint64_t)_mm_extract_epi64(c,0);
+  __m128i t=_mm_clmulepi64_si128(_mm_set_epi64x(0,(long long)chi),_mm_set_epi64x(0,(long long)e->mu),0x00);
+  uint64_t q=chi^(uint64_t)_mm_extract_epi64(t,1);
+  t=_mm_clmulepi64_si128(_mm_set_epi64x(0,(long long)q),_mm_set_epi64x(0,(long long)e->apoly),0x00);
+  return clo^(uint64_t)_mm_extract_epi64(t,0);
+}
+
+/* Folds x forward over the remaining whole 16-byte lanes and reduces. */
+__attribute__((target("pclmul,sse4.2")))
+static inline uint64_t crc_fold_finish(const struct crc_engine *e,__m128i x,const unsigned char *p,size_t len,size_t *used)
+{
+  const __m128i swap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m128i k16=_mm_set_epi64x((long long)e->fold[0][0],(long long)e->fold[0][1]);
+  size_t n=0;
+  while(len-n>=16)
+  {
+    x=_mm_xor_si128(crc_fold128(x,k16),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+n)),swap));
+    n+=16;
+  }
+  *used+=n;
+  return crc_fold_reduce(e,x);
+}
+
+__attribute__((target("pclmul,sse4.2")))
+static size_t crc_kernel_sse42(const struct crc_engine *e,uint64_t *crc,const unsigned char *p,size_t len)
+{
+  const __m128i swap=_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m128i k16=_mm_set_epi64x((long long)e->fold[0][0],(long long)e->fold[0][1]);
+  const __m128i k64=_mm_set_epi64x((long long)e->fold[2][0],(long long)e->fold[2][1]);
+  __m128i x0,x1,x2,x3;
+  size_t used=64;
+  x0=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p),swap);
+  x0=_mm_xor_si128(x0,_mm_set_epi64x((long long)*crc,0));
+  x1=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+16)),swap);
+  x2=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+32)),swap);
+  x3=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p+48)),swap);
+  while(len-used>=64)
+  {
+    const unsigned char *q=p+used;
+    x0=_mm_xor_si128(crc_fold128(x0,k64),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)q),swap));
+    x1=_mm_xor_si128(crc_fold128(x1,k64),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(q+16)),swap));
+    x2=_mm_xor_si128(crc_fold128(x2,k64),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(q+32)),swap));
+    x3=_mm_xor_si128(crc_fold128(x3,k64),_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(q+48)),swap));
+    used+=64;
+  }
+  x1=_mm_xor_si128(x1,crc_fold128(x0,k16));
+  x2=_mm_xor_si128(x2,crc_fold128(x1,k16));
+  x3=_mm_xor_si128(x3,crc_fold128(x2,k16));
+  *crc=crc_fold_finish(e,x3,p+used,len-used,&used);
+  return used;
+}
+
+__attribute__((target("avx2,vpclmulqdq,pclmul,sse4.2")))
+static size_t crc_kernel_avx2(const struct crc_engine *e,uint64_t *crc,const unsigned char *p,size_t len)
+{
+  const __m256i swap=_mm256_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,
+                                     0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+  const __m256i k32=_mm256_set_epi64x((long long)e->fold[1][0],(long long)e->fold[1][1],
+                                      (long long)e->fold[1][0],(long long)e->fold[1][1]);
+  const __m256i k128=_mm256_set_epi64x((long long)e->fold[3][0],(long long)e->fold[3][1],
+                                       (long long)e->fold[3][0],(long long)e->fold[3][1]);
+  const __m128i k16=_mm_set_epi64x((long long)e->fold[0][0],(long long)e->fold[0][1]);
+  __m256i y[4];
+  __m128i x;
+  size_t used=128;
+  int i;
+  for(i=0;i<4;i++)
+    y[i]=_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(p+32*i)),swap);
+  y[0]=_mm256_xor_si256(y[0],_mm256_set_epi64x(0,0,(long long)*crc,0));
+  while(len-used>=128)
+  {
+    for(i=0;i<4;i++)
+    {
+      __m256i d=_mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(p+used+32*i)),swap);
+      y[i]=_mm256_xor_si256(_mm256_xor_si256(_mm256_clmulepi64_epi128(y[i],k128,0x11),
+                                             _mm256_clmulepi64_epi128(y[i],k128,0x00)),d);
+    }
+    used+=128;
+  }
+  for(i=1;i<4;i++)
+    y[i]=_mm256_xor_si256(y[i],_mm256_xor_si256(_mm256_clmulepi64_epi128(y[i-1],k32,0x11),
+                                                _mm256_clmulepi64_epi128(y[i-1],k32,0x00)));
+  x=_mm_xor_si128(crc_fold128(_mm256_castsi256_si128(y[3]),k16),_mm256_extracti128_si256(y[3],1));
+  *crc=crc_fold_finish(e,x,p+used,len-used,&used);
+  return used;
+}
+
+__attribute__((target("avx512f,avx512bw,vpclmulqdq,pclmul,sse4.2")))
+static size_t crc_kernel_avx512(const struct crc_engine *e,uint64_t *crc,const unsigned char *p,size_t len)
+{
+  const __m512i swap=_mm512_broadcast_i32x4(_mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15));
+  const __m512i k64=_mm512_broadcast_i32x4(_mm_set_epi64x((long long)e->fold[2][0],(long long)e->fold[2][1]));
+  const __m512i k256=_mm512_broadcast_i32x4(_mm_set_epi64x((long long)e->fold[4][0],(long long)e->fold[4][1]));
+  const __m128i k16=_mm_set_epi64x((long long)e->fold[0][0],(long long)e->fold[0][1]);
+  __m512i z[4];
+  __m128i x;
+  size_t used=256;
+  int i;
+  for(i=0;i<4;i++)
+    z[i]=_mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(p+64*i)),swap);
+  z[0]=_mm512_xor_si512(z[0],_mm512_set_epi64(0,0,0,0,0,0,(long long)*crc,0));
+  while(len-used>=256)
+  {
+    for(i=0;i<4;i++)
+    {
+      __m512i d=_mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(p+used+64*i)),swap);
+      z[i]=_mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z[i],k256,0x11),
+                                     _mm512_clmulepi64_epi128(z[i],k256,0x00),d,0x96);
+    }
+    used+=256;
+  }
+  for(i=1;i<4;i++)
+    z[i]=_mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z[i-1],k64,0x11),
+                                   _mm512_clmulepi64_epi128(z[i-1],k64,0x00),z[i],0x96);
+  x=_mm512_extracti32x4_epi32(z[3],0);
+  x=_mm_xor_si128(crc_fold128(x,k16),_mm512_extracti32x4_epi32(z[3],1));
+  x=_mm_xor_si128(crc_fold128(x,k16),_mm512_extracti32x4_epi32(z[3],2));
+  x=_mm_xor_si128(crc_fold128(x,k16),_mm512_extracti32x4_epi32(z[3],3));
+  *crc=crc_fold_finish(e,x,p+used,len-used,&used);
+  return used;
+}
+
+typedef size_t (*crc_kernel_fn)(const struct crc_engine *,uint64_t *,const unsigned char *,size_t);
+
+static const crc_kernel_fn crc_kernels[]={0,crc_kernel_sse42,crc_kernel_avx2,crc_kernel_avx512};
+static const size_t crc_kernel_block[]={0,64,128,256};
+
+#else
+
+static inline int crc_kernel_detect(void)
+{
+  return CRC_KERNEL_SCALAR;
+}
+
+#endif
+
+static int crc_kernel_tier=-1;
+
+/* Kernel in use; detected on first call.  Threads may race to detect it:
+   the first store wins and a forced kernel is never overwritten. */
+static inline int crc_kernel_get(void)
+{
+  int tier=__atomic_load_n(&crc_kernel_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=crc_kernel_detect();
+    if (!__atomic_compare_exchange_n(&crc_kernel_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to cross-check them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int crc_kernel_set(int tier)
+{
+  if (tier<CRC_KERNEL_SCALAR || tier>crc_kernel_detect())
+    return -1;
+  __atomic_store_n(&crc_kernel_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* crc_engine_update() that folds large buffers with carry-less multiply. */
+static inline uint64_t crc_engine_update_fast(const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+#if defined(__x86_64__) || defined(__i386__)
+  int tier=crc_kernel_get();
+  if (tier!=CRC_KERNEL_SCALAR && e->width && len>=CRC_FOLD_MIN && len>=crc_kernel_block[tier])
+  {
+    size_t used=crc_kernels[tier](e,&crc,p,len);
+    p+=used;
+    len-=used;
+  }
+#endif
+  return crc_engine_update(e,crc,p,len);
+}
+
+#endif
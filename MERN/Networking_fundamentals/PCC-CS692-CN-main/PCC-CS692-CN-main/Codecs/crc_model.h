@@ -0,0 +1,426 @@
+#ifndef CODECS_CRC_MODEL_H
+#define CODECS_CRC_MODEL_H
+
+/*
+ * Rocksoft-style CRC models on top of the engine in crc.h.
+ *
+ * A model is (width, poly, init, refin, refout, xorout), the parameters
+ * every published CRC catalogue uses, so CRC-16/CCITT, CRC-32, CRC-32C and
+ * friends come out bit-for-bit as other systems compute them.
+ *
+ *   refin=0  the left-aligned engine from crc.h, folding kernels included,
+ *            with the register preloaded with init
+ *   refin=1  a right-aligned reflected slice-by-8 engine, bytes consumed
+ *            LSB first, in the same struct crc_engine (table holds the
+ *            reflected slices and apoly the reflected generator)
+ *
+ * A reflected CRC is the plain CRC of the same bytes with their bits
+ * reversed, so reflected input of CRC_FOLD_MIN bytes or more is reversed a
+ * chunk at a time (PSHUFB on nibbles) and folded by a plain engine through
+ * the carry-less multiply kernels of crc_clmul.h; the tables only take
+ * short inputs and the tail.
+ *
+ * Every catalogue entry also gets its own kernel from CRC_MODEL_KERNEL, with
+ * the parameters as constants so the compiler drops the reflection branches
+ * and folds the init/xorout/shift arithmetic.  C has no constexpr tables, so
+ * each kernel builds its engines on first use under pthread_once().  CRC-32C
+ * uses the SSE4.2 crc32 instruction for buffers too short to fold.
+ */
+
+#include<stdlib.h>
+#include<pthread.h>
+#include"crc.h"
+
+struct crc_model
+{
+  const char *name;
+  int width;
+  uint64_t poly;              /* generator without the x^width term */
+  uint64_t init;              /* register before the first bit */
+  int refin;                  /* bytes consumed LSB first */
+  int refout;                 /* remainder reflected before xorout */
+  uint64_t xorout;
+  uint64_t check;             /* CRC of the ASCII string "123456789" */
+  uint64_t (*kernel)(const void *buf,size_t len);
+};
+
+/* Low width bits of v in reverse order. */
+static inline uint64_t crc_reflect(uint64_t v,int width)
+{
+  v=((v>>1)&0x5555555555555555ull)|((v&0x5555555555555555ull)<<1);
+  v=((v>>2)&0x3333333333333333ull)|((v&0x3333333333333333ull)<<2);
+  v=((v>>4)&0x0F0F0F0F0F0F0F0Full)|((v&0x0F0F0F0F0F0F0F0Full)<<4);
+  v=__builtin_bswap64(v);
+  return v>>(64-width);
+}
+
+static inline uint64_t crc_load_le64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v,p,8);
+#if __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+  v=__builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/* Reflected slice-by-8 tables: table[k][b] = b followed by 8k zero bytes,
+   reduced, in the bit-reversed domain. */
+static inline void crc_engine_init_reflected(struct crc_engine *e,uint64_t poly,int width)
+{
+  int b,k,i;
+  e->width=width;
+  e->poly=(width==64)?poly:(poly&((1ull<<width)-1));
+  e->apoly=crc_reflect(e->poly,width);
+  for(b=0;b<256;b++)
+  {
+    uint64_t r=(uint64_t)b;
+    for(i=0;i<8;i++)
+      r=(r>>1)^((r&1)?e->apoly:0);
+    e->table[0][b]=r;
+  }
+  for(k=1;k<8;k++)
+    for(b=0;b<256;b++)
+    {
+      uint64_t r=e->table[k-1][b];
+      e->table[k][b]=(r>>8)^e->table[0][r&0xff];
+    }
+  memset(e->fold,0,sizeof(e->fold));
+  e->mu=0;
+}
+
+/* Shifts len bytes, LSB first, into a reflected register. */
+static inline __attribute__((always_inline)) uint64_t crc_engine_update_reflected(const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+  while(len>=8)
+  {
+    uint64_t x=crc^crc_load_le64(p);
+    crc=e->table[7][x&0xff]^e->table[6][(x>>8)&0xff]
+       ^e->table[5][(x>>16)&0xff]^e->table[4][(x>>24)&0xff]
+       ^e->table[3][(x>>32)&0xff]^e->table[2][(x>>40)&0xff]
+       ^e->table[1][(x>>48)&0xff]^e->table[0][x>>56];
+    p+=8;
+    len-=8;
+  }
+  while(len--)
+    crc=e->table[0][(crc^*p++)&0xff]^(crc>>8);
+  return crc;
+}
+
+/* Bytes bit-reversed per folding call: the stack buffer stays in L1. */
+#define CRC_REFLECT_CHUNK 16384
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* dst[i] = src[i] with its bits reversed, for n a multiple of 32. */
+__attribute__((target("avx2")))
+static void crc_reverse_bytes_avx2(unsigned char *dst,const unsigned char *src,size_t n)
+{
+  const __m256i lo=_mm256_setr_epi8(0x0,0x8,0x4,0xC,0x2,0xA,0x6,0xE,0x1,0x9,0x5,0xD,0x3,0xB,0x7,0xF,
+                                    0x0,0x8,0x4,0xC,0x2,0xA,0x6,0xE,0x1,0x9,0x5,0xD,0x3,0xB,0x7,0xF);
+  const __m256i hi=_mm256_slli_epi16(lo,4),nib=_mm256_set1_epi8(0x0F);
+  size_t i;
+  for(i=0;i<n;i+=32)
+  {
+    __m256i v=_mm256_loadu_si256((const __m256i *)(src+i));
+    v=_mm256_or_si256(_mm256_shuffle_epi8(hi,_mm256_and_si256(v,nib)),
+                      _mm256_shuffle_epi8(lo,_mm256_and_si256(_mm256_srli_epi16(v,4),nib)));
+    _mm256_storeu_si256((__m256i *)(dst+i),v);
+  }
+}
+
+/* The same for n a multiple of 16. */
+__attribute__((target("ssse3")))
+static void crc_reverse_bytes_ssse3(unsigned char *dst,const unsigned char *src,size_t n)
+{
+  const __m128i lo=_mm_setr_epi8(0x0,0x8,0x4,0xC,0x2,0xA,0x6,0xE,0x1,0x9,0x5,0xD,0x3,0xB,0x7,0xF);
+  const __m128i hi=_mm_slli_epi16(lo,4),nib=_mm_set1_epi8(0x0F);
+  size_t i;
+  for(i=0;i<n;i+=16)
+  {
+    __m128i v=_mm_loadu_si128((const __m128i *)(src+i));
+    v=_mm_or_si128(_mm_shuffle_epi8(hi,_mm_and_si128(v,nib)),
+                   _mm_shuffle_epi8(lo,_mm_and_si128(_mm_srli_epi16(v,4),nib)));
+    _mm_storeu_si128((__m128i *)(dst+i),v);
+  }
+}
+
+#endif
+
+/* crc_engine_update_reflected() that folds large buffers: refl is the
+   reflected engine and plain the ordinary one for the same generator. */
+static inline uint64_t crc_engine_update_reflected_fast(const struct crc_engine *plain,const struct crc_engine *refl,uint64_t crc,const void *buf,size_t len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+#if defined(__x86_64__) || defined(__i386__)
+  int tier=crc_kernel_get(),shift=64-refl->width;
+  if (tier!=CRC_KERNEL_SCALAR && len>=CRC_FOLD_MIN)
+  {
+    unsigned char tmp[CRC_REFLECT_CHUNK] __attribute__((aligned(64)));
+    uint64_t reg=crc_reflect(crc,refl->width)<<shift;
+    while(len>=CRC_FOLD_MIN)
+    {
+      size_t n=(len<CRC_REFLECT_CHUNK?len:CRC_REFLECT_CHUNK)&~(size_t)63;
+      if (tier>=CRC_KERNEL_AVX2)
+        crc_reverse_bytes_avx2(tmp,p,n);
+      else
+        crc_reverse_bytes_ssse3(tmp,p,n);
+      reg=crc_engine_update_fast(plain,reg,tmp,n);
+      p+=n;
+      len-=n;
+    }
+    crc=crc_reflect(reg>>shift,refl->width);
+  }
+#endif
+  return crc_engine_update_reflected(refl,crc,p,len);
+}
+
+/* Builds whichever engine the model's input reflection calls for, and for
+   reflected input the plain engine that folds it. */
+static inline void crc_model_build(struct crc_engine *e,struct crc_engine *plain,uint64_t poly,int width,int refin)
+{
+  if (refin)
+  {
+    crc_engine_init_reflected(e,poly,width);
+    crc_engine_init(plain,poly,width);
+  }
+  else
+    crc_engine_init(e,poly,width);
+}
+
+/* Register holding init, in the engine's alignment. */
+static inline __attribute__((always_inline)) uint64_t crc_model_start(int width,uint64_t init,int refin)
+{
+  return refin?crc_reflect(init,width):init<<(64-width);
+}
+
+static inline __attribute__((always_inline)) uint64_t crc_model_run(const struct crc_engine *e,const struct crc_engine *plain,int refin,uint64_t reg,const void *buf,size_t len)
+{
+  return refin?crc_engine_update_reflected_fast(plain,e,reg,buf,len):crc_engine_update_fast(e,reg,buf,len);
+}
+
+/* Right-aligned CRC value from the register. */
+static inline __attribute__((always_inline)) uint64_t crc_model_finish(int width,int refin,int refout,uint64_t xorout,uint64_t reg)
+{
+  uint64_t v=refin?reg:reg>>(64-width);
+  if (refin!=refout)
+    v=crc_reflect(v,width);
+  return (v^xorout)&(width==64?~0ull:(1ull<<width)-1);
+}
+
+/*
+ * Defines fn(buf,len) computing one fixed model.  The tables live in static
+ * engines built the first time fn runs; fn##_plain is only built, and only
+ * touched, for reflected input.
+ */
+#define CRC_MODEL_KERNEL(fn,width,poly,init,refin,refout,xorout) \
+  static struct crc_engine fn##_engine,fn##_plain; \
+  static pthread_once_t fn##_once=PTHREAD_ONCE_INIT; \
+  static void fn##_build(void) \
+  { \
+    crc_model_build(&fn##_engine,&fn##_plain,(poly),(width),(refin)); \
+  } \
+  static inline uint64_t fn(const void *buf,size_t len) \
+  { \
+    uint64_t reg; \
+    pthread_once(&fn##_once,fn##_build); \
+    reg=crc_model_run(&fn##_engine,&fn##_plain,(refin),crc_model_start((width),(init),(refin)),buf,len); \
+    return crc_model_finish((width),(refin),(refout),(xorout),reg); \
+  }
+
+CRC_MODEL_KERNEL(crc8_smbus,8,0x07,0,0,0,0)
+CRC_MODEL_KERNEL(crc8_maxim,8,0x31,0,1,1,0)
+CRC_MODEL_KERNEL(crc12_umts,12,0x80F,0,0,1,0)
+CRC_MODEL_KERNEL(crc16_arc,16,0x8005,0,1,1,0)
+CRC_MODEL_KERNEL(crc16_ccitt_false,16,0x1021,0xFFFF,0,0,0)
+CRC_MODEL_KERNEL(crc16_kermit,16,0x1021,0,1,1,0)
+CRC_MODEL_KERNEL(crc16_modbus,16,0x8005,0xFFFF,1,1,0)
+CRC_MODEL_KERNEL(crc16_xmodem,16,0x1021,0,0,0,0)
+CRC_MODEL_KERNEL(crc32_iso_hdlc,32,0x04C11DB7,0xFFFFFFFF,1,1,0xFFFFFFFF)
+CRC_MODEL_KERNEL(crc32c_table,32,0x1EDC6F41,0xFFFFFFFF,1,1,0xFFFFFFFF)
+CRC_MODEL_KERNEL(crc32_bzip2,32,0x04C11DB7,0xFFFFFFFF,0,0,0xFFFFFFFF)
+CRC_MODEL_KERNEL(crc32_mpeg2,32,0x04C11DB7,0xFFFFFFFF,0,0,0)
+CRC_MODEL_KERNEL(crc64_ecma182,64,0x42F0E1EBA9EA3693ull,0,0,0,0)
+CRC_MODEL_KERNEL(crc64_xz,64,0x42F0E1EBA9EA3693ull,~0ull,1,1,~0ull)
+
+#if defined(__x86_64__)
+
+/* CRC-32C with the SSE4.2 crc32 instruction, which implements exactly the
+   reflected Castagnoli register update.  Its one-instruction dependency
+   chain tops out near 8 GB/s, so from CRC32C_FOLD_MIN bytes the folding
+   kernels win. */
+#define CRC32C_FOLD_MIN 1024
+
+__attribute__((target("sse4.2"))) static uint64_t crc32c_sse42(const void *buf,size_t len)
+{
+  const unsigned char *p=(const unsigned char *)buf;
+  uint64_t crc=0xFFFFFFFF;
+  while(len>=8)
+  {
+    crc=__builtin_ia32_crc32di(crc,crc_load_le64(p));
+    p+=8;
+    len-=8;
+  }
+  while(len--)
+    crc=__builtin_ia32_crc32qi((unsigned int)crc,*p++);
+  return crc^0xFFFFFFFF;
+}
+
+static int crc32c_hw;
+static pthread_once_t crc32c_once=PTHREAD_ONCE_INIT;
+
+static void crc32c_detect(void)
+{
+  crc32c_hw=__builtin_cpu_supports("sse4.2")?1:0;
+}
+
+static inline uint64_t crc32c(const void *buf,size_t len)
+{
+  pthread_once(&crc32c_once,crc32c_detect);
+  if (crc32c_hw && (len<CRC32C_FOLD_MIN || crc_kernel_get()==CRC_KERNEL_SCALAR))
+    return crc32c_sse42(buf,len);
+  return crc32c_table(buf,len);
+}
+
+#else
+
+static inline uint64_t crc32c(const void *buf,size_t len)
+{
+  return crc32c_table(buf,len);
+}
+
+#endif
+
+/* Catalogue; a model's id on the wire is its index plus one, 0 meaning a
+   raw generator. */
+static const struct crc_model crc_models[]=
+{
+  {"CRC-8/SMBUS",8,0x07,0,0,0,0,0xF4,crc8_smbus},
+  {"CRC-8/MAXIM",8,0x31,0,1,1,0,0xA1,crc8_maxim},
+  {"CRC-12/UMTS",12,0x80F,0,0,1,0,0xDAF,crc12_umts},
+  {"CRC-16/ARC",16,0x8005,0,1,1,0,0xBB3D,crc16_arc},
+  {"CRC-16/CCITT-FALSE",16,0x1021,0xFFFF,0,0,0,0x29B1,crc16_ccitt_false},
+  {"CRC-16/KERMIT",16,0x1021,0,1,1,0,0x2189,crc16_kermit},
+  {"CRC-16/MODBUS",16,0x8005,0xFFFF,1,1,0,0x4B37,crc16_modbus},
+  {"CRC-16/XMODEM",16,0x1021,0,0,0,0,0x31C3,crc16_xmodem},
+  {"CRC-32",32,0x04C11DB7,0xFFFFFFFF,1,1,0xFFFFFFFF,0xCBF43926,crc32_iso_hdlc},
+  {"CRC-32C",32,0x1EDC6F41,0xFFFFFFFF,1,1,0xFFFFFFFF,0xE3069283,crc32c},
+  {"CRC-32/BZIP2",32,0x04C11DB7,0xFFFFFFFF,0,0,0xFFFFFFFF,0xFC891918,crc32_bzip2},
+  {"CRC-32/MPEG-2",32,0x04C11DB7,0xFFFFFFFF,0,0,0,0x0376E6E7,crc32_mpeg2},
+  {"CRC-64/ECMA-182",64,0x42F0E1EBA9EA3693ull,0,0,0,0,0x6C40DF5F0B497347ull,crc64_ecma182},
+  {"CRC-64/XZ",64,0x42F0E1EBA9EA3693ull,~0ull,1,1,~0ull,0x995DC9BBDF1939FAull,crc64_xz},
+};
+
+#define CRC_MODEL_COUNT ((int)(sizeof(crc_models)/sizeof(crc_models[0])))
+
+/* Model with wire id 1..CRC_MODEL_COUNT, or NULL. */
+static inline const struct crc_model *crc_model_get(int id)
+{
+  return (id>=1 && id<=CRC_MODEL_COUNT)?&crc_models[id-1]:NULL;
+}
+
+/* Wire id of a catalogue name (case-insensitive), or 0. */
+static inline int crc_model_find(const char *name)
+{
+  int i;
+  for(i=0;i<CRC_MODEL_COUNT;i++)
+  {
+    const char *a=crc_models[i].name,*b=name;
+    while(*a && (*a|0x20)==(*b|0x20))
+      a++,b++;
+    if (!*a && !*b)
+      return i+1;
+  }
+  return 0;
+}
+
+/*
+ * Any model, including ones outside the catalogue, with a runtime-built
+ * engine.  Slower to set up than the catalogue kernels but the same per
+ * byte.
+ */
+struct crc_model_engine
+{
+  const struct crc_model *m;
+  struct crc_engine e;
+  struct crc_engine plain;    /* reflected input only */
+  uint64_t reg;
+};
+
+static inline void crc_model_engine_init(struct crc_model_engine *me,const struct crc_model *m)
+{
+  me->m=m;
+  crc_model_build(&me->e,&me->plain,m->poly,m->width,m->refin);
+  me->reg=crc_model_start(m->width,m->init,m->refin);
+}
+
+/* Feeds len bytes; may be called any number of times. */
+static inline void crc_model_engine_update(struct crc_model_engine *me,const void *buf,size_t len)
+{
+  me->reg=me->m->refin?crc_engine_update_reflected_fast(&me->plain,&me->e,me->reg,buf,len)
+                      :crc_engine_update_fast(&me->e,me->reg,buf,len);
+}
+
+/* CRC of everything fed; the engine is left ready for more input. */
+static inline uint64_t crc_model_engine_final(const struct crc_model_engine *me)
+{
+  const struct crc_model *m=me->m;
+  return crc_model_finish(m->width,m->refin,m->refout,m->xorout,me->reg);
+}
+
+/*
+ * Combines CRC values of two pieces under any model.  Working on the
+ * unreflected register N = (refout ? reflect(v^xorout) : v^xorout):
+ * N(AB) = (N(A)^init)*x^(8*lenB) mod P ^ N(B), whatever the input
+ * reflection, since a reflected CRC is the plain one over bit-reversed
+ * bytes.
+ */
+static inline uint64_t crc_model_combine(const struct crc_model *m,uint64_t crcA,uint64_t crcB,uint64_t lenB)
+{
+  int shift=64-m->width;
+  uint64_t mask=m->width==64?~0ull:(1ull<<m->width)-1;
+  uint64_t apoly=(m->poly&mask)<<shift,a=crcA^m->xorout,b=crcB^m->xorout,r;
+  if (m->refout)
+  {
+    a=crc_reflect(a,m->width);
+    b=crc_reflect(b,m->width);
+  }
+  a=((a^m->init)&mask)<<shift;
+  r=(crc_mulmod(apoly,a,crc_xpow(apoly,lenB*8))>>shift)^(b&mask);
+  if (m->refout)
+    r=crc_reflect(r,m->width);
+  return (r^m->xorout)&mask;
+}
+
+/*
+ * Struct-protocol counterpart of crc_codeword(): divisor names a catalogue
+ * model instead of spelling a generator.  The dataword is '0'/'1'
+ * characters making whole bytes, MSB of each byte first; remainder is the
+ * model's CRC value written MSB first in width characters and codeword is
+ * the dataword followed by it.  Returns -1 on an unknown model, a bad
+ * dataword or a codeword that would not fit in cap.
+ */
+static inline int crc_model_codeword(const char *dataword,const char *name,char *codeword,char *remainder,size_t cap)
+{
+  const struct crc_model *m=crc_model_get(crc_model_find(name));
+  size_t dlen=strlen(dataword);
+  unsigned char *bytes;
+  if (!m || dlen%8 || dlen+m->width+1>cap)
+    return -1;
+  bytes=malloc(dlen/8+1);
+  if (!bytes)
+    return -1;
+  if (crc_pack_bits(dataword,dlen,bytes)<0)
+  {
+    free(bytes);
+    return -1;
+  }
+  crc_to_bitstring(m->kernel(bytes,dlen/8),m->width,remainder);
+  free(bytes);
+  memcpy(codeword,dataword,dlen);
+  strcpy(codeword+dlen,remainder);
+  return 0;
+}
+
+#endif
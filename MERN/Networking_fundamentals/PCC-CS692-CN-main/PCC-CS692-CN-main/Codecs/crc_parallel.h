@@ -0,0 +1,171 @@
+#ifndef CODECS_CRC_PARALLEL_H
+#define CODECS_CRC_PARALLEL_H
+
+/*
+ * Multi-threaded CRC over one large buffer.
+ *
+ * The buffer is cut into equal chunks which a persistent pool of threads
+ * (plus the caller) claim one at a time and run through
+ * crc_engine_update_fast() from a zero register.  The partial registers
+ * are then chained with crc_engine_shift(): every chunk but the last has
+ * the same length, so one x^(8*chunk) mod Q is computed per job and each
+ * merge is a single multiply.  The result equals the serial register bit
+ * for bit.
+ *
+ * Needs -pthread on older C libraries.
+ */
+
+#include<pthread.h>
+#include"crc.h"
+
+#define CRC_POOL_MAX_THREADS 64
+#define CRC_POOL_MAX_CHUNKS 256
+#define CRC_POOL_MIN_CHUNK (1<<20)
+
+struct crc_pool
+{
+  int nthreads;               /* workers, not counting the caller */
+  pthread_t tid[CRC_POOL_MAX_THREADS];
+  pthread_mutex_t busy;       /* one job at a time */
+  pthread_mutex_t lock;
+  pthread_cond_t start,done;
+  int stop;
+  /* current job, guarded by lock */
+  const struct crc_engine *e;
+  const unsigned char *buf;
+  size_t len,chunk;
+  int nchunks,next,finished;
+  uint64_t part[CRC_POOL_MAX_CHUNKS];
+};
+
+/* Claims and runs chunks until the job has none left.  Called and
+   returns with lock held. */
+static inline void crc_pool_work(struct crc_pool *pool)
+{
+  while(pool->next<pool->nchunks)
+  {
+    int c=pool->next++;
+    const struct crc_engine *e=pool->e;
+    const unsigned char *p=pool->buf+(size_t)c*pool->chunk;
+    size_t n=c==pool->nchunks-1?pool->len-(size_t)c*pool->chunk:pool->chunk;
+    uint64_t r;
+    pthread_mutex_unlock(&pool->lock);
+    r=crc_engine_update_fast(e,0,p,n);
+    pthread_mutex_lock(&pool->lock);
+    pool->part[c]=r;
+    if (++pool->finished==pool->nchunks)
+      pthread_cond_broadcast(&pool->done);
+  }
+}
+
+static void *crc_pool_worker(void *arg)
+{
+  struct crc_pool *pool=(struct crc_pool *)arg;
+  pthread_mutex_lock(&pool->lock);
+  while(!pool->stop)
+  {
+    if (pool->next<pool->nchunks)
+      crc_pool_work(pool);
+    else
+      pthread_cond_wait(&pool->start,&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* Starts nthreads workers; the caller of crc_pool_update() works as well,
+   so nthreads=0 is a valid serial pool.  Returns -1 if no thread could be
+   started when some were asked for. */
+static inline int crc_pool_init(struct crc_pool *pool,int nthreads)
+{
+  int i;
+  memset(pool,0,sizeof(*pool));
+  if (nthreads>CRC_POOL_MAX_THREADS)
+    nthreads=CRC_POOL_MAX_THREADS;
+  pthread_mutex_init(&pool->busy,NULL);
+  pthread_mutex_init(&pool->lock,NULL);
+  pthread_cond_init(&pool->start,NULL);
+  pthread_cond_init(&pool->done,NULL);
+  crc_kernel_get();
+  for(i=0;i<nthreads;i++)
+  {
+    if (pthread_create(&pool->tid[i],NULL,crc_pool_worker,pool)!=0)
+      break;
+    pool->nthreads++;
+  }
+  return (nthreads>0 && pool->nthreads==0)?-1:0;
+}
+
+static inline void crc_pool_destroy(struct crc_pool *pool)
+{
+  int i;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop=1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for(i=0;i<pool->nthreads;i++)
+    pthread_join(pool->tid[i],NULL);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->busy);
+}
+
+/* Body of crc_pool_update() once the pool is ours. */
+static inline uint64_t crc_pool_run(struct crc_pool *pool,const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  size_t chunk;
+  int nchunks=4*(pool->nthreads+1),c;
+  uint64_t k;
+  if (nchunks>CRC_POOL_MAX_CHUNKS)
+    nchunks=CRC_POOL_MAX_CHUNKS;
+  chunk=(len/nchunks+255)&~(size_t)255;
+  if (chunk<CRC_POOL_MIN_CHUNK)
+    chunk=CRC_POOL_MIN_CHUNK;
+  nchunks=(int)((len+chunk-1)/chunk);
+  if (pool->nthreads==0 || nchunks<2 || e->width==0)
+    return crc_engine_update_fast(e,crc,buf,len);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->e=e;
+  pool->buf=(const unsigned char *)buf;
+  pool->len=len;
+  pool->chunk=chunk;
+  pool->finished=0;
+  pool->next=0;
+  pool->nchunks=nchunks;
+  pthread_cond_broadcast(&pool->start);
+  crc_pool_work(pool);
+  while(pool->finished<nchunks)
+    pthread_cond_wait(&pool->done,&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+
+  k=crc_xpow(e->apoly,(uint64_t)chunk*8);
+  for(c=0;c<nchunks-1;c++)
+    crc=crc_mulmod(e->apoly,crc,k)^pool->part[c];
+  return crc_engine_shift(e,crc,(uint64_t)(len-(size_t)c*chunk)*8)^pool->part[c];
+}
+
+/* crc_engine_update_fast() spread over the pool.  Jobs from several
+   threads are run one after another. */
+static inline uint64_t crc_pool_update(struct crc_pool *pool,const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  pthread_mutex_lock(&pool->busy);
+  crc=crc_pool_run(pool,e,crc,buf,len);
+  pthread_mutex_unlock(&pool->busy);
+  return crc;
+}
+
+/* As crc_pool_update(), but falls back to the calling thread alone when
+   the pool is already busy, so a server never queues behind another
+   client's request. */
+static inline uint64_t crc_pool_try_update(struct crc_pool *pool,const struct crc_engine *e,uint64_t crc,const void *buf,size_t len)
+{
+  if (pthread_mutex_trylock(&pool->busy)!=0)
+    return crc_engine_update_fast(e,crc,buf,len);
+  crc=crc_pool_run(pool,e,crc,buf,len);
+  pthread_mutex_unlock(&pool->busy);
+  return crc;
+}
+
+#endif
@@ -0,0 +1,526 @@
+/*
+ * crc_search.c - ranks CRC generator polynomials by Hamming distance.
+ *
+ *   gcc -O2 -pthread crc_search.c -o crc_search
+ *   ./crc_search -W 8,16 -l 64,256,1024 [options]
+ *
+ *   -W widths      generator degrees, 1..64
+ *   -l lengths     codeword lengths in bits (dataword + width)
+ *   -p poly,...    evaluate just these generators (hex, x^width implied)
+ *   -r from:count  constrained search over candidate numbers from..from+count-1
+ *   -n count       constrained search over count random candidates
+ *   -h hd          only keep generators with at least this Hamming distance
+ *   -w weight      highest error weight to count, 2..5 (default 4)
+ *   -k top         generators reported per (width, length) (default 10)
+ *   -j threads
+ *
+ * Without -p, -r or -n the search is exhaustive over every generator with
+ * an x^0 term, 2^(width-1) of them, skipping one of each reciprocal pair
+ * since a polynomial and its reverse have the same weight distribution.
+ *
+ * For codeword length n, an error pattern goes undetected exactly when the
+ * syndromes x^i mod G of its bit positions XOR to zero.  The counts of
+ * undetected patterns of each weight are
+ *   W2  pairs of equal syndromes,
+ *   W3  pairs whose XOR is another syndrome, looked up in a bit set,
+ *   W4  pairs of pairs with the same XOR, from the radix-sorted pair sums,
+ *   W5  triples whose XOR is a pair sum, by binary search of the same,
+ * the last two relying on lower weights being zero, as they are for any
+ * generator worth keeping.  Generators divisible by x+1 detect every odd
+ * weight, so W3 and W5 are skipped for them.  The Hamming distance is the
+ * lowest weight with a non-zero count; "6+" means nothing up to weight 5
+ * was found.  Ranking is by distance, then by the count at that weight.
+ *
+ * Pair sums take 8*n*n/2 bytes, so W4 is limited to n <= MAX_PAIR_N and
+ * W5, which is cubic, to n <= MAX_TRIPLE_N.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<stdatomic.h>
+
+#define MAX_LIST 32
+#define MAX_PAIR_N 8192
+#define MAX_TRIPLE_N 1024
+#define BITSET_MAX_WIDTH 26   /* 8 MB bit set per thread; hashing above */
+#define BLOCK 256             /* candidates claimed per step */
+
+struct profile
+{
+  uint64_t poly;
+  int hd;                     /* 0 when rejected by -h */
+  int upto;                   /* highest weight counted */
+  uint64_t w[6];              /* undetected patterns of weight 2..5 */
+};
+
+struct search
+{
+  int width,n;
+  uint64_t mask;
+  /* candidates */
+  const uint64_t *list;       /* explicit list, or NULL */
+  uint64_t from,count;
+  int randomised;
+  atomic_uint_fast64_t next;
+  /* results, merged under lock */
+  pthread_mutex_t lock;
+  struct profile *best;
+  int nbest;
+  uint64_t evaluated;
+};
+
+static int minHD,maxWeight=4,top=10,nthreads;
+
+/* ---- candidates ---- */
+
+static uint64_t reflectBits(uint64_t v,int n)
+{
+  uint64_t r=0;
+  int i;
+  for(i=0;i<n;i++)
+    r|=((v>>i)&1)<<(n-1-i);
+  return r;
+}
+
+/* Of a generator and its reciprocal x^width*G(1/x), only the smaller is
+   evaluated.  poly has its x^0 term, so the reciprocal has one too. */
+static int canonical(uint64_t poly,int width)
+{
+  uint64_t rev=reflectBits((poly>>1)|((uint64_t)1<<(width-1)),width);
+  return poly<=rev;
+}
+
+static uint64_t splitmix(uint64_t x)
+{
+  x+=0x9E3779B97F4A7C15ull;
+  x=(x^(x>>30))*0xBF58476D1CE4E5B9ull;
+  x=(x^(x>>27))*0x94D049BB133111EBull;
+  return x^(x>>31);
+}
+
+/* Candidate number i; exhaustive and ranged searches number the odd
+   generators, random ones draw from the same set. */
+static uint64_t candidate(const struct search *s,uint64_t i)
+{
+  if (s->list)
+    return s->list[i]&s->mask;
+  if (s->randomised)
+    return (splitmix(i)&s->mask)|1;
+  return (((s->from+i)<<1)|1)&s->mask;
+}
+
+/* ---- weight counting ---- */
+
+struct scratch
+{
+  uint64_t *syn;              /* n syndromes */
+  uint64_t *pairs,*tmp;       /* pair sums and the radix sort's buffer */
+  uint64_t *bits;             /* bit set over syndromes, width<=BITSET_MAX_WIDTH */
+  uint64_t *hash;             /* open-addressing set otherwise, 0 = empty */
+  size_t hashMask;
+};
+
+static inline int inSet(const struct scratch *sc,int width,uint64_t v)
+{
+  size_t h;
+  if (width<=BITSET_MAX_WIDTH)
+    return (int)((sc->bits[v>>6]>>(v&63))&1);
+  for(h=(size_t)(v*0x9E3779B97F4A7C15ull>>20)&sc->hashMask;sc->hash[h];h=(h+1)&sc->hashMask)
+    if (sc->hash[h]==v)
+      return 1;
+  return 0;
+}
+
+static void setAdd(struct scratch *sc,int width,uint64_t v)
+{
+  size_t h;
+  if (width<=BITSET_MAX_WIDTH)
+  {
+    sc->bits[v>>6]|=1ull<<(v&63);
+    return;
+  }
+  for(h=(size_t)(v*0x9E3779B97F4A7C15ull>>20)&sc->hashMask;sc->hash[h];h=(h+1)&sc->hashMask)
+    if (sc->hash[h]==v)
+      return;
+  sc->hash[h]=v;
+}
+
+static void setClear(struct scratch *sc,int width,int n)
+{
+  int i;
+  if (width<=BITSET_MAX_WIDTH)
+    for(i=0;i<n;i++)
+      sc->bits[sc->syn[i]>>6]=0;
+  else
+    memset(sc->hash,0,(sc->hashMask+1)*sizeof(uint64_t));
+}
+
+/* LSD radix sort on the low width bits, one byte per pass. */
+static void radixSort(uint64_t *a,uint64_t *tmp,size_t n,int width)
+{
+  int shift;
+  for(shift=0;shift<width;shift+=8)
+  {
+    size_t count[257]={0},i;
+    uint64_t *t;
+    for(i=0;i<n;i++)
+      count[((a[i]>>shift)&255)+1]++;
+    for(i=1;i<257;i++)
+      count[i]+=count[i-1];
+    for(i=0;i<n;i++)
+      tmp[count[(a[i]>>shift)&255]++]=a[i];
+    t=a;
+    a=tmp;
+    tmp=t;
+  }
+  if (((width+7)/8)&1)
+    memcpy(tmp,a,n*sizeof(uint64_t));
+}
+
+static size_t countEqual(const uint64_t *a,size_t n,uint64_t v)
+{
+  size_t lo=0,hi=n,first;
+  while(lo<hi)
+  {
+    size_t mid=(lo+hi)/2;
+    if (a[mid]<v)
+      lo=mid+1;
+    else
+      hi=mid;
+  }
+  first=lo;
+  while(lo<n && a[lo]==v)
+    lo++;
+  return lo-first;
+}
+
+/* Fills p for generator x^width + poly at codeword length n.  Stops as
+   soon as the distance is known to be below minHD. */
+static void profileOf(struct scratch *sc,int width,uint64_t mask,uint64_t poly,int n,struct profile *p)
+{
+  uint64_t top=(uint64_t)1<<(width-1),s=1;
+  int oddFree=(__builtin_popcountll(poly)+1)%2==0;   /* G(1)=0: x+1 divides G */
+  size_t npairs=(size_t)n*(n-1)/2,i,k;
+  int a,b,c;
+  memset(p,0,sizeof(*p));
+  p->poly=poly;
+  p->hd=0;
+  for(a=0;a<n;a++)
+  {
+    sc->syn[a]=s;
+    s=((s<<1)&mask)^((s&top)?poly:0);
+  }
+
+  /* Weight 2: x^a = x^b, i.e. the order of x is below n.  Sorting the
+     syndromes would count them all; a repeat means the code is no better
+     than parity, so one is enough. */
+  p->upto=2;
+  for(a=0;a<n;a++)
+  {
+    if (inSet(sc,width,sc->syn[a]))
+      p->w[2]++;
+    setAdd(sc,width,sc->syn[a]);
+  }
+  if (p->w[2])
+  {
+    p->hd=2;
+    setClear(sc,width,n);
+    return;
+  }
+
+  /* Weight 3. */
+  p->upto=3;
+  if (!oddFree)
+  {
+    for(a=0;a<n && !(minHD>3 && p->w[3]);a++)
+      for(b=a+1;b<n;b++)
+        p->w[3]+=inSet(sc,width,sc->syn[a]^sc->syn[b]);
+    /* Exact when the loops ran through; rounding up keeps a count cut
+       short by -h from reaching zero. */
+    p->w[3]=(p->w[3]+2)/3;
+  }
+  setClear(sc,width,n);
+  if (p->w[3])
+  {
+    p->hd=3;
+    return;
+  }
+
+  /* Weight 4: a 4-set splits into three pairs of pairs with equal sums. */
+  if (maxWeight<4 || n>MAX_PAIR_N)
+  {
+    p->hd=4;                  /* at least */
+    return;
+  }
+  p->upto=4;
+  for(a=0,k=0;a<n;a++)
+    for(b=a+1;b<n;b++)
+      sc->pairs[k++]=sc->syn[a]^sc->syn[b];
+  radixSort(sc->pairs,sc->tmp,npairs,width);
+  for(i=0;i<npairs;)
+  {
+    size_t j=i+1;
+    while(j<npairs && sc->pairs[j]==sc->pairs[i])
+      j++;
+    p->w[4]+=(uint64_t)(j-i)*(j-i-1)/2;
+    i=j;
+  }
+  p->w[4]/=3;
+  if (p->w[4])
+  {
+    p->hd=4;
+    return;
+  }
+
+  /* Weight 5: a triple sum equal to a pair sum, each 5-set counted once
+     for every way of choosing its pair. */
+  if (maxWeight<5 || n>MAX_TRIPLE_N)
+  {
+    p->hd=5;
+    return;
+  }
+  p->upto=5;
+  if (!oddFree)
+  {
+    for(a=0;a<n && !(minHD>5 && p->w[5]);a++)
+      for(b=a+1;b<n;b++)
+      {
+        uint64_t ab=sc->syn[a]^sc->syn[b];
+        for(c=b+1;c<n;c++)
+          p->w[5]+=countEqual(sc->pairs,npairs,ab^sc->syn[c]);
+      }
+    p->w[5]=(p->w[5]+9)/10;
+  }
+  p->hd=p->w[5]?5:6;
+}
+
+/* ---- ranking ---- */
+
+static uint64_t countAtHD(const struct profile *p)
+{
+  return p->hd<=p->upto?p->w[p->hd]:0;
+}
+
+/* Negative when a ranks above b. */
+static int better(const struct profile *a,const struct profile *b)
+{
+  if (a->hd!=b->hd)
+    return b->hd-a->hd;
+  if (countAtHD(a)!=countAtHD(b))
+    return countAtHD(a)<countAtHD(b)?-1:1;
+  return a->poly<b->poly?-1:a->poly>b->poly;
+}
+
+static int cmpProfile(const void *a,const void *b)
+{
+  return better((const struct profile *)a,(const struct profile *)b);
+}
+
+/* Keeps the top entries of list, sorted. */
+static void keep(struct profile *list,int *len,const struct profile *p)
+{
+  int i;
+  if (*len==top && better(p,&list[top-1])>=0)
+    return;
+  i=*len<top?(*len)++:top-1;
+  while(i>0 && better(p,&list[i-1])<0)
+  {
+    list[i]=list[i-1];
+    i--;
+  }
+  list[i]=*p;
+}
+
+static void *worker(void *arg)
+{
+  struct search *s=(struct search *)arg;
+  struct scratch sc;
+  struct profile *mine=calloc(top,sizeof(*mine)),p;
+  int nmine=0,i;
+  uint64_t done=0,base;
+  size_t npairs=(size_t)s->n*(s->n-1)/2;
+  memset(&sc,0,sizeof(sc));
+  sc.syn=malloc(s->n*sizeof(uint64_t));
+  if (maxWeight>=4 && s->n<=MAX_PAIR_N)
+  {
+    sc.pairs=malloc(npairs*sizeof(uint64_t)+8);
+    sc.tmp=malloc(npairs*sizeof(uint64_t)+8);
+  }
+  if (s->width<=BITSET_MAX_WIDTH)
+    sc.bits=calloc(((size_t)1<<s->width)/64+1,sizeof(uint64_t));
+  else
+  {
+    for(sc.hashMask=1;sc.hashMask<4*(size_t)s->n;sc.hashMask<<=1);
+    sc.hash=calloc(sc.hashMask,sizeof(uint64_t));
+    sc.hashMask--;
+  }
+  if (!mine || !sc.syn || (maxWeight>=4 && s->n<=MAX_PAIR_N && (!sc.pairs || !sc.tmp)) || (!sc.bits && !sc.hash))
+  {
+    fprintf(stderr,"crc_search: out of memory\n");
+    exit(1);
+  }
+  while((base=atomic_fetch_add(&s->next,BLOCK))<s->count)
+  {
+    uint64_t end=base+BLOCK<s->count?base+BLOCK:s->count,c;
+    for(c=base;c<end;c++)
+    {
+      uint64_t poly=candidate(s,c);
+      if (!s->list && !s->randomised && !canonical(poly,s->width))
+        continue;
+      profileOf(&sc,s->width,s->mask,poly,s->n,&p);
+      done++;
+      if (p.hd>=minHD)
+        keep(mine,&nmine,&p);
+    }
+  }
+  pthread_mutex_lock(&s->lock);
+  for(i=0;i<nmine;i++)
+    keep(s->best,&s->nbest,&mine[i]);
+  s->evaluated+=done;
+  pthread_mutex_unlock(&s->lock);
+  free(sc.syn);
+  free(sc.pairs);
+  free(sc.tmp);
+  free(sc.bits);
+  free(sc.hash);
+  free(mine);
+  return NULL;
+}
+
+/* ---- reporting ---- */
+
+static void printDivisor(uint64_t poly,int width)
+{
+  int i;
+  putchar('1');
+  for(i=width-1;i>=0;i--)
+    putchar((int)('0'+((poly>>i)&1)));
+}
+
+static void report(const struct search *s)
+{
+  int i,k;
+  printf("\nwidth %d, codeword %d bits (dataword %d): %llu generators evaluated\n",
+         s->width,s->n,s->n-s->width,(unsigned long long)s->evaluated);
+  if (s->nbest==0)
+  {
+    printf("  none with HD >= %d\n",minHD);
+    return;
+  }
+  printf("  %-4s %-18s %-4s %-40s %s\n","rank","poly","HD","undetected W2 W3 W4 W5","divisor");
+  for(i=0;i<s->nbest;i++)
+  {
+    const struct profile *p=&s->best[i];
+    char w[64]="",*q=w;
+    for(k=2;k<=5;k++)
+      q+=sprintf(q,k<=p->upto?"%llu ":"- ",(unsigned long long)p->w[k]);
+    char hd[8];
+    sprintf(hd,p->hd>p->upto?"%d+":"%d",p->hd);
+    printf("  %-4d 0x%0*llx%*s %-4s %-40s ",i+1,(s->width+3)/4,(unsigned long long)p->poly,
+           16-(s->width+3)/4,"",hd,w);
+    printDivisor(p->poly,s->width);
+    putchar('\n');
+  }
+}
+
+static int parseList(const char *arg,uint64_t *out,int hex)
+{
+  int n=0;
+  char *end;
+  while(*arg && n<MAX_LIST)
+  {
+    out[n++]=strtoull(arg,&end,hex?16:10);
+    if (end==arg)
+      return -1;
+    arg=*end==','?end+1:end;
+  }
+  return n;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,"Usage : %s -W widths -l lengths [-p polys | -r from:count | -n count] [-h hd] [-w weight] [-k top] [-j threads]\n",argv0);
+  exit(2);
+}
+
+int main(int argc,char **argv)
+{
+  uint64_t widths[MAX_LIST],lengths[MAX_LIST],polys[MAX_LIST],from=0,count=0;
+  int nwidths=0,nlengths=0,npolys=0,randomised=0,ranged=0,opt,wi,li,t;
+  nthreads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+  while((opt=getopt(argc,argv,"W:l:p:r:n:h:w:k:j:"))!=-1)
+  {
+    switch(opt)
+    {
+      case 'W': nwidths=parseList(optarg,widths,0); break;
+      case 'l': nlengths=parseList(optarg,lengths,0); break;
+      case 'p': npolys=parseList(optarg,polys,1); break;
+      case 'r': ranged=sscanf(optarg,"%llu:%llu",(unsigned long long *)&from,(unsigned long long *)&count)==2; break;
+      case 'n': randomised=1; count=strtoull(optarg,NULL,10); break;
+      case 'h': minHD=atoi(optarg); break;
+      case 'w': maxWeight=atoi(optarg); break;
+      case 'k': top=atoi(optarg); break;
+      case 'j': nthreads=atoi(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (nwidths<1 || nlengths<1 || npolys<0 || maxWeight<2 || maxWeight>5 || top<1 || nthreads<1)
+    usage(argv[0]);
+
+  for(wi=0;wi<nwidths;wi++)
+    for(li=0;li<nlengths;li++)
+    {
+      struct search s;
+      pthread_t tid[256];
+      int width=(int)widths[wi];
+      if (width<1 || width>64 || lengths[li]<=(uint64_t)width || lengths[li]>(1u<<24))
+      {
+        fprintf(stderr,"crc_search: width %d with length %llu is out of range\n",width,(unsigned long long)lengths[li]);
+        continue;
+      }
+      memset(&s,0,sizeof(s));
+      s.width=width;
+      s.n=(int)lengths[li];
+      s.mask=width==64?~0ull:((uint64_t)1<<width)-1;
+      if (npolys)
+      {
+        for(t=0;t<npolys;t++)
+          if (!(polys[t]&1))
+          {
+            fprintf(stderr,"crc_search: 0x%llx has no x^0 term\n",(unsigned long long)polys[t]);
+            return 2;
+          }
+        s.list=polys;
+        s.count=npolys;
+      }
+      else if (randomised || ranged)
+      {
+        s.randomised=randomised;
+        s.from=from;
+        s.count=count;
+      }
+      else if (width>40)
+      {
+        fprintf(stderr,"crc_search: exhaustive search of width %d is out of reach, use -r or -n\n",width);
+        continue;
+      }
+      else
+        s.count=(uint64_t)1<<(width-1);
+      s.best=calloc(top,sizeof(*s.best));
+      pthread_mutex_init(&s.lock,NULL);
+      for(t=1;t<nthreads && t<256;t++)
+        pthread_create(&tid[t],NULL,worker,&s);
+      worker(&s);
+      for(t=1;t<nthreads && t<256;t++)
+        pthread_join(tid[t],NULL);
+      qsort(s.best,s.nbest,sizeof(*s.best),cmpProfile);
+      report(&s);
+      pthread_mutex_destroy(&s.lock);
+      free(s.best);
+    }
+  return 0;
+}
@@ -0,0 +1,318 @@
+#ifndef CODECS_CRC_VERIFY_H
+#define CODECS_CRC_VERIFY_H
+
+/*
+ * Codeword verification with single-bit error location.
+ *
+ * A codeword is the dataword followed by its width check bits, bit-packed
+ * MSB first.  Its syndrome is the remainder of the dataword recomputed
+ * with the engine XOR the check bits received, i.e. codeword mod G.  Zero
+ * means the codeword passes.  A single flipped bit d places from the end
+ * of the codeword leaves syndrome x^d mod G, so a table from x^d mod G
+ * back to d locates it.
+ *
+ * x^d mod G repeats with the order of x modulo G.  When the codeword is
+ * longer than that, two positions share a syndrome and the error is
+ * reported as uncorrectable rather than guessed.  The table is built for
+ * one codeword length and holds at most CRC_SYNDROME_MAX entries; errors
+ * further from the end are reported as uncorrectable too.
+ *
+ * A table takes up to 96 MB and far longer to build than one codeword
+ * takes to check, so servers keep them in a crc_syndrome_cache, next to
+ * their engine cache.  A table built for one length also serves every
+ * shorter codeword, and once the period is known every length, so the
+ * cache keeps one table per generator and rebuilds it, for twice the
+ * length at least, only when a longer codeword arrives.
+ */
+
+#include<stddef.h>
+#include<stdlib.h>
+#include<pthread.h>
+#include"crc.h"
+
+#define CRC_VERIFY_PASS 0
+#define CRC_VERIFY_BIT 1            /* single-bit error at *pos */
+#define CRC_VERIFY_FAIL 2
+#define CRC_SYNDROME_MAX (1u<<22)
+
+struct crc_syndrome_table
+{
+  uint32_t len;                     /* distances 0..len-1 are in the table */
+  uint32_t period;                  /* order of x if reached, else 0 */
+  uint32_t mask;
+  uint64_t *key;                    /* syndrome, 0 = empty slot */
+  uint32_t *dist;
+};
+
+static inline uint32_t crc_syndrome_slot(const struct crc_syndrome_table *t,uint64_t s)
+{
+  return (uint32_t)((s*0x9E3779B97F4A7C15ull)>>32)&t->mask;
+}
+
+static inline void crc_syndrome_free(struct crc_syndrome_table *t)
+{
+  free(t->key);
+  free(t->dist);
+  t->key=NULL;
+  t->dist=NULL;
+}
+
+/* Table for codewords of up to nbits bits under engine e.  Returns -1 if
+   out of memory. */
+static inline int crc_syndrome_init(struct crc_syndrome_table *t,const struct crc_engine *e,uint64_t nbits)
+{
+  uint64_t mask=e->width==64?~0ull:((uint64_t)1<<e->width)-1,top=(uint64_t)1<<(e->width-1),s=1;
+  uint32_t want=nbits<CRC_SYNDROME_MAX?(uint32_t)nbits:CRC_SYNDROME_MAX,cap=2,d;
+  memset(t,0,sizeof(*t));
+  if (e->width==0)
+    return 0;
+  while(cap<2*want)
+    cap<<=1;
+  t->mask=cap-1;
+  t->key=calloc(cap,sizeof(uint64_t));
+  t->dist=malloc(cap*sizeof(uint32_t));
+  if (!t->key || !t->dist)
+  {
+    crc_syndrome_free(t);
+    return -1;
+  }
+  for(d=0;d<want && s;d++)
+  {
+    uint32_t h=crc_syndrome_slot(t,s);
+    while(t->key[h] && t->key[h]!=s)
+      h=(h+1)&t->mask;
+    if (t->key[h])
+    {
+      /* x^d = x^0: every later distance aliases an earlier one. */
+      t->period=d;
+      break;
+    }
+    t->key[h]=s;
+    t->dist[h]=d;
+    s=((s<<1)&mask)^((s&top)?e->poly:0);
+  }
+  t->len=d;
+  /* Cut short by CRC_SYNDROME_MAX: keep stepping, without storing, to find
+     out whether positions within the codeword still alias. */
+  if (!t->period && want<nbits)
+  {
+    uint64_t k;
+    for(k=d;k<nbits && s;k++)
+    {
+      if (s==1)
+      {
+        t->period=(uint32_t)(k<0xFFFFFFFFull?k:0xFFFFFFFFull);
+        break;
+      }
+      s=((s<<1)&mask)^((s&top)?e->poly:0);
+    }
+  }
+  return 0;
+}
+
+/* Distance from the end of the codeword of the bit with syndrome s, or -1
+   if no single bit in the table has it. */
+static inline int64_t crc_syndrome_lookup(const struct crc_syndrome_table *t,uint64_t s)
+{
+  uint32_t h;
+  if (!t->key)
+    return -1;
+  for(h=crc_syndrome_slot(t,s);t->key[h];h=(h+1)&t->mask)
+    if (t->key[h]==s)
+      return t->dist[h];
+  return -1;
+}
+
+/* count bits of buf from bit start, MSB first, right-aligned. */
+static inline uint64_t crc_read_bits(const unsigned char *buf,uint64_t start,int count)
+{
+  uint64_t v=0;
+  int i;
+  for(i=0;i<count;i++,start++)
+    v=v<<1|((buf[start/8]>>(7-start%8))&1);
+  return v;
+}
+
+static inline void crc_flip_bit(unsigned char *buf,uint64_t pos)
+{
+  buf[pos/8]^=(unsigned char)(0x80>>(pos%8));
+}
+
+/* Checks one nbits-bit codeword.  Returns CRC_VERIFY_PASS, CRC_VERIFY_BIT
+   with the bit's index from the start of the codeword in *pos, or
+   CRC_VERIFY_FAIL for anything a single flip cannot explain. */
+static inline int crc_verify_codeword(const struct crc_engine *e,const struct crc_syndrome_table *t,const unsigned char *cw,uint64_t nbits,uint64_t *pos)
+{
+  struct crc_stream s;
+  uint64_t syn;
+  int64_t d;
+  if (nbits<(uint64_t)e->width)
+    return CRC_VERIFY_FAIL;
+  crc_stream_init(&s,e);
+  crc_stream_update_bits(&s,cw,nbits-e->width);
+  syn=crc_stream_final(&s)^crc_read_bits(cw,nbits-e->width,e->width);
+  if (!syn)
+    return CRC_VERIFY_PASS;
+  d=crc_syndrome_lookup(t,syn);
+  if (d<0 || (uint64_t)d>=nbits || (t->period && (uint64_t)d+t->period<nbits))
+    return CRC_VERIFY_FAIL;
+  *pos=nbits-1-(uint64_t)d;
+  return CRC_VERIFY_BIT;
+}
+
+/* Bounded, thread-safe cache of syndrome tables, one per generator, most
+   recent first.  A table stays valid until its crc_syndrome_cache_release(),
+   even if it falls off the end or is replaced by a longer one meanwhile. */
+struct crc_syndrome_entry
+{
+  struct crc_syndrome_table t;
+  uint64_t poly,nbits;              /* built for codewords of up to nbits */
+  int width;
+  int refs;
+  int stale;                        /* replaced, freed on its last release */
+  struct crc_syndrome_entry *next;
+};
+
+struct crc_syndrome_cache
+{
+  pthread_mutex_t lock;
+  int cap,count;
+  struct crc_syndrome_entry *head;
+  uint64_t hits,misses;
+};
+
+static inline void crc_syndrome_cache_init(struct crc_syndrome_cache *c,int cap)
+{
+  memset(c,0,sizeof(*c));
+  c->cap=cap<1?1:cap;
+  pthread_mutex_init(&c->lock,NULL);
+}
+
+/* Drops unreferenced tables beyond cap, oldest first.  Called with the
+   lock held. */
+static inline void crc_syndrome_cache_trim(struct crc_syndrome_cache *c)
+{
+  struct crc_syndrome_entry **pp=&c->head,*x;
+  int kept=0;
+  while((x=*pp))
+  {
+    if (kept>=c->cap && x->refs==0)
+    {
+      *pp=x->next;
+      crc_syndrome_free(&x->t);
+      free(x);
+      c->count--;
+    }
+    else
+    {
+      kept++;
+      pp=&x->next;
+    }
+  }
+}
+
+/* Whether x serves nbits-bit codewords. */
+static inline int crc_syndrome_entry_covers(const struct crc_syndrome_entry *x,uint64_t nbits)
+{
+  return x->t.period || x->nbits>=nbits;
+}
+
+static inline void crc_syndrome_cache_destroy(struct crc_syndrome_cache *c)
+{
+  c->cap=0;
+  crc_syndrome_cache_trim(c);
+  pthread_mutex_destroy(&c->lock);
+}
+
+/* Moves x to the front and takes a reference.  Called with the lock held. */
+static inline const struct crc_syndrome_table *crc_syndrome_cache_take(struct crc_syndrome_cache *c,struct crc_syndrome_entry **pp)
+{
+  struct crc_syndrome_entry *x=*pp;
+  *pp=x->next;
+  x->next=c->head;
+  c->head=x;
+  x->refs++;
+  return &x->t;
+}
+
+/* Table for codewords of up to nbits bits under engine e, built outside the
+   lock on a miss.  Returns NULL if out of memory. */
+static inline const struct crc_syndrome_table *crc_syndrome_cache_get(struct crc_syndrome_cache *c,const struct crc_engine *e,uint64_t nbits)
+{
+  struct crc_syndrome_entry **pp,*built,*old;
+  const struct crc_syndrome_table *t;
+  uint64_t want=nbits;
+  pthread_mutex_lock(&c->lock);
+  for(pp=&c->head;*pp;pp=&(*pp)->next)
+    if ((*pp)->poly==e->poly && (*pp)->width==e->width)
+      break;
+  if (*pp && crc_syndrome_entry_covers(*pp,nbits))
+  {
+    c->hits++;
+    t=crc_syndrome_cache_take(c,pp);
+    pthread_mutex_unlock(&c->lock);
+    return t;
+  }
+  /* Growing: at least double, so lengths creeping up cost few builds. */
+  if (*pp && want<2*(*pp)->nbits)
+    want=2*(*pp)->nbits;
+  c->misses++;
+  pthread_mutex_unlock(&c->lock);
+  built=malloc(sizeof(*built));
+  if (!built || crc_syndrome_init(&built->t,e,want)<0)
+  {
+    free(built);
+    return NULL;
+  }
+  built->poly=e->poly;
+  built->width=e->width;
+  built->nbits=want;
+  built->refs=0;
+  built->stale=0;
+  pthread_mutex_lock(&c->lock);
+  /* Another thread may have built the same or a longer table meanwhile. */
+  for(pp=&c->head;*pp;pp=&(*pp)->next)
+    if ((*pp)->poly==e->poly && (*pp)->width==e->width)
+      break;
+  if (*pp && crc_syndrome_entry_covers(*pp,want))
+  {
+    crc_syndrome_free(&built->t);
+    free(built);
+  }
+  else
+  {
+    old=*pp;
+    built->next=old?old->next:NULL;
+    *pp=built;
+    if (!old)
+      c->count++;
+    else if (old->refs)
+      old->stale=1;
+    else
+    {
+      crc_syndrome_free(&old->t);
+      free(old);
+    }
+  }
+  t=crc_syndrome_cache_take(c,pp);
+  crc_syndrome_cache_trim(c);
+  pthread_mutex_unlock(&c->lock);
+  return t;
+}
+
+/* Gives back a table from crc_syndrome_cache_get(). */
+static inline void crc_syndrome_cache_release(struct crc_syndrome_cache *c,const struct crc_syndrome_table *t)
+{
+  struct crc_syndrome_entry *x=(struct crc_syndrome_entry *)((char *)t-offsetof(struct crc_syndrome_entry,t));
+  pthread_mutex_lock(&c->lock);
+  if (--x->refs==0 && x->stale)
+  {
+    crc_syndrome_free(&x->t);
+    free(x);
+  }
+  else if (x->refs==0 && c->count>c->cap)
+    crc_syndrome_cache_trim(c);
+  pthread_mutex_unlock(&c->lock);
+}
+
+#endif
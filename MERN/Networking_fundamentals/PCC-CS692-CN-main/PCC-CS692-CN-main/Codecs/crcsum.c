@@ -0,0 +1,537 @@
+/*
+ * crcsum.c - CRC of files and directory trees.
+ *
+ *   gcc -O2 -pthread crcsum.c -o crcsum
+ *   ./crcsum [-a model|generator] [-j threads] [-b KB] [-q depth] [-m|-u] [-s] path...
+ *
+ * Prints "crc size path" per regular file, directories being walked
+ * without following links.  The CRC is any catalogue model (default
+ * CRC-32, so the output matches zlib's crc32) or a generator given in
+ * binary, taken as init 0, no reflection, no xorout.
+ *
+ * Files are shared out to a pool of threads.  Each file is read one of two
+ * ways:
+ *   - mostly in the page cache (mincore): mmap + MADV_SEQUENTIAL and one
+ *     pass of the model's kernel over the mapping;
+ *   - otherwise: an io_uring read pipeline with depth buffers in flight,
+ *     CRCing chunk k while the kernel fills chunks k+1..k+depth-1.
+ * -m and -u force one way.  io_uring is driven with raw system calls; where
+ * it is unavailable (old kernel, seccomp) the pipeline falls back to
+ * pread().  Chunks are CRCed on their own and joined with
+ * crc_model_combine(), so catalogue models keep their fastest kernel.
+ * -s prints throughput and how each file was read to stderr.
+ */
+
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<time.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<ftw.h>
+#include<pthread.h>
+#include<stdatomic.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<sys/uio.h>
+#include<linux/io_uring.h>
+#include"crc_model.h"
+
+#define MAX_DEPTH 64
+#define MIN_CACHED 0.5        /* resident fraction that counts as cached */
+
+enum { VIA_MMAP=1, VIA_URING, VIA_PREAD };
+
+struct job
+{
+  char *path;
+  uint64_t size,crc;
+  int err;                    /* errno, 0 on success */
+  int via;
+};
+
+/* Options and the work list, shared by all threads. */
+static struct crc_model model;
+static struct crc_engine rawEngine;     /* when model.kernel is NULL */
+static struct job *jobs;
+static size_t njobs,jobsCap;
+static atomic_size_t nextJob;
+static size_t chunkSize=1<<20;
+static int depth=4,force;
+static int walkFailed;
+
+/* ---- CRC of one piece, and joining pieces ---- */
+
+static uint64_t crcPiece(const void *buf,size_t len)
+{
+  uint64_t reg;
+  if (model.kernel)
+    return model.kernel(buf,len);
+  reg=crc_model_start(model.width,model.init,0);
+  reg=crc_engine_update_fast(&rawEngine,reg,buf,len);
+  return crc_model_finish(model.width,0,0,model.xorout,reg);
+}
+
+static uint64_t crcJoin(uint64_t crc,uint64_t sofar,const void *buf,size_t len)
+{
+  uint64_t piece=crcPiece(buf,len);
+  return sofar?crc_model_combine(&model,crc,piece,len):piece;
+}
+
+/* ---- minimal io_uring ---- */
+
+struct uring
+{
+  int fd;
+  unsigned int entries;
+  void *sqMap,*cqMap;
+  size_t sqMapLen,cqMapLen;
+  struct io_uring_sqe *sqes;
+  size_t sqesLen;
+  _Atomic unsigned int *sqHead,*sqTail,*cqHead,*cqTail;
+  unsigned int sqMask,cqMask,*sqArray;
+  struct io_uring_cqe *cqes;
+};
+
+static int uringInit(struct uring *u,unsigned int entries)
+{
+  struct io_uring_params p;
+  memset(u,0,sizeof(*u));
+  memset(&p,0,sizeof(p));
+  u->fd=(int)syscall(__NR_io_uring_setup,entries,&p);
+  if (u->fd<0)
+    return -1;
+  u->entries=p.sq_entries;
+  u->sqMapLen=p.sq_off.array+p.sq_entries*sizeof(unsigned int);
+  u->cqMapLen=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+  if (p.features&IORING_FEAT_SINGLE_MMAP)
+  {
+    if (u->cqMapLen>u->sqMapLen)
+      u->sqMapLen=u->cqMapLen;
+    u->cqMapLen=u->sqMapLen;
+  }
+  u->sqMap=mmap(NULL,u->sqMapLen,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_SQ_RING);
+  if (u->sqMap==MAP_FAILED)
+  {
+    close(u->fd);
+    return -1;
+  }
+  if (p.features&IORING_FEAT_SINGLE_MMAP)
+    u->cqMap=u->sqMap;
+  else
+    u->cqMap=mmap(NULL,u->cqMapLen,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_CQ_RING);
+  u->sqesLen=p.sq_entries*sizeof(struct io_uring_sqe);
+  u->sqes=mmap(NULL,u->sqesLen,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,u->fd,IORING_OFF_SQES);
+  if (u->cqMap==MAP_FAILED || u->sqes==MAP_FAILED)
+  {
+    munmap(u->sqMap,u->sqMapLen);
+    if (u->cqMap!=MAP_FAILED && u->cqMap!=u->sqMap)
+      munmap(u->cqMap,u->cqMapLen);
+    if (u->sqes!=MAP_FAILED)
+      munmap(u->sqes,u->sqesLen);
+    close(u->fd);
+    return -1;
+  }
+  u->sqHead=(_Atomic unsigned int *)((char *)u->sqMap+p.sq_off.head);
+  u->sqTail=(_Atomic unsigned int *)((char *)u->sqMap+p.sq_off.tail);
+  u->sqMask=*(unsigned int *)((char *)u->sqMap+p.sq_off.ring_mask);
+  u->sqArray=(unsigned int *)((char *)u->sqMap+p.sq_off.array);
+  u->cqHead=(_Atomic unsigned int *)((char *)u->cqMap+p.cq_off.head);
+  u->cqTail=(_Atomic unsigned int *)((char *)u->cqMap+p.cq_off.tail);
+  u->cqMask=*(unsigned int *)((char *)u->cqMap+p.cq_off.ring_mask);
+  u->cqes=(struct io_uring_cqe *)((char *)u->cqMap+p.cq_off.cqes);
+  return 0;
+}
+
+static void uringExit(struct uring *u)
+{
+  munmap(u->sqes,u->sqesLen);
+  if (u->cqMap!=u->sqMap)
+    munmap(u->cqMap,u->cqMapLen);
+  munmap(u->sqMap,u->sqMapLen);
+  close(u->fd);
+}
+
+/* Queues a read; the caller never has more than entries outstanding. */
+static void uringRead(struct uring *u,int fd,void *buf,unsigned int len,uint64_t off,uint64_t tag)
+{
+  unsigned int tail=atomic_load_explicit(u->sqTail,memory_order_relaxed);
+  unsigned int i=tail&u->sqMask;
+  struct io_uring_sqe *sqe=&u->sqes[i];
+  memset(sqe,0,sizeof(*sqe));
+  sqe->opcode=IORING_OP_READ;
+  sqe->fd=fd;
+  sqe->addr=(uint64_t)(uintptr_t)buf;
+  sqe->len=len;
+  sqe->off=off;
+  sqe->user_data=tag;
+  u->sqArray[i]=i;
+  atomic_store_explicit(u->sqTail,tail+1,memory_order_release);
+}
+
+/* Submits what is queued and waits for at least one completion. */
+static int uringEnter(struct uring *u,unsigned int submit)
+{
+  int r;
+  do
+    r=(int)syscall(__NR_io_uring_enter,u->fd,submit,1,IORING_ENTER_GETEVENTS,NULL,0);
+  while(r<0 && errno==EINTR);
+  return r;
+}
+
+static int uringReap(struct uring *u,uint64_t *tag,int *res)
+{
+  unsigned int head=atomic_load_explicit(u->cqHead,memory_order_relaxed);
+  struct io_uring_cqe *cqe;
+  if (head==atomic_load_explicit(u->cqTail,memory_order_acquire))
+    return 0;
+  cqe=&u->cqes[head&u->cqMask];
+  *tag=cqe->user_data;
+  *res=cqe->res;
+  atomic_store_explicit(u->cqHead,head+1,memory_order_release);
+  return 1;
+}
+
+/* ---- per-thread readers ---- */
+
+struct worker
+{
+  pthread_t tid;
+  struct uring ring;
+  int haveRing;
+  unsigned char *buf[MAX_DEPTH];
+  uint64_t bytes;
+};
+
+/* Fills len bytes at off with pread, for the fallback and short reads. */
+static int preadFull(int fd,unsigned char *p,size_t len,uint64_t off)
+{
+  while(len)
+  {
+    ssize_t r=pread(fd,p,len,(off_t)off);
+    if (r<0 && errno==EINTR)
+      continue;
+    if (r<=0)
+      return r<0?-errno:-EIO;
+    p+=r;
+    len-=r;
+    off+=r;
+  }
+  return 0;
+}
+
+static int viaPread(struct worker *w,int fd,struct job *j)
+{
+  uint64_t off;
+  j->via=VIA_PREAD;
+  for(off=0;off<j->size;off+=chunkSize)
+  {
+    size_t n=j->size-off<chunkSize?j->size-off:chunkSize;
+    int r=preadFull(fd,w->buf[0],n,off);
+    if (r<0)
+      return -r;
+    j->crc=crcJoin(j->crc,off,w->buf[0],n);
+  }
+  return 0;
+}
+
+/* Chunk k lives in buffer k%depth.  Completions may arrive in any order;
+   the CRC takes chunks strictly in order, and a buffer is refilled with
+   chunk k+depth only once chunk k has been folded in. */
+static int viaUring(struct worker *w,int fd,struct job *j)
+{
+  uint64_t nchunks=(j->size+chunkSize-1)/chunkSize,submitted=0,folded=0;
+  int doneRes[MAX_DEPTH],done[MAX_DEPTH]={0};
+  unsigned int queued=0;
+  int err=0;
+  j->via=VIA_URING;
+  while(folded<nchunks)
+  {
+    uint64_t tag;
+    int res;
+    while(!err && submitted<nchunks && submitted<folded+(uint64_t)depth)
+    {
+      uint64_t off=submitted*chunkSize;
+      size_t n=j->size-off<chunkSize?j->size-off:chunkSize;
+      uringRead(&w->ring,fd,w->buf[submitted%depth],(unsigned int)n,off,submitted);
+      submitted++;
+      queued++;
+    }
+    if (uringEnter(&w->ring,queued)<0)
+    {
+      /* Reads may still be in flight into our buffers; stop using the
+         ring for good rather than risk reaping them for another file. */
+      w->haveRing=0;
+      return errno;
+    }
+    queued=0;
+    while(uringReap(&w->ring,&tag,&res))
+    {
+      done[tag%depth]=1;
+      doneRes[tag%depth]=res;
+    }
+    while(folded<submitted && done[folded%depth])
+    {
+      uint64_t off=folded*chunkSize;
+      size_t n=j->size-off<chunkSize?j->size-off:chunkSize;
+      int slot=(int)(folded%depth);
+      done[slot]=0;
+      if (doneRes[slot]<0)
+        err=-doneRes[slot];
+      else if ((size_t)doneRes[slot]<n)
+      {
+        int r=preadFull(fd,w->buf[slot]+doneRes[slot],n-doneRes[slot],off+doneRes[slot]);
+        if (r<0)
+          err=-r;
+      }
+      if (!err)
+        j->crc=crcJoin(j->crc,off,w->buf[slot],n);
+      folded++;
+    }
+    /* On an error, drain what is in flight before the buffers are reused. */
+    if (err && folded==submitted)
+      return err;
+  }
+  return err;
+}
+
+/* Share of the file's pages already in the page cache. */
+static double residentShare(void *map,uint64_t size)
+{
+  size_t page=(size_t)sysconf(_SC_PAGESIZE),n=(size+page-1)/page,i,in=0;
+  unsigned char *vec=malloc(n);
+  if (!vec || mincore(map,size,vec)<0)
+  {
+    free(vec);
+    return 0;
+  }
+  for(i=0;i<n;i++)
+    in+=vec[i]&1;
+  free(vec);
+  return (double)in/n;
+}
+
+static void runJob(struct worker *w,struct job *j)
+{
+  struct stat st;
+  void *map=MAP_FAILED;
+  int fd=open(j->path,O_RDONLY|O_CLOEXEC);
+  if (fd<0 || fstat(fd,&st)<0)
+  {
+    j->err=errno;
+    if (fd>=0)
+      close(fd);
+    return;
+  }
+  j->size=(uint64_t)st.st_size;
+  j->crc=crcPiece("",0);
+  if (j->size==0)
+  {
+    j->via=VIA_MMAP;
+    close(fd);
+    return;
+  }
+  if (force!=VIA_URING)
+    map=mmap(NULL,j->size,PROT_READ,MAP_SHARED,fd,0);
+  if (map!=MAP_FAILED && (force==VIA_MMAP || residentShare(map,j->size)>=MIN_CACHED))
+  {
+    madvise(map,j->size,MADV_SEQUENTIAL);
+    j->via=VIA_MMAP;
+    j->crc=crcPiece(map,j->size);
+  }
+  else
+  {
+    posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+    j->err=w->haveRing?viaUring(w,fd,j):viaPread(w,fd,j);
+  }
+  if (map!=MAP_FAILED)
+    munmap(map,j->size);
+  if (!j->err)
+    w->bytes+=j->size;
+  close(fd);
+}
+
+static void *workerMain(void *arg)
+{
+  struct worker *w=(struct worker *)arg;
+  size_t i;
+  while((i=atomic_fetch_add(&nextJob,1))<njobs)
+    runJob(w,&jobs[i]);
+  return NULL;
+}
+
+/* ---- collecting files ---- */
+
+static int addJob(const char *path)
+{
+  if (njobs==jobsCap)
+  {
+    size_t cap=jobsCap?jobsCap*2:256;
+    struct job *grown=realloc(jobs,cap*sizeof(*jobs));
+    if (!grown)
+      return -1;
+    jobs=grown;
+    jobsCap=cap;
+  }
+  memset(&jobs[njobs],0,sizeof(*jobs));
+  jobs[njobs].path=strdup(path);
+  if (!jobs[njobs].path)
+    return -1;
+  njobs++;
+  return 0;
+}
+
+static int visit(const char *path,const struct stat *st,int type,struct FTW *ftw)
+{
+  (void)st;
+  (void)ftw;
+  if (type==FTW_F)
+    return addJob(path)<0?-1:0;
+  if (type==FTW_DNR || type==FTW_NS)
+  {
+    fprintf(stderr,"crcsum: %s: cannot read\n",path);
+    walkFailed=1;
+  }
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,"Usage : %s [-a model|generator] [-j threads] [-b chunk KB] [-q depth] [-m|-u] [-s] path...\n",argv0);
+  exit(2);
+}
+
+int main(int argc,char **argv)
+{
+  const char *algo="CRC-32";
+  int nthreads=(int)sysconf(_SC_NPROCESSORS_ONLN),stats=0,opt,i,failed=0,digits;
+  size_t k,counts[4]={0};
+  struct worker *workers;
+  uint64_t total=0;
+  double t0,t1;
+  while((opt=getopt(argc,argv,"a:j:b:q:mus"))!=-1)
+  {
+    switch(opt)
+    {
+      case 'a': algo=optarg; break;
+      case 'j': nthreads=atoi(optarg); break;
+      case 'b': chunkSize=(size_t)strtoul(optarg,NULL,10)<<10; break;
+      case 'q': depth=atoi(optarg); break;
+      case 'm': force=VIA_MMAP; break;
+      case 'u': force=VIA_URING; break;
+      case 's': stats=1; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind>=argc || nthreads<1 || depth<1 || depth>MAX_DEPTH || chunkSize==0 || chunkSize>(1u<<30))
+    usage(argv[0]);
+
+  if (crc_model_find(algo))
+    model=*crc_model_get(crc_model_find(algo));
+  else
+  {
+    uint64_t poly;
+    int width;
+    if (crc_parse_bits(algo,&poly,&width)<0 || width<1)
+    {
+      fprintf(stderr,"crcsum: %s is neither a model nor a generator\n",algo);
+      return 2;
+    }
+    memset(&model,0,sizeof(model));
+    model.name=algo;
+    model.width=width;
+    model.poly=poly;
+    crc_engine_init(&rawEngine,poly,width);
+  }
+  crc_kernel_get();
+
+  for(i=optind;i<argc;i++)
+  {
+    struct stat st;
+    if (stat(argv[i],&st)<0)
+    {
+      fprintf(stderr,"crcsum: %s: %s\n",argv[i],strerror(errno));
+      failed=1;
+    }
+    else if (S_ISDIR(st.st_mode))
+    {
+      if (nftw(argv[i],visit,64,FTW_PHYS)<0)
+      {
+        fprintf(stderr,"crcsum: out of memory\n");
+        return 1;
+      }
+    }
+    else if (addJob(argv[i])<0)
+    {
+      fprintf(stderr,"crcsum: out of memory\n");
+      return 1;
+    }
+  }
+  if ((size_t)nthreads>njobs)
+    nthreads=njobs?(int)njobs:1;
+
+  workers=calloc(nthreads,sizeof(*workers));
+  if (!workers)
+    return 1;
+  for(i=0;i<nthreads;i++)
+  {
+    int b;
+    workers[i].haveRing=force!=VIA_MMAP && uringInit(&workers[i].ring,(unsigned int)depth)==0;
+    for(b=0;b<depth;b++)
+      if (!(workers[i].buf[b]=aligned_alloc(4096,(chunkSize+4095)&~(size_t)4095)))
+      {
+        fprintf(stderr,"crcsum: out of memory\n");
+        return 1;
+      }
+  }
+  t0=now();
+  for(i=1;i<nthreads;i++)
+    pthread_create(&workers[i].tid,NULL,workerMain,&workers[i]);
+  workerMain(&workers[0]);
+  for(i=1;i<nthreads;i++)
+    pthread_join(workers[i].tid,NULL);
+  t1=now();
+
+  digits=(model.width+3)/4;
+  for(k=0;k<njobs;k++)
+  {
+    if (jobs[k].err)
+    {
+      fprintf(stderr,"crcsum: %s: %s\n",jobs[k].path,strerror(jobs[k].err));
+      failed=1;
+    }
+    else
+    {
+      printf("%0*llx %llu %s\n",digits,(unsigned long long)jobs[k].crc,
+             (unsigned long long)jobs[k].size,jobs[k].path);
+      counts[jobs[k].via]++;
+    }
+    free(jobs[k].path);
+  }
+  for(i=0;i<nthreads;i++)
+  {
+    int b;
+    total+=workers[i].bytes;
+    if (workers[i].ring.sqMap)
+      uringExit(&workers[i].ring);
+    for(b=0;b<depth;b++)
+      free(workers[i].buf[b]);
+  }
+  if (stats)
+    fprintf(stderr,"%zu files, %.1f MB in %.3f s, %.2f GB/s, %d threads (mmap %zu, io_uring %zu, pread %zu)\n",
+            njobs,total/1048576.0,t1-t0,total/(t1-t0)/1e9,nthreads,
+            counts[VIA_MMAP],counts[VIA_URING],counts[VIA_PREAD]);
+  free(jobs);
+  free(workers);
+  return failed||walkFailed;
+}
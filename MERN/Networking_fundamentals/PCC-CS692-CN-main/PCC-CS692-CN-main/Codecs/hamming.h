@@ -0,0 +1,268 @@
+#ifndef CODECS_HAMMING_H
+#define CODECS_HAMMING_H
+
+/*
+ * Bit-parallel Hamming SEC-DED encoder and decoder.
+ *
+ * Positions of an n-bit Hamming codeword are numbered n down to 1, as in
+ * the string codeword of Assignment7/server.c: check bit i sits at
+ * position 2^i, the data bits fill the other positions from the top, and
+ * check bit i is the parity of every position with bit i set.  With the
+ * positions fixed, each check bit is the parity of the data under a mask,
+ * so a code is built once into r masks and a dataword is encoded with one
+ * AND and popcount per mask and 64-bit word, no bit-by-bit loop.  An extra
+ * overall parity bit over the whole codeword extends the code to SEC-DED.
+ *
+ * Decoding re-encodes the received data: the XOR of the two sets of check
+ * bits is the syndrome, which is the position of a single flipped bit, and
+ * a table from position to data bit corrects it.  The overall parity tells
+ * a single error (odd weight) from a double one (even weight, syndrome
+ * not zero), which is detected but left alone.
+ *
+ * Datawords are bit-packed MSB first in 64-bit words: data bit 0, the
+ * first and top position, is bit 63 of word 0.  Check bits come back
+ * packed in one integer, bit i being check bit i and bit r the overall
+ * parity.
+ *
+ *   hamming_init()         any k up to HAMMING_MAX_DATA, i.e. the
+ *                          (2^r-1,2^r-1-r) codes and their shortened forms
+ *   hamming72_encode()     the (72,64) SEC-DED code with its masks and
+ *   hamming72_decode()     syndrome table as constants, for one uint64_t
+ *   hamming_encode_text()  '0'/'1' strings, the same codeword as hamming()
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+#define HAMMING_MAX_DATA 4096
+#define HAMMING_MAX_WORDS (HAMMING_MAX_DATA/64)
+#define HAMMING_MAX_R 13            /* 2^13-1-13 >= HAMMING_MAX_DATA */
+
+#define HAMMING_CLEAN 0
+#define HAMMING_CORRECTED 1         /* one bit flipped back */
+#define HAMMING_DOUBLE 2            /* two or more errors, detected only */
+
+struct hamming_code
+{
+  int k;                            /* data bits */
+  int r;                            /* check bits, without overall parity */
+  int n;                            /* k+r */
+  int words;                        /* 64-bit words per dataword */
+  uint64_t mask[HAMMING_MAX_R][HAMMING_MAX_WORDS];   /* data under check bit i */
+  uint16_t pos[HAMMING_MAX_DATA];   /* position of data bit j */
+  int16_t bit[1<<HAMMING_MAX_R];    /* data bit at position p, or -1 */
+};
+
+/* Builds the code for k data bits.  Returns -1 if k is out of range. */
+static inline int hamming_init(struct hamming_code *h,int k)
+{
+  int p,j=0;
+  memset(h,0,sizeof(*h));
+  if (k<1 || k>HAMMING_MAX_DATA)
+    return -1;
+  while((1<<h->r)<h->r+k+1)
+    h->r++;
+  h->k=k;
+  h->n=k+h->r;
+  h->words=(k+63)/64;
+  memset(h->bit,0xFF,sizeof(h->bit));
+  for(p=h->n;p>=1;p--)
+  {
+    int i;
+    if ((p&(p-1))==0)
+      continue;
+    h->pos[j]=p;
+    h->bit[p]=j;
+    for(i=0;i<h->r;i++)
+      if (p>>i&1)
+        h->mask[i][j/64]|=1ull<<(63-j%64);
+    j++;
+  }
+  return 0;
+}
+
+/* Check bits of one dataword of h->words words, bits past k being zero. */
+static inline uint32_t hamming_encode(const struct hamming_code *h,const uint64_t *data)
+{
+  uint32_t check=0;
+  uint64_t all=0;
+  int i,w;
+  for(w=0;w<h->words;w++)
+  {
+    for(i=0;i<h->r;i++)
+      check^=(uint32_t)__builtin_parityll(data[w]&h->mask[i][w])<<i;
+    all^=data[w];
+  }
+  check|=(uint32_t)(__builtin_parityll(all)^__builtin_parity(check))<<h->r;
+  return check;
+}
+
+/* Corrects one received dataword in place given its received check bits.
+   Returns HAMMING_CLEAN, HAMMING_CORRECTED with the flipped position in
+   *pos (0 for the overall parity bit), or HAMMING_DOUBLE. */
+static inline int hamming_decode(const struct hamming_code *h,uint64_t *data,uint32_t check,int *pos)
+{
+  uint32_t syn=(hamming_encode(h,data)^check)&((1u<<h->r)-1);
+  uint64_t all=0;
+  int w,odd;
+  for(w=0;w<h->words;w++)
+    all^=data[w];
+  odd=__builtin_parityll(all)^__builtin_parity(check&((2u<<h->r)-1));
+  if (!odd)
+    return syn?HAMMING_DOUBLE:HAMMING_CLEAN;
+  /* A syndrome past n cannot come from one flip of a shortened code. */
+  if (syn>(uint32_t)h->n)
+    return HAMMING_DOUBLE;
+  *pos=(int)syn;
+  if (syn && h->bit[syn]>=0)
+    data[h->bit[syn]/64]^=1ull<<(63-h->bit[syn]%64);
+  return HAMMING_CORRECTED;
+}
+
+#define HAMMING72_M0 0xAB55555556AAAD5Bull
+#define HAMMING72_M1 0xCD9999999B33366Dull
+#define HAMMING72_M2 0xF1E1E1E1E3C3C78Eull
+#define HAMMING72_M3 0x01FE01FE03FC07F0ull
+#define HAMMING72_M4 0x01FFFE0003FFF800ull
+#define HAMMING72_M5 0x01FFFFFFFC000000ull
+#define HAMMING72_M6 0xFE00000000000000ull
+
+/* Check byte of the (72,64) code, hamming_init(h,64) unrolled: bits 0-6
+   are the Hamming check bits, bit 7 the overall parity. */
+static inline uint8_t hamming72_encode(uint64_t data)
+{
+  uint32_t c=__builtin_parityll(data&HAMMING72_M0)
+            |__builtin_parityll(data&HAMMING72_M1)<<1
+            |__builtin_parityll(data&HAMMING72_M2)<<2
+            |__builtin_parityll(data&HAMMING72_M3)<<3
+            |__builtin_parityll(data&HAMMING72_M4)<<4
+            |__builtin_parityll(data&HAMMING72_M5)<<5
+            |__builtin_parityll(data&HAMMING72_M6)<<6;
+  return (uint8_t)(c|(__builtin_parityll(data)^__builtin_parity(c))<<7);
+}
+
+/* Syndrome to data bit of the (72,64) code: 0-63 a data bit, 64+i check
+   bit i, 255 no single position. */
+static const uint8_t hamming72_syndrome[128]=
+{
+  255,64,65,63,66,62,61,60,67,59,58,57,56,55,54,53,
+  68,52,51,50,49,48,47,46,45,44,43,42,41,40,39,38,
+  69,37,36,35,34,33,32,31,30,29,28,27,26,25,24,23,
+  22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,
+  70,6,5,4,3,2,1,0,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+};
+
+/* hamming_decode() of the (72,64) code. */
+static inline int hamming72_decode(uint64_t *data,uint8_t check,int *pos)
+{
+  uint32_t syn=(hamming72_encode(*data)^check)&0x7F;
+  uint32_t bit=hamming72_syndrome[syn];
+  if (!(__builtin_parityll(*data)^__builtin_parity(check)))
+    return syn?HAMMING_DOUBLE:HAMMING_CLEAN;
+  if (syn && bit==255)
+    return HAMMING_DOUBLE;
+  *pos=(int)syn;
+  if (bit<64)
+    *data^=1ull<<(63-bit);
+  return HAMMING_CORRECTED;
+}
+
+static inline void hamming72_encode_block(const uint64_t *data,uint8_t *check,size_t count)
+{
+  size_t i;
+  for(i=0;i<count;i++)
+    check[i]=hamming72_encode(data[i]);
+}
+
+/* Corrects count datawords in place, leaving each one's HAMMING_* result
+   in result.  Returns the number not clean. */
+static inline size_t hamming72_decode_block(uint64_t *data,const uint8_t *check,uint8_t *result,size_t count)
+{
+  size_t i,bad=0;
+  int pos;
+  for(i=0;i<count;i++)
+  {
+    result[i]=(uint8_t)hamming72_decode(&data[i],check[i],&pos);
+    bad+=result[i]!=HAMMING_CLEAN;
+  }
+  return bad;
+}
+
+/* Loads a dataword of (k+7)/8 bytes, MSB first, clearing the pad bits
+   after bit k. */
+static inline void hamming_load(const struct hamming_code *h,const unsigned char *in,uint64_t *data)
+{
+  int b,bytes=(h->k+7)/8;
+  memset(data,0,h->words*sizeof(uint64_t));
+  for(b=0;b<bytes;b++)
+    data[b/8]|=(uint64_t)in[b]<<(56-8*(b%8));
+  if (h->k%64)
+    data[h->words-1]&=~0ull<<(64-h->k%64);
+}
+
+/* Big-endian: one load and a byte swap. */
+static inline uint64_t hamming_load64(const unsigned char *in)
+{
+  uint64_t v;
+  memcpy(&v,in,8);
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  v=__builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/* Packs k '0'/'1' characters MSB first.  Returns -1 on any other
+   character. */
+static inline int hamming_pack(const char *bits,int k,uint64_t *data)
+{
+  int j;
+  memset(data,0,(k+63)/64*sizeof(uint64_t));
+  for(j=0;j<k;j++)
+  {
+    if (bits[j]!='0' && bits[j]!='1')
+      return -1;
+    data[j/64]|=(uint64_t)(bits[j]-'0')<<(63-j%64);
+  }
+  return 0;
+}
+
+/* Writes the n-character codeword, positions n down to 1, and with
+   secded the overall parity bit as position 0 after them. */
+static inline void hamming_format(const struct hamming_code *h,const uint64_t *data,uint32_t check,int secded,char *codeword)
+{
+  int p,j=0;
+  for(p=h->n;p>=1;p--)
+  {
+    if ((p&(p-1))==0)
+      codeword[h->n-p]='0'+(check>>__builtin_ctz(p)&1);
+    else
+    {
+      codeword[h->n-p]='0'+(data[j/64]>>(63-j%64)&1);
+      j++;
+    }
+  }
+  p=h->n;
+  if (secded)
+    codeword[p++]='0'+(check>>h->r&1);
+  codeword[p]='\0';
+}
+
+/* hamming() of Assignment7/server.c for a '0'/'1' dataword of up to
+   HAMMING_MAX_DATA bits.  h is rebuilt only when the length changes, so
+   zero it before the first call.  Returns -1 on a bad dataword. */
+static inline int hamming_encode_text(struct hamming_code *h,const char *dataword,char *codeword,int secded)
+{
+  uint64_t data[HAMMING_MAX_WORDS];
+  int k=strlen(dataword);
+  if (h->k!=k && hamming_init(h,k)<0)
+    return -1;
+  if (hamming_pack(dataword,k,data)<0)
+    return -1;
+  hamming_format(h,data,hamming_encode(h,data),secded,codeword);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef CODECS_HAMMING_INTERLEAVE_H
+#define CODECS_HAMMING_INTERLEAVE_H
+
+/*
+ * Interleaved (72,64) Hamming block codec for burst errors.
+ *
+ * The input is cut into 64-bit datawords, big-endian, and every depth of
+ * them form a block.  Each dataword becomes the 72-bit codeword of
+ * hamming.h (the eight data bytes, then the check byte), and the block is
+ * sent bit-interleaved: 72 rows of depth bits, row q holding bit q of
+ * every codeword, MSB first.  A burst of up to depth bits then flips at
+ * most one bit per codeword, which SEC-DED corrects; a block is 9*depth
+ * bytes for 8*depth bytes of input.
+ *
+ * The rows are the codewords bit-sliced, so no codeword is encoded on its
+ * own: check row i is the XOR of the data rows under HAMMING72_Mi, and on
+ * the way back the same XOR against the received check row gives a
+ * syndrome row.  Only the columns with a syndrome or odd parity are
+ * decoded one by one.  What is left is the bit-matrix transpose between
+ * datawords and rows:
+ *
+ *   avx2    8x8 byte transposes with unpacks on 32 datawords at a time,
+ *           then movemask per bit; the inverse with pshufb and compares
+ *   scalar  8x8 bit transposes of 64-bit words, 8 datawords at a time
+ *
+ * picked once from CPUID.  depth must be a multiple of 32.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include"hamming.h"
+
+#define HAMMING_IL_MAX_DEPTH 4096
+#define HAMMING_IL_ROWS 72
+
+/* Data rows with an even number of check bits over their position: their
+   XOR is the overall parity of a codeword. */
+#define HAMMING72_MP 0x972CD2D32DA65CB7ull
+
+#define HAMMING_IL_SCALAR 0
+#define HAMMING_IL_AVX2 1
+
+static const char *const hamming_il_kernel_names[]={"scalar","avx2"};
+
+struct hamming_il_stats
+{
+  uint64_t blocks;
+  uint64_t corrected;               /* codewords with one bit flipped back */
+  uint64_t doubles;                 /* codewords with a detected double error */
+};
+
+static inline int hamming_il_depth_ok(int depth)
+{
+  return depth>=32 && depth<=HAMMING_IL_MAX_DEPTH && depth%32==0;
+}
+
+/* Encoded size of len input bytes; the last block is zero-padded. */
+static inline size_t hamming_il_encoded_size(size_t len,int depth)
+{
+  return (len+8*(size_t)depth-1)/(8*(size_t)depth)*9*depth;
+}
+
+static inline uint32_t hamming_il_load32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v,p,4);
+  return v;
+}
+
+static inline void hamming_il_store32(unsigned char *p,uint32_t v)
+{
+  memcpy(p,&v,4);
+}
+
+static const uint64_t hamming_il_masks[7]=
+{
+  HAMMING72_M0,HAMMING72_M1,HAMMING72_M2,HAMMING72_M3,HAMMING72_M4,HAMMING72_M5,HAMMING72_M6
+};
+
+/* The XORs of the data rows under HAMMING72_M0-M6 and HAMMING72_MP for 4
+   bytes at offset x: c[i] for check bit i, c[7] for the parity.  The
+   masks are constants, so the unrolled loop is straight-line code. */
+static inline void hamming_il_sums32(const unsigned char *rows,size_t rowBytes,size_t x,uint32_t c[8])
+{
+  int q,i;
+  for(i=0;i<8;i++)
+    c[i]=0;
+#pragma GCC unroll 64
+  for(q=0;q<64;q++)
+  {
+    uint32_t v=hamming_il_load32(rows+q*rowBytes+x);
+#pragma GCC unroll 7
+    for(i=0;i<7;i++)
+      if (hamming_il_masks[i]>>(63-q)&1)
+        c[i]^=v;
+    if (HAMMING72_MP>>(63-q)&1)
+      c[7]^=v;
+  }
+}
+
+/* Check rows 64-71 of a block from its data rows, for bytes [from,to) of
+   each row.  Row 64 is the overall parity, row 71-i check bit i. */
+static inline void hamming_il_checks_scalar(unsigned char *rows,size_t rowBytes,size_t from,size_t to)
+{
+  size_t x;
+  int i;
+  for(x=from;x<to;x+=4)
+  {
+    uint32_t c[8];
+    hamming_il_sums32(rows,rowBytes,x,c);
+    for(i=0;i<7;i++)
+      hamming_il_store32(rows+(71-i)*rowBytes+x,c[i]);
+    hamming_il_store32(rows+64*rowBytes+x,c[7]);
+  }
+}
+
+/* Syndrome rows of a received block: syn+i*rowBytes for check bit i,
+   syn+7*rowBytes the odd-parity row and syn+8*rowBytes their OR, which
+   flags the codewords to decode. */
+static inline void hamming_il_syndromes_scalar(const unsigned char *rows,size_t rowBytes,unsigned char *syn,size_t from,size_t to)
+{
+  size_t x;
+  int i;
+  for(x=from;x<to;x+=4)
+  {
+    uint32_t c[8],odd,any=0;
+    hamming_il_sums32(rows,rowBytes,x,c);
+    odd=c[7]^hamming_il_load32(rows+64*rowBytes+x);
+    for(i=0;i<7;i++)
+    {
+      uint32_t s=c[i]^hamming_il_load32(rows+(71-i)*rowBytes+x);
+      hamming_il_store32(syn+i*rowBytes+x,s);
+      odd^=s;
+      any|=s;
+    }
+    hamming_il_store32(syn+7*rowBytes+x,odd);
+    hamming_il_store32(syn+8*rowBytes+x,any|odd);
+  }
+}
+
+/* 8x8 bit transpose, row i being byte i from the top and column 0 the
+   MSB of each byte. */
+static inline uint64_t hamming_il_transpose8(uint64_t x)
+{
+  uint64_t t;
+  t=(x^(x>>7))&0x00AA00AA00AA00AAull;
+  x^=t^(t<<7);
+  t=(x^(x>>14))&0x0000CCCC0000CCCCull;
+  x^=t^(t<<14);
+  t=(x^(x>>28))&0x00000000F0F0F0F0ull;
+  x^=t^(t<<28);
+  return x;
+}
+
+/* Data rows of one block, 8 datawords at a time. */
+static inline void hamming_il_rows_scalar(const unsigned char *in,unsigned char *rows,int depth)
+{
+  size_t rowBytes=depth/8;
+  int c,b,j,t;
+  for(c=0;c<depth;c+=8)
+    for(b=0;b<8;b++)
+    {
+      uint64_t x=0;
+      for(j=0;j<8;j++)
+        x|=(uint64_t)in[8*(c+j)+b]<<(56-8*j);
+      x=hamming_il_transpose8(x);
+      for(t=0;t<8;t++)
+        rows[(8*b+t)*rowBytes+c/8]=(unsigned char)(x>>(56-8*t));
+    }
+}
+
+/* Datawords of one block back from its data rows. */
+static inline void hamming_il_words_scalar(const unsigned char *rows,unsigned char *out,int depth)
+{
+  size_t rowBytes=depth/8;
+  int c,b,j,t;
+  for(c=0;c<depth;c+=8)
+    for(b=0;b<8;b++)
+    {
+      uint64_t x=0;
+      for(t=0;t<8;t++)
+        x|=(uint64_t)rows[(8*b+t)*rowBytes+c/8]<<(56-8*t);
+      x=hamming_il_transpose8(x);
+      for(j=0;j<8;j++)
+        out[8*(c+j)+b]=(unsigned char)(x>>(56-8*j));
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+#include<immintrin.h>
+
+static inline int hamming_il_detect(void)
+{
+  unsigned int a,b,c,d,xcr0=0;
+  if (!__get_cpuid(1,&a,&b,&c,&d) || !(c&bit_OSXSAVE) || !(c&bit_AVX))
+    return HAMMING_IL_SCALAR;
+  __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+  if ((xcr0&0x6)!=0x6 || !__get_cpuid_count(7,0,&a,&b,&c,&d) || !(b&bit_AVX2))
+    return HAMMING_IL_SCALAR;
+  return HAMMING_IL_AVX2;
+}
+
+/* Per 128-bit lane, an 8x8 byte transpose of the rows [r0 r1], [r2 r3],
+   [r4 r5], [r6 r7] into the columns in the same layout. */
+__attribute__((target("avx2")))
+static inline void hamming_il_t8x8(__m256i *y01,__m256i *y23,__m256i *y45,__m256i *y67)
+{
+  __m256i a=_mm256_unpacklo_epi64(*y01,*y45),b=_mm256_unpackhi_epi64(*y01,*y45);
+  __m256i c=_mm256_unpacklo_epi64(*y23,*y67),d=_mm256_unpackhi_epi64(*y23,*y67);
+  __m256i abLo=_mm256_unpacklo_epi8(a,b),abHi=_mm256_unpackhi_epi8(a,b);
+  __m256i cdLo=_mm256_unpacklo_epi8(c,d),cdHi=_mm256_unpackhi_epi8(c,d);
+  __m256i l03=_mm256_unpacklo_epi16(abLo,cdLo),h03=_mm256_unpackhi_epi16(abLo,cdLo);
+  __m256i l47=_mm256_unpacklo_epi16(abHi,cdHi),h47=_mm256_unpackhi_epi16(abHi,cdHi);
+  *y01=_mm256_unpacklo_epi32(l03,l47);
+  *y23=_mm256_unpackhi_epi32(l03,l47);
+  *y45=_mm256_unpacklo_epi32(h03,h47);
+  *y67=_mm256_unpackhi_epi32(h03,h47);
+}
+
+/* Byte planes of 16 datawords, words 0-7 in the low lanes and 8-15 in the
+   high: p[k] holds planes 2k and 2k+1. */
+__attribute__((target("avx2")))
+static inline void hamming_il_planes16(const unsigned char *in,__m256i p[4])
+{
+  int k;
+  for(k=0;k<4;k++)
+    p[k]=_mm256_loadu2_m128i((const __m128i *)(in+64+16*k),(const __m128i *)(in+16*k));
+  hamming_il_t8x8(&p[0],&p[1],&p[2],&p[3]);
+}
+
+__attribute__((target("avx2")))
+static inline void hamming_il_rows_avx2(const unsigned char *in,unsigned char *rows,int depth)
+{
+  const __m256i rev=_mm256_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,
+                                     7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+  size_t rowBytes=depth/8;
+  int c,k,t;
+  for(c=0;c<depth;c+=32)
+  {
+    __m256i lo[4],hi[4];
+    hamming_il_planes16(in+8*c,lo);
+    hamming_il_planes16(in+8*c+128,hi);
+    for(k=0;k<4;k++)
+    {
+      /* [G0 G2 | G1 G3] of two planes, then each plane in group order.
+         Reversing each group's bytes puts column 0 at the MSB. */
+      __m256i pl[2];
+      pl[0]=_mm256_permute4x64_epi64(_mm256_unpacklo_epi64(lo[k],hi[k]),0xD8);
+      pl[1]=_mm256_permute4x64_epi64(_mm256_unpackhi_epi64(lo[k],hi[k]),0xD8);
+      for(int h=0;h<2;h++)
+      {
+        __m256i v=_mm256_shuffle_epi8(pl[h],rev);
+        unsigned char *r=rows+8*(2*k+h)*rowBytes+c/8;
+        for(t=0;t<8;t++)
+        {
+          hamming_il_store32(r+t*rowBytes,(uint32_t)_mm256_movemask_epi8(v));
+          v=_mm256_add_epi8(v,v);
+        }
+      }
+    }
+  }
+}
+
+/* Plane b of 32 columns from its eight rows: each row's 32 bits spread
+   to one byte per column, bit 7-t. */
+__attribute__((target("avx2")))
+static inline __m256i hamming_il_plane_avx2(const unsigned char *r,size_t rowBytes)
+{
+  const __m256i spread=_mm256_setr_epi8(0,0,0,0,0,0,0,0,1,1,1,1,1,1,1,1,
+                                        2,2,2,2,2,2,2,2,3,3,3,3,3,3,3,3);
+  const __m256i bits=_mm256_set1_epi64x((long long)0x0102040810204080ull);
+  __m256i p=_mm256_setzero_si256();
+  int t;
+  for(t=0;t<8;t++)
+  {
+    __m256i v=_mm256_shuffle_epi8(_mm256_set1_epi32((int)hamming_il_load32(r+t*rowBytes)),spread);
+    v=_mm256_cmpeq_epi8(_mm256_and_si256(v,bits),bits);
+    p=_mm256_sub_epi8(_mm256_add_epi8(p,p),v);
+  }
+  return p;
+}
+
+__attribute__((target("avx2")))
+static inline void hamming_il_words_avx2(const unsigned char *rows,unsigned char *out,int depth)
+{
+  size_t rowBytes=depth/8;
+  int c,k;
+  for(c=0;c<depth;c+=32)
+  {
+    __m256i lo[4],hi[4];
+    for(k=0;k<4;k++)
+    {
+      __m256i p0=_mm256_permute4x64_epi64(hamming_il_plane_avx2(rows+16*k*rowBytes+c/8,rowBytes),0xD8);
+      __m256i p1=_mm256_permute4x64_epi64(hamming_il_plane_avx2(rows+(16*k+8)*rowBytes+c/8,rowBytes),0xD8);
+      lo[k]=_mm256_unpacklo_epi64(p0,p1);
+      hi[k]=_mm256_unpackhi_epi64(p0,p1);
+    }
+    hamming_il_t8x8(&lo[0],&lo[1],&lo[2],&lo[3]);
+    hamming_il_t8x8(&hi[0],&hi[1],&hi[2],&hi[3]);
+    for(k=0;k<4;k++)
+    {
+      _mm256_storeu2_m128i((__m128i *)(out+8*c+64+16*k),(__m128i *)(out+8*c+16*k),lo[k]);
+      _mm256_storeu2_m128i((__m128i *)(out+8*c+192+16*k),(__m128i *)(out+8*c+128+16*k),hi[k]);
+    }
+  }
+}
+
+/* hamming_il_sums32() over 32 bytes. */
+__attribute__((target("avx2")))
+static inline void hamming_il_sums256(const unsigned char *rows,size_t rowBytes,size_t x,__m256i c[8])
+{
+  int q,i;
+  for(i=0;i<8;i++)
+    c[i]=_mm256_setzero_si256();
+#pragma GCC unroll 64
+  for(q=0;q<64;q++)
+  {
+    __m256i v=_mm256_loadu_si256((const __m256i *)(rows+q*rowBytes+x));
+#pragma GCC unroll 7
+    for(i=0;i<7;i++)
+      if (hamming_il_masks[i]>>(63-q)&1)
+        c[i]=_mm256_xor_si256(c[i],v);
+    if (HAMMING72_MP>>(63-q)&1)
+      c[7]=_mm256_xor_si256(c[7],v);
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void hamming_il_checks_avx2(unsigned char *rows,size_t rowBytes)
+{
+  size_t x;
+  int i;
+  for(x=0;x+32<=rowBytes;x+=32)
+  {
+    __m256i c[8];
+    hamming_il_sums256(rows,rowBytes,x,c);
+    for(i=0;i<7;i++)
+      _mm256_storeu_si256((__m256i *)(rows+(71-i)*rowBytes+x),c[i]);
+    _mm256_storeu_si256((__m256i *)(rows+64*rowBytes+x),c[7]);
+  }
+  hamming_il_checks_scalar(rows,rowBytes,x,rowBytes);
+}
+
+__attribute__((target("avx2")))
+static inline void hamming_il_syndromes_avx2(const unsigned char *rows,size_t rowBytes,unsigned char *syn)
+{
+  size_t x;
+  int i;
+  for(x=0;x+32<=rowBytes;x+=32)
+  {
+    __m256i c[8],odd,any=_mm256_setzero_si256();
+    hamming_il_sums256(rows,rowBytes,x,c);
+    odd=_mm256_xor_si256(c[7],_mm256_loadu_si256((const __m256i *)(rows+64*rowBytes+x)));
+    for(i=0;i<7;i++)
+    {
+      __m256i s=_mm256_xor_si256(c[i],_mm256_loadu_si256((const __m256i *)(rows+(71-i)*rowBytes+x)));
+      _mm256_storeu_si256((__m256i *)(syn+i*rowBytes+x),s);
+      odd=_mm256_xor_si256(odd,s);
+      any=_mm256_or_si256(any,s);
+    }
+    _mm256_storeu_si256((__m256i *)(syn+7*rowBytes+x),odd);
+    _mm256_storeu_si256((__m256i *)(syn+8*rowBytes+x),_mm256_or_si256(any,odd));
+  }
+  hamming_il_syndromes_scalar(rows,rowBytes,syn,x,rowBytes);
+}
+
+#else
+
+static inline int hamming_il_detect(void)
+{
+  return HAMMING_IL_SCALAR;
+}
+
+#endif
+
+static int hamming_il_tier=-1;
+
+/* Kernel in use; detected on first call, without a data race. */
+static inline int hamming_il_kernel_get(void)
+{
+  int tier=__atomic_load_n(&hamming_il_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=hamming_il_detect();
+    if (!__atomic_compare_exchange_n(&hamming_il_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to compare them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int hamming_il_kernel_set(int tier)
+{
+  if (tier<HAMMING_IL_SCALAR || tier>hamming_il_detect())
+    return -1;
+  __atomic_store_n(&hamming_il_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* One block: 8*depth bytes in, 9*depth bytes of rows out. */
+static inline void hamming_il_encode_block(const unsigned char *in,unsigned char *out,int depth)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (hamming_il_kernel_get()==HAMMING_IL_AVX2)
+  {
+    hamming_il_rows_avx2(in,out,depth);
+    hamming_il_checks_avx2(out,depth/8);
+    return;
+  }
+#endif
+  hamming_il_rows_scalar(in,out,depth);
+  hamming_il_checks_scalar(out,depth/8,0,depth/8);
+}
+
+/* Reads bit c of a row. */
+static inline int hamming_il_bit(const unsigned char *row,int c)
+{
+  return row[c/8]>>(7-c%8)&1;
+}
+
+/* One block back: 9*depth bytes of rows in, 8*depth corrected bytes out. */
+static inline void hamming_il_decode_block(const unsigned char *in,unsigned char *out,int depth,struct hamming_il_stats *st)
+{
+  unsigned char syn[9*HAMMING_IL_MAX_DEPTH/8];
+  size_t rowBytes=depth/8,x;
+  int i;
+#if defined(__x86_64__) || defined(__i386__)
+  if (hamming_il_kernel_get()==HAMMING_IL_AVX2)
+  {
+    hamming_il_syndromes_avx2(in,rowBytes,syn);
+    hamming_il_words_avx2(in,out,depth);
+  }
+  else
+#endif
+  {
+    hamming_il_syndromes_scalar(in,rowBytes,syn,0,rowBytes);
+    hamming_il_words_scalar(in,out,depth);
+  }
+  st->blocks++;
+  /* Errors are rare: only flagged columns are looked at one by one. */
+  for(x=0;x<rowBytes;x+=4)
+  {
+    uint32_t flags=hamming_il_load32(syn+8*rowBytes+x);
+    int b;
+    if (!flags)
+      continue;
+    for(b=0;b<32;b++)
+    {
+      int c=(int)(8*x)+b,s=0,bit;
+      if (!hamming_il_bit(syn+8*rowBytes,c))
+        continue;
+      for(i=0;i<7;i++)
+        s|=hamming_il_bit(syn+i*rowBytes,c)<<i;
+      if (!hamming_il_bit(syn+7*rowBytes,c))
+      {
+        st->doubles++;
+        continue;
+      }
+      bit=hamming72_syndrome[s];
+      if (s && bit==255)
+      {
+        st->doubles++;
+        continue;
+      }
+      if (s && bit<64)
+        out[8*c+bit/8]^=(unsigned char)(0x80>>(bit%8));
+      st->corrected++;
+    }
+  }
+}
+
+/* Encodes len bytes into hamming_il_encoded_size(len,depth) bytes.
+   Returns -1 on a bad depth. */
+static inline int hamming_il_encode(const unsigned char *in,size_t len,unsigned char *out,int depth)
+{
+  size_t blockIn=8*(size_t)depth,blockOut=9*(size_t)depth;
+  if (!hamming_il_depth_ok(depth))
+    return -1;
+  for(;len>=blockIn;len-=blockIn,in+=blockIn,out+=blockOut)
+    hamming_il_encode_block(in,out,depth);
+  if (len)
+  {
+    unsigned char last[8*HAMMING_IL_MAX_DEPTH];
+    memcpy(last,in,len);
+    memset(last+len,0,blockIn-len);
+    hamming_il_encode_block(last,out,depth);
+  }
+  return 0;
+}
+
+/* Decodes len bytes, a whole number of blocks, into len/9*8 bytes,
+   correcting what it can and counting into st.  Returns -1 on a bad depth
+   or length. */
+static inline int hamming_il_decode(const unsigned char *in,size_t len,unsigned char *out,int depth,struct hamming_il_stats *st)
+{
+  size_t blockIn=9*(size_t)depth,blockOut=8*(size_t)depth;
+  if (!hamming_il_depth_ok(depth) || len%blockIn)
+    return -1;
+  for(;len;len-=blockIn,in+=blockIn,out+=blockOut)
+    hamming_il_decode_block(in,out,depth,st);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef CODECS_HAMMING_SYNDROME_H
+#define CODECS_HAMMING_SYNDROME_H
+
+/*
+ * One-pass syndrome decoder for Hamming codewords of any length.
+ *
+ * A codeword is bit-packed by position: bit p of the buffer, MSB first
+ * (bit 7-p%8 of byte p/8), is Hamming position p, so positions 1..n read
+ * left to right as in Assignment1/HammingCode.c, and bit 0 holds the
+ * overall parity bit of the SEC-DED extension.  Check bit i sits at
+ * position 2^i and makes the XOR of the positions of all set bits zero;
+ * after one flip that XOR, the syndrome, is the flipped position.  Bits
+ * after position n must be zero.
+ *
+ * The XOR of set-bit positions needs no per-check-bit pass over the
+ * codeword.  Its low three bits and the parity of a byte depend on the
+ * byte alone, so one 256-entry table covers a byte and the byte's offset
+ * is folded in when its parity is odd.  Taking 64 bits at a time, the low
+ * six bits of the syndrome are linear in the data, so the words are only
+ * XORed together and six masked parities are taken at the end, while the
+ * word's own offset is folded in when its parity is odd.
+ *
+ *   hamming_syn_bits()    set bits one by one, the reference
+ *   hamming_syn_bytes()   the byte table
+ *   hamming_syn_words()   64-bit words, the table for the tail
+ *
+ * Each returns the syndrome and the overall parity; correcting is then
+ * a single bit flip.  Add -mpopcnt to make each parity one instruction.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include"hamming.h"
+
+/* Per byte: bits 0-2 the XOR of the offsets (0 for the MSB) of its set
+   bits, bit 3 its parity. */
+static const uint8_t hamming_syn_lut[256]=
+{
+  0,15,14,1,13,2,3,12,12,3,2,13,1,14,15,0,
+  11,4,5,10,6,9,8,7,7,8,9,6,10,5,4,11,
+  10,5,4,11,7,8,9,6,6,9,8,7,11,4,5,10,
+  1,14,15,0,12,3,2,13,13,2,3,12,0,15,14,1,
+  9,6,7,8,4,11,10,5,5,10,11,4,8,7,6,9,
+  2,13,12,3,15,0,1,14,14,1,0,15,3,12,13,2,
+  3,12,13,2,14,1,0,15,15,0,1,14,2,13,12,3,
+  8,7,6,9,5,10,11,4,4,11,10,5,9,6,7,8,
+  8,7,6,9,5,10,11,4,4,11,10,5,9,6,7,8,
+  3,12,13,2,14,1,0,15,15,0,1,14,2,13,12,3,
+  2,13,12,3,15,0,1,14,14,1,0,15,3,12,13,2,
+  9,6,7,8,4,11,10,5,5,10,11,4,8,7,6,9,
+  1,14,15,0,12,3,2,13,13,2,3,12,0,15,14,1,
+  10,5,4,11,7,8,9,6,6,9,8,7,11,4,5,10,
+  11,4,5,10,6,9,8,7,7,8,9,6,10,5,4,11,
+  0,15,14,1,13,2,3,12,12,3,2,13,1,14,15,0,
+};
+
+/* Bits of a big-endian 64-bit word whose offset has bit i set. */
+static const uint64_t hamming_syn_masks[6]=
+{
+  0x5555555555555555ull,0x3333333333333333ull,0x0F0F0F0F0F0F0F0Full,
+  0x00FF00FF00FF00FFull,0x0000FFFF0000FFFFull,0x00000000FFFFFFFFull,
+};
+
+/* Bytes of a codeword with positions 0..n. */
+static inline size_t hamming_syn_size(uint64_t n)
+{
+  return (size_t)(n/8+1);
+}
+
+static inline int hamming_syn_get(const unsigned char *cw,uint64_t p)
+{
+  return cw[p/8]>>(7-p%8)&1;
+}
+
+static inline void hamming_syn_flip(unsigned char *cw,uint64_t p)
+{
+  cw[p/8]^=(unsigned char)(0x80>>(p%8));
+}
+
+/* Syndrome of positions 0..n by walking the set bits of each byte. */
+static inline uint64_t hamming_syn_bits(const unsigned char *cw,uint64_t n,int *odd)
+{
+  size_t bytes=hamming_syn_size(n),i;
+  uint64_t syn=0;
+  int par=0;
+  for(i=0;i<bytes;i++)
+  {
+    unsigned int b=cw[i];
+    while(b)
+    {
+      int top=__builtin_clz(b)-24;
+      syn^=8*(uint64_t)i+top;
+      par^=1;
+      b&=~(0x80u>>top);
+    }
+  }
+  *odd=par;
+  return syn;
+}
+
+/* Syndrome of len bytes that start at byte first of the codeword. */
+static inline uint64_t hamming_syn_lut_run(const unsigned char *p,size_t first,size_t len,int *odd)
+{
+  uint64_t syn=0;
+  int par=0;
+  size_t i;
+  for(i=0;i<len;i++)
+  {
+    unsigned int v=hamming_syn_lut[p[i]];
+    syn^=(v&7)^(-(uint64_t)(v>>3)&8*(uint64_t)(first+i));
+    par^=v>>3;
+  }
+  *odd=par;
+  return syn;
+}
+
+static inline uint64_t hamming_syn_bytes(const unsigned char *cw,uint64_t n,int *odd)
+{
+  return hamming_syn_lut_run(cw,0,hamming_syn_size(n),odd);
+}
+
+static inline uint64_t hamming_syn_words(const unsigned char *cw,uint64_t n,int *odd)
+{
+  size_t bytes=hamming_syn_size(n),words=bytes/8,w;
+  uint64_t all=0,hi=0,syn;
+  int i,par=0,tail;
+  /* Parity and XOR do not care about byte order: swap once at the end. */
+  for(w=0;w<words;w++)
+  {
+    uint64_t x;
+    int px;
+    memcpy(&x,cw+8*w,8);
+    px=__builtin_parityll(x);
+    all^=x;
+    hi^=-(uint64_t)px&64*(uint64_t)w;
+    par^=px;
+  }
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  all=__builtin_bswap64(all);
+#endif
+  syn=hi^hamming_syn_lut_run(cw+8*words,8*words,bytes-8*words,&tail);
+  for(i=0;i<6;i++)
+    syn^=(uint64_t)__builtin_parityll(all&hamming_syn_masks[i])<<i;
+  *odd=par^tail;
+  return syn;
+}
+
+/* Corrects a SEC-DED codeword of positions 0..n in place.  Returns
+   HAMMING_CLEAN, HAMMING_CORRECTED with the flipped position in *pos (0
+   for the overall parity bit), or HAMMING_DOUBLE. */
+static inline int hamming_syn_decode(unsigned char *cw,uint64_t n,uint64_t *pos)
+{
+  int odd;
+  uint64_t syn=hamming_syn_words(cw,n,&odd);
+  if (!odd)
+    return syn?HAMMING_DOUBLE:HAMMING_CLEAN;
+  if (syn>n)
+    return HAMMING_DOUBLE;
+  hamming_syn_flip(cw,syn);
+  *pos=syn;
+  return HAMMING_CORRECTED;
+}
+
+/* Sets the check bits at the powers of two up to n and the overall parity
+   bit of a codeword whose data positions are filled in; the bits after
+   position n are cleared. */
+static inline void hamming_syn_encode(unsigned char *cw,uint64_t n)
+{
+  uint64_t p,syn;
+  int odd;
+  cw[n/8]&=(unsigned char)(0xFF00>>(n%8+1));
+  cw[0]&=0x7F;
+  for(p=1;p<=n;p<<=1)
+    cw[p/8]&=(unsigned char)~(0x80>>(p%8));
+  syn=hamming_syn_words(cw,n,&odd);
+  for(p=1;p<=n;p<<=1)
+    if (syn&p)
+    {
+      hamming_syn_flip(cw,p);
+      odd^=1;
+    }
+  if (odd)
+    hamming_syn_flip(cw,0);
+}
+
+/* Corrects count codewords of positions 0..n stored back to back,
+   leaving each one's HAMMING_* result in result.  Returns the number not
+   clean. */
+static inline size_t hamming_syn_decode_block(unsigned char *cws,uint64_t n,size_t count,uint8_t *result)
+{
+  size_t size=hamming_syn_size(n),i,bad=0;
+  uint64_t pos;
+  for(i=0;i<count;i++,cws+=size)
+  {
+    result[i]=(uint8_t)hamming_syn_decode(cws,n,&pos);
+    bad+=result[i]!=HAMMING_CLEAN;
+  }
+  return bad;
+}
+
+#endif
@@ -0,0 +1,551 @@
+/*
+ * hamstream.c - Hamming encoding of files and pipes of any size.
+ *
+ *   gcc -O2 -pthread hamstream.c -o hamstream
+ *   ./hamstream [-i depth] [-b KB] [-j threads] [-s] [in [out]]
+ *   ./hamstream -d [-j threads] [-s] [in [out]]
+ *
+ * Encodes in (default stdin) to out (default stdout) with the (72,64)
+ * SEC-DED code of hamming.h, or with -d decodes and corrects it back.
+ * Unlike the string routines of Assignment1 and Assignment7, which stop
+ * at a few dozen bits, the input is cut into blocks (default 1 MB) and
+ * any length goes through in bounded memory: a batch of two blocks per
+ * thread is read, coded by all threads at once, and written out in order.
+ * A regular file is read through mmap + MADV_SEQUENTIAL, anything else
+ * with read().
+ *
+ * The output is a self-describing container, integers big-endian:
+ *
+ *   header    char[4] "HAMS", u8 version 1, u8 code, u16 depth,
+ *             u16 n 72, u16 k 64, u32 block bytes, u8 check 1 (CRC-32C),
+ *             3 bytes zero, u32 CRC-32C of the 20 bytes before it
+ *   block     u32 seq, u32 len, u32 CRC-32C of the len input bytes,
+ *             u32 CRC-32C of these 12 bytes, then the coded len bytes
+ *   trailer   a block header with seq the block count, len 0 and the
+ *             CRC-32C of the whole input, and no payload
+ *
+ * Code HAMSTREAM_CODE_PLAIN stores each 64-bit dataword as its 9-byte
+ * codeword; HAMSTREAM_CODE_INTERLEAVED (the default, depth 256) stores
+ * blocks of hamming_interleave.h, so a burst of up to depth bits is
+ * corrected as well.  Every block but the last holds exactly block input
+ * bytes, the last is zero-padded to whole datawords or interleave blocks.
+ *
+ * On decode the per-block CRC catches what SEC-DED cannot (three or more
+ * flips in a codeword); such a block is still written, reported on stderr
+ * and makes the exit status 1.  -s prints throughput and the number of
+ * corrected codewords to stderr.
+ */
+
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<time.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<pthread.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"crc_model.h"
+#include"hamming_interleave.h"
+
+#define HAMSTREAM_MAGIC "HAMS"
+#define HAMSTREAM_VERSION 1
+#define HAMSTREAM_HDR 24
+#define HAMSTREAM_BLOCK_HDR 16
+#define HAMSTREAM_CODE_PLAIN 1
+#define HAMSTREAM_CODE_INTERLEAVED 2
+#define HAMSTREAM_CHECK_CRC32C 1
+
+#define MAX_THREADS 64
+#define MAX_BLOCK (256u<<20)
+
+struct slot
+{
+  const unsigned char *in;
+  unsigned char *out;
+  uint32_t seq,len,crc;
+  int bad;                    /* decode: CRC mismatch after correction */
+  struct hamming_il_stats st;
+};
+
+/* Options, and the batch shared with the workers. */
+static int code=HAMSTREAM_CODE_INTERLEAVED,depth=256,decoding;
+static size_t blockSize=1<<20;
+static struct slot *slots;
+static int nslots,nextSlot,finished,stop;
+static pthread_mutex_t lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start=PTHREAD_COND_INITIALIZER,done=PTHREAD_COND_INITIALIZER;
+
+static uint32_t get32(const unsigned char *p)
+{
+  return (uint32_t)p[0]<<24|(uint32_t)p[1]<<16|(uint32_t)p[2]<<8|p[3];
+}
+
+static void put32(unsigned char *p,uint32_t v)
+{
+  p[0]=(unsigned char)(v>>24);
+  p[1]=(unsigned char)(v>>16);
+  p[2]=(unsigned char)(v>>8);
+  p[3]=(unsigned char)v;
+}
+
+static uint32_t crcOf(const void *buf,size_t len)
+{
+  return (uint32_t)crc32c(buf,len);
+}
+
+/* Coded bytes of a block of len input bytes. */
+static size_t payloadSize(size_t len)
+{
+  if (code==HAMSTREAM_CODE_INTERLEAVED)
+    return hamming_il_encoded_size(len,depth);
+  return (len+7)/8*9;
+}
+
+static void putBlockHeader(unsigned char *p,uint32_t seq,uint32_t len,uint32_t crc)
+{
+  put32(p,seq);
+  put32(p+4,len);
+  put32(p+8,crc);
+  put32(p+12,crcOf(p,12));
+}
+
+/* ---- one block, run by any thread ---- */
+
+static void encodePlain(const unsigned char *in,size_t len,unsigned char *out)
+{
+  unsigned char last[8]={0};
+  size_t i;
+  for(i=0;i+8<=len;i+=8,out+=9)
+  {
+    memcpy(out,in+i,8);
+    out[8]=hamming72_encode(hamming_load64(in+i));
+  }
+  if (i<len)
+  {
+    memcpy(last,in+i,len-i);
+    memcpy(out,last,8);
+    out[8]=hamming72_encode(hamming_load64(last));
+  }
+}
+
+/* Writes whole datawords, so out needs len rounded up to 8 bytes. */
+static void decodePlain(const unsigned char *in,size_t len,unsigned char *out,struct hamming_il_stats *st)
+{
+  size_t i;
+  int b,pos;
+  for(i=0;i<len;i+=8,in+=9,out+=8)
+  {
+    uint64_t d=hamming_load64(in);
+    int r=hamming72_decode(&d,in[8],&pos);
+    st->corrected+=r==HAMMING_CORRECTED;
+    st->doubles+=r==HAMMING_DOUBLE;
+    for(b=0;b<8;b++)
+      out[b]=(unsigned char)(d>>(56-8*b));
+  }
+  st->blocks++;
+}
+
+static void runSlot(struct slot *s)
+{
+  if (!decoding)
+  {
+    s->crc=crcOf(s->in,s->len);
+    putBlockHeader(s->out,s->seq,s->len,s->crc);
+    if (code==HAMSTREAM_CODE_INTERLEAVED)
+      hamming_il_encode(s->in,s->len,s->out+HAMSTREAM_BLOCK_HDR,depth);
+    else
+      encodePlain(s->in,s->len,s->out+HAMSTREAM_BLOCK_HDR);
+    return;
+  }
+  if (code==HAMSTREAM_CODE_INTERLEAVED)
+    hamming_il_decode(s->in,payloadSize(s->len),s->out,depth,&s->st);
+  else
+    decodePlain(s->in,s->len,s->out,&s->st);
+  s->bad=crcOf(s->out,s->len)!=s->crc;
+}
+
+/* ---- the batch: workers and the main thread claim slots ---- */
+
+/* Called and returns with lock held. */
+static void workBatch(void)
+{
+  while(nextSlot<nslots)
+  {
+    struct slot *s=&slots[nextSlot++];
+    pthread_mutex_unlock(&lock);
+    runSlot(s);
+    pthread_mutex_lock(&lock);
+    if (++finished==nslots)
+      pthread_cond_broadcast(&done);
+  }
+}
+
+static void *workerMain(void *arg)
+{
+  (void)arg;
+  pthread_mutex_lock(&lock);
+  while(!stop)
+  {
+    if (nextSlot<nslots)
+      workBatch();
+    else
+      pthread_cond_wait(&start,&lock);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+static void runBatch(int n)
+{
+  pthread_mutex_lock(&lock);
+  nslots=n;
+  nextSlot=0;
+  finished=0;
+  pthread_cond_broadcast(&start);
+  workBatch();
+  while(finished<n)
+    pthread_cond_wait(&done,&lock);
+  pthread_mutex_unlock(&lock);
+}
+
+/* ---- input and output ---- */
+
+struct source
+{
+  int fd;
+  const unsigned char *map;   /* whole file, or NULL to read() */
+  size_t mapLen,off;
+  unsigned char *buf;         /* read() target, refilled every batch */
+  size_t fill;
+};
+
+static void die(const char *what)
+{
+  fprintf(stderr,"hamstream: %s\n",what);
+  exit(1);
+}
+
+/* Up to n more bytes of input at *p; fewer only at the end. */
+static size_t take(struct source *s,size_t n,const unsigned char **p)
+{
+  size_t got=0;
+  if (s->map)
+  {
+    if (n>s->mapLen-s->off)
+      n=s->mapLen-s->off;
+    *p=s->map+s->off;
+    s->off+=n;
+    return n;
+  }
+  *p=s->buf+s->fill;
+  while(got<n)
+  {
+    ssize_t r=read(s->fd,s->buf+s->fill+got,n-got);
+    if (r<0 && errno==EINTR)
+      continue;
+    if (r<0)
+      die(strerror(errno));
+    if (r==0)
+      break;
+    got+=r;
+  }
+  s->fill+=got;
+  return got;
+}
+
+static void openSource(struct source *s,const char *path,size_t bufSize)
+{
+  struct stat st;
+  memset(s,0,sizeof(*s));
+  s->fd=path?open(path,O_RDONLY|O_CLOEXEC):0;
+  if (s->fd<0)
+    die(strerror(errno));
+  if (fstat(s->fd,&st)==0 && S_ISREG(st.st_mode) && st.st_size>0)
+  {
+    void *map=mmap(NULL,(size_t)st.st_size,PROT_READ,MAP_SHARED,s->fd,0);
+    if (map!=MAP_FAILED)
+    {
+      madvise(map,(size_t)st.st_size,MADV_SEQUENTIAL);
+      s->map=(const unsigned char *)map;
+      s->mapLen=(size_t)st.st_size;
+      return;
+    }
+  }
+  if (!(s->buf=malloc(bufSize)))
+    die("out of memory");
+}
+
+static void writeFull(int fd,const unsigned char *p,size_t len)
+{
+  while(len)
+  {
+    ssize_t r=write(fd,p,len);
+    if (r<0 && errno==EINTR)
+      continue;
+    if (r<0)
+      die(strerror(errno));
+    p+=r;
+    len-=r;
+  }
+}
+
+/* ---- the two directions ---- */
+
+static uint64_t totalBytes,totalBlocks;
+static struct hamming_il_stats totalStats;
+static int badBlocks;
+
+static void encodeStream(struct source *src,int outFd,int batch)
+{
+  const struct crc_model *m=crc_model_get(crc_model_find("CRC-32C"));
+  size_t slotOut=HAMSTREAM_BLOCK_HDR+payloadSize(blockSize);
+  unsigned char hdr[HAMSTREAM_HDR],*out=malloc(batch*slotOut);
+  uint32_t seq=0,total=crcOf("",0);
+  int last=0,n,i;
+  if (!out)
+    die("out of memory");
+  memset(hdr,0,sizeof(hdr));
+  memcpy(hdr,HAMSTREAM_MAGIC,4);
+  hdr[4]=HAMSTREAM_VERSION;
+  hdr[5]=(unsigned char)code;
+  hdr[6]=(unsigned char)(depth>>8);
+  hdr[7]=(unsigned char)depth;
+  hdr[9]=72;
+  hdr[11]=64;
+  put32(hdr+12,(uint32_t)blockSize);
+  hdr[16]=HAMSTREAM_CHECK_CRC32C;
+  put32(hdr+20,crcOf(hdr,20));
+  writeFull(outFd,hdr,sizeof(hdr));
+  while(!last)
+  {
+    size_t outLen=0;
+    src->fill=0;
+    for(n=0;n<batch && !last;n++)
+    {
+      const unsigned char *p;
+      size_t got=take(src,blockSize,&p);
+      if (got==0)
+        break;
+      slots[n].in=p;
+      slots[n].len=(uint32_t)got;
+      slots[n].seq=seq++;
+      slots[n].out=out+n*slotOut;
+      last=got<blockSize;
+    }
+    if (n==0)
+      break;
+    runBatch(n);
+    /* Only the last block is short, so the slots are back to back. */
+    for(i=0;i<n;i++)
+    {
+      outLen+=HAMSTREAM_BLOCK_HDR+payloadSize(slots[i].len);
+      total=(uint32_t)crc_model_combine(m,total,slots[i].crc,slots[i].len);
+      totalBytes+=slots[i].len;
+    }
+    writeFull(outFd,out,outLen);
+  }
+  putBlockHeader(hdr,seq,0,total);
+  writeFull(outFd,hdr,HAMSTREAM_BLOCK_HDR);
+  totalBlocks=seq;
+  free(out);
+}
+
+/* Reads and checks the container header, setting code, depth and
+   blockSize. */
+static void readHeader(struct source *src)
+{
+  const unsigned char *h;
+  if (take(src,HAMSTREAM_HDR,&h)<HAMSTREAM_HDR || memcmp(h,HAMSTREAM_MAGIC,4)!=0)
+    die("not a hamstream container");
+  if (get32(h+20)!=crcOf(h,20))
+    die("container header damaged");
+  code=h[5];
+  depth=h[6]<<8|h[7];
+  blockSize=get32(h+12);
+  if (h[4]!=HAMSTREAM_VERSION || (h[8]<<8|h[9])!=72 || (h[10]<<8|h[11])!=64 || h[16]!=HAMSTREAM_CHECK_CRC32C)
+    die("unsupported version, code or check");
+  if (code==HAMSTREAM_CODE_INTERLEAVED ? !hamming_il_depth_ok(depth) || blockSize%(8*(size_t)depth)
+      : code!=HAMSTREAM_CODE_PLAIN || blockSize%8)
+    die("unsupported version, code or check");
+  if (blockSize==0 || blockSize>MAX_BLOCK)
+    die("bad block size");
+}
+
+static void decodeStream(struct source *src,int outFd,int batch)
+{
+  const struct crc_model *m=crc_model_get(crc_model_find("CRC-32C"));
+  unsigned char *out=malloc(batch*blockSize);
+  uint32_t seq=0,total=crcOf("",0),want=0;
+  int last=0,n,i;
+  if (!out)
+    die("out of memory");
+  while(!last)
+  {
+    size_t outLen=0;
+    src->fill=0;
+    for(n=0;n<batch && !last;n++)
+    {
+      const unsigned char *h,*p;
+      uint32_t len;
+      if (take(src,HAMSTREAM_BLOCK_HDR,&h)<HAMSTREAM_BLOCK_HDR)
+        die("truncated: no trailer");
+      if (get32(h+12)!=crcOf(h,12))
+      {
+        fprintf(stderr,"hamstream: block %u: header damaged\n",seq);
+        exit(1);
+      }
+      if (get32(h)!=seq)
+      {
+        fprintf(stderr,"hamstream: block %u: found block %u instead\n",seq,get32(h));
+        exit(1);
+      }
+      len=get32(h+4);
+      if (len==0)
+      {
+        want=get32(h+8);
+        last=1;
+        break;
+      }
+      if (len>blockSize || take(src,payloadSize(len),&p)<payloadSize(len))
+        die("truncated block");
+      slots[n].in=p;
+      slots[n].len=len;
+      slots[n].crc=get32(h+8);
+      slots[n].seq=seq++;
+      slots[n].out=out+n*blockSize;
+      memset(&slots[n].st,0,sizeof(slots[n].st));
+    }
+    if (n)
+      runBatch(n);
+    for(i=0;i<n;i++)
+    {
+      if (slots[i].bad)
+      {
+        fprintf(stderr,"hamstream: block %u: CRC mismatch after correction\n",slots[i].seq);
+        badBlocks++;
+      }
+      totalStats.corrected+=slots[i].st.corrected;
+      totalStats.doubles+=slots[i].st.doubles;
+      total=(uint32_t)crc_model_combine(m,total,slots[i].crc,slots[i].len);
+      outLen+=slots[i].len;
+      totalBytes+=slots[i].len;
+    }
+    writeFull(outFd,out,outLen);
+  }
+  if (total!=want)
+  {
+    fprintf(stderr,"hamstream: stream CRC mismatch, blocks missing or reordered\n");
+    badBlocks++;
+  }
+  totalBlocks=seq;
+  free(out);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,"Usage : %s [-i depth] [-b block KB] [-j threads] [-s] [in [out]]\n"
+                 "        %s -d [-j threads] [-s] [in [out]]\n"
+                 "depth 0 stores plain 9-byte codewords\n",argv0,argv0);
+  exit(2);
+}
+
+int main(int argc,char **argv)
+{
+  int nthreads=(int)sysconf(_SC_NPROCESSORS_ONLN),stats=0,opt,outFd=1,batch,i;
+  const char *inPath=NULL,*outPath=NULL;
+  pthread_t tid[MAX_THREADS];
+  struct source src;
+  size_t unit;
+  double t0,t1;
+  while((opt=getopt(argc,argv,"di:b:j:s"))!=-1)
+  {
+    switch(opt)
+    {
+      case 'd': decoding=1; break;
+      case 'i': depth=atoi(optarg); break;
+      case 'b': blockSize=(size_t)strtoul(optarg,NULL,10)<<10; break;
+      case 'j': nthreads=atoi(optarg); break;
+      case 's': stats=1; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc-optind>2 || nthreads<1 || blockSize==0 || blockSize>MAX_BLOCK)
+    usage(argv[0]);
+  if (depth==0)
+    code=HAMSTREAM_CODE_PLAIN;
+  else if (!hamming_il_depth_ok(depth))
+    usage(argv[0]);
+  if (nthreads>MAX_THREADS)
+    nthreads=MAX_THREADS;
+  if (optind<argc && strcmp(argv[optind],"-")!=0)
+    inPath=argv[optind];
+  if (optind+1<argc && strcmp(argv[optind+1],"-")!=0)
+    outPath=argv[optind+1];
+  /* Whole interleave blocks, so only the last container block pads. */
+  unit=code==HAMSTREAM_CODE_INTERLEAVED?8*(size_t)depth:8;
+  blockSize=(blockSize+unit-1)/unit*unit;
+
+  /* Resolve both kernels before any worker races to. */
+  hamming_il_kernel_get();
+  crcOf("",0);
+  batch=2*nthreads;
+  slots=calloc(batch,sizeof(*slots));
+  if (!slots)
+    die("out of memory");
+  if (decoding)
+  {
+    /* The header sizes the read buffer, so read it on its own first. */
+    openSource(&src,inPath,HAMSTREAM_HDR);
+    readHeader(&src);
+    if (!src.map)
+    {
+      free(src.buf);
+      if (!(src.buf=malloc(batch*(HAMSTREAM_BLOCK_HDR+payloadSize(blockSize))+HAMSTREAM_BLOCK_HDR)))
+        die("out of memory");
+    }
+  }
+  else
+    openSource(&src,inPath,batch*blockSize);
+  if (outPath && (outFd=open(outPath,O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644))<0)
+    die(strerror(errno));
+
+  for(i=1;i<nthreads;i++)
+    if (pthread_create(&tid[i],NULL,workerMain,NULL)!=0)
+      die("cannot start threads");
+  t0=now();
+  if (decoding)
+    decodeStream(&src,outFd,batch);
+  else
+    encodeStream(&src,outFd,batch);
+  t1=now();
+  pthread_mutex_lock(&lock);
+  stop=1;
+  pthread_cond_broadcast(&start);
+  pthread_mutex_unlock(&lock);
+  for(i=1;i<nthreads;i++)
+    pthread_join(tid[i],NULL);
+
+  if (stats)
+  {
+    fprintf(stderr,"%llu blocks, %.1f MB in %.3f s, %.2f GB/s, %d threads, %s, %s kernel\n",
+            (unsigned long long)totalBlocks,totalBytes/1048576.0,t1-t0,totalBytes/(t1-t0)/1e9,
+            nthreads,src.map?"mmap":"read",
+            code==HAMSTREAM_CODE_INTERLEAVED?hamming_il_kernel_names[hamming_il_kernel_get()]:"plain");
+    if (decoding)
+      fprintf(stderr,"%llu codewords corrected, %llu double errors, %d bad blocks\n",
+              (unsigned long long)totalStats.corrected,(unsigned long long)totalStats.doubles,badBlocks);
+  }
+  if (outPath && close(outFd)<0)
+    die(strerror(errno));
+  return badBlocks?1:0;
+}
@@ -0,0 +1,288 @@
+#ifndef CODECS_HDLC_H
+#define CODECS_HDLC_H
+
+/*
+ * HDLC bit stuffing and destuffing in linear time, streaming.
+ *
+ * The stuffer puts a 0 after every five consecutive 1s so the data can
+ * never look like the 01111110 flag; the destuffer drops the 0 after five
+ * 1s and counts six 1s in a row as an error (a flag or abort inside the
+ * data).  Both are driven by tables indexed by the current run of 1s and
+ * the next input byte, giving that byte's output bits, their number and
+ * the run after it: a byte in puts out at most ten bits when stuffing,
+ * at most eight when destuffing.  A 64-bit word with no run of five 1s,
+ * counting the run carried into it, passes through unchanged in one step.
+ *
+ * Bits are MSB first.  Output collects in a 64-bit register and is written
+ * 32 bits at a time; hdlc_stuff()/hdlc_destuff() take any number of bits
+ * (whole bytes on all but the last call) and keep up to 31 bits pending
+ * until hdlc_flush().  The output of a call fits hdlc_stuff_room() or
+ * hdlc_destuff_room() bytes, so a stream of any length runs through
+ * fixed-size buffers one chunk at a time.
+ *
+ * hdlc_pack()/hdlc_unpack() convert '0'/'1' text eight characters at a
+ * time for the string programs.
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+struct hdlc_entry
+{
+  uint16_t bits;                    /* output, right-aligned */
+  uint8_t len;
+  uint8_t run;                      /* 1s in a row after the byte */
+};
+
+struct hdlc_state
+{
+  uint64_t acc;                     /* pending output, low n bits */
+  int n;
+  int run;
+  uint64_t bitsOut;                 /* bits written so far, pending ones too */
+  uint64_t errors;                  /* destuffer: six 1s in a row */
+};
+
+static struct hdlc_entry hdlc_stuff_table[5][256];
+static struct hdlc_entry hdlc_destuff_table[6][256];
+static uint8_t hdlc_destuff_errors[6][256];
+static int hdlc_ready;
+
+static inline void hdlc_tables_init(void)
+{
+  int run,b,i;
+  if (hdlc_ready)
+    return;
+  for(run=0;run<5;run++)
+    for(b=0;b<256;b++)
+    {
+      unsigned out=0,len=0,r=run;
+      for(i=7;i>=0;i--)
+      {
+        unsigned bit=b>>i&1;
+        out=out<<1|bit;
+        len++;
+        r=bit?r+1:0;
+        if (r==5)
+        {
+          out<<=1;
+          len++;
+          r=0;
+        }
+      }
+      hdlc_stuff_table[run][b]=(struct hdlc_entry){(uint16_t)out,(uint8_t)len,(uint8_t)r};
+    }
+  /* Run 5 means the next bit follows five 1s: a stuffed 0 to drop, or a
+     sixth 1. */
+  for(run=0;run<6;run++)
+    for(b=0;b<256;b++)
+    {
+      unsigned out=0,len=0,r=run,errors=0;
+      for(i=7;i>=0;i--)
+      {
+        unsigned bit=b>>i&1;
+        if (r==5)
+        {
+          r=0;
+          if (!bit)
+            continue;
+          errors++;
+        }
+        out=out<<1|bit;
+        len++;
+        r=bit?r+1:0;
+      }
+      hdlc_destuff_table[run][b]=(struct hdlc_entry){(uint16_t)out,(uint8_t)len,(uint8_t)r};
+      hdlc_destuff_errors[run][b]=(uint8_t)errors;
+    }
+  hdlc_ready=1;
+}
+
+static inline void hdlc_init(struct hdlc_state *st)
+{
+  hdlc_tables_init();
+  memset(st,0,sizeof(*st));
+}
+
+/* Bytes one hdlc_stuff() call of nbits may write: five bits become six,
+   plus what was pending. */
+static inline size_t hdlc_stuff_room(uint64_t nbits)
+{
+  return (size_t)((nbits+nbits/5+1+31)/32*4+4);
+}
+
+static inline size_t hdlc_destuff_room(uint64_t nbits)
+{
+  return (size_t)((nbits+31)/32*4+4);
+}
+
+/* Appends len bits to the register acc holding n, writing out 32 once
+   there are that many.  acc and n are the caller's locals, kept out of
+   memory that out may alias. */
+static inline __attribute__((always_inline)) unsigned char *hdlc_put(uint64_t *acc,int *n,unsigned char *out,uint64_t bits,int len)
+{
+  *acc=*acc<<len|bits;
+  *n+=len;
+  if (*n>=32)
+  {
+    uint32_t w=(uint32_t)(*acc>>(*n-32));
+    out[0]=(unsigned char)(w>>24);
+    out[1]=(unsigned char)(w>>16);
+    out[2]=(unsigned char)(w>>8);
+    out[3]=(unsigned char)w;
+    out+=4;
+    *n-=32;
+  }
+  return out;
+}
+
+static inline uint64_t hdlc_load64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v,p,8);
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  v=__builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/* Whether w, after run 1s, holds no five 1s in a row: then it needs no
+   stuffing and no destuffing. */
+static inline int hdlc_plain(uint64_t w,int run)
+{
+  return (w&w>>1&w>>2&w>>3&w>>4)==0 && ~w!=0 && __builtin_clzll(~w)+run<5;
+}
+
+/* Runs nbits from in through the stuffing (destuff clear) or destuffing
+   table.  Returns the bytes written to out. */
+static inline __attribute__((always_inline)) size_t hdlc_run(struct hdlc_state *st,const unsigned char *in,uint64_t nbits,
+                                                              unsigned char *out,int destuff)
+{
+  unsigned char *o=out;
+  uint64_t nbytes=nbits/8,i=0,acc=st->acc,errors=0;
+  int run=st->run,n=st->n,n0=st->n,b,k;
+  while(i<nbytes)
+  {
+    if (i+8<=nbytes && run<5)
+    {
+      uint64_t w=hdlc_load64(in+i);
+      if (hdlc_plain(w,run))
+      {
+        o=hdlc_put(&acc,&n,o,w>>32,32);
+        o=hdlc_put(&acc,&n,o,w&0xFFFFFFFF,32);
+        run=__builtin_ctzll(~w);
+        i+=8;
+        continue;
+      }
+    }
+    for(k=0;k<8 && i<nbytes;k++,i++)
+    {
+      const struct hdlc_entry *e=destuff?&hdlc_destuff_table[run][in[i]]:&hdlc_stuff_table[run][in[i]];
+      if (destuff)
+        errors+=hdlc_destuff_errors[run][in[i]];
+      o=hdlc_put(&acc,&n,o,e->bits,e->len);
+      run=e->run;
+    }
+  }
+  for(b=0;b<(int)(nbits&7);b++)
+  {
+    unsigned bit=in[nbytes]>>(7-b)&1;
+    if (destuff && run==5)
+    {
+      run=0;
+      if (!bit)
+        continue;
+      errors++;
+    }
+    o=hdlc_put(&acc,&n,o,bit,1);
+    run=bit?run+1:0;
+    if (!destuff && run==5)
+    {
+      o=hdlc_put(&acc,&n,o,0,1);
+      run=0;
+    }
+  }
+  st->acc=acc;
+  st->n=n;
+  st->run=run;
+  st->errors+=errors;
+  st->bitsOut+=8*(uint64_t)(o-out)+n-n0;
+  return (size_t)(o-out);
+}
+
+/* Stuffs nbits from in into out, which needs hdlc_stuff_room(nbits)
+   bytes.  Returns the bytes written; the rest stays pending. */
+static inline size_t hdlc_stuff(struct hdlc_state *st,const void *in,uint64_t nbits,void *out)
+{
+  return hdlc_run(st,(const unsigned char *)in,nbits,(unsigned char *)out,0);
+}
+
+/* Destuffs nbits from in into out, which needs hdlc_destuff_room(nbits)
+   bytes.  Returns the bytes written; st->errors counts six 1s in a row. */
+static inline size_t hdlc_destuff(struct hdlc_state *st,const void *in,uint64_t nbits,void *out)
+{
+  return hdlc_run(st,(const unsigned char *)in,nbits,(unsigned char *)out,1);
+}
+
+/* Writes the pending bits, the last byte zero-padded, to out (at most 4
+   bytes).  Returns the bytes written; st->bitsOut is the stream's length. */
+static inline size_t hdlc_flush(struct hdlc_state *st,void *out)
+{
+  unsigned char *o=(unsigned char *)out;
+  int bytes=(st->n+7)/8,i;
+  uint64_t w=st->acc<<(8*bytes-st->n);
+  for(i=0;i<bytes;i++)
+    o[i]=(unsigned char)(w>>8*(bytes-1-i));
+  st->n=0;
+  st->acc=0;
+  return (size_t)bytes;
+}
+
+/* Packs len '0'/'1' characters MSB first.  Returns -1 on any other
+   character. */
+static inline int hdlc_pack(const char *s,size_t len,unsigned char *out)
+{
+  uint64_t w;
+  size_t i;
+  for(i=0;i+8<=len;i+=8)
+  {
+    memcpy(&w,s+i,8);
+    if ((w&0xFEFEFEFEFEFEFEFEull)!=0x3030303030303030ull)
+      return -1;
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    out[i/8]=(unsigned char)((w&0x0101010101010101ull)*0x8040201008040201ull>>56);
+#else
+    out[i/8]=(unsigned char)((w&0x0101010101010101ull)*0x0102040810204080ull>>56);
+#endif
+  }
+  if (i<len)
+    out[i/8]=0;
+  for(;i<len;i++)
+  {
+    if (s[i]!='0' && s[i]!='1')
+      return -1;
+    out[i/8]|=(unsigned char)((s[i]-'0')<<(7-i%8));
+  }
+  return 0;
+}
+
+/* Writes nbits of p as '0'/'1' characters, a byte spread over eight
+   characters at a time. */
+static inline void hdlc_unpack(const unsigned char *p,size_t nbits,char *s)
+{
+  size_t i;
+  for(i=0;i+8<=nbits;i+=8)
+  {
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    uint64_t w=(p[i/8]*0x0101010101010101ull)&0x0102040810204080ull;
+#else
+    uint64_t w=(p[i/8]*0x0101010101010101ull)&0x8040201008040201ull;
+#endif
+    w=((w+0x7F7F7F7F7F7F7F7Full)>>7&0x0101010101010101ull)|0x3030303030303030ull;
+    memcpy(s+i,&w,8);
+  }
+  for(;i<nbits;i++)
+    s[i]=(char)('0'+(p[i/8]>>(7-i%8)&1));
+}
+
+#endif
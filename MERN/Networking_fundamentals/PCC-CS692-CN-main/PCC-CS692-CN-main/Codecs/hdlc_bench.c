@@ -0,0 +1,208 @@
+/*
+ * hdlc_bench.c - HDLC bit stuffing and destuffing of hdlc.h against the
+ * string loop of Assignment5/server.c, over several kinds of data.
+ *
+ *   gcc -O2 hdlc_bench.c -o hdlc_bench
+ *   ./hdlc_bench [max MB]
+ *
+ * Every string up to 300 bits is stuffed by bit_stuff() and by hdlc.h and
+ * the two must agree; destuffing must give the string back.  A stream fed
+ * in random-sized chunks through fixed buffers must equal the one-shot
+ * result.  Throughput is timed from 1 KB to the maximum (default 16 MB)
+ * of random bits, all 1s, all 0s and ASCII text.  bit_stuff() shifts the
+ * string and calls strlen() per character, nearly cubic on 1s, so it is
+ * timed once per kind on the first 4 Kbit only.  Gbit/s are of unstuffed
+ * data bits both ways.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"reference.h"
+#include"hdlc.h"
+
+#define MIN_SECS 0.2
+#define REF_BITS 4096
+#define CHUNK 4096
+
+static volatile size_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* Stuffs (or destuffs) nbits in one call.  Returns the output bits. */
+static uint64_t oneShot(int destuff,const unsigned char *in,uint64_t nbits,unsigned char *out,uint64_t *errors)
+{
+  struct hdlc_state st;
+  size_t n;
+  hdlc_init(&st);
+  n=destuff?hdlc_destuff(&st,in,nbits,out):hdlc_stuff(&st,in,nbits,out);
+  hdlc_flush(&st,out+n);
+  if (errors)
+    *errors=st.errors;
+  return st.bitsOut;
+}
+
+/* Strings of every length up to 300 bits against bit_stuff(). */
+static int checkStrings(void)
+{
+  char text[400],ours[400];
+  unsigned char packed[64],stuffed[80],back[80];
+  int len,t;
+  for(len=0;len<=300;len++)
+    for(t=0;t<40;t++)
+    {
+      uint64_t bits,backBits,errors;
+      int i,ones=rand()%4;
+      for(i=0;i<len;i++)
+        text[i]=(rand()%4<ones+1)?'1':'0';
+      text[len]='\0';
+      hdlc_pack(text,len,packed);
+      bits=oneShot(0,packed,len,stuffed,NULL);
+      hdlc_unpack(stuffed,bits,ours);
+      ours[bits]='\0';
+      bit_stuff(text);
+      if (strcmp(text,ours)!=0)
+      {
+        printf("stuffing disagrees with bit_stuff() at %d bits\n",len);
+        return 1;
+      }
+      backBits=oneShot(1,stuffed,bits,back,&errors);
+      if (backBits!=(uint64_t)len || errors || (len && memcmp(back,packed,len/8)!=0) ||
+          (len%8 && (back[len/8]^packed[len/8])&(0xFF00>>len%8)))
+      {
+        printf("destuffing does not give back %d bits\n",len);
+        return 1;
+      }
+    }
+  return 0;
+}
+
+/* The stream through CHUNK-byte buffers in random-sized pieces must equal
+   the one-shot output. */
+static int checkStreaming(const unsigned char *in,uint64_t nbits,const unsigned char *want,uint64_t wantBits,int destuff)
+{
+  static unsigned char buf[CHUNK*2];
+  unsigned char *out=malloc(hdlc_stuff_room(nbits)+8),*o=out;
+  struct hdlc_state st;
+  uint64_t done=0;
+  int bad;
+  hdlc_init(&st);
+  while(done<nbits)
+  {
+    uint64_t piece=8*(1+(uint64_t)rand()%CHUNK),n;
+    if (piece>nbits-done)
+      piece=nbits-done;
+    n=destuff?hdlc_destuff(&st,in+done/8,piece,buf):hdlc_stuff(&st,in+done/8,piece,buf);
+    if (n>hdlc_stuff_room(piece))
+    {
+      free(out);
+      return 1;
+    }
+    memcpy(o,buf,n);
+    o+=n;
+    done+=piece;
+  }
+  o+=hdlc_flush(&st,o);
+  bad=st.bitsOut!=wantBits || memcmp(out,want,(wantBits+7)/8)!=0;
+  free(out);
+  return bad;
+}
+
+static double timeRun(int destuff,const unsigned char *in,uint64_t nbits,unsigned char *out)
+{
+  double t0;
+  long calls;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    sink+=oneShot(destuff,in,nbits,out,NULL);
+  return (now()-t0)/calls;
+}
+
+static double timeRef(const char *text,char *work,uint64_t nbits)
+{
+  double t0;
+  long calls;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+  {
+    memcpy(work,text,nbits+1);
+    bit_stuff(work);
+    sink+=work[0];
+  }
+  return (now()-t0)/calls;
+}
+
+int main(int argc,char **argv)
+{
+  static const char *const kinds[]={"random","ones","zeros","text"};
+  static const char sample[]="The quick brown fox jumps over the lazy dog; ";
+  uint64_t maxBytes=(argc>1?strtoull(argv[1],NULL,10):16)<<20,bytes,i;
+  unsigned char *data,*stuffed,*back;
+  char *text,*work;
+  int kind,failed=0;
+  if (maxBytes==0)
+  {
+    printf("Usage : %s [max MB]\n",argv[0]);
+    return 1;
+  }
+  data=malloc(maxBytes+8);
+  stuffed=malloc(hdlc_stuff_room(8*maxBytes)+8);
+  back=malloc(maxBytes+16);
+  text=malloc(REF_BITS+1);
+  work=malloc(REF_BITS+REF_BITS/5+2);
+  if (!data || !stuffed || !back || !text || !work)
+  {
+    printf("Out of memory...\n");
+    return 1;
+  }
+  srand(25);
+  hdlc_tables_init();
+  if (checkStrings())
+    failed=1;
+
+  printf("%-8s %10s %8s %12s %10s %10s   Gbit/s\n","data","bytes","stuffed","bit_stuff","stuff","destuff");
+  for(kind=0;kind<4;kind++)
+  {
+    for(i=0;i<maxBytes;i++)
+      data[i]=kind==0?(unsigned char)rand():kind==1?0xFF:kind==2?0:(unsigned char)sample[i%(sizeof(sample)-1)];
+    for(bytes=1024;bytes<=maxBytes;bytes*=8)
+    {
+      uint64_t nbits=8*bytes-3,bits,backBits,errors;
+      double tStuff,tDestuff;
+      bits=oneShot(0,data,nbits,stuffed,NULL);
+      backBits=oneShot(1,stuffed,bits,back,&errors);
+      if (backBits!=nbits || errors || memcmp(back,data,nbits/8)!=0)
+      {
+        printf("%s: %llu bytes do not come back\n",kinds[kind],(unsigned long long)bytes);
+        failed=1;
+      }
+      if (bytes<=(1u<<20) && (checkStreaming(data,nbits,stuffed,bits,0) || checkStreaming(stuffed,bits,back,nbits,1)))
+      {
+        printf("%s: %llu bytes streamed differ\n",kinds[kind],(unsigned long long)bytes);
+        failed=1;
+      }
+      printf("%-8s %10llu %7.2f%%",kinds[kind],(unsigned long long)bytes,100.0*(bits-nbits)/nbits);
+      if (bytes==1024)
+      {
+        hdlc_unpack(data,REF_BITS,text);
+        text[REF_BITS]='\0';
+        printf(" %12.6f",REF_BITS/timeRef(text,work,REF_BITS)/1e9);
+      }
+      else
+        printf(" %12s","-");
+      tStuff=timeRun(0,data,nbits,stuffed);
+      tDestuff=timeRun(1,stuffed,bits,back);
+      printf(" %10.3f %10.3f\n",nbits/tStuff/1e9,nbits/tDestuff/1e9);
+    }
+  }
+  free(data);
+  free(stuffed);
+  free(back);
+  free(text);
+  free(work);
+  return failed;
+}
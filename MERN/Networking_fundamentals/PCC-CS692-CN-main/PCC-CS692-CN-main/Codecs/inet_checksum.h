@@ -0,0 +1,256 @@
+#ifndef CODECS_INET_CHECKSUM_H
+#define CODECS_INET_CHECKSUM_H
+
+/*
+ * Internet checksum (RFC 1071) with incremental update (RFC 1624).
+ *
+ * The checksum is the one's complement of the one's complement sum of the
+ * data as 16-bit words, an odd last byte padded with a zero after it.
+ * That sum does not care about byte order (RFC 1071, 2.B), so words are
+ * read in host order and the result is in memory order: store it with
+ * memcpy, or straight into a 16-bit header field, as the BSD in_cksum
+ * does.  Nor does it care how wide the additions are, since 2^16 = 1
+ * modulo 2^16-1: the data is summed as 32-bit halves of 64-bit loads into
+ * 64-bit accumulators, which cannot overflow below 16 GB, and folded to
+ * 16 bits once at the end.
+ *
+ *   avx2    four 64-bit lanes per register, two registers per 64 bytes
+ *   scalar  two accumulators per 64-bit word
+ *
+ * picked once from CPUID.  Loads are unaligned and the tail is summed in
+ * 4-, 2- and 1-byte pieces, so any address and length work.
+ *
+ * Header rewrites need not re-sum the packet: RFC 1624 eqn. 3,
+ * HC' = ~(~HC + ~m + m'), takes the old and the new value of the field
+ * into the stored checksum.  inet_csum_update16/32() and
+ * inet_csum_replace() do that for one word, an address, or any run of
+ * words.
+ *
+ * inet_add_limbs() and inet_ones_add() are the same end-around-carry
+ * addition for words of any width, as in the textbook checksum of
+ * Assignment1.
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+#define INET_SCALAR 0
+#define INET_AVX2 1
+
+#define INET_AVX2_MIN 256           /* shorter buffers stay scalar */
+
+static const char *const inet_kernel_names[]={"scalar","avx2"};
+
+/* Adds the 32-bit halves of len bytes from p into sum. */
+static inline uint64_t inet_sum_scalar(const unsigned char *p,size_t len,uint64_t sum)
+{
+  uint64_t a=0,b=0,w;
+  size_t i;
+  for(i=0;i+32<=len;i+=32)
+  {
+    uint64_t w0,w1,w2,w3;
+    memcpy(&w0,p+i,8);
+    memcpy(&w1,p+i+8,8);
+    memcpy(&w2,p+i+16,8);
+    memcpy(&w3,p+i+24,8);
+    a+=(w0&0xFFFFFFFF)+(w1&0xFFFFFFFF)+(w2&0xFFFFFFFF)+(w3&0xFFFFFFFF);
+    b+=(w0>>32)+(w1>>32)+(w2>>32)+(w3>>32);
+  }
+  for(;i+8<=len;i+=8)
+  {
+    memcpy(&w,p+i,8);
+    a+=w&0xFFFFFFFF;
+    b+=w>>32;
+  }
+  /* The tail by fixed-size pieces; a lone last byte is the first half of
+     a word whose second half is zero. */
+  if (len-i>=4)
+  {
+    uint32_t v;
+    memcpy(&v,p+i,4);
+    a+=v;
+    i+=4;
+  }
+  if (len-i>=2)
+  {
+    uint16_t v;
+    memcpy(&v,p+i,2);
+    a+=v;
+    i+=2;
+  }
+  if (i<len)
+  {
+    uint16_t v=0;
+    memcpy(&v,p+i,1);
+    b+=v;
+  }
+  return sum+a+b;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+#include<immintrin.h>
+
+static inline int inet_detect(void)
+{
+  unsigned int a,b,c,d,xcr0=0;
+  if (!__get_cpuid(1,&a,&b,&c,&d) || !(c&bit_OSXSAVE) || !(c&bit_AVX))
+    return INET_SCALAR;
+  __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+  if ((xcr0&0x6)!=0x6 || !__get_cpuid_count(7,0,&a,&b,&c,&d) || !(b&bit_AVX2))
+    return INET_SCALAR;
+  return INET_AVX2;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t inet_sum_avx2(const unsigned char *p,size_t len,uint64_t sum)
+{
+  const __m256i low=_mm256_set1_epi64x(0xFFFFFFFF);
+  __m256i a0=_mm256_setzero_si256(),b0=a0,a1=a0,b1=a0;
+  uint64_t lanes[4];
+  size_t i;
+  for(i=0;i+64<=len;i+=64)
+  {
+    __m256i v0=_mm256_loadu_si256((const __m256i *)(p+i)),v1=_mm256_loadu_si256((const __m256i *)(p+i+32));
+    a0=_mm256_add_epi64(a0,_mm256_and_si256(v0,low));
+    b0=_mm256_add_epi64(b0,_mm256_srli_epi64(v0,32));
+    a1=_mm256_add_epi64(a1,_mm256_and_si256(v1,low));
+    b1=_mm256_add_epi64(b1,_mm256_srli_epi64(v1,32));
+  }
+  a0=_mm256_add_epi64(_mm256_add_epi64(a0,b0),_mm256_add_epi64(a1,b1));
+  _mm256_storeu_si256((__m256i *)lanes,a0);
+  return inet_sum_scalar(p+i,len-i,sum+lanes[0]+lanes[1]+lanes[2]+lanes[3]);
+}
+
+#else
+
+static inline int inet_detect(void)
+{
+  return INET_SCALAR;
+}
+
+#endif
+
+static int inet_tier=-1;
+
+/* Kernel in use; detected on first call, without a data race. */
+static inline int inet_kernel_get(void)
+{
+  int tier=__atomic_load_n(&inet_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=inet_detect();
+    if (!__atomic_compare_exchange_n(&inet_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to compare them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int inet_kernel_set(int tier)
+{
+  if (tier<INET_SCALAR || tier>inet_detect())
+    return -1;
+  __atomic_store_n(&inet_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* Adds len bytes to a running sum, unfolded.  Pieces summed one after
+   another must all but the last have even length; otherwise sum them
+   apart and join them with inet_csum_combine(). */
+static inline uint64_t inet_csum_partial(const void *buf,size_t len,uint64_t sum)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (len>=INET_AVX2_MIN && inet_kernel_get()==INET_AVX2)
+    return inet_sum_avx2((const unsigned char *)buf,len,sum);
+#endif
+  return inet_sum_scalar((const unsigned char *)buf,len,sum);
+}
+
+/* The 16-bit one's complement sum of a running sum. */
+static inline uint16_t inet_csum_fold(uint64_t sum)
+{
+  sum=(sum&0xFFFFFFFF)+(sum>>32);
+  sum=(sum&0xFFFFFFFF)+(sum>>32);
+  sum=(sum&0xFFFF)+(sum>>16);
+  sum=(sum&0xFFFF)+(sum>>16);
+  return (uint16_t)sum;
+}
+
+/* The checksum of len bytes, in memory order. */
+static inline uint16_t inet_csum(const void *buf,size_t len)
+{
+  return (uint16_t)~inet_csum_fold(inet_csum_partial(buf,len,0));
+}
+
+/* Joins two folded sums, the second of bytes that start at offset in the
+   whole: at an odd offset its bytes sit in the other half of each word. */
+static inline uint16_t inet_csum_combine(uint16_t a,uint16_t b,size_t offset)
+{
+  if (offset&1)
+    b=(uint16_t)(b<<8|b>>8);
+  return inet_csum_fold((uint64_t)a+b);
+}
+
+/* RFC 1624 eqn. 3: the checksum after a 16-bit word at an even offset
+   changes from old to new, all three in memory order. */
+static inline uint16_t inet_csum_update16(uint16_t check,uint16_t old,uint16_t new)
+{
+  return (uint16_t)~inet_csum_fold((uint64_t)(uint16_t)~check+(uint16_t)~old+new);
+}
+
+/* The same for a 32-bit field such as an IPv4 address. */
+static inline uint16_t inet_csum_update32(uint16_t check,uint32_t old,uint32_t new)
+{
+  uint64_t sum=(uint16_t)~check;
+  sum+=(uint16_t)~old+(uint16_t)~(old>>16);
+  sum+=(new&0xFFFF)+(new>>16);
+  return (uint16_t)~inet_csum_fold(sum);
+}
+
+/* The same for len bytes at an even offset: the old and the new contents.
+   An odd len counts the last byte as padded, so give the whole word. */
+static inline uint16_t inet_csum_replace(uint16_t check,const void *old,const void *new,size_t len)
+{
+  uint64_t sum=(uint16_t)~check;
+  /* ~old summed is old's sum negated: 0xFFFF per word less its sum. */
+  sum+=(uint16_t)~inet_csum_fold(inet_csum_partial(old,len,0));
+  sum=inet_csum_partial(new,len,sum);
+  return (uint16_t)~inet_csum_fold(sum);
+}
+
+/* r = a+b+cin over width-bit numbers held in (width+63)/64 limbs, least
+   significant first, with nothing set above bit width-1; b may be NULL
+   for zero.  r keeps the low width bits and the carry out of the top one
+   is returned. */
+static inline int inet_add_limbs(uint64_t *r,const uint64_t *a,const uint64_t *b,int cin,int width)
+{
+  int n=(width+63)/64,top=width-64*(n-1),i;
+  uint64_t carry=(uint64_t)cin;
+  for(i=0;i<n;i++)
+  {
+    uint64_t x=a[i],s=x+(b?b[i]:0),c=s<x;
+    s+=carry;
+    c|=s<carry;
+    r[i]=s;
+    carry=c;
+  }
+  if (top<64)
+  {
+    carry=r[n-1]>>top&1;
+    r[n-1]&=(1ull<<top)-1;
+  }
+  return (int)carry;
+}
+
+/* One's complement a+b of width-bit numbers: a carry out of the top bit
+   is added back in at the bottom. */
+static inline void inet_ones_add(uint64_t *r,const uint64_t *a,const uint64_t *b,int width)
+{
+  if (inet_add_limbs(r,a,b,0,width))
+    inet_add_limbs(r,r,NULL,1,width);
+}
+
+#endif
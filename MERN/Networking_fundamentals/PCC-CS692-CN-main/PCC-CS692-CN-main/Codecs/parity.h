@@ -0,0 +1,520 @@
+#ifndef CODECS_PARITY_H
+#define CODECS_PARITY_H
+
+/*
+ * Even and odd parity of bit-packed blocks of any length, one-dimensional
+ * (one bit over the block) and two-dimensional (a VRC bit per row, an LRC
+ * row of column bits and a corner bit over the whole block).
+ *
+ * Data is MSB first in bytes, as on the wire.  The parity of a block is
+ * that of the XOR of its 64-bit words, so parity_bit() is four XOR chains
+ * and one popcount; parity_ones() counts with a popcount per word.  For
+ * '0'/'1' text, parity_text_ones() counts the '1' characters eight at a
+ * time and parity_pack() packs them the same way.
+ *
+ * The 2-D code lays the block out in rows of cols bits, the last row short
+ * when cols does not divide the length (its missing bits count as zero).
+ * Rows of 8, 16, 32 or 64 bits lie whole in a 64-bit word and are folded
+ * lane-wise, 64/cols rows per word.  Other widths are read through 64-bit
+ * windows at bit offsets, 64/cols narrow rows or 64 bits of a wide one at
+ * a time, and each row folded with a popcount.  The
+ * popcount is the POPCNT instruction where the CPU has it, picked once
+ * from CPUID, else the compiler's bit trick.
+ *
+ * parity2d_check() corrects one flipped bit anywhere in the block or its
+ * check bits:
+ *
+ *   rows bad  columns bad  corner bad
+ *   1         1            yes         data bit row*cols+column
+ *   1         0            no          that row's VRC bit
+ *   0         1            no          that column's LRC bit
+ *   0         0            yes         the corner bit
+ *
+ * Any two flipped bits match none of these and are reported as detected;
+ * four at the corners of a rectangle go unseen.
+ */
+
+#include<stdint.h>
+#include<string.h>
+
+#define PARITY_SCALAR 0
+#define PARITY_POPCNT 1
+
+#define PARITY_MAX_COLS 65535
+#define PARITY_ACC_WORDS ((PARITY_MAX_COLS+63)/64)
+#define PARITY_CHUNK 4096           /* rows checked per pass */
+
+#define PARITY_CLEAN 0
+#define PARITY_CORRECTED 1          /* a data bit, flipped back */
+#define PARITY_CHECK_BIT 2          /* a VRC, LRC or corner bit; data good */
+#define PARITY_DETECTED 3           /* more than one bit, not corrected */
+
+static const char *const parity_kernel_names[]={"scalar","popcnt"};
+
+struct parity2d
+{
+  uint64_t nbits;
+  uint64_t rows;
+  uint32_t cols;
+  int odd;
+};
+
+/* Big-endian: one load and a byte swap. */
+static inline uint64_t parity_load64(const unsigned char *p)
+{
+  uint64_t v;
+  memcpy(&v,p,8);
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+  v=__builtin_bswap64(v);
+#endif
+  return v;
+}
+
+/* The 64 bits from bit offset bit of a block of nbytes, zero past its
+   end. */
+static inline uint64_t parity_window(const unsigned char *p,uint64_t nbytes,uint64_t bit)
+{
+  uint64_t byte=bit>>3,w=0;
+  unsigned sh=bit&7,i;
+  if (byte+9<=nbytes)
+  {
+    w=parity_load64(p+byte);
+    return sh?w<<sh|p[byte+8]>>(8-sh):w;
+  }
+  for(i=0;i<8;i++)
+    w=w<<8|(byte+i<nbytes?p[byte+i]:0);
+  if (sh && byte+8<nbytes)
+    w=w<<sh|p[byte+8]>>(8-sh);
+  else
+    w<<=sh;
+  return w;
+}
+
+/* The XOR of the 64-bit words of nbits from p, bits past nbits cleared. */
+static inline uint64_t parity_xor(const unsigned char *p,uint64_t nbits)
+{
+  uint64_t x0=0,x1=0,x2=0,x3=0,w,nbytes=nbits/8,i;
+  for(i=0;i+32<=nbytes;i+=32)
+  {
+    uint64_t w0,w1,w2,w3;
+    memcpy(&w0,p+i,8);
+    memcpy(&w1,p+i+8,8);
+    memcpy(&w2,p+i+16,8);
+    memcpy(&w3,p+i+24,8);
+    x0^=w0;
+    x1^=w1;
+    x2^=w2;
+    x3^=w3;
+  }
+  for(;i+8<=nbytes;i+=8)
+  {
+    memcpy(&w,p+i,8);
+    x0^=w;
+  }
+  for(;i<nbytes;i++)
+    x1^=p[i];
+  if (nbits&7)
+    x2^=p[nbytes]&(0xFF00>>(nbits&7));
+  return x0^x1^x2^x3;
+}
+
+/* Bit order does not matter to a count, so words are loaded as they lie. */
+static inline __attribute__((always_inline)) uint64_t parity_ones_body(const unsigned char *p,uint64_t nbits)
+{
+  uint64_t c0=0,c1=0,w,nbytes=nbits/8,i;
+  for(i=0;i+16<=nbytes;i+=16)
+  {
+    uint64_t w0,w1;
+    memcpy(&w0,p+i,8);
+    memcpy(&w1,p+i+8,8);
+    c0+=__builtin_popcountll(w0);
+    c1+=__builtin_popcountll(w1);
+  }
+  for(;i+8<=nbytes;i+=8)
+  {
+    memcpy(&w,p+i,8);
+    c0+=__builtin_popcountll(w);
+  }
+  for(;i<nbytes;i++)
+    c1+=__builtin_popcount(p[i]);
+  if (nbits&7)
+    c1+=__builtin_popcount(p[nbytes]&(0xFF00>>(nbits&7)));
+  return c0+c1;
+}
+
+/* '1' characters among len: each XORed with '1' is zero, and a zero byte
+   is the one whose top bit survives the carry-free test below. */
+static inline __attribute__((always_inline)) uint64_t parity_text_body(const char *s,uint64_t len)
+{
+  const uint64_t ones=0x3131313131313131ull,low=0x7F7F7F7F7F7F7F7Full;
+  uint64_t count=0,w,i;
+  for(i=0;i+8<=len;i+=8)
+  {
+    memcpy(&w,s+i,8);
+    w^=ones;
+    count+=__builtin_popcountll(~(((w&low)+low)|w|low));
+  }
+  for(;i<len;i++)
+    count+=s[i]=='1';
+  return count;
+}
+
+/* Widths whose rows lie whole in a word: lanes per word, the low bit of
+   every lane, and a multiplier that gathers those bits into the top
+   lanes bits, the first row (top lane) highest. */
+static inline int parity_lanes(uint32_t cols,uint64_t *lowBits,uint64_t *gather)
+{
+  switch(cols)
+  {
+    case 8: *lowBits=0x0101010101010101ull; *gather=0x0102040810204080ull; return 8;
+    case 16: *lowBits=0x0001000100010001ull; *gather=0x1000200040008000ull; return 4;
+    case 32: *lowBits=0x0000000100000001ull; *gather=0x4000000080000000ull; return 2;
+    case 64: *lowBits=1; *gather=1ull<<63; return 1;
+  }
+  return 0;
+}
+
+/* VRC bits of rows [r0,r1) into out, MSB first from row r0, and the rows
+   XORed into acc, (cols+63)/64 words with column 0 at the top of acc[0].
+   r0 is a multiple of 8; check bits do not include odd here. */
+static inline __attribute__((always_inline)) void parity2d_rows_body(const struct parity2d *g,const unsigned char *data,
+                                                                      uint64_t r0,uint64_t r1,unsigned char *out,uint64_t *acc)
+{
+  uint64_t nbytes=(g->nbits+7)/8,lowBits,gather,r;
+  uint32_t cols=g->cols;
+  int lanes=parity_lanes(cols,&lowBits,&gather);
+  memset(out,0,(r1-r0+7)/8);
+  if (lanes)
+  {
+    uint64_t end=r1*cols<g->nbits?r1*cols:g->nbits,bit,colAcc=0;
+    int s;
+    for(bit=r0*cols;bit<end;bit+=64)
+    {
+      uint64_t v=bit/8+8<=nbytes?parity_load64(data+bit/8):parity_window(data,nbytes,bit);
+      uint64_t row=(bit-r0*cols)/cols,x,b;
+      if (end-bit<64)
+        v&=~0ull<<(64-(end-bit));
+      colAcc^=v;
+      if (lanes==1)
+        b=__builtin_popcountll(v)&1;
+      else
+      {
+        x=v;
+        for(s=cols/2;s>0;s/=2)
+          x^=x>>s;
+        b=(x&lowBits)*gather>>(64-lanes);
+      }
+      out[row/8]|=(unsigned char)(b<<(8-lanes-row%8));
+    }
+    for(s=32;s>=(int)cols;s/=2)
+      colAcc^=colAcc>>s;
+    acc[0]^=cols==64?colAcc:colAcc<<(64-cols);
+    return;
+  }
+  if (cols<64)
+  {
+    /* One window for every 64/cols rows, VRC bits gathered a byte at a
+       time. */
+    uint64_t mask=~0ull<<(64-cols),colAcc=0;
+    unsigned pend=0;
+    for(r=r0;r<r1;)
+    {
+      uint64_t bit=r*cols,v=parity_window(data,nbytes,bit),n=64/cols;
+      if (g->nbits-bit<64)
+        v&=~0ull<<(64-(g->nbits-bit));
+      if (n>r1-r)
+        n=r1-r;
+      for(;n>0;n--,r++,v<<=cols)
+      {
+        uint64_t row=v&mask;
+        colAcc^=row;
+        pend=pend<<1|(__builtin_popcountll(row)&1);
+        if ((r-r0)%8==7)
+          out[(r-r0)/8]=(unsigned char)pend;
+      }
+    }
+    if ((r1-r0)%8)
+      out[(r1-r0)/8]=(unsigned char)(pend<<(8-(r1-r0)%8));
+    acc[0]^=colAcc;
+    return;
+  }
+  for(r=r0;r<r1;r++)
+  {
+    uint64_t bit=r*cols,left=g->nbits-bit<cols?g->nbits-bit:cols,x=0;
+    int k;
+    for(k=0;left>0;k++)
+    {
+      int n=left<64?(int)left:64;
+      uint64_t w=parity_window(data,nbytes,bit)&~0ull<<(64-n);
+      x^=w;
+      acc[k]^=w;
+      bit+=n;
+      left-=n;
+    }
+    out[(r-r0)/8]|=(unsigned char)((__builtin_popcountll(x)&1)<<(7-(r-r0)%8));
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+
+static inline int parity_detect(void)
+{
+  unsigned int a,b,c,d;
+  if (!__get_cpuid(1,&a,&b,&c,&d) || !(c&bit_POPCNT))
+    return PARITY_SCALAR;
+  return PARITY_POPCNT;
+}
+
+__attribute__((target("popcnt")))
+static uint64_t parity_ones_popcnt(const unsigned char *p,uint64_t nbits)
+{
+  return parity_ones_body(p,nbits);
+}
+
+__attribute__((target("popcnt")))
+static uint64_t parity_text_popcnt(const char *s,uint64_t len)
+{
+  return parity_text_body(s,len);
+}
+
+__attribute__((target("popcnt")))
+static void parity2d_rows_popcnt(const struct parity2d *g,const unsigned char *data,uint64_t r0,uint64_t r1,unsigned char *out,uint64_t *acc)
+{
+  parity2d_rows_body(g,data,r0,r1,out,acc);
+}
+
+#else
+
+static inline int parity_detect(void)
+{
+  return PARITY_SCALAR;
+}
+
+#endif
+
+static uint64_t parity_ones_scalar(const unsigned char *p,uint64_t nbits)
+{
+  return parity_ones_body(p,nbits);
+}
+
+static uint64_t parity_text_scalar(const char *s,uint64_t len)
+{
+  return parity_text_body(s,len);
+}
+
+static void parity2d_rows_scalar(const struct parity2d *g,const unsigned char *data,uint64_t r0,uint64_t r1,unsigned char *out,uint64_t *acc)
+{
+  parity2d_rows_body(g,data,r0,r1,out,acc);
+}
+
+static int parity_tier=-1;
+
+/* Kernel in use; detected on first call, without a data race. */
+static inline int parity_kernel_get(void)
+{
+  int tier=__atomic_load_n(&parity_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=parity_detect();
+    if (!__atomic_compare_exchange_n(&parity_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to compare them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int parity_kernel_set(int tier)
+{
+  if (tier<PARITY_SCALAR || tier>parity_detect())
+    return -1;
+  __atomic_store_n(&parity_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* 1 bits among the first nbits of p. */
+static inline uint64_t parity_ones(const void *p,uint64_t nbits)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (parity_kernel_get()==PARITY_POPCNT)
+    return parity_ones_popcnt((const unsigned char *)p,nbits);
+#endif
+  return parity_ones_scalar((const unsigned char *)p,nbits);
+}
+
+/* The parity bit of the first nbits of p: with odd clear, the bit that
+   makes the count of 1s even, else the one that makes it odd. */
+static inline int parity_bit(const void *p,uint64_t nbits,int odd)
+{
+  return (__builtin_popcountll(parity_xor((const unsigned char *)p,nbits))&1)^(odd!=0);
+}
+
+/* '1' characters among the len characters of s, whatever the others are. */
+static inline uint64_t parity_text_ones(const char *s,uint64_t len)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (parity_kernel_get()==PARITY_POPCNT)
+    return parity_text_popcnt(s,len);
+#endif
+  return parity_text_scalar(s,len);
+}
+
+/* Packs len '0'/'1' characters MSB first, eight at a time: the low bit of
+   each character gathered by one multiply.  Returns -1 on any other
+   character. */
+static inline int parity_pack(const char *s,uint64_t len,unsigned char *out)
+{
+  uint64_t w,i;
+  for(i=0;i+8<=len;i+=8)
+  {
+    memcpy(&w,s+i,8);
+    if ((w&0xFEFEFEFEFEFEFEFEull)!=0x3030303030303030ull)
+      return -1;
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    out[i/8]=(unsigned char)((w&0x0101010101010101ull)*0x8040201008040201ull>>56);
+#else
+    out[i/8]=(unsigned char)((w&0x0101010101010101ull)*0x0102040810204080ull>>56);
+#endif
+  }
+  if (i<len)
+    out[i/8]=0;
+  for(;i<len;i++)
+  {
+    if (s[i]!='0' && s[i]!='1')
+      return -1;
+    out[i/8]|=(unsigned char)((s[i]-'0')<<(7-i%8));
+  }
+  return 0;
+}
+
+/* Lays out nbits in rows of cols bits.  Returns -1 if cols is 0 or over
+   PARITY_MAX_COLS. */
+static inline int parity2d_init(struct parity2d *g,uint64_t nbits,uint32_t cols,int odd)
+{
+  if (cols<1 || cols>PARITY_MAX_COLS)
+    return -1;
+  g->nbits=nbits;
+  g->cols=cols;
+  g->rows=(nbits+cols-1)/cols;
+  g->odd=odd!=0;
+  return 0;
+}
+
+static inline uint64_t parity2d_vrc_bytes(const struct parity2d *g)
+{
+  return (g->rows+7)/8;
+}
+
+static inline uint64_t parity2d_lrc_bytes(const struct parity2d *g)
+{
+  return (g->cols+7)/8;
+}
+
+static inline void parity2d_rows(const struct parity2d *g,const unsigned char *data,uint64_t r0,uint64_t r1,unsigned char *out,uint64_t *acc)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if (parity_kernel_get()==PARITY_POPCNT)
+  {
+    parity2d_rows_popcnt(g,data,r0,r1,out,acc);
+    return;
+  }
+#endif
+  parity2d_rows_scalar(g,data,r0,r1,out,acc);
+}
+
+/* Flips every check bit of n bytes holding nbits, for odd parity. */
+static inline void parity_invert(unsigned char *p,uint64_t n,uint64_t nbits)
+{
+  uint64_t i;
+  for(i=0;i<n;i++)
+    p[i]=(unsigned char)~p[i];
+  if (nbits&7)
+    p[n-1]&=(unsigned char)(0xFF00>>(nbits&7));
+}
+
+/* The LRC bytes of the column sums in acc, and the corner bit. */
+static inline int parity2d_lrc(const struct parity2d *g,const uint64_t *acc,unsigned char *lrc)
+{
+  uint64_t x=0,i,n=parity2d_lrc_bytes(g);
+  for(i=0;i<n;i++)
+    lrc[i]=(unsigned char)(acc[i/8]>>(56-8*(i%8)));
+  for(i=0;i<(g->cols+63)/64;i++)
+    x^=acc[i];
+  if (g->odd)
+    parity_invert(lrc,n,g->cols);
+  return (__builtin_popcountll(x)&1)^g->odd;
+}
+
+/* VRC bits into vrc (parity2d_vrc_bytes()) and LRC bits into lrc
+   (parity2d_lrc_bytes()), both MSB first.  Returns the corner bit. */
+static inline int parity2d_encode(const struct parity2d *g,const void *data,unsigned char *vrc,unsigned char *lrc)
+{
+  uint64_t acc[PARITY_ACC_WORDS];
+  memset(acc,0,(g->cols+63)/64*sizeof(uint64_t));
+  parity2d_rows(g,(const unsigned char *)data,0,g->rows,vrc,acc);
+  if (g->odd && g->rows)
+    parity_invert(vrc,parity2d_vrc_bytes(g),g->rows);
+  return parity2d_lrc(g,acc,lrc);
+}
+
+/* Bits that differ among the first nbits of a and b; *first gets the
+   index of the first. */
+static inline uint64_t parity_diff(const unsigned char *a,const unsigned char *b,uint64_t nbits,uint64_t *first)
+{
+  uint64_t i,count=0;
+  for(i=0;i<(nbits+7)/8;i++)
+  {
+    unsigned d=a[i]^b[i];
+    if (8*i+8>nbits)
+      d&=0xFF00>>(nbits-8*i);
+    if (d && !count)
+      *first=8*i+__builtin_clz(d)-24;
+    count+=__builtin_popcount(d);
+  }
+  return count;
+}
+
+/* Checks a block against its received check bits and corrects a single
+   flipped bit in data, vrc or lrc.  Returns PARITY_CLEAN,
+   PARITY_CORRECTED with the data bit in *pos, PARITY_CHECK_BIT or
+   PARITY_DETECTED. */
+static inline int parity2d_check(const struct parity2d *g,void *data,unsigned char *vrc,unsigned char *lrc,int corner,uint64_t *pos)
+{
+  uint64_t acc[PARITY_ACC_WORDS],r0,badRows=0,badRow=0,badCols,badCol=0;
+  unsigned char rows[PARITY_CHUNK/8],cols[(PARITY_MAX_COLS+7)/8];
+  int badCorner;
+  *pos=0;
+  memset(acc,0,(g->cols+63)/64*sizeof(uint64_t));
+  for(r0=0;r0<g->rows;r0+=PARITY_CHUNK)
+  {
+    uint64_t r1=r0+PARITY_CHUNK<g->rows?r0+PARITY_CHUNK:g->rows,first=0,bad;
+    parity2d_rows(g,(const unsigned char *)data,r0,r1,rows,acc);
+    if (g->odd)
+      parity_invert(rows,(r1-r0+7)/8,r1-r0);
+    bad=parity_diff(rows,vrc+r0/8,r1-r0,&first);
+    if (bad && !badRows)
+      badRow=r0+first;
+    badRows+=bad;
+  }
+  badCorner=parity2d_lrc(g,acc,cols)!=corner;
+  badCols=parity_diff(cols,lrc,g->cols,&badCol);
+  if (!badRows && !badCols && !badCorner)
+    return PARITY_CLEAN;
+  if (badRows==1 && badCols==1 && badCorner && badRow*g->cols+badCol<g->nbits)
+  {
+    *pos=badRow*g->cols+badCol;
+    ((unsigned char *)data)[*pos/8]^=(unsigned char)(0x80>>*pos%8);
+    return PARITY_CORRECTED;
+  }
+  if (badRows+badCols+badCorner!=1)
+    return PARITY_DETECTED;
+  if (badRows)
+    vrc[badRow/8]^=(unsigned char)(0x80>>badRow%8);
+  if (badCols)
+    lrc[badCol/8]^=(unsigned char)(0x80>>badCol%8);
+  return PARITY_CHECK_BIT;
+}
+
+#endif
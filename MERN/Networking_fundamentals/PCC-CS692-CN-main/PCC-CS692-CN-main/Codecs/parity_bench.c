@@ -0,0 +1,282 @@
+/*
+ * parity_bench.c - parity of parity.h against the character loop of
+ * Assignment2/server.c, and its two-dimensional VRC/LRC code, per kernel.
+ *
+ *   gcc -O2 parity_bench.c -o parity_bench
+ *   ./parity_bench [max MB]
+ *
+ * The 1-D rows time parity_append() on '0'/'1' text, parity_text_ones()
+ * on the same text and parity_bit()/parity_ones() on it bit-packed, from
+ * 100 bits to the maximum (default 16 MB packed); every one must agree
+ * with parity_append().  The 2-D rows encode a block of odd length in
+ * rows of several widths, check the bits against a bit-by-bit reference,
+ * then flip every single bit position class (data, VRC, LRC, corner) and
+ * random pairs of bits, and expect the single ones corrected and the pairs
+ * detected.  Gbit/s are of data bits.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"reference.h"
+#include"parity.h"
+
+#define MIN_SECS 0.2
+#define TRIALS 300
+
+static volatile uint64_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+static int getBit(const unsigned char *p,uint64_t i)
+{
+  return p[i/8]>>(7-i%8)&1;
+}
+
+static void flipBit(unsigned char *p,uint64_t i)
+{
+  p[i/8]^=(unsigned char)(0x80>>i%8);
+}
+
+/* The 2-D check bits one data bit at a time. */
+static int slowEncode(const struct parity2d *g,const unsigned char *data,unsigned char *vrc,unsigned char *lrc)
+{
+  uint64_t i;
+  int all=0;
+  memset(vrc,0,parity2d_vrc_bytes(g));
+  memset(lrc,0,parity2d_lrc_bytes(g));
+  for(i=0;i<g->nbits;i++)
+    if (getBit(data,i))
+    {
+      flipBit(vrc,i/g->cols);
+      flipBit(lrc,i%g->cols);
+      all^=1;
+    }
+  if (g->odd)
+  {
+    for(i=0;i<g->rows;i++)
+      flipBit(vrc,i);
+    for(i=0;i<g->cols;i++)
+      flipBit(lrc,i);
+  }
+  return all^g->odd;
+}
+
+/* Seconds per call of op 0 parity_append(), 1 parity_text_ones(),
+   2 parity_bit(), 3 parity_ones().  text is NUL-terminated at nbits;
+   parity_append() writes two characters past it, put back each call. */
+static double time1d(int op,char *text,const unsigned char *packed,uint64_t nbits)
+{
+  double t0;
+  long calls;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    switch(op)
+    {
+      case 0:
+      {
+        char next=text[nbits+1];
+        parity_append(text);
+        sink+=text[nbits];
+        text[nbits]='\0';
+        text[nbits+1]=next;
+        break;
+      }
+      case 1: sink+=parity_text_ones(text,nbits); break;
+      case 2: sink+=parity_bit(packed,nbits,0); break;
+      case 3: sink+=parity_ones(packed,nbits); break;
+    }
+  return (now()-t0)/calls;
+}
+
+static double timeEncode(const struct parity2d *g,const unsigned char *data,unsigned char *vrc,unsigned char *lrc)
+{
+  double t0;
+  long calls;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    sink+=parity2d_encode(g,data,vrc,lrc);
+  return (now()-t0)/calls;
+}
+
+/* Single flips in every part of the block and random pairs.  Returns the
+   number of wrong outcomes. */
+static int testCorrection(const struct parity2d *g,unsigned char *data,const unsigned char *orig,
+                          unsigned char *vrc,unsigned char *lrc,const unsigned char *vrcOrig,const unsigned char *lrcOrig,int corner)
+{
+  uint64_t vrcBytes=parity2d_vrc_bytes(g),lrcBytes=parity2d_lrc_bytes(g),dataBytes=(g->nbits+7)/8;
+  uint64_t total=g->nbits+g->rows+g->cols+1,pos;
+  int t,wrong=0;
+  for(t=0;t<2*TRIALS;t++)
+  {
+    uint64_t e[2];
+    int flips=t<TRIALS?1:2,i,c=corner,want,r;
+    e[0]=t<4?(uint64_t[]){0,g->nbits,g->nbits+g->rows,total-1}[t]:((uint64_t)rand()<<31^rand())%total;
+    do
+      e[1]=((uint64_t)rand()<<31^rand())%total;
+    while(e[1]==e[0]);
+    for(i=0;i<flips;i++)
+    {
+      if (e[i]<g->nbits)
+        flipBit(data,e[i]);
+      else if (e[i]<g->nbits+g->rows)
+        flipBit(vrc,e[i]-g->nbits);
+      else if (e[i]<total-1)
+        flipBit(lrc,e[i]-g->nbits-g->rows);
+      else
+        c^=1;
+    }
+    want=flips==2?PARITY_DETECTED:e[0]<g->nbits?PARITY_CORRECTED:PARITY_CHECK_BIT;
+    r=parity2d_check(g,data,vrc,lrc,c,&pos);
+    if (r!=want || (r==PARITY_CORRECTED && pos!=e[0]))
+      wrong++;
+    else if (flips==1 && (memcmp(data,orig,dataBytes)!=0 || memcmp(vrc,vrcOrig,vrcBytes)!=0 || memcmp(lrc,lrcOrig,lrcBytes)!=0))
+      wrong++;
+    memcpy(data,orig,dataBytes);
+    memcpy(vrc,vrcOrig,vrcBytes);
+    memcpy(lrc,lrcOrig,lrcBytes);
+  }
+  return wrong;
+}
+
+int main(int argc,char **argv)
+{
+  static const uint32_t widths[]={7,8,16,64,100,1000};
+  uint64_t maxBits=(argc>1?strtoull(argv[1],NULL,10):16)<<23,nbits,i;
+  int best=parity_kernel_get(),k,w,failed=0;
+  unsigned char *packed,*orig,*vrc,*vrcOrig,*vrcRef,lrc[PARITY_MAX_COLS/8+1],lrcOrig[PARITY_MAX_COLS/8+1],lrcRef[PARITY_MAX_COLS/8+1];
+  char *text;
+  if (maxBits<800)
+  {
+    printf("Usage : %s [max MB]\n",argv[0]);
+    return 1;
+  }
+  text=malloc(maxBits+2);
+  packed=calloc(maxBits/8+8,1);
+  orig=malloc(maxBits/8+8);
+  vrc=malloc(maxBits/8+8);
+  vrcOrig=malloc(maxBits/8+8);
+  vrcRef=malloc(maxBits/8+8);
+  if (!text || !packed || !orig || !vrc || !vrcOrig || !vrcRef)
+  {
+    printf("Out of memory...\n");
+    return 1;
+  }
+  srand(24);
+  for(i=0;i<maxBits;i++)
+    if (rand()&1)
+    {
+      text[i]='1';
+      packed[i/8]|=(unsigned char)(0x80>>i%8);
+    }
+    else
+      text[i]='0';
+
+  printf("%-10s %14s","bits","parity_append");
+  for(k=0;k<=best;k++)
+    printf("  text %-7s",parity_kernel_names[k]);
+  printf(" %10s","bit");
+  for(k=0;k<=best;k++)
+    printf("  ones %-7s",parity_kernel_names[k]);
+  printf("   Gbit/s\n");
+  for(nbits=100;nbits<=maxBits;nbits=nbits*8+5)
+  {
+    char at=text[nbits],next=text[nbits+1];
+    double tRef;
+    int want;
+    text[nbits]='\0';
+    parity_append(text);
+    want=text[nbits]-'0';
+    text[nbits]='\0';
+    text[nbits+1]=next;
+    tRef=time1d(0,text,packed,nbits);
+    printf("%-10llu %14.3f",(unsigned long long)nbits,nbits/tRef/1e9);
+    for(k=0;k<=best;k++)
+    {
+      parity_kernel_set(k);
+      if ((int)(parity_text_ones(text,nbits)&1)!=want)
+      {
+        printf("\nparity_text_ones() %s disagrees at %llu bits\n",parity_kernel_names[k],(unsigned long long)nbits);
+        failed=1;
+      }
+      printf(" %13.3f",nbits/time1d(1,text,packed,nbits)/1e9);
+    }
+    if (parity_bit(packed,nbits,0)!=want || parity_bit(packed,nbits,1)==want)
+    {
+      printf("\nparity_bit() disagrees at %llu bits\n",(unsigned long long)nbits);
+      failed=1;
+    }
+    printf(" %10.3f",nbits/time1d(2,text,packed,nbits)/1e9);
+    for(k=0;k<=best;k++)
+    {
+      parity_kernel_set(k);
+      if ((int)(parity_ones(packed,nbits)&1)!=want)
+      {
+        printf("\nparity_ones() %s disagrees at %llu bits\n",parity_kernel_names[k],(unsigned long long)nbits);
+        failed=1;
+      }
+      printf(" %13.3f",nbits/time1d(3,text,packed,nbits)/1e9);
+    }
+    printf("\n");
+    text[nbits]=at;
+  }
+  parity_kernel_set(best);
+
+  nbits=(maxBits<(8u<<23)?maxBits:8u<<23)-3;
+  printf("\n2-D, %llu-bit block\n%-6s %-5s",(unsigned long long)nbits,"cols","odd");
+  for(k=0;k<=best;k++)
+    printf(" %10s",parity_kernel_names[k]);
+  printf("   Gbit/s encode\n");
+  for(w=0;w<(int)(sizeof(widths)/sizeof(widths[0]));w++)
+  {
+    int odd;
+    for(odd=0;odd<2;odd++)
+    {
+      struct parity2d g;
+      int corner,wrong=0;
+      if (parity2d_init(&g,nbits,widths[w],odd)<0)
+        return 1;
+      corner=slowEncode(&g,packed,vrcRef,lrcRef);
+      printf("%-6u %-5d",(unsigned)widths[w],odd);
+      for(k=0;k<=best;k++)
+      {
+        parity_kernel_set(k);
+        if (parity2d_encode(&g,packed,vrc,lrc)!=corner || memcmp(vrc,vrcRef,parity2d_vrc_bytes(&g))!=0 ||
+            memcmp(lrc,lrcRef,parity2d_lrc_bytes(&g))!=0)
+        {
+          printf("\n%s encode disagrees at %u columns\n",parity_kernel_names[k],(unsigned)widths[w]);
+          failed=1;
+        }
+        printf(" %10.3f",nbits/timeEncode(&g,packed,vrc,lrc)/1e9);
+      }
+      /* Corrections on a short block, so each check is quick. */
+      parity2d_init(&g,20000+widths[w]/3,widths[w],odd);
+      corner=parity2d_encode(&g,packed,vrcOrig,lrcOrig);
+      memcpy(orig,packed,(g.nbits+7)/8);
+      memcpy(vrc,vrcOrig,parity2d_vrc_bytes(&g));
+      memcpy(lrc,lrcOrig,parity2d_lrc_bytes(&g));
+      for(k=0;k<=best;k++)
+      {
+        parity_kernel_set(k);
+        wrong+=testCorrection(&g,packed,orig,vrc,lrc,vrcOrig,lrcOrig,corner);
+      }
+      if (wrong)
+      {
+        printf("   %d wrong corrections",wrong);
+        failed=1;
+      }
+      printf("\n");
+    }
+  }
+  free(text);
+  free(packed);
+  free(orig);
+  free(vrc);
+  free(vrcOrig);
+  free(vrcRef);
+  return failed;
+}
@@ -0,0 +1,184 @@
+#ifndef CODECS_REFERENCE_H
+#define CODECS_REFERENCE_H
+
+/*
+ * The error-detection routines of the Assignment programs, lifted out of
+ * their main() loops into callable functions so they can be timed and used
+ * as references.  The algorithms are kept exactly as written; only fixed
+ * MAX-sized buffers became caller-sized and console output was dropped.
+ *
+ *   xorDivision()         Assignment1/CRC/cyclicredundancycheck.c
+ *   hamming()             Assignment7/server.c
+ *   add_binary_strings()  Assignment1/Automatic_Repeat_Request_Algorithm/CheckSum.c
+ *   calculate_checksum()  Assignment4/Spoofing/IPV4Spoofing.c
+ *   parity_append()       the loop in Assignment2/server.c
+ *   bit_stuff()           the loop in Assignment5/server.c
+ *
+ * hamming() uses pow()/log2(), so link with -lm.
+ */
+
+#include<string.h>
+#include<math.h>
+
+/* Modulo-2 long division of dividend (dataword followed by zeros) by
+   divisor, one character at a time.  remainder gets strlen(divisor)-1
+   characters; divisor may be up to 100 characters. */
+static inline void xorDivision(const char *dividend,const char *divisor,char *remainder)
+{
+  int dividendLen=strlen(dividend);
+  int divisorLen=strlen(divisor);
+  char temp[101];
+  strncpy(temp,dividend,divisorLen);
+  temp[divisorLen]='\0';
+  for(int i=divisorLen;i<=dividendLen;i++)
+  {
+    if (temp[0]=='1')
+      for(int j=0;j<divisorLen;j++)
+        temp[j]=(temp[j]==divisor[j])?'0':'1';
+    if (i<dividendLen)
+    {
+      memmove(temp,temp+1,divisorLen-1);
+      temp[divisorLen-1]=dividend[i];
+      temp[divisorLen]='\0';
+    }
+  }
+  memcpy(remainder,temp+1,divisorLen-1);
+  remainder[divisorLen-1]='\0';
+}
+
+/* Hamming code with even parity bits at the power-of-two positions counted
+   from the right.  codeword needs strlen(dataword)+log2 room. */
+static inline void hamming(const char *dataword,char *codeword)
+{
+  int m=strlen(dataword),power=0;
+  while(pow(2,power)<power+m+1)
+    power++;
+  int sz=m+power;
+  int i,j=0;
+  for(i=0;i<sz;i++)
+  {
+    if (ceil(log2(sz-i))==floor(log2(sz-i)))
+      codeword[i]='p';
+    else
+      codeword[i]=dataword[j++];
+  }
+  codeword[i]='\0';
+  int bitsCal=0;
+  while(bitsCal<power)
+  {
+    int pos=pow(2,bitsCal);
+    int bitsPos=pos;
+    int ones=0;
+    while(bitsPos<=sz)
+    {
+      j=0;
+      /* The original reads past the left end of codeword when the last
+         group is cut short; stopping at position sz gives the same parity
+         without the stray read. */
+      while(j<pos && bitsPos+j<=sz)
+      {
+        if(codeword[sz-(bitsPos+j)]=='1')
+          ones++;
+        j++;
+      }
+      bitsPos+=2*pos;
+    }
+    if (ones%2==0)
+      codeword[sz-pos]='0';
+    else
+      codeword[sz-pos]='1';
+    bitsCal++;
+  }
+}
+
+/* One's complement sum of two equal-length binary strings, right to left,
+   with the end-around carry. */
+static inline void add_binary_strings(const char *binary1,const char *binary2,char *result,int length)
+{
+  int carry=0;
+  for(int i=length-1;i>=0;i--)
+  {
+    int bit1=binary1[i]-'0';
+    int bit2=binary2[i]-'0';
+    int sum=bit1+bit2+carry;
+    result[i]=(sum%2)+'0';
+    carry=sum/2;
+  }
+  while(carry>0)
+  {
+    carry=0;
+    for(int i=length-1;i>=0;i--)
+    {
+      if (result[i]=='0')
+      {
+        result[i]='1';
+        break;
+      }
+      else
+      {
+        result[i]='0';
+        carry=1;
+      }
+    }
+  }
+}
+
+/* RFC 1071 checksum of nwords 16-bit words, one word per addition into an
+   unsigned long, folded twice at the end. */
+static inline unsigned short calculate_checksum(const unsigned short *buf,int nwords)
+{
+  unsigned long sum=0;
+  for(sum=0;nwords>0;nwords--)
+    sum+=*buf++;
+  sum=(sum>>16)+(sum&0xffff);
+  sum+=(sum>>16);
+  return (unsigned short)(~sum);
+}
+
+/* Appends the even-parity bit to a '0'/'1' string; bit needs room for one
+   more character. */
+static inline void parity_append(char *bit)
+{
+  int i,count=0;
+  for(i=0;i<(int)strlen(bit);i++)
+  {
+    if (bit[i]=='1')
+      count++;
+  }
+  if (count%2==1)
+    bit[i++]='1';
+  else
+    bit[i++]='0';
+  bit[i]='\0';
+}
+
+/* HDLC bit stuffing in place: a '0' after every five consecutive '1's,
+   shifting the rest of the string right each time.  bit needs room for
+   strlen(bit)/5+1 more characters. */
+static inline void bit_stuff(char *bit)
+{
+  int count=0;
+  int i;
+  for(i=0;i<(int)strlen(bit);i++)
+  {
+    if (bit[i]=='1')
+      count++;
+    if (bit[i]=='0')
+      count=0;
+    if (count==5)
+    {
+      int j;
+      char prev='0';
+      for(j=i+1;j<(int)strlen(bit);j++)
+      {
+        int curr=bit[j];
+        bit[j]=prev;
+        prev=curr;
+      }
+      bit[j]=prev;
+      bit[j+1]='\0';
+    }
+  }
+}
+
+#endif
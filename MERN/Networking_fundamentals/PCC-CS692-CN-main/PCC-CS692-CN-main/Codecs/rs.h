@@ -0,0 +1,557 @@
+#ifndef CODECS_RS_H
+#define CODECS_RS_H
+
+/*
+ * Systematic Reed-Solomon erasure code over GF(2^8): k data shards and m
+ * parity shards of equal length, any k of which give the data back.
+ *
+ * Parity shard p is the sum over j of C[p][j]*data_j, C the Cauchy matrix
+ * 1/(x_p+y_j) with x_p = k+p and y_j = j.  Every square submatrix of a
+ * Cauchy matrix is invertible, so the rows of any k shards (identity rows
+ * for the data shards) form an invertible matrix; the decoder inverts it,
+ * multiplies the missing data shards out of the shards it holds, then
+ * re-encodes the missing parity.  The field polynomial is 0x11D.
+ *
+ * Both directions are one kernel, a dot product of up to RS_DOT_WAYS
+ * coefficient rows with the source shards.  c*x splits x into nibbles and
+ * looks each up in a 16-entry table of c*lo or c*hi, one PSHUFB apiece:
+ *
+ *   avx512  64 bytes per step (AVX-512BW)
+ *   avx2    32 bytes per step
+ *   ssse3   16 bytes per step
+ *   scalar  the same tables a byte at a time
+ *
+ * picked once from CPUID.  Each source vector is loaded once for all the
+ * rows, which accumulate in registers, and the shards are walked in
+ * RS_BLOCK columns at a time so that passes for more rows hit the cache.
+ * struct rs_pool spreads the columns over threads; build with -pthread.
+ */
+
+#include<stdint.h>
+#include<string.h>
+#include<pthread.h>
+
+#define RS_MAX_DATA 128
+#define RS_MAX_PARITY 128
+#define RS_MAX_SHARDS 256
+#define RS_DOT_WAYS 4
+#define RS_BLOCK 16384
+
+#define RS_SCALAR 0
+#define RS_SSSE3 1
+#define RS_AVX2 2
+#define RS_AVX512 3
+
+static const char *const rs_kernel_names[]={"scalar","ssse3","avx2","avx512"};
+
+static uint8_t rs_exp[2*255],rs_log[256];
+static uint8_t rs_nib[256][32];     /* c*i, then c*(i<<4), for i < 16 */
+static int rs_gf_ready;
+
+struct rs_code
+{
+  int k,m;
+  uint8_t coef[RS_MAX_PARITY*RS_MAX_DATA];  /* C, m rows of k */
+};
+
+static inline uint8_t rs_mul(uint8_t a,uint8_t b)
+{
+  return (a && b)?rs_exp[rs_log[a]+rs_log[b]]:0;
+}
+
+static inline uint8_t rs_inv(uint8_t a)
+{
+  return rs_exp[255-rs_log[a]];
+}
+
+static inline void rs_gf_init(void)
+{
+  int i,c,x=1;
+  if (rs_gf_ready)
+    return;
+  for(i=0;i<255;i++)
+  {
+    rs_exp[i]=rs_exp[i+255]=(uint8_t)x;
+    rs_log[x]=(uint8_t)i;
+    x<<=1;
+    if (x&0x100)
+      x^=0x11D;
+  }
+  for(c=0;c<256;c++)
+    for(i=0;i<16;i++)
+    {
+      rs_nib[c][i]=rs_mul((uint8_t)c,(uint8_t)i);
+      rs_nib[c][16+i]=rs_mul((uint8_t)c,(uint8_t)(i<<4));
+    }
+  rs_gf_ready=1;
+}
+
+/* Builds the code.  Returns -1 unless 1 <= k <= RS_MAX_DATA and
+   1 <= m <= RS_MAX_PARITY. */
+static inline int rs_init(struct rs_code *c,int k,int m)
+{
+  int p,j;
+  if (k<1 || k>RS_MAX_DATA || m<1 || m>RS_MAX_PARITY)
+    return -1;
+  rs_gf_init();
+  c->k=k;
+  c->m=m;
+  for(p=0;p<m;p++)
+    for(j=0;j<k;j++)
+      c->coef[p*k+j]=rs_inv((uint8_t)((k+p)^j));
+  return 0;
+}
+
+/* Rows r < ways of dst over [off,off+len): dst[r] = sum of rows[r*k+j]*src[j]. */
+static inline void rs_dot_scalar(const uint8_t *rows,int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  size_t x;
+  int r,j;
+  for(r=0;r<ways;r++)
+  {
+    uint8_t *d=dst[r]+off;
+    memset(d,0,len);
+    for(j=0;j<k;j++)
+    {
+      const uint8_t *t=rs_nib[rows[r*k+j]],*s=src[j]+off;
+      for(x=0;x<len;x++)
+        d[x]^=t[s[x]&15]^t[16+(s[x]>>4)];
+    }
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include<cpuid.h>
+#include<immintrin.h>
+
+static inline int rs_detect(void)
+{
+  unsigned int a,b,c,d,xcr0=0;
+  if (!__get_cpuid(1,&a,&b,&c,&d) || !(c&bit_SSSE3))
+    return RS_SCALAR;
+  if (!(c&bit_OSXSAVE) || !(c&bit_AVX))
+    return RS_SSSE3;
+  __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "edx");
+  if ((xcr0&0x6)!=0x6 || !__get_cpuid_count(7,0,&a,&b,&c,&d) || !(b&bit_AVX2))
+    return RS_SSSE3;
+  if ((xcr0&0xE6)!=0xE6 || !(b&bit_AVX512F) || !(b&bit_AVX512BW))
+    return RS_AVX2;
+  return RS_AVX512;
+}
+
+/* The kernels below do the columns in whole vectors and return how many
+   they did; the rest goes to rs_dot_scalar().  Inlined with ways constant
+   so that the accumulators live in registers. */
+__attribute__((target("ssse3")))
+static inline __attribute__((always_inline)) size_t rs_dot_ssse3_n(const uint8_t *rows,const int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  const __m128i mask=_mm_set1_epi8(0x0F);
+  size_t x,end=off+(len&~(size_t)15);
+  int r,j;
+  for(x=off;x<end;x+=16)
+  {
+    __m128i acc[RS_DOT_WAYS];
+    for(r=0;r<ways;r++)
+      acc[r]=_mm_setzero_si128();
+    for(j=0;j<k;j++)
+    {
+      __m128i s=_mm_loadu_si128((const __m128i *)(src[j]+x));
+      __m128i lo=_mm_and_si128(s,mask),hi=_mm_and_si128(_mm_srli_epi64(s,4),mask);
+      for(r=0;r<ways;r++)
+      {
+        const uint8_t *t=rs_nib[rows[r*k+j]];
+        __m128i pl=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)t),lo);
+        __m128i ph=_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(t+16)),hi);
+        acc[r]=_mm_xor_si128(acc[r],_mm_xor_si128(pl,ph));
+      }
+    }
+    for(r=0;r<ways;r++)
+      _mm_storeu_si128((__m128i *)(dst[r]+x),acc[r]);
+  }
+  return end-off;
+}
+
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline)) size_t rs_dot_avx2_n(const uint8_t *rows,const int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  const __m256i mask=_mm256_set1_epi8(0x0F);
+  size_t x,end=off+(len&~(size_t)31);
+  int r,j;
+  for(x=off;x<end;x+=32)
+  {
+    __m256i acc[RS_DOT_WAYS];
+    for(r=0;r<ways;r++)
+      acc[r]=_mm256_setzero_si256();
+    for(j=0;j<k;j++)
+    {
+      __m256i s=_mm256_loadu_si256((const __m256i *)(src[j]+x));
+      __m256i lo=_mm256_and_si256(s,mask),hi=_mm256_and_si256(_mm256_srli_epi64(s,4),mask);
+      for(r=0;r<ways;r++)
+      {
+        const uint8_t *t=rs_nib[rows[r*k+j]];
+        __m256i pl=_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)t)),lo);
+        __m256i ph=_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(t+16))),hi);
+        acc[r]=_mm256_xor_si256(acc[r],_mm256_xor_si256(pl,ph));
+      }
+    }
+    for(r=0;r<ways;r++)
+      _mm256_storeu_si256((__m256i *)(dst[r]+x),acc[r]);
+  }
+  return end-off;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline __attribute__((always_inline)) size_t rs_dot_avx512_n(const uint8_t *rows,const int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  const __m512i mask=_mm512_set1_epi8(0x0F);
+  size_t x,end=off+(len&~(size_t)63);
+  int r,j;
+  for(x=off;x<end;x+=64)
+  {
+    __m512i acc[RS_DOT_WAYS];
+    for(r=0;r<ways;r++)
+      acc[r]=_mm512_setzero_si512();
+    for(j=0;j<k;j++)
+    {
+      __m512i s=_mm512_loadu_si512((const void *)(src[j]+x));
+      __m512i lo=_mm512_and_si512(s,mask),hi=_mm512_and_si512(_mm512_srli_epi64(s,4),mask);
+      for(r=0;r<ways;r++)
+      {
+        const uint8_t *t=rs_nib[rows[r*k+j]];
+        __m512i pl=_mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)t)),lo);
+        __m512i ph=_mm512_shuffle_epi8(_mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(t+16))),hi);
+        acc[r]=_mm512_xor_si512(acc[r],_mm512_xor_si512(pl,ph));
+      }
+    }
+    for(r=0;r<ways;r++)
+      _mm512_storeu_si512((void *)(dst[r]+x),acc[r]);
+  }
+  return end-off;
+}
+
+#define RS_DOT_WAYS_SWITCH(fn) \
+  switch(ways) \
+  { \
+    case 1: return fn(rows,1,k,src,dst,off,len); \
+    case 2: return fn(rows,2,k,src,dst,off,len); \
+    case 3: return fn(rows,3,k,src,dst,off,len); \
+    default: return fn(rows,4,k,src,dst,off,len); \
+  }
+
+__attribute__((target("ssse3")))
+static inline size_t rs_dot_ssse3(const uint8_t *rows,int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  RS_DOT_WAYS_SWITCH(rs_dot_ssse3_n)
+}
+
+__attribute__((target("avx2")))
+static inline size_t rs_dot_avx2(const uint8_t *rows,int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  RS_DOT_WAYS_SWITCH(rs_dot_avx2_n)
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static inline size_t rs_dot_avx512(const uint8_t *rows,int ways,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  RS_DOT_WAYS_SWITCH(rs_dot_avx512_n)
+}
+
+#undef RS_DOT_WAYS_SWITCH
+
+#else
+
+static inline int rs_detect(void)
+{
+  return RS_SCALAR;
+}
+
+#endif
+
+static int rs_tier=-1;
+
+/* Kernel in use; detected on first call, without a data race. */
+static inline int rs_kernel_get(void)
+{
+  int tier=__atomic_load_n(&rs_tier,__ATOMIC_RELAXED),none=-1;
+  if (tier<0)
+  {
+    tier=rs_detect();
+    if (!__atomic_compare_exchange_n(&rs_tier,&none,tier,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+      tier=none;
+  }
+  return tier;
+}
+
+/* Forces a kernel, e.g. to compare them.  Returns -1 if the CPU cannot
+   run it. */
+static inline int rs_kernel_set(int tier)
+{
+  if (tier<RS_SCALAR || tier>rs_detect())
+    return -1;
+  __atomic_store_n(&rs_tier,tier,__ATOMIC_RELAXED);
+  return 0;
+}
+
+/* dst[r] = sum over j < k of rows[r*k+j]*src[j] over the columns
+   [off,off+len), for nrows rows. */
+static inline void rs_dot(const uint8_t *rows,int nrows,int k,const uint8_t *const *src,uint8_t *const *dst,size_t off,size_t len)
+{
+  int tier=rs_kernel_get(),r;
+  size_t x,n;
+  for(x=off;x<off+len;x+=n)
+  {
+    n=off+len-x<RS_BLOCK?off+len-x:RS_BLOCK;
+    for(r=0;r<nrows;r+=RS_DOT_WAYS)
+    {
+      int ways=nrows-r<RS_DOT_WAYS?nrows-r:RS_DOT_WAYS;
+      size_t done=0;
+#if defined(__x86_64__) || defined(__i386__)
+      if (tier==RS_AVX512)
+        done=rs_dot_avx512(rows+r*k,ways,k,src,dst+r,x,n);
+      else if (tier==RS_AVX2)
+        done=rs_dot_avx2(rows+r*k,ways,k,src,dst+r,x,n);
+      else if (tier==RS_SSSE3)
+        done=rs_dot_ssse3(rows+r*k,ways,k,src,dst+r,x,n);
+#endif
+      if (done<n)
+        rs_dot_scalar(rows+r*k,ways,k,src,dst+r,x+done,n-done);
+    }
+  }
+}
+
+#define RS_POOL_MAX_THREADS 64
+#define RS_POOL_MAX_CHUNKS 256
+#define RS_POOL_MIN_CHUNK (64<<10)
+
+/* Persistent threads that split the columns of one dot product between
+   them and the caller, as crc_pool does for a CRC. */
+struct rs_pool
+{
+  int nthreads;               /* workers, not counting the caller */
+  pthread_t tid[RS_POOL_MAX_THREADS];
+  pthread_mutex_t busy;       /* one job at a time */
+  pthread_mutex_t lock;
+  pthread_cond_t start,done;
+  int stop;
+  /* current job, guarded by lock */
+  const uint8_t *rows;
+  int nrows,k;
+  const uint8_t *const *src;
+  uint8_t *const *dst;
+  size_t len,chunk;
+  int nchunks,next,finished;
+};
+
+/* Claims and runs chunks until the job has none left.  Called and
+   returns with lock held. */
+static inline void rs_pool_work(struct rs_pool *pool)
+{
+  while(pool->next<pool->nchunks)
+  {
+    int c=pool->next++;
+    size_t off=(size_t)c*pool->chunk;
+    size_t n=c==pool->nchunks-1?pool->len-off:pool->chunk;
+    pthread_mutex_unlock(&pool->lock);
+    rs_dot(pool->rows,pool->nrows,pool->k,pool->src,pool->dst,off,n);
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->finished==pool->nchunks)
+      pthread_cond_broadcast(&pool->done);
+  }
+}
+
+static void *rs_pool_worker(void *arg)
+{
+  struct rs_pool *pool=(struct rs_pool *)arg;
+  pthread_mutex_lock(&pool->lock);
+  while(!pool->stop)
+  {
+    if (pool->next<pool->nchunks)
+      rs_pool_work(pool);
+    else
+      pthread_cond_wait(&pool->start,&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* Starts nthreads workers; the caller works as well, so nthreads=0 is a
+   valid serial pool.  Returns -1 if no thread could be started when some
+   were asked for. */
+static inline int rs_pool_init(struct rs_pool *pool,int nthreads)
+{
+  int i;
+  memset(pool,0,sizeof(*pool));
+  if (nthreads>RS_POOL_MAX_THREADS)
+    nthreads=RS_POOL_MAX_THREADS;
+  pthread_mutex_init(&pool->busy,NULL);
+  pthread_mutex_init(&pool->lock,NULL);
+  pthread_cond_init(&pool->start,NULL);
+  pthread_cond_init(&pool->done,NULL);
+  rs_gf_init();
+  rs_kernel_get();
+  for(i=0;i<nthreads;i++)
+  {
+    if (pthread_create(&pool->tid[i],NULL,rs_pool_worker,pool)!=0)
+      break;
+    pool->nthreads++;
+  }
+  return (nthreads>0 && pool->nthreads==0)?-1:0;
+}
+
+static inline void rs_pool_destroy(struct rs_pool *pool)
+{
+  int i;
+  pthread_mutex_lock(&pool->lock);
+  pool->stop=1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for(i=0;i<pool->nthreads;i++)
+    pthread_join(pool->tid[i],NULL);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->busy);
+}
+
+/* rs_dot() over all len columns, on the pool when there is one and the
+   shards are long enough to split. */
+static inline void rs_run(struct rs_pool *pool,const uint8_t *rows,int nrows,int k,const uint8_t *const *src,uint8_t *const *dst,size_t len)
+{
+  size_t chunk;
+  int nchunks;
+  if (!pool || pool->nthreads==0 || len<2*RS_POOL_MIN_CHUNK)
+  {
+    rs_dot(rows,nrows,k,src,dst,0,len);
+    return;
+  }
+  nchunks=4*(pool->nthreads+1);
+  if (nchunks>RS_POOL_MAX_CHUNKS)
+    nchunks=RS_POOL_MAX_CHUNKS;
+  chunk=(len/nchunks+63)&~(size_t)63;
+  if (chunk<RS_POOL_MIN_CHUNK)
+    chunk=RS_POOL_MIN_CHUNK;
+  nchunks=(int)((len+chunk-1)/chunk);
+
+  pthread_mutex_lock(&pool->busy);
+  pthread_mutex_lock(&pool->lock);
+  pool->rows=rows;
+  pool->nrows=nrows;
+  pool->k=k;
+  pool->src=src;
+  pool->dst=dst;
+  pool->len=len;
+  pool->chunk=chunk;
+  pool->finished=0;
+  pool->next=0;
+  pool->nchunks=nchunks;
+  pthread_cond_broadcast(&pool->start);
+  rs_pool_work(pool);
+  while(pool->finished<nchunks)
+    pthread_cond_wait(&pool->done,&pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->busy);
+}
+
+/* Writes the m parity shards of the k data shards, len bytes each.  pool
+   may be NULL to run on the calling thread. */
+static inline void rs_encode(const struct rs_code *c,struct rs_pool *pool,const uint8_t *const *data,uint8_t *const *parity,size_t len)
+{
+  rs_run(pool,c->coef,c->m,c->k,data,parity,len);
+}
+
+/* Inverts the n x n matrix a into inv.  Returns -1 if it is singular. */
+static inline int rs_invert(uint8_t *a,uint8_t *inv,int n)
+{
+  int i,j,r;
+  memset(inv,0,(size_t)n*n);
+  for(i=0;i<n;i++)
+    inv[i*n+i]=1;
+  for(i=0;i<n;i++)
+  {
+    uint8_t f;
+    for(r=i;r<n && !a[r*n+i];r++)
+      ;
+    if (r==n)
+      return -1;
+    if (r!=i)
+      for(j=0;j<n;j++)
+      {
+        uint8_t t=a[i*n+j];
+        a[i*n+j]=a[r*n+j];
+        a[r*n+j]=t;
+        t=inv[i*n+j];
+        inv[i*n+j]=inv[r*n+j];
+        inv[r*n+j]=t;
+      }
+    f=rs_inv(a[i*n+i]);
+    for(j=0;j<n;j++)
+    {
+      a[i*n+j]=rs_mul(a[i*n+j],f);
+      inv[i*n+j]=rs_mul(inv[i*n+j],f);
+    }
+    for(r=0;r<n;r++)
+      if (r!=i && a[r*n+i])
+      {
+        f=a[r*n+i];
+        for(j=0;j<n;j++)
+        {
+          a[r*n+j]^=rs_mul(f,a[i*n+j]);
+          inv[r*n+j]^=rs_mul(f,inv[i*n+j]);
+        }
+      }
+  }
+  return 0;
+}
+
+/* Rebuilds the shards whose present[] entry is zero, in place: shards[0]
+   to shards[k-1] are the data, then the m parity shards, len bytes each,
+   and every one must point at a buffer.  Returns the number of shards
+   rebuilt, or -1 with fewer than k present. */
+static inline int rs_decode(const struct rs_code *c,struct rs_pool *pool,uint8_t *const *shards,const unsigned char *present,size_t len)
+{
+  uint8_t a[RS_MAX_DATA*RS_MAX_DATA],inv[RS_MAX_DATA*RS_MAX_DATA],rows[RS_MAX_DATA*RS_MAX_DATA];
+  const uint8_t *src[RS_MAX_DATA];
+  uint8_t *dst[RS_MAX_PARITY];
+  int k=c->k,sel=0,lost=0,i,j;
+  /* Shards held: the data first, whose rows need no elimination. */
+  for(i=0;i<k+c->m && sel<k;i++)
+    if (present[i])
+    {
+      memset(a+sel*k,0,k);
+      if (i<k)
+        a[sel*k+i]=1;
+      else
+        memcpy(a+sel*k,c->coef+(i-k)*k,k);
+      src[sel++]=shards[i];
+    }
+  if (sel<k)
+    return -1;
+  for(i=0;i<k;i++)
+    if (!present[i])
+      break;
+  if (i<k)
+  {
+    if (rs_invert(a,inv,k)<0)
+      return -1;
+    for(i=0;i<k;i++)
+      if (!present[i])
+      {
+        memcpy(rows+lost*k,inv+i*k,k);
+        dst[lost++]=shards[i];
+      }
+    rs_run(pool,rows,lost,k,src,dst,len);
+  }
+  /* Then the parity from the full data. */
+  for(i=0,j=0;i<c->m;i++)
+    if (!present[k+i])
+    {
+      memcpy(rows+j*k,c->coef+i*k,k);
+      dst[j++]=shards[k+i];
+    }
+  if (j>0)
+    rs_run(pool,rows,j,k,(const uint8_t *const *)shards,dst,len);
+  return lost+j;
+}
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * rs_bench.c - encode and decode throughput of the Reed-Solomon erasure
+ * code of rs.h for several k+m, per kernel and on a thread pool.
+ *
+ *   gcc -O2 -pthread rs_bench.c -o rs_bench
+ *   ./rs_bench [shard KB] [threads]
+ *
+ * Each configuration encodes k shards of random data (default 1 MB each)
+ * and checks the parity of every kernel against a byte-by-byte product
+ * through the log tables.  Decoding drops min(k,m) data shards and the
+ * rest of the m up to the parity, rebuilds them and checks them.  GB/s are
+ * of data bytes.  The pool run (default one thread per CPU) uses the
+ * fastest kernel.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include"rs.h"
+
+#define MIN_SECS 0.2
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* Parity shard p the slow way. */
+static void referenceParity(const struct rs_code *c,uint8_t **shards,uint8_t *out,int p,size_t len)
+{
+  size_t x;
+  int j;
+  memset(out,0,len);
+  for(j=0;j<c->k;j++)
+    for(x=0;x<len;x++)
+      out[x]^=rs_mul(c->coef[p*c->k+j],shards[j][x]);
+}
+
+static double timeEncode(const struct rs_code *c,struct rs_pool *pool,uint8_t **shards,size_t len)
+{
+  double t0;
+  long calls;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    rs_encode(c,pool,(const uint8_t *const *)shards,shards+c->k,len);
+  return (now()-t0)/calls;
+}
+
+/* Drops and rebuilds shards until MIN_SECS have passed.  Returns seconds
+   per decode, or -1 if a rebuilt shard differs. */
+static double timeDecode(const struct rs_code *c,struct rs_pool *pool,uint8_t **shards,uint8_t **orig,size_t len)
+{
+  unsigned char present[RS_MAX_SHARDS];
+  double t,total=0;
+  long calls;
+  int i,lost=c->k<c->m?c->k:c->m;
+  for(i=0;i<c->k+c->m;i++)
+    present[i]=i>=lost && i<c->k+c->m-(c->m-lost);
+  for(calls=0;calls==0 || total<MIN_SECS;calls++)
+  {
+    for(i=0;i<c->k+c->m;i++)
+      if (!present[i])
+        memset(shards[i],0,len);
+    t=now();
+    if (rs_decode(c,pool,shards,present,len)!=c->m)
+      return -1;
+    total+=now()-t;
+  }
+  for(i=0;i<c->k+c->m;i++)
+    if (memcmp(shards[i],orig[i],len)!=0)
+      return -1;
+  return total/calls;
+}
+
+int main(int argc,char **argv)
+{
+  static const int codes[][2]={{4,2},{6,3},{10,4},{17,3},{32,8}};
+  size_t len=(argc>1?strtoul(argv[1],NULL,10):1024)<<10,x;
+  long cpus=sysconf(_SC_NPROCESSORS_ONLN);
+  int threads=argc>2?atoi(argv[2]):(int)(cpus>0?cpus:1);
+  uint8_t *shards[RS_MAX_SHARDS],*orig[RS_MAX_SHARDS],*ref;
+  struct rs_code code;
+  struct rs_pool pool;
+  int cfg,tier,best=rs_kernel_get(),i,failed=0;
+  if (len==0 || threads<1)
+  {
+    printf("Usage : %s [shard KB] [threads]\n",argv[0]);
+    return 1;
+  }
+  for(i=0;i<40;i++)
+  {
+    shards[i]=aligned_alloc(64,len);
+    orig[i]=malloc(len);
+    if (!shards[i] || !orig[i])
+    {
+      printf("Cannot allocate %d shards of %zu bytes\n",40,len);
+      return 1;
+    }
+  }
+  ref=malloc(len);
+  srand(17);
+  for(i=0;i<40;i++)
+    for(x=0;x<len;x++)
+      shards[i][x]=(uint8_t)rand();
+  if (rs_pool_init(&pool,threads-1)<0)
+  {
+    printf("Cannot start %d threads\n",threads-1);
+    return 1;
+  }
+
+  printf("%-8s %-8s %10s %10s\n","k+m","kernel","enc GB/s","dec GB/s");
+  for(cfg=0;cfg<(int)(sizeof(codes)/sizeof(codes[0]));cfg++)
+  {
+    int k=codes[cfg][0],m=codes[cfg][1];
+    char name[16];
+    rs_init(&code,k,m);
+    snprintf(name,sizeof(name),"%d+%d",k,m);
+    for(tier=RS_SCALAR;tier<=best;tier++)
+    {
+      double tEnc,tDec;
+      rs_kernel_set(tier);
+      tEnc=timeEncode(&code,NULL,shards,len);
+      for(i=0;i<m;i++)
+      {
+        referenceParity(&code,shards,ref,i,len);
+        if (memcmp(ref,shards[k+i],len)!=0)
+        {
+          printf("%-8s %-8s parity %d mismatch\n",name,rs_kernel_names[tier],i);
+          failed=1;
+        }
+      }
+      for(i=0;i<k+m;i++)
+        memcpy(orig[i],shards[i],len);
+      tDec=timeDecode(&code,NULL,shards,orig,len);
+      if (tDec<0)
+      {
+        printf("%-8s %-8s decode mismatch\n",name,rs_kernel_names[tier]);
+        failed=1;
+        continue;
+      }
+      printf("%-8s %-8s %10.2f %10.2f\n",name,rs_kernel_names[tier],k*len/tEnc/1e9,k*len/tDec/1e9);
+    }
+    rs_kernel_set(best);
+    if (threads>1)
+    {
+      double tEnc=timeEncode(&code,&pool,shards,len),tDec=timeDecode(&code,&pool,shards,orig,len);
+      if (tDec<0 || memcmp(shards[k],orig[k],len)!=0)
+      {
+        printf("%-8s %d threads mismatch\n",name,threads);
+        failed=1;
+      }
+      else
+        printf("%-8s %d threads %7.2f %10.2f\n",name,threads,k*len/tEnc/1e9,k*len/tDec/1e9);
+    }
+  }
+  rs_pool_destroy(&pool);
+  for(i=0;i<40;i++)
+  {
+    free(shards[i]);
+    free(orig[i]);
+  }
+  free(ref);
+  return failed;
+}
@@ -0,0 +1,179 @@
+/*
+ * syndrome_bench.c - throughput of the syndrome kernels of
+ * hamming_syndrome.h against the per-check-bit rescan of hamming_calc()
+ * in Assignment1/HammingCode.c, for several codeword lengths.
+ *
+ *   gcc -O2 -mpopcnt syndrome_bench.c -o syndrome_bench
+ *   ./syndrome_bench [MB]
+ *
+ * The buffer (default 16 MB) is filled with encoded codewords of which a
+ * third are left clean, a third get one flipped bit and a third two.
+ * Every kernel must return the same syndrome and parity for every
+ * codeword, and hamming_syn_decode_block() must restore the clean and
+ * single-error ones and flag the rest.  GB/s are of packed codeword
+ * bytes; hamming_calc() runs over one int per bit, as in Assignment1,
+ * on the first MB only.
+ */
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include"hamming_syndrome.h"
+
+#define MIN_SECS 0.2
+#define CALC_BYTES (1<<20)
+
+static volatile uint64_t sink;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec+ts.tv_nsec*1e-9;
+}
+
+/* hamming_calc() of Assignment1 with code[i] holding position i+1. */
+static int hammingCalc(const int *code,int position,int c_1)
+{
+  int count=0,i,j;
+  for(i=position-1;i<c_1;i+=2*position)
+    for(j=i;j<i+position && j<c_1;j++)
+      count+=code[j]==1;
+  return count%2;
+}
+
+static uint64_t calcSyndrome(const int *code,int c_1)
+{
+  uint64_t syn=0;
+  int position;
+  for(position=1;position<=c_1;position<<=1)
+    if (hammingCalc(code,position,c_1))
+      syn+=position;
+  return syn;
+}
+
+typedef uint64_t (*syn_fn)(const unsigned char *,uint64_t,int *);
+
+/* Seconds per pass of fn over count codewords. */
+static double timeKernel(syn_fn fn,const unsigned char *buf,uint64_t n,size_t count)
+{
+  size_t size=hamming_syn_size(n),i;
+  double t0;
+  long calls;
+  int odd;
+  for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+    for(i=0;i<count;i++)
+      sink+=fn(buf+i*size,n,&odd)+odd;
+  return (now()-t0)/calls;
+}
+
+int main(int argc,char **argv)
+{
+  static const uint64_t lengths[]={71,255,4095,65535};
+  static const syn_fn fns[]={hamming_syn_bits,hamming_syn_bytes,hamming_syn_words};
+  size_t total=(argc>1?strtoul(argv[1],NULL,10):16)<<20;
+  unsigned char *buf=malloc(total),*orig=malloc(total),*work=malloc(total);
+  uint8_t *result=malloc(total);
+  int *code=malloc(8*CALC_BYTES*sizeof(int));
+  int l,k,failed=0;
+  if (total==0 || !buf || !orig || !work || !result || !code)
+  {
+    printf("Usage : %s [MB]\n",argv[0]);
+    return 1;
+  }
+  srand(5);
+  printf("%-8s %14s %12s %12s %12s %12s\n","n","hamming_calc","bits","bytes","words","decode");
+  for(l=0;l<(int)(sizeof(lengths)/sizeof(lengths[0]));l++)
+  {
+    uint64_t n=lengths[l];
+    size_t size=hamming_syn_size(n),count=total/size,calcCount,i,j;
+    double gbs[3],tCalc,tDec,t0;
+    long calls;
+    for(i=0;i<count;i++)
+    {
+      unsigned char *cw=buf+i*size;
+      for(j=0;j<size;j++)
+        cw[j]=(unsigned char)rand();
+      hamming_syn_encode(cw,n);
+    }
+    memcpy(orig,buf,count*size);
+    for(i=0;i<count;i++)
+    {
+      uint64_t p=rand()%(n+1);
+      if (i%3>0)
+        hamming_syn_flip(buf+i*size,p);
+      if (i%3>1)
+        hamming_syn_flip(buf+i*size,(p+1+rand()%n)%(n+1));
+    }
+
+    for(i=0;i<count;i++)
+    {
+      uint64_t syn[3];
+      int odd[3];
+      for(k=0;k<3;k++)
+        syn[k]=fns[k](buf+i*size,n,&odd[k]);
+      if (syn[1]!=syn[0] || syn[2]!=syn[0] || odd[1]!=odd[0] || odd[2]!=odd[0]
+          || odd[0]!=(i%3==1) || (i%3==0 && syn[0]))
+      {
+        printf("n=%llu codeword %zu : kernels disagree\n",(unsigned long long)n,i);
+        failed=1;
+        break;
+      }
+    }
+
+    /* The original rescans one int per bit, once per check bit. */
+    calcCount=CALC_BYTES/size?CALC_BYTES/size:1;
+    if (calcCount>count)
+      calcCount=count;
+    for(i=0;i<calcCount;i++)
+      for(j=1;j<=n;j++)
+        code[i*n+j-1]=hamming_syn_get(buf+i*size,j);
+    for(i=0;i<calcCount;i++)
+    {
+      int odd;
+      if (calcSyndrome(code+i*n,(int)n)!=hamming_syn_words(buf+i*size,n,&odd))
+      {
+        printf("n=%llu codeword %zu : hamming_calc disagrees\n",(unsigned long long)n,i);
+        failed=1;
+        break;
+      }
+    }
+    for(calls=0,t0=now();calls==0 || now()-t0<MIN_SECS;calls++)
+      for(i=0;i<calcCount;i++)
+        sink+=calcSyndrome(code+i*n,(int)n);
+    tCalc=(now()-t0)/calls/calcCount*count;
+
+    for(k=0;k<3;k++)
+      gbs[k]=count*size/timeKernel(fns[k],buf,n,count)/1e9;
+
+    /* Decoding flips bits back, so every timed pass starts from a copy. */
+    for(calls=0,tDec=0;calls==0 || tDec<MIN_SECS;calls++)
+    {
+      memcpy(work,buf,count*size);
+      t0=now();
+      hamming_syn_decode_block(work,n,count,result);
+      tDec+=now()-t0;
+      if (calls==0)
+        for(i=0;i<count;i++)
+        {
+          int want=i%3==0?HAMMING_CLEAN:i%3==1?HAMMING_CORRECTED:HAMMING_DOUBLE;
+          if (result[i]!=want || (want!=HAMMING_DOUBLE && memcmp(work+i*size,orig+i*size,size)!=0))
+          {
+            printf("n=%llu codeword %zu : result %d, expected %d\n",(unsigned long long)n,i,result[i],want);
+            failed=1;
+            break;
+          }
+        }
+    }
+    tDec/=calls;
+    printf("%-8llu %14.3f %12.2f %12.2f %12.2f %12.2f\n",(unsigned long long)n,count*size/tCalc/1e9,
+           gbs[0],gbs[1],gbs[2],count*size/tDec/1e9);
+  }
+  free(buf);
+  free(orig);
+  free(work);
+  free(result);
+  free(code);
+  return failed;
+}